@@ -1,10 +1,13 @@
 #include "Logging.h"
 #include "binaryRead.h"
+#include "routingGraphCache.h"
+#include "routeTileCache.h"
 
 #include <fcntl.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <algorithm>
+#include <mutex>
 #include "google/protobuf/wire_format_lite.h"
 #include "google/protobuf/io/zero_copy_stream_impl.h"
 #include "google/protobuf/wire_format_lite.cc"
@@ -20,6 +23,10 @@ using namespace std;
 #define DO_(EXPRESSION) if (!(EXPRESSION)) return false
 using google::protobuf::io::CodedInputStream;
 using google::protobuf::io::FileInputStream;
+using google::protobuf::io::ZeroCopyInputStream;
+using google::protobuf::io::CopyingInputStream;
+using google::protobuf::io::CopyingInputStreamAdaptor;
+using google::protobuf::io::ArrayInputStream;
 using google::protobuf::internal::WireFormatLite;
 
 //using namespace google::protobuf::internal;
@@ -28,13 +35,180 @@ using google::protobuf::internal::WireFormatLite;
 static uint zoomForBaseRouteRendering  = 13;
 static uint detailedZoomStartForRouteSection = 13;
 static uint zoomOnlyForBasemaps  = 11;
-std::vector<BinaryMapFile* > openFiles;
 OsmAndStoredIndex* cache = NULL;
 
-void searchRouteSubRegion(int fileInd, std::vector<RouteDataObject*>& list,  RoutingIndex* routingIndex, RouteSubregion* sub);
-void searchRouteRegion(CodedInputStream** input, 
-	FileInputStream** fis, BinaryMapFile* file, SearchQuery* q,
-    RoutingIndex* ind, std::vector<RouteSubregion>& subregions, std::vector<RouteSubregion>& toLoad);
+/**
+ * Reads file from own position (pread), so any number of streams could read one descriptor concurrently
+ */
+class PositionalCopyingInputStream : public CopyingInputStream {
+	int fd;
+	int64_t position;
+public:
+	PositionalCopyingInputStream(int fd) : fd(fd), position(0) {
+	}
+
+	int Read(void* buffer, int size) {
+#if defined(_WIN32)
+		// no pread : descriptors are not shared between threads on windows
+		_lseeki64(fd, position, SEEK_SET);
+		int r = _read(fd, buffer, size);
+#else
+		int r = pread(fd, buffer, size, position);
+#endif
+		if (r > 0) {
+			position += r;
+		}
+		return r < 0 ? -1 : r;
+	}
+
+	int Skip(int count) {
+		position += count;
+		return count;
+	}
+};
+
+class PositionalFileInputStream : public CopyingInputStreamAdaptor {
+public:
+	PositionalFileInputStream(int fd) : CopyingInputStreamAdaptor(new PositionalCopyingInputStream(fd)) {
+		SetOwnsCopyingStream(true);
+	}
+};
+
+/**
+ * Zero copy stream over mapped file (CodedInputStream reads mapped bytes in place), positional reads of
+ * descriptor if file is not mapped
+ */
+class BinaryMapInputStream : public ZeroCopyInputStream {
+	ZeroCopyInputStream* stream;
+public:
+	BinaryMapInputStream(BinaryMapFile* file, int fd) {
+		if (file->mapped.get() != NULL) {
+			stream = new ArrayInputStream(file->mapped->getData(), (int) file->mapped->getSize());
+		} else {
+			stream = new PositionalFileInputStream(fd);
+		}
+	}
+
+	~BinaryMapInputStream() {
+		delete stream;
+	}
+
+	bool Next(const void** data, int* size) {
+		return stream->Next(data, size);
+	}
+
+	void BackUp(int count) {
+		stream->BackUp(count);
+	}
+
+	bool Skip(int count) {
+		return stream->Skip(count);
+	}
+
+	google::protobuf::int64 ByteCount() const {
+		return stream->ByteCount();
+	}
+};
+
+// whole mapped file is one chunk of stream, so default warning threshold would be crossed by first read of any query
+static inline void setBinaryMapInputLimits(CodedInputStream* cis) {
+	cis->SetTotalBytesLimit(INT_MAXIMUM, -1);
+}
+
+// address space of 32 bit processes is not enough to map all files
+static const int64_t MAX_MAPPED_SIZE_32 = 1024 * 1024 * 1024;
+static int64_t mappedSize = 0;
+// files are mapped by opening threads and unmapped by last query using closed file
+static std::mutex mappedSizeMutex;
+
+// size is checked and reserved before mapping, files which can't be mmaped are read by descriptors
+// (never into memory), array stream is limited by int size
+static void mapBinaryMapFile(BinaryMapFile* file) {
+	struct stat st;
+	if (stat(file->inputName.c_str(), &st) != 0 || st.st_size <= 0 || st.st_size > INT_MAXIMUM) {
+		return;
+	}
+	int64_t size = st.st_size;
+	{
+		std::lock_guard<std::mutex> lock(mappedSizeMutex);
+		if (sizeof(void*) < 8 && mappedSize + size > MAX_MAPPED_SIZE_32) {
+			return;
+		}
+		mappedSize += size;
+	}
+	SHARED_PTR<MappedFile> mapped(new MappedFile());
+	if (!mapped->open(file->inputName.c_str(), true) || (int64_t) mapped->getSize() != size) {
+		std::lock_guard<std::mutex> lock(mappedSizeMutex);
+		mappedSize -= size;
+		return;
+	}
+	file->mapped = mapped;
+}
+
+static void unmapBinaryMapFile(BinaryMapFile* file) {
+	if (file->mapped.get() != NULL) {
+		std::lock_guard<std::mutex> lock(mappedSizeMutex);
+		mappedSize -= file->mapped->getSize();
+		file->mapped.reset();
+	}
+}
+
+static void deleteBinaryMapFile(BinaryMapFile* file) {
+	unmapBinaryMapFile(file);
+	delete file;
+}
+
+SHARED_PTR<BinaryMapFile> MapRepository::addFile(SHARED_PTR<BinaryMapFile> file) {
+	std::lock_guard<ReadWriteLock> lock(rwLock);
+	SHARED_PTR<BinaryMapFile> replaced;
+	for (uint i = 0; i < files.size(); i++) {
+		if (files[i]->inputName == file->inputName) {
+			replaced = files[i];
+			files[i] = file;
+			return replaced;
+		}
+	}
+	files.push_back(file);
+	return replaced;
+}
+
+SHARED_PTR<BinaryMapFile> MapRepository::removeFile(const std::string& inputName) {
+	std::lock_guard<ReadWriteLock> lock(rwLock);
+	SHARED_PTR<BinaryMapFile> removed;
+	for (uint i = 0; i < files.size(); i++) {
+		if (files[i]->inputName == inputName) {
+			removed = files[i];
+			files.erase(files.begin() + i);
+			break;
+		}
+	}
+	return removed;
+}
+
+SHARED_PTR<BinaryMapFile> MapRepository::getFile(const std::string& inputName) {
+	SharedLockGuard lock(rwLock);
+	for (uint i = 0; i < files.size(); i++) {
+		if (files[i]->inputName == inputName) {
+			return files[i];
+		}
+	}
+	return SHARED_PTR<BinaryMapFile>();
+}
+
+void MapRepository::getFiles(std::vector<SHARED_PTR<BinaryMapFile> >& result) {
+	SharedLockGuard lock(rwLock);
+	result = files;
+}
+
+MapRepository& getMapRepository() {
+	static MapRepository repository;
+	return repository;
+}
+
+void searchRouteSubRegion(BinaryMapFile* file, std::vector<RouteDataObject*>& list,  RoutingIndex* routingIndex, RouteSubregion* sub);
+void searchRouteRegion(SearchQuery* q, std::vector<RouteSubregion>& subregions, std::vector<RouteSubregion>& toLoad);
+void checkAndInitRouteTree(BinaryMapFile* file, RoutingIndex* routingIndex, bool basemap);
+void initInputForRouteFile(CodedInputStream** inputStream, ZeroCopyInputStream** fis, BinaryMapFile* file, uint32_t seek);
 bool readRouteTreeData(CodedInputStream* input, RouteSubregion* s, std::vector<RouteDataObject*>& dataObjects,
 		RoutingIndex* routingIndex);
 
@@ -915,7 +1089,9 @@ void searchMapData(CodedInputStream* input, MapRoot* root, MapIndex* ind, Search
 		std::vector<MapTreeBounds> foundSubtrees;
 		input->Seek(i->filePointer);
 		int oldLimit = input->PushLimit(i->length);
-		searchMapTreeBounds(input, &(*i), root, req, &foundSubtrees);
+		// bounds of level are shared by concurrent queries, box is read into copy
+		MapTreeBounds current = *i;
+		searchMapTreeBounds(input, &current, root, req, &foundSubtrees);
 		input->PopLimit(oldLimit);
 
 		sort(foundSubtrees.begin(), foundSubtrees.end(), sortTreeBounds);
@@ -990,14 +1166,12 @@ void convertRouteDataObjecToMapObjects(SearchQuery* q, std::vector<RouteDataObje
 	}
 }
 
-void checkAndInitRouteRegionRules(int fileInd, RoutingIndex* routingIndex){
-	// init decoding rules
+void initRouteRegionRules(BinaryMapFile* file, RoutingIndex* routingIndex) {
+	// rules are usually read with file
 	if (routingIndex->decodingRules.size() == 0) {
-		lseek(fileInd, 0, SEEK_SET);
-		FileInputStream input(fileInd);
-		input.SetCloseOnDelete(false);
+		BinaryMapInputStream input(file, file->routefd);
 		CodedInputStream cis(&input);
-		cis.SetTotalBytesLimit(INT_MAXIMUM, INT_MAXIMUM >> 1);
+		setBinaryMapInputLimits(&cis);
 
 		cis.Seek(routingIndex->filePointer);
 		uint32_t old = cis.PushLimit(routingIndex->length);
@@ -1006,10 +1180,37 @@ void checkAndInitRouteRegionRules(int fileInd, RoutingIndex* routingIndex){
 	}
 }
 
+void checkAndInitRouteRegionRules(BinaryMapFile* file, RoutingIndex* routingIndex){
+	std::call_once(routingIndex->rulesInitialized, initRouteRegionRules, file, routingIndex);
+}
+
+// reads subtrees of all top level boxes of level
+void initRouteTree(BinaryMapFile* file, RoutingIndex* routingIndex, bool basemap) {
+	std::vector<RouteSubregion>& subs = basemap ? routingIndex->basesubregions : routingIndex->subregions;
+	ZeroCopyInputStream* nt = NULL;
+	CodedInputStream* cis = NULL;
+	for (std::vector<RouteSubregion>::iterator subreg = subs.begin(); subreg != subs.end(); subreg++) {
+		if (subreg->subregions.empty() && subreg->mapDataBlock == 0) {
+			initInputForRouteFile(&cis, &nt, file, subreg->filePointer);
+			uint32_t old = cis->PushLimit(subreg->length);
+			readRouteTree(cis, &(*subreg), NULL, routingIndex, -1, false);
+			cis->PopLimit(old);
+		}
+	}
+	if (cis != NULL) { delete cis; }
+	if (nt != NULL) { delete nt; }
+}
+
+void checkAndInitRouteTree(BinaryMapFile* file, RoutingIndex* routingIndex, bool basemap) {
+	std::call_once(routingIndex->treeInitialized[basemap ? 1 : 0], initRouteTree, file, routingIndex, basemap);
+}
+
 void searchRouteSubregions(SearchQuery* q, std::vector<RouteSubregion>& tempResult, bool basemap) {
-	vector<BinaryMapFile*>::iterator i = openFiles.begin();
-	for (; i != openFiles.end() && !q->publisher->isCancelled(); i++) {
-		BinaryMapFile* file = *i;
+	vector<SHARED_PTR<BinaryMapFile> > files;
+	getMapRepository().getFiles(files);
+	vector<SHARED_PTR<BinaryMapFile> >::iterator i = files.begin();
+	for (; i != files.end() && !q->publisher->isCancelled(); i++) {
+		BinaryMapFile* file = i->get();
 		std::vector<RoutingIndex*>::iterator routeIndex = file->routingIndexes.begin();
 		for (; routeIndex != file->routingIndexes.end(); routeIndex++) {
 			bool contains = false;
@@ -1021,12 +1222,9 @@ void searchRouteSubregions(SearchQuery* q, std::vector<RouteSubregion>& tempResu
 				}
 			}
 			if (contains) {	
-				FileInputStream* nt = NULL;
-				CodedInputStream* cis = NULL;
-				searchRouteRegion(&cis, &nt, file, q, *routeIndex, subs, tempResult);				
-				if ( cis != NULL) { delete cis; }
-				if ( nt != NULL) { delete nt; }
-				checkAndInitRouteRegionRules(file->routefd, (*routeIndex));
+				checkAndInitRouteTree(file, (*routeIndex), basemap);
+				checkAndInitRouteRegionRules(file, (*routeIndex));
+				searchRouteRegion(q, subs, tempResult);
 			}
 		}
 
@@ -1036,11 +1234,9 @@ void searchRouteSubregions(SearchQuery* q, std::vector<RouteSubregion>& tempResu
 void readRouteMapObjects(SearchQuery* q, BinaryMapFile* file, vector<RouteSubregion>& found,
 		RoutingIndex* routeIndex, std::vector<MapDataObject*>& tempResult, int& renderedState) {
 	sort(found.begin(), found.end(), sortRouteRegions);
-	lseek(file->fd, 0, SEEK_SET);
-	FileInputStream input(file->fd);
-	input.SetCloseOnDelete(false);
+	BinaryMapInputStream input(file, file->fd);
 	CodedInputStream cis(&input);
-	cis.SetTotalBytesLimit(INT_MAX, INT_MAX >> 2);
+	setBinaryMapInputLimits(&cis);
 	for (std::vector<RouteSubregion>::iterator sub = found.begin(); sub != found.end(); sub++) {
 		std::vector<RouteDataObject*> list;
 		cis.Seek(sub->filePointer + sub->mapDataBlock);
@@ -1061,10 +1257,8 @@ void readRouteDataAsMapObjects(SearchQuery* q, BinaryMapFile* file, std::vector<
 			break;
 		}
 		bool contains = false;
-		std::vector<RouteSubregion> subs = (*routeIndex)->subregions;
-		if (q->zoom <= zoomForBaseRouteRendering) {
-			subs = (*routeIndex)->basesubregions;
-		}
+		bool basemap = q->zoom <= zoomForBaseRouteRendering;
+		std::vector<RouteSubregion>& subs = basemap ? (*routeIndex)->basesubregions : (*routeIndex)->subregions;
 		for (std::vector<RouteSubregion>::iterator subreg = subs.begin(); subreg != subs.end(); subreg++) {
 			if (subreg->right >= (uint) q->left && (uint)q->right >= subreg->left && 
 					subreg->bottom >= (uint) q->top && (uint) q->bottom >= subreg->top) {
@@ -1074,12 +1268,9 @@ void readRouteDataAsMapObjects(SearchQuery* q, BinaryMapFile* file, std::vector<
 		}
 		if (contains) {
 			vector<RouteSubregion> found;			
-			FileInputStream* nt = NULL;
-			CodedInputStream* cis = NULL;
-			searchRouteRegion(&cis, &nt, file, q, *routeIndex, subs, found);
-			if ( cis != NULL) { delete cis; }
-			if ( nt != NULL) { delete nt; }
-			checkAndInitRouteRegionRules(file->fd, (*routeIndex));
+			checkAndInitRouteTree(file, (*routeIndex), basemap);
+			checkAndInitRouteRegionRules(file, (*routeIndex));
+			searchRouteRegion(q, subs, found);
 			readRouteMapObjects(q, file, found, (*routeIndex), tempResult, renderedState);
 		}
 	}
@@ -1098,35 +1289,38 @@ void readMapObjects(SearchQuery* q, BinaryMapFile* file) {
 				if (mapLevel->right >= (uint)q->left && (uint)q->right >= mapLevel->left && 
 						mapLevel->bottom >= (uint)q->top && (uint)q->bottom >= mapLevel->top) {
 					// OsmAnd::LogPrintf(OsmAnd::LogSeverityLevel::Info, "Search map %s", mapIndex->name.c_str());
-					// lazy initializing rules
-					if (mapIndex->decodingRules.size() == 0) {
-						lseek(file->fd, 0, SEEK_SET);
-						FileInputStream input(file->fd);
-						input.SetCloseOnDelete(false);
-						CodedInputStream cis(&input);
-						cis.SetTotalBytesLimit(INT_MAXIMUM, INT_MAXIMUM >> 1);
-						cis.Seek(mapIndex->filePointer);
-						int oldLimit = cis.PushLimit(mapIndex->length);
-						readMapIndex(&cis, &(*mapIndex), true);
-						cis.PopLimit(oldLimit);
-					}
-					// lazy initializing subtrees
-					if (mapLevel->bounds.size() == 0) {
-						lseek(file->fd, 0, SEEK_SET);
-						FileInputStream input(file->fd);
-						input.SetCloseOnDelete(false);
-						CodedInputStream cis(&input);
-						cis.SetTotalBytesLimit(INT_MAXIMUM, INT_MAXIMUM >> 1);
-						cis.Seek(mapLevel->filePointer);
-						int oldLimit = cis.PushLimit(mapLevel->length);
-						readMapLevel(&cis, &(*mapLevel), true);
-						cis.PopLimit(oldLimit);
-					}
-					lseek(file->fd, 0, SEEK_SET);
-					FileInputStream input(file->fd);
-					input.SetCloseOnDelete(false);
+					// lazy initializing rules (once, queries of repository run concurrently)
+					MapIndex* index = &(*mapIndex);
+					std::call_once(*index->rulesInitialized, [file, index]() {
+						if (index->decodingRules.size() == 0) {
+							BinaryMapInputStream input(file, file->fd);
+							CodedInputStream cis(&input);
+							setBinaryMapInputLimits(&cis);
+							cis.Seek(index->filePointer);
+							int oldLimit = cis.PushLimit(index->length);
+							readMapIndex(&cis, index, true);
+							cis.PopLimit(oldLimit);
+						}
+					});
+					// lazy initializing subtrees (zooms and box of level are read by other queries, so level is
+					// read into copy and only bounds are taken)
+					MapRoot* level = &(*mapLevel);
+					std::call_once(*level->boundsInitialized, [file, level]() {
+						if (level->bounds.size() == 0) {
+							BinaryMapInputStream input(file, file->fd);
+							CodedInputStream cis(&input);
+							setBinaryMapInputLimits(&cis);
+							cis.Seek(level->filePointer);
+							int oldLimit = cis.PushLimit(level->length);
+							MapRoot read;
+							readMapLevel(&cis, &read, true);
+							cis.PopLimit(oldLimit);
+							level->bounds.swap(read.bounds);
+						}
+					});
+					BinaryMapInputStream input(file, file->fd);
 					CodedInputStream cis(&input);
-					cis.SetTotalBytesLimit(INT_MAXIMUM, INT_MAXIMUM >> 1);
+					setBinaryMapInputLimits(&cis);
 					searchMapData(&cis, &(*mapLevel), &(*mapIndex), q);
 				}
 			}
@@ -1134,17 +1328,18 @@ void readMapObjects(SearchQuery* q, BinaryMapFile* file) {
 	}
 }
 
-void readMapObjectsForRendering(SearchQuery* q, std::vector<MapDataObject*> & basemapResult, std::vector<MapDataObject*>& tempResult,
+void readMapObjectsForRendering(SearchQuery* q, vector<SHARED_PTR<BinaryMapFile> >& files,
+		std::vector<MapDataObject*> & basemapResult, std::vector<MapDataObject*>& tempResult,
 		std::vector<MapDataObject*>& coastLines,std::vector<MapDataObject*>& basemapCoastLines,
 		int& count, bool& basemapExists, int& renderedState) {
-	vector< BinaryMapFile*>::iterator i = openFiles.begin();
-	for (; i != openFiles.end() && !q->publisher->isCancelled(); i++) {
-		BinaryMapFile* file = *i;
+	vector<SHARED_PTR<BinaryMapFile> >::iterator i = files.begin();
+	for (; i != files.end() && !q->publisher->isCancelled(); i++) {
+		BinaryMapFile* file = i->get();
 		basemapExists |= file->isBasemap();
 	}
-	i = openFiles.begin();
-	for (; i != openFiles.end() && !q->publisher->isCancelled(); i++) {
-		BinaryMapFile* file = *i;
+	i = files.begin();
+	for (; i != files.end() && !q->publisher->isCancelled(); i++) {
+		BinaryMapFile* file = i->get();
 		if (q->req != NULL) {
 			q->req->clearState();
 		}
@@ -1197,15 +1392,18 @@ ResultPublisher* searchObjectsForRendering(SearchQuery* q, bool skipDuplicates,
 	std::vector<MapDataObject*> basemapCoastLines;
 
 	bool basemapExists = false;
-	readMapObjectsForRendering(q, basemapResult, tempResult, coastLines, basemapCoastLines, count,
+	// same files for map and route sections, even if files are opened or closed meanwhile
+	vector<SHARED_PTR<BinaryMapFile> > files;
+	getMapRepository().getFiles(files);
+	readMapObjectsForRendering(q, files, basemapResult, tempResult, coastLines, basemapCoastLines, count,
 			basemapExists, renderedState);
 
 	bool objectsFromMapSectionRead = tempResult.size() > 0;
 	bool objectsFromRoutingSectionRead = false;
 	if (q->zoom >= zoomOnlyForBasemaps) {
-		vector<BinaryMapFile*>::iterator i = openFiles.begin();
-		for (; i != openFiles.end() && !q->publisher->isCancelled(); i++) {
-			BinaryMapFile* file = *i;
+		vector<SHARED_PTR<BinaryMapFile> >::iterator i = files.begin();
+		for (; i != files.end() && !q->publisher->isCancelled(); i++) {
+			BinaryMapFile* file = i->get();
 			// false positive case when we have 2 sep maps Country-roads & Country
 			if(file->isRoadOnly()) {
 				if (q->req != NULL) {
@@ -1291,13 +1489,11 @@ ResultPublisher* searchObjectsForRendering(SearchQuery* q, bool skipDuplicates,
 	return q->publisher;
 }
 
-void initInputForRouteFile(CodedInputStream** inputStream, FileInputStream** fis, BinaryMapFile* file, uint32_t seek) {
+void initInputForRouteFile(CodedInputStream** inputStream, ZeroCopyInputStream** fis, BinaryMapFile* file, uint32_t seek) {
   if(*inputStream == 0) {
-      lseek(file->routefd, 0, SEEK_SET); // seek 0 or seek (*routeIndex)->filePointer
-	  *fis = new FileInputStream(file->routefd);
-	  (*fis)->SetCloseOnDelete(false);
+	  *fis = new BinaryMapInputStream(file, file->routefd);
 	  *inputStream = new CodedInputStream(*fis);	  
-	  (*inputStream) -> SetTotalBytesLimit(INT_MAXIMUM, INT_MAXIMUM >> 1);
+	  setBinaryMapInputLimits(*inputStream);
 	  (*inputStream)->PushLimit(INT_MAXIMUM);
 	  //inputStream -> Seek((*routeIndex)->filePointer);		 
 	  (*inputStream)->Seek(seek);
@@ -1306,20 +1502,13 @@ void initInputForRouteFile(CodedInputStream** inputStream, FileInputStream** fis
   }
 }
 
-void searchRouteRegion(CodedInputStream** input, FileInputStream** fis, BinaryMapFile* file, SearchQuery* q, RoutingIndex* ind, std::vector<RouteSubregion>& subregions,
-		std::vector<RouteSubregion>& toLoad) {
-  
+// route tree should be initialized (checkAndInitRouteTree)
+void searchRouteRegion(SearchQuery* q, std::vector<RouteSubregion>& subregions, std::vector<RouteSubregion>& toLoad) {
 	for (std::vector<RouteSubregion>::iterator subreg = subregions.begin();
 						subreg != subregions.end(); subreg++) {
 		if (subreg->right >= (uint) q->left && (uint)q->right >= subreg->left && 
 				subreg->bottom >= (uint)q->top && (uint)q->bottom >= subreg->top) {
-			if(subreg->subregions.empty() && subreg->mapDataBlock == 0) {
-				initInputForRouteFile(input, fis, file, subreg->filePointer);
-				uint32_t old = (*input)->PushLimit(subreg->length);
-				readRouteTree(*input, &(*subreg), NULL, ind, -1/*contains? -1 : 1*/, false);
-				(*input)->PopLimit(old);
-			}
-			searchRouteRegion(input, fis, file, q, ind, subreg->subregions, toLoad);
+			searchRouteRegion(q, subreg->subregions, toLoad);
 			if(subreg->mapDataBlock != 0) {
 				toLoad.push_back(*subreg);
 			}
@@ -1450,6 +1639,7 @@ bool readRouteTreeData(CodedInputStream* input, RouteSubregion* s, std::vector<R
 	int tag;
 	std::vector<int64_t> idTables;
 	UNORDERED(map)<int64_t, std::vector<uint64_t> > restrictions;
+	UNORDERED(map)<int64_t, std::vector<int64_t> > restrictionsVia;
 	std::vector<std::string> stringTable;
 	while ((tag = input->ReadTag()) != 0) {
 		switch (WireFormatLite::GetTagFieldNumber(tag)) {
@@ -1484,6 +1674,7 @@ bool readRouteTreeData(CodedInputStream* input, RouteSubregion* s, std::vector<R
 			uint64_t from = 0;
 			uint64_t to = 0;
 			uint64_t type = 0;
+			int64_t via = 0;
 			int tm;
 			int ts;
 			while ((ts = input->ReadTag()) != 0) {
@@ -1503,6 +1694,11 @@ bool readRouteTreeData(CodedInputStream* input, RouteSubregion* s, std::vector<R
 					type = tm;
 					break;
 				}
+				case OsmAnd::OBF::RestrictionData::kViaFieldNumber: {
+					DO_((WireFormatLite::ReadPrimitive<int, WireFormatLite::TYPE_INT32>(input, &tm)));
+					via = tm;
+					break;
+				}
 				default: {
 					if (WireFormatLite::GetTagWireType(ts) == WireFormatLite::WIRETYPE_END_GROUP) {
 						return true;
@@ -1515,6 +1711,7 @@ bool readRouteTreeData(CodedInputStream* input, RouteSubregion* s, std::vector<R
 				}
 			}
 			restrictions[from].push_back((to << RouteDataObject::RESTRICTION_SHIFT) + type);
+			restrictionsVia[from].push_back(via);
 			input->PopLimit(oldLimit);
 			break;
 		}
@@ -1562,12 +1759,32 @@ bool readRouteTreeData(CodedInputStream* input, RouteSubregion* s, std::vector<R
 	for (; itRestrictions != restrictions.end(); itRestrictions++) {
 		RouteDataObject* fromr = dataObjects[itRestrictions->first];
 		if (fromr != NULL) {
-			fromr->restrictions = itRestrictions->second;
-			for (uint i = 0; i < fromr->restrictions.size(); i++) {
-				uint64_t to = fromr->restrictions[i] >> RouteDataObject::RESTRICTION_SHIFT;
+			std::vector<uint64_t>& rs = itRestrictions->second;
+			std::vector<int64_t>& vias = restrictionsVia[itRestrictions->first];
+			// index of restrictions : sorted by target road id with aligned via roads
+			std::vector<std::pair<uint64_t, int64_t> > sorted;
+			bool hasVia = false;
+			for (uint i = 0; i < rs.size(); i++) {
+				uint64_t to = rs[i] >> RouteDataObject::RESTRICTION_SHIFT;
 				uint64_t valto = (idTables[to] << RouteDataObject::RESTRICTION_SHIFT)
-					| (fromr->restrictions[i] & RouteDataObject::RESTRICTION_MASK);
-				fromr->restrictions[i] = valto;
+					| (rs[i] & RouteDataObject::RESTRICTION_MASK);
+				int64_t via = 0;
+				if (vias[i] != 0 && (uint64_t) vias[i] < idTables.size()) {
+					via = idTables[vias[i]];
+					hasVia = true;
+				}
+				sorted.push_back(std::pair<uint64_t, int64_t>(valto, via));
+			}
+			std::sort(sorted.begin(), sorted.end());
+			fromr->restrictions.resize(sorted.size());
+			for (uint i = 0; i < sorted.size(); i++) {
+				fromr->restrictions[i] = sorted[i].first;
+			}
+			if (hasVia) {
+				fromr->restrictionsVia.resize(sorted.size());
+				for (uint i = 0; i < sorted.size(); i++) {
+					fromr->restrictionsVia[i] = sorted[i].second;
+				}
 			}
 		}
 	}
@@ -1577,6 +1794,8 @@ bool readRouteTreeData(CodedInputStream* input, RouteSubregion* s, std::vector<R
 			if ((uint)(*dobj)->id < idTables.size()) {
 				(*dobj)->id = idTables[(*dobj)->id];
 			}
+			// restrictions are already indexed
+			(*dobj)->initFlags();
 			if ((*dobj)->namesIds.size() > 0) {
 				vector<pair<uint32_t, uint32_t> >::iterator itnames = (*dobj)->namesIds.begin();
 				for(; itnames != (*dobj)->namesIds.end(); itnames++) {
@@ -1607,16 +1826,14 @@ bool readRouteTreeData(CodedInputStream* input, RouteSubregion* s, std::vector<R
 }
 
 
-void searchRouteSubRegion(int fileInd, std::vector<RouteDataObject*>& list,  RoutingIndex* routingIndex, RouteSubregion* sub){
+void searchRouteSubRegion(BinaryMapFile* file, std::vector<RouteDataObject*>& list,  RoutingIndex* routingIndex, RouteSubregion* sub){
 
-	checkAndInitRouteRegionRules(fileInd, routingIndex);
+	checkAndInitRouteRegionRules(file, routingIndex);
 
 	// could be simplified but it will be concurrency with init block
-	lseek(fileInd, 0, SEEK_SET);
-	FileInputStream input(fileInd);
-	input.SetCloseOnDelete(false);
+	BinaryMapInputStream input(file, file->routefd);
 	CodedInputStream cis(&input);
-	cis.SetTotalBytesLimit(INT_MAXIMUM, INT_MAXIMUM >> 1);
+	setBinaryMapInputLimits(&cis);
 
 	cis.Seek(sub->filePointer + sub->mapDataBlock);
 	uint32_t length;
@@ -1627,10 +1844,12 @@ void searchRouteSubRegion(int fileInd, std::vector<RouteDataObject*>& list,  Rou
 }
 
 void searchRouteDataForSubRegion(SearchQuery* q, std::vector<RouteDataObject*>& list, RouteSubregion* sub){
-	vector< BinaryMapFile*>::iterator i = openFiles.begin();
+	vector<SHARED_PTR<BinaryMapFile> > files;
+	getMapRepository().getFiles(files);
+	vector<SHARED_PTR<BinaryMapFile> >::iterator i = files.begin();
 	RoutingIndex* rs = sub->routingIndex;
-	for (; i != openFiles.end() && !q->publisher->isCancelled(); i++) {
-		BinaryMapFile* file = *i;
+	for (; i != files.end() && !q->publisher->isCancelled(); i++) {
+		BinaryMapFile* file = i->get();
 		for (std::vector<RoutingIndex*>::iterator routingIndex = file->routingIndexes.begin();
 				routingIndex != file->routingIndexes.end(); routingIndex++) {
 			if (q->publisher->isCancelled()) {
@@ -1639,7 +1858,14 @@ void searchRouteDataForSubRegion(SearchQuery* q, std::vector<RouteDataObject*>&
 			if(rs != NULL && (rs->name != (*routingIndex)->name || rs->filePointer != (*routingIndex)->filePointer)){
 				continue;
 			}
-			searchRouteSubRegion(file->routefd, list, (*routingIndex), sub);
+			if (file->graphCache.get() != NULL) {
+				// rules are still needed to interpret types of cached objects
+				checkAndInitRouteRegionRules(file, (*routingIndex));
+				if (file->graphCache->readTile(sub->filePointer + sub->mapDataBlock, (*routingIndex), list)) {
+					return;
+				}
+			}
+			searchRouteSubRegion(file, list, (*routingIndex), sub);
 			return;
 		}
 
@@ -1648,16 +1874,34 @@ void searchRouteDataForSubRegion(SearchQuery* q, std::vector<RouteDataObject*>&
 
 
 
-bool closeBinaryMapFile(std::string inputName) {
-	std::vector< BinaryMapFile*>::iterator iterator = openFiles.begin();
-	for (;iterator != openFiles.end();iterator++) {
-		if((*iterator)->inputName == inputName) {
-			delete *iterator;
-			openFiles.erase(iterator);
-			return true;
+SHARED_PTR<BinaryMapFile> getBinaryMapFile(std::string inputName) {
+	return getMapRepository().getFile(inputName);
+}
+
+void getRoutingBinaryMapFiles(std::vector<std::string>& names) {
+	vector<SHARED_PTR<BinaryMapFile> > files;
+	getMapRepository().getFiles(files);
+	for (uint i = 0; i < files.size(); i++) {
+		if (!files[i]->routingIndexes.empty()) {
+			names.push_back(files[i]->inputName);
 		}
 	}
-	return false;
+}
+
+static void releaseBinaryMapFile(SHARED_PTR<BinaryMapFile> file) {
+	// descriptors and mapping are released with last reference (running queries)
+	for (uint i = 0; i < file->routingIndexes.size(); i++) {
+		releaseSharedRouteTiles(file->routingIndexes[i]);
+	}
+}
+
+bool closeBinaryMapFile(std::string inputName) {
+	SHARED_PTR<BinaryMapFile> file = getMapRepository().removeFile(inputName);
+	if (file.get() == NULL) {
+		return false;
+	}
+	releaseBinaryMapFile(file);
+	return true;
 }
 
 bool initMapFilesFromCache(std::string inputName) {
@@ -1712,9 +1956,12 @@ BinaryMapFile* initBinaryMapFile(std::string inputName) {
 		return NULL;
 	}
 	BinaryMapFile* mapFile = new BinaryMapFile();
+	SHARED_PTR<BinaryMapFile> file(mapFile, deleteBinaryMapFile);
 	mapFile->fd = fileDescriptor;
 
 	mapFile->routefd = routeDescriptor;
+	mapFile->inputName = inputName;
+	mapBinaryMapFile(mapFile);
 	FileIndex* fo = NULL;
 	if (cache != NULL) {
 		struct stat stat;
@@ -1781,19 +2028,22 @@ BinaryMapFile* initBinaryMapFile(std::string inputName) {
 		}
 		OsmAnd::LogPrintf(OsmAnd::LogSeverityLevel::Debug, "Native file initialized from cache %s", inputName.c_str());
 	} else {
-		FileInputStream input(fileDescriptor);
-		input.SetCloseOnDelete(false);
+		BinaryMapInputStream input(mapFile, fileDescriptor);
 		CodedInputStream cis(&input);
-		cis.SetTotalBytesLimit(INT_MAXIMUM, INT_MAXIMUM >> 1);
+		setBinaryMapInputLimits(&cis);
 		OsmAnd::LogPrintf(OsmAnd::LogSeverityLevel::Warning, "File not initialized from cache : %s", inputName.c_str());
 		if (!initMapStructure(&cis, mapFile)) {
 			OsmAnd::LogPrintf(OsmAnd::LogSeverityLevel::Error, "File not initialised : %s", inputName.c_str());
-			delete mapFile;
 			return NULL;
 		}
 	}
 	mapFile->inputName = inputName;
 	mapFile->roadOnly = inputName.find(".road") != string::npos;
-	openFiles.push_back(mapFile);
+	mapFile->graphCache = openRoutingGraphCache(mapFile);
+	SHARED_PTR<BinaryMapFile> replaced = getMapRepository().addFile(file);
+	if (replaced.get() != NULL) {
+		// same file was opened concurrently
+		releaseBinaryMapFile(replaced);
+	}
 	return mapFile;
 }
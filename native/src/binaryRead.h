@@ -12,12 +12,16 @@
 #include <stdio.h>
 #include <fstream>
 #include <map>
+#include <algorithm>
 #include <string>
 #include <stdint.h>
+#include <mutex>
+#include <condition_variable>
 #include "mapObjects.h"
 #include "multipolygons.h"
 #include "Common.h"
 #include "common2.h"
+#include "mappedFile.h"
 
 #if defined(WIN32)
 #define close _close
@@ -42,6 +46,7 @@ struct MapTreeBounds {
 	}
 };
 struct RoutingIndex;
+class RoutingGraphCache;
 struct RouteSubregion {
 	uint32_t length;
 	uint32_t filePointer;
@@ -62,6 +67,11 @@ struct MapRoot: MapTreeBounds {
 	uint minZoom ;
 	uint maxZoom ;
 	std::vector<MapTreeBounds> bounds;
+	// bounds are read once by first query (levels are copied while file is read, so flag is shared)
+	SHARED_PTR<std::once_flag> boundsInitialized;
+
+	MapRoot() : boundsInitialized(new std::once_flag()) {
+	}
 };
 
 enum PART_INDEXES {
@@ -81,11 +91,27 @@ struct BinaryPartIndex {
 	BinaryPartIndex(PART_INDEXES tp) : type(tp) {}
 };
 
+// flags of route decoding rules and road (RouteDataObject::flags)
+static const uint32_t ROAD_FLAGS_INITIALIZED = 1;
+static const uint32_t ROAD_FLAG_ROUNDABOUT = 1 << 1;
+// oneway tag is present and not "no"
+static const uint32_t ROAD_FLAG_ONEWAY = 1 << 2;
+// road has only_* turn restriction
+static const uint32_t ROAD_FLAG_ONLY_RESTRICTION = 1 << 3;
+// road has restriction through via road
+static const uint32_t ROAD_FLAG_VIA_RESTRICTION = 1 << 4;
+
 struct RoutingIndex : BinaryPartIndex {
 //	UNORDERED(map)< uint32_t, tag_value > decodingRules;
 	vector< tag_value > decodingRules;
+	// ROAD_FLAG_* of each decoding rule
+	vector< uint32_t > decodingRuleFlags;
 	std::vector<RouteSubregion> subregions;
 	std::vector<RouteSubregion> basesubregions;
+	// rules and route trees of top level boxes (subregions and basesubregions) are read once by first search,
+	// they are not changed after that, so concurrent searches read them without locks
+	std::once_flag rulesInitialized;
+	std::once_flag treeInitialized[2];
 	RoutingIndex() : BinaryPartIndex(ROUTING_INDEX) {
 	}
 
@@ -95,8 +121,16 @@ struct RoutingIndex : BinaryPartIndex {
 		//encodingRules[pair] = id;
 		while(decodingRules.size() < id + 1){
 			decodingRules.push_back(pair);
+			decodingRuleFlags.push_back(0);
 		}
 		decodingRules[id] = pair;
+		uint32_t flags = 0;
+		if(tag == "roundabout" || val == "roundabout") {
+			flags |= ROAD_FLAG_ROUNDABOUT;
+		} else if(tag == "oneway" && val != "no") {
+			flags |= ROAD_FLAG_ONEWAY;
+		}
+		decodingRuleFlags[id] = flags;
 	}
 };
 
@@ -108,7 +142,10 @@ struct RouteDataObject {
 	std::vector<uint32_t> types ;
 	std::vector<uint32_t> pointsX ;
 	std::vector<uint32_t> pointsY ;
+	// (to << RESTRICTION_SHIFT) + type sorted ascending, so restrictions to the road could be found by binary search
 	std::vector<uint64_t> restrictions ;
+	// via road id of restriction with the same index (0 - no via road)
+	std::vector<int64_t> restrictionsVia ;
 	std::vector<std::vector<uint32_t> > pointTypes;
 	std::vector<std::vector<uint32_t> > pointNameTypes;
 	std::vector<std::vector<uint32_t> > pointNameIds;
@@ -117,6 +154,16 @@ struct RouteDataObject {
 
 	UNORDERED(map)<int, std::string > names;
 	vector<pair<uint32_t, uint32_t> > namesIds;
+	// precomputed from types by initFlags() when road is decoded (roads built by hand should call it)
+	uint32_t flags;
+	// cached directionRoute(i, true) and directionRoute(i, false), see initBearings()
+	vector<float> bearings;
+	// first point of road in routing graph, route search keeps visited intervals by it (NO_GRAPH_POINT - not in graph)
+	uint32_t graphPointsStart;
+	static const uint32_t NO_GRAPH_POINT = 0xffffffff;
+
+	RouteDataObject() : region(NULL), id(0), flags(0), graphPointsStart(NO_GRAPH_POINT) {
+	}
 
 	string getName() {
 		if(names.size() > 0) {
@@ -135,6 +182,7 @@ struct RouteDataObject {
 		s += pointsY.capacity()*sizeof(uint32_t);
 		s += types.capacity()*sizeof(uint32_t);
 		s += restrictions.capacity()*sizeof(uint64_t);
+		s += restrictionsVia.capacity()*sizeof(int64_t);
 		std::vector<std::vector<uint32_t> >::iterator t = pointTypes.begin();
 		for(;t!=pointTypes.end(); t++) {
 			s+= (*t).capacity() * sizeof(uint32_t);
@@ -148,6 +196,7 @@ struct RouteDataObject {
 			s+= (*ts).capacity() *10;
 		}
 		s += namesIds.capacity()*sizeof(pair<uint32_t, uint32_t>);
+		s += bearings.capacity()*sizeof(float);
 		s += names.size()*sizeof(pair<int, string>)*10;
 		return s;
 	}
@@ -160,6 +209,60 @@ struct RouteDataObject {
 		return pointsX[0] == pointsX[pointsX.size() - 1] && pointsY[0] == pointsY[pointsY.size() - 1] ; 
 	}
 
+	void initFlags() {
+		uint32_t f = ROAD_FLAGS_INITIALIZED;
+		uint sz = types.size();
+		for(uint i = 0; i < sz; i++) {
+			if(types[i] < region->decodingRuleFlags.size()) {
+				f |= region->decodingRuleFlags[types[i]];
+			}
+		}
+		if((f & ROAD_FLAG_ONEWAY) && pointsX.size() > 0 && loop()) {
+			f |= ROAD_FLAG_ROUNDABOUT;
+		}
+		for(uint i = 0; i < restrictions.size(); i++) {
+			uint64_t tp = restrictions[i] & RESTRICTION_MASK;
+			// only_right_turn, only_left_turn, only_straight_on
+			if(tp >= 5) {
+				f |= ROAD_FLAG_ONLY_RESTRICTION;
+			}
+			if(restrictionsVia.size() > i && restrictionsVia[i] != 0) {
+				f |= ROAD_FLAG_VIA_RESTRICTION;
+			}
+		}
+		flags = f;
+	}
+
+	/**
+	 * return type of restriction to road toId or -1. Restrictions through via road are matched only if
+	 * viaId is equal to their via road, restrictions without via road are always matched
+	 */
+	int findRestriction(int64_t toId, int64_t viaId) {
+		std::vector<uint64_t>::iterator it = std::lower_bound(restrictions.begin(), restrictions.end(),
+				((uint64_t) toId) << RESTRICTION_SHIFT);
+		for (; it != restrictions.end() && (int64_t)(*it >> RESTRICTION_SHIFT) == toId; it++) {
+			int64_t via = restrictionsVia.size() > 0 ? restrictionsVia[it - restrictions.begin()] : 0;
+			if (via == 0 || via == viaId) {
+				return (int) (*it & RESTRICTION_MASK);
+			}
+		}
+		return -1;
+	}
+
+	// roads are shared by routing contexts, so flags are never computed here (see initFlags())
+	inline uint32_t getFlags() const {
+		return flags;
+	}
+
+	void initBearings() {
+		uint sz = pointsX.size();
+		bearings.resize(2 * sz);
+		for(uint i = 0; i < sz; i++) {
+			bearings[2 * i] = (float) directionRoute(i, true, 5);
+			bearings[2 * i + 1] = (float) directionRoute(i, false, 5);
+		}
+	}
+
 	string getHighway() {
 		uint sz = types.size();
 		for(uint i=0; i < sz; i++) {
@@ -171,20 +274,14 @@ struct RouteDataObject {
 		return "";
 	}
 	
-	bool roundabout(){
-		uint sz = types.size();
-		for(uint i=0; i < sz; i++) {
-			tag_value r = region->decodingRules[types[i]];
-			if(r.first == "roundabout" || r.second == "roundabout") {
-				return true;
-			} else if(r.first == "oneway" && r.second != "no" && loop()) {
-				return true;
-			}
-		}
-		return false;
+	inline bool roundabout(){
+		return (getFlags() & ROAD_FLAG_ROUNDABOUT) != 0;
 	}
 
 	double directionRoute(int startPoint, bool plus){
+		if(bearings.size() > 0) {
+			return bearings[2 * startPoint + (plus ? 0 : 1)];
+		}
 		// look at comment JAVA
 		return directionRoute(startPoint, plus, 5);
 	}
@@ -281,8 +378,10 @@ struct MapIndex : BinaryPartIndex {
 	int onewayReverseAttribute ;
 	UNORDERED(set)< int > positiveLayers;
 	UNORDERED(set)< int > negativeLayers;
+	// rules are read once by first query, concurrent queries of repository wait for it
+	SHARED_PTR<std::once_flag> rulesInitialized;
 
-	MapIndex() : BinaryPartIndex(MAP_INDEX) {
+	MapIndex() : BinaryPartIndex(MAP_INDEX), rulesInitialized(new std::once_flag()) {
 		nameEncodingType = refEncodingType = coastlineBrokenEncodingType = coastlineEncodingType = -1;
 		landEncodingType = onewayAttribute = onewayReverseAttribute = -1;
 	}
@@ -339,6 +438,10 @@ struct BinaryMapFile {
 	int routefd;
 	bool basemap;
 	bool roadOnly;
+	// precompiled route data blocks (<obf>.rgc), used instead of decoding obf when present
+	SHARED_PTR<RoutingGraphCache> graphCache;
+	// whole file mapped into memory, streams decode mapped bytes without reads (NULL - file is read by descriptors)
+	SHARED_PTR<MappedFile> mapped;
 
 	bool isBasemap(){
 		return basemap;
@@ -422,14 +525,99 @@ struct SearchQuery {
 	}
 };
 
+/**
+ * Reader/writer lock (shared_mutex is not available in c++0x), waiting writer blocks new readers
+ */
+class ReadWriteLock {
+private:
+	std::mutex mutex;
+	std::condition_variable changed;
+	int readers;
+	int waitingWriters;
+	bool writer;
+
+public:
+	ReadWriteLock() : readers(0), waitingWriters(0), writer(false) {
+	}
+
+	void lock_shared() {
+		std::unique_lock<std::mutex> lock(mutex);
+		changed.wait(lock, [this] { return !writer && waitingWriters == 0; });
+		readers++;
+	}
+
+	void unlock_shared() {
+		std::lock_guard<std::mutex> lock(mutex);
+		if (--readers == 0) {
+			changed.notify_all();
+		}
+	}
+
+	void lock() {
+		std::unique_lock<std::mutex> lock(mutex);
+		waitingWriters++;
+		changed.wait(lock, [this] { return !writer && readers == 0; });
+		waitingWriters--;
+		writer = true;
+	}
+
+	void unlock() {
+		std::lock_guard<std::mutex> lock(mutex);
+		writer = false;
+		changed.notify_all();
+	}
+};
+
+struct SharedLockGuard {
+	ReadWriteLock& rwLock;
+
+	SharedLockGuard(ReadWriteLock& rwLock) : rwLock(rwLock) {
+		rwLock.lock_shared();
+	}
+
+	~SharedLockGuard() {
+		rwLock.unlock_shared();
+	}
+};
+
+/**
+ * Opened files. Queries take snapshot of files and read them without lock through own streams (mapped bytes
+ * or positional reads), so files could be opened and closed while queries run : closed file is released
+ * when last query using it is finished.
+ */
+class MapRepository {
+private:
+	ReadWriteLock rwLock;
+	std::vector<SHARED_PTR<BinaryMapFile> > files;
+
+public:
+	// replaces file with the same name, replaced file is returned
+	SHARED_PTR<BinaryMapFile> addFile(SHARED_PTR<BinaryMapFile> file);
+
+	SHARED_PTR<BinaryMapFile> removeFile(const std::string& inputName);
+
+	SHARED_PTR<BinaryMapFile> getFile(const std::string& inputName);
+
+	void getFiles(std::vector<SHARED_PTR<BinaryMapFile> >& result);
+};
+
+MapRepository& getMapRepository();
+
 void searchRouteSubregions(SearchQuery* q, std::vector<RouteSubregion>& tempResult, bool basemap);
 
 void searchRouteDataForSubRegion(SearchQuery* q, std::vector<RouteDataObject*>& list, RouteSubregion* sub);
 
 ResultPublisher* searchObjectsForRendering(SearchQuery* q, bool skipDuplicates, std::string msgNothingFound, int& renderedState);
 
+// returned file is valid until it is closed, concurrent queries should use repository
 BinaryMapFile* initBinaryMapFile(std::string inputName);
 
+// file stays valid while returned pointer is held, even if it is closed meanwhile
+SHARED_PTR<BinaryMapFile> getBinaryMapFile(std::string inputName);
+
+// names of opened files with routing data
+void getRoutingBinaryMapFiles(std::vector<std::string>& names);
+
 bool initMapFilesFromCache(std::string inputName) ;
 
 bool closeBinaryMapFile(std::string inputName);
@@ -4,6 +4,8 @@
 #include "binaryRead.h"
 #include "binaryRoutePlanner.h"
 #include <functional>
+#include <mutex>
+#include <thread>
 #include "CppSQLite3.h"
 
 #include "Logging.h"
@@ -22,18 +24,12 @@ static const short RESTRICTION_ONLY_LEFT_TURN = 6;
 static const short RESTRICTION_ONLY_STRAIGHT_ON = 7;
 static const bool TRACE_ROUTING = false;
 
-static bool useSrRouting = false;
-static int srLevel = 2;
-
-// INFO hashmap for sr values
-typedef UNORDERED(map)<int64_t, double> SRVALUE_MAP;
-static SRVALUE_MAP srValueMap;
-
 // INFO get sr value from cache
-inline double readSrValueFromCache(int64_t id) {
-	if (useSrRouting) {
-		SRVALUE_MAP::iterator it = srValueMap.find(id);
-		if (it != srValueMap.end()) {
+inline double readSrValueFromCache(RoutingContext* ctx, int64_t id) {
+	if (ctx->useSrRouting) {
+		ctx->stats.srLookups++;
+		SRVALUE_MAP::iterator it = ctx->srValueMap.find(id);
+		if (it != ctx->srValueMap.end()) {
 			return it->second;
 		}
 	}
@@ -61,6 +57,47 @@ void printRoad(const char* prefix, SHARED_PTR<RouteSegment> segment) {
 		segment->parentRoute.get() != NULL? segment->parentRoute->road->id : 0);
 }
 
+// direction < 0 - segment belongs to search of last popped segment
+inline void traceSegment(RoutingContext* ctx, SearchTraceEventType type, SHARED_PTR<RouteSegment>& segment,
+		int direction = -1) {
+	SearchTrace* trace = ctx->trace.get();
+	if (trace != NULL) {
+		if (direction >= 0) {
+			trace->direction = direction;
+		}
+		uint16_t p = segment->getSegmentStart();
+		trace->add(type, trace->direction, segment->road->id, p, segment->road->pointsX[p],
+				segment->road->pointsY[p], segment->distanceFromStart, segment->distanceToEnd, segment->srValue);
+	}
+}
+
+// frontier eviction policy keeps tiles of queued segments and unloads tiles far from expanded ones
+inline void trackQueuedSegment(RoutingContext* ctx, SHARED_PTR<RouteSegment>& segment, int delta, int direction = -1) {
+	if (ctx->config->tileEvictionPolicy == TILE_EVICTION_FRONTIER) {
+		uint16_t p = segment->getSegmentStart();
+		int x31 = segment->road->pointsX[p];
+		int y31 = segment->road->pointsY[p];
+		ctx->segmentQueued(x31, y31, delta);
+		if (direction >= 0) {
+			ctx->frontierX[direction] = x31;
+			ctx->frontierY[direction] = y31;
+		}
+	}
+}
+
+static void tracePath(RoutingContext* ctx, SHARED_PTR<RouteSegment> finalSegment) {
+	if (ctx->trace.get() == NULL) {
+		return;
+	}
+	traceSegment(ctx, SEARCH_TRACE_FINAL, finalSegment, finalSegment->isReverseWaySearch() ? 1 : 0);
+	for (SHARED_PTR<RouteSegment> s = finalSegment->parentRoute; s.get() != NULL; s = s->parentRoute) {
+		traceSegment(ctx, SEARCH_TRACE_PATH, s, finalSegment->isReverseWaySearch() ? 1 : 0);
+	}
+	for (SHARED_PTR<RouteSegment> s = finalSegment->opposite; s.get() != NULL; s = s->parentRoute) {
+		traceSegment(ctx, SEARCH_TRACE_PATH, s, finalSegment->isReverseWaySearch() ? 0 : 1);
+	}
+}
+
 // static double measuredDist(int x1, int y1, int x2, int y2) {
 // 	return getDistance(get31LatitudeY(y1), get31LongitudeX(x1), get31LatitudeY(y2),
 // 			get31LongitudeX(x2));
@@ -129,38 +166,126 @@ float PrecalculatedRouteDirection::getDeviationDistance(int x31, int y31, int in
 	return distToPoint;
 }
 
-int PrecalculatedRouteDirection::SHIFT = (1 << (31 - 17));
-int PrecalculatedRouteDirection::SHIFTS[] = {1 << (31 - 15), 1 << (31 - 13), 1 << (31 - 12), 
-		1 << (31 - 11), 1 << (31 - 7)};
-int PrecalculatedRouteDirection::getIndex(int x31, int y31) {
-	int ind = -1;
-	vector<int> cachedS;
-	SkRect rct = SkRect::MakeLTRB(x31 - SHIFT, y31 - SHIFT, x31 + SHIFT, y31 + SHIFT);
-	quadTree.query_in_box(rct, cachedS);
-	if (cachedS.size() == 0) {
-		for (uint k = 0; k < 5 /* SHIFTS.size()*/; k++) {
-			rct = SkRect::MakeLTRB(x31 - SHIFTS[k], y31 - SHIFTS[k], x31 + SHIFTS[k], y31 + SHIFTS[k]);
-			quadTree.query_in_box(rct, cachedS);
-			if (cachedS.size() != 0) {
-				break;
-			}
+const int PrecalculatedRouteDirection::EMPTY_SLOT;
+
+void PrecalculatedRouteDirection::buildIndex() {
+	cellStart.clear();
+	cellPoints.clear();
+	cachedKeys.assign(1 << INDEX_CACHE_BITS, 0);
+	cachedIndexes.assign(1 << INDEX_CACHE_BITS, EMPTY_SLOT);
+	gridWidth = gridHeight = 0;
+	if (pointsX.empty()) {
+		return;
+	}
+	uint32_t minX = pointsX[0], maxX = pointsX[0];
+	uint32_t minY = pointsY[0], maxY = pointsY[0];
+	for (uint i = 1; i < pointsX.size(); i++) {
+		minX = std::min(minX, pointsX[i]);
+		maxX = std::max(maxX, pointsX[i]);
+		minY = std::min(minY, pointsY[i]);
+		maxY = std::max(maxY, pointsY[i]);
+	}
+	cellShift = MIN_CELL_SHIFT;
+	while (((maxX - minX) >> cellShift) >= (uint32_t) MAX_GRID_SIZE || 
+			((maxY - minY) >> cellShift) >= (uint32_t) MAX_GRID_SIZE) {
+		cellShift++;
+	}
+	gridMinX = minX;
+	gridMinY = minY;
+	gridWidth = ((maxX - minX) >> cellShift) + 1;
+	gridHeight = ((maxY - minY) >> cellShift) + 1;
+	cellStart.assign(gridWidth * gridHeight + 1, 0);
+	for (uint i = 0; i < pointsX.size(); i++) {
+		int c = ((pointsY[i] - minY) >> cellShift) * gridWidth + ((pointsX[i] - minX) >> cellShift);
+		cellStart[c + 1]++;
+	}
+	for (uint c = 1; c < cellStart.size(); c++) {
+		cellStart[c] += cellStart[c - 1];
+	}
+	cellPoints.resize(pointsX.size());
+	vector<int> fill(cellStart.begin(), cellStart.end() - 1);
+	for (uint i = 0; i < pointsX.size(); i++) {
+		int c = ((pointsY[i] - minY) >> cellShift) * gridWidth + ((pointsX[i] - minX) >> cellShift);
+		cellPoints[fill[c]++] = i;
+	}
+}
+
+void PrecalculatedRouteDirection::searchCell(int64_t cx, int64_t cy, int x31, int y31, int& ind, double& minDist) {
+	if (cx < 0 || cy < 0 || cx >= gridWidth || cy >= gridHeight) {
+		return;
+	}
+	int c = cy * gridWidth + cx;
+	for (int k = cellStart[c]; k < cellStart[c + 1]; k++) {
+		int n = cellPoints[k];
+		double dx = (double) x31 - pointsX[n];
+		double dy = (double) y31 - pointsY[n];
+		if (std::abs(dx) > MAX_SEARCH_RADIUS || std::abs(dy) > MAX_SEARCH_RADIUS) {
+			continue;
 		}
-		if (cachedS.size() == 0) {
-			return -1;
+		double ds = dx * dx + dy * dy;
+		if (ind == -1 || ds < minDist) {
+			ind = n;
+			minDist = ds;
 		}
 	}
+}
+
+int PrecalculatedRouteDirection::findNearestIndex(int x31, int y31) {
+	if (gridWidth == 0) {
+		return -1;
+	}
+	// arithmetic shift keeps cells left/above of grid negative
+	int64_t cx = ((int64_t) x31 - gridMinX) >> cellShift;
+	int64_t cy = ((int64_t) y31 - gridMinY) >> cellShift;
+	int64_t cellSize = 1ll << cellShift;
+	int64_t maxRing = (MAX_SEARCH_RADIUS >> cellShift) + 1;
+	// skip rings which don't intersect grid
+	int64_t ring = std::max(std::max(-cx, cx - (gridWidth - 1)), std::max(-cy, cy - (gridHeight - 1)));
+	if (ring < 0) {
+		ring = 0;
+	}
+	int ind = -1;
 	double minDist = 0;
-	for (uint i = 0; i < cachedS.size(); i++) {
-		int n = cachedS[i];
-		double ds = squareRootDist(x31, y31, pointsX[n], pointsY[n]);
-		if (ds < minDist || i == 0) {
-			ind = n;
-			minDist = ds;
+	for (; ring <= maxRing; ring++) {
+		// points of ring are at least (ring - 1) cells away
+		double ringDist = (double) (ring - 1) * cellSize;
+		if (ind != -1 && ring > 0 && ringDist * ringDist > minDist) {
+			break;
+		}
+		int64_t y0 = std::max(cy - ring, (int64_t) 0);
+		int64_t y1 = std::min(cy + ring, (int64_t) gridHeight - 1);
+		for (int64_t y = y0; y <= y1; y++) {
+			if (y == cy - ring || y == cy + ring) {
+				int64_t x0 = std::max(cx - ring, (int64_t) 0);
+				int64_t x1 = std::min(cx + ring, (int64_t) gridWidth - 1);
+				for (int64_t x = x0; x <= x1; x++) {
+					searchCell(x, y, x31, y31, ind, minDist);
+				}
+			} else {
+				searchCell(cx - ring, y, x31, y31, ind, minDist);
+				searchCell(cx + ring, y, x31, y31, ind, minDist);
+			}
 		}
 	}
 	return ind;
 }
 
+int PrecalculatedRouteDirection::getIndex(int x31, int y31) {
+	uint64_t key = calc(x31, y31);
+	if (cachedIndexes.empty()) {
+		return findNearestIndex(x31, y31);
+	}
+	// fibonacci hashing spreads neighbour points over slots
+	uint slot = (uint) ((key * 0x9E3779B97F4A7C15ull) >> (64 - INDEX_CACHE_BITS));
+	if (cachedIndexes[slot] != EMPTY_SLOT && cachedKeys[slot] == key) {
+		return cachedIndexes[slot];
+	}
+	int ind = findNearestIndex(x31, y31);
+	cachedKeys[slot] = key;
+	cachedIndexes[slot] = ind;
+	return ind;
+}
+
 float PrecalculatedRouteDirection::timeEstimate(int sx31, int sy31, int ex31, int ey31) {
 	uint64_t l1 = calc(sx31, sy31);
 	uint64_t l2 = calc(ex31, ey31);
@@ -204,9 +329,34 @@ static double h(RoutingContext* ctx, int begX, int begY, int endX, int endY) {
 		float te = ctx->precalcRoute.timeEstimate(begX, begY,  endX, endY);
 		if(te > 0) return te;
 	}
+	for (int i = 0; i < 2; i++) {
+		if (ctx->speedRings[i].get() != NULL && ctx->speedRings[i]->isCenter(endX, endY)) {
+			return ctx->speedRings[i]->time(distToFinalPoint);
+		}
+	}
 	return result;
 }
 
+// cell speeds are static, live factors which could speed up roads are applied to whole bound
+static void initSpeedBoundsHeuristic(RoutingContext* ctx) {
+	ctx->speedRings[0].reset();
+	ctx->speedRings[1].reset();
+	SHARED_PTR<RouteSpeedBounds> bounds = getRouteSpeedBounds(ctx->config);
+	if (bounds.get() == NULL) {
+		return;
+	}
+	float factor = ctx->overlay.get() != NULL ? ctx->overlay->maxFactor : 1;
+	if (ctx->isTimeDependent()) {
+		// speed profile stores percent of routing speed in byte
+		factor *= 2.55f;
+	}
+	float maxSpeed = ctx->config->router.getMaxDefaultSpeed();
+	ctx->speedRings[0] = SHARED_PTR<RouteSpeedRings>(new RouteSpeedRings(bounds, ctx->targetX, ctx->targetY,
+			factor, maxSpeed));
+	ctx->speedRings[1] = SHARED_PTR<RouteSpeedRings>(new RouteSpeedRings(bounds, ctx->startX, ctx->startY,
+			factor, maxSpeed));
+}
+
 struct SegmentsComparator: public std::binary_function<SHARED_PTR<RouteSegment>, SHARED_PTR<RouteSegment>, bool>
 {
 	RoutingContext* ctx;
@@ -232,8 +382,101 @@ struct NonHeuristicSegmentsComparator: public std::binary_function<SHARED_PTR<Ro
 	}
 };
 
-typedef UNORDERED(map)<int64_t, SHARED_PTR<RouteSegment> > VISITED_MAP;
-typedef priority_queue<SHARED_PTR<RouteSegment>, vector<SHARED_PTR<RouteSegment> >, SegmentsComparator > SEGMENTS_QUEUE;
+// visited intervals of roads by direction with segment from which interval was reached : roads of routing graph
+// use array indexed by graph points (no hashing and rehashing in large searches), other roads use map by route point id
+class VisitedSegments {
+private:
+	UNORDERED(map)<int64_t, SHARED_PTR<RouteSegment> > segments;
+	// ((graphPointsStart + interval) << 1) + positive -> index in slotSegments + 1 (0 - not visited)
+	vector<uint32_t> graphSlots;
+	vector<uint32_t> usedSlots;
+	vector<SHARED_PTR<RouteSegment> > slotSegments;
+
+public:
+	// anytime mode : segments which reached their interval faster than it was visited by first step, they are
+	// queued again by next step (refinement steps queue them at once)
+	vector<SHARED_PTR<RouteSegment> > skipped;
+
+private:
+	inline size_t getGraphSlot(const SHARED_PTR<RouteDataObject>& road, int interval, bool positive) {
+		if (road->graphPointsStart == RouteDataObject::NO_GRAPH_POINT || interval < 0) {
+			return graphSlots.size();
+		}
+		return (((size_t) road->graphPointsStart + interval) << 1) + (positive ? 1 : 0);
+	}
+
+public:
+	// array is allocated once for graph of context (2 slots per graph point)
+	void init(const RoutingGraph* graph) {
+		size_t slots = graph == NULL ? 0 : (size_t) graph->getPointsCount() << 1;
+		if (graphSlots.size() != slots) {
+			vector<uint32_t>(slots, 0).swap(graphSlots);
+		}
+	}
+
+	SHARED_PTR<RouteSegment> get(const SHARED_PTR<RouteDataObject>& road, int interval, bool positive) {
+		size_t slot = getGraphSlot(road, interval, positive);
+		if (slot < graphSlots.size()) {
+			uint32_t ind = graphSlots[slot];
+			return ind == 0 ? SHARED_PTR<RouteSegment>() : slotSegments[ind - 1];
+		}
+		UNORDERED(map)<int64_t, SHARED_PTR<RouteSegment> >::iterator it =
+				segments.find(calculateRoutePointId(road, interval, positive));
+		return it == segments.end() ? SHARED_PTR<RouteSegment>() : it->second;
+	}
+
+	// same interval as calculateRoutePointId(segm, direction)
+	SHARED_PTR<RouteSegment> get(SHARED_PTR<RouteSegment> segm, bool direction) {
+		return get(segm->road, direction ? segm->getSegmentStart() : segm->getSegmentStart() - 1, direction);
+	}
+
+	void put(const SHARED_PTR<RouteDataObject>& road, int interval, bool positive, SHARED_PTR<RouteSegment> s) {
+		size_t slot = getGraphSlot(road, interval, positive);
+		if (slot >= graphSlots.size()) {
+			segments[calculateRoutePointId(road, interval, positive)] = s;
+		} else if (graphSlots[slot] == 0) {
+			slotSegments.push_back(s);
+			usedSlots.push_back(slot);
+			graphSlots[slot] = slotSegments.size();
+		} else {
+			slotSegments[graphSlots[slot] - 1] = s;
+		}
+	}
+
+	size_t size() {
+		return segments.size() + slotSegments.size();
+	}
+
+	void clear() {
+		segments.clear();
+		for (uint i = 0; i < usedSlots.size(); i++) {
+			graphSlots[usedSlots[i]] = 0;
+		}
+		usedSlots.clear();
+		slotSegments.clear();
+		skipped.clear();
+	}
+};
+
+typedef VisitedSegments VISITED_MAP;
+// priority queue of segments, anytime mode reads all queued segments and reorders them once coefficient is changed
+class SegmentsQueue : public priority_queue<SHARED_PTR<RouteSegment>, vector<SHARED_PTR<RouteSegment> >,
+		SegmentsComparator> {
+public:
+	SegmentsQueue(const SegmentsComparator& cmp) :
+			priority_queue<SHARED_PTR<RouteSegment>, vector<SHARED_PTR<RouteSegment> >, SegmentsComparator>(cmp) {
+	}
+
+	const vector<SHARED_PTR<RouteSegment> >& getSegments() const {
+		return c;
+	}
+
+	void reorder() {
+		std::make_heap(c.begin(), c.end(), comp);
+	}
+};
+
+typedef SegmentsQueue SEGMENTS_QUEUE;
 void processRouteSegment(RoutingContext* ctx, bool reverseWaySearch, SEGMENTS_QUEUE& graphSegments,
 		VISITED_MAP& visitedSegments, SHARED_PTR<RouteSegment> segment, 
 		VISITED_MAP& oppositeSegments, bool direction);
@@ -247,6 +490,68 @@ void processOneRoadIntersection(RoutingContext* ctx, SEGMENTS_QUEUE& graphSegmen
 			SHARED_PTR<RouteSegment> segment, int segmentPoint, SHARED_PTR<RouteSegment> next);
 
 
+// per calculation search state, in graph mode it is reused by following calculations
+// (arrays of graph points are allocated once)
+struct RoutingScratch {
+	VISITED_MAP visitedDirectSegments;
+	VISITED_MAP visitedOppositeSegments;
+};
+
+static std::mutex scratchMutex;
+static vector<RoutingScratch*> idleScratches;
+// each idle scratch keeps arrays of all graph points, by default one per hardware thread is kept
+static uint maxIdleScratches = std::max(1u, std::thread::hardware_concurrency());
+
+void setIdleRoutingScratchesLimit(int limit) {
+	vector<RoutingScratch*> released;
+	{
+		std::lock_guard<std::mutex> lock(scratchMutex);
+		maxIdleScratches = std::max(0, limit);
+		while (idleScratches.size() > maxIdleScratches) {
+			released.push_back(idleScratches.back());
+			idleScratches.pop_back();
+		}
+	}
+	for (uint i = 0; i < released.size(); i++) {
+		delete released[i];
+	}
+}
+
+struct ReleaseRoutingScratch {
+	void operator()(RoutingScratch* scratch) const {
+		scratch->visitedDirectSegments.clear();
+		scratch->visitedOppositeSegments.clear();
+		{
+			std::lock_guard<std::mutex> lock(scratchMutex);
+			if (idleScratches.size() < maxIdleScratches) {
+				idleScratches.push_back(scratch);
+				return;
+			}
+		}
+		delete scratch;
+	}
+};
+
+SHARED_PTR<RoutingScratch> acquireRoutingScratch(RoutingContext* ctx) {
+	if (!ctx->isGraphMode()) {
+		return SHARED_PTR<RoutingScratch>(new RoutingScratch());
+	}
+	RoutingScratch* scratch = NULL;
+	{
+		std::lock_guard<std::mutex> lock(scratchMutex);
+		if (!idleScratches.empty()) {
+			scratch = idleScratches.back();
+			idleScratches.pop_back();
+		}
+	}
+	if (scratch == NULL) {
+		scratch = new RoutingScratch();
+	}
+	scratch->visitedDirectSegments.init(ctx->graph.get());
+	scratch->visitedOppositeSegments.init(ctx->graph.get());
+	return SHARED_PTR<RoutingScratch>(scratch, ReleaseRoutingScratch());
+}
+
 int calculateSizeOfSearchMaps(SEGMENTS_QUEUE& graphDirectSegments, SEGMENTS_QUEUE& graphReverseSegments,
 		VISITED_MAP& visitedDirectSegments, VISITED_MAP& visitedOppositeSegments) {
 	int sz = visitedDirectSegments.size() * sizeof(pair<int64_t, SHARED_PTR<RouteSegment> > );
@@ -309,26 +614,45 @@ void initQueuesWithStartEnd(RoutingContext* ctx,  SHARED_PTR<RouteSegment> start
 		//int startX = start->road->pointsX[start->segmentStart];
 		//int startY = start->road->pointsY[start->segmentStart];
 	
+		initSpeedBoundsHeuristic(ctx);
 		float estimatedDistance = (float) h(ctx, ctx->startX, ctx->startY, ctx->targetX, ctx->targetY);
+		ctx->estimatedRouteTime = estimatedDistance;
+		ctx->queuedTiles.clear();
+		ctx->frontierX[0] = ctx->startX;
+		ctx->frontierY[0] = ctx->startY;
+		ctx->frontierX[1] = ctx->targetX;
+		ctx->frontierY[1] = ctx->targetY;
 		if(startPos.get() != NULL) {
 			startPos->srValue = 1.0; // INFO set sr value
 			startPos->distanceToEnd = estimatedDistance;
 			graphDirectSegments.push(startPos);
+			ctx->stats.heapPushes++;
+			traceSegment(ctx, SEARCH_TRACE_PUSH, startPos, 0);
+			trackQueuedSegment(ctx, startPos, 1);
 		}
 		if(startNeg.get() != NULL) {
 			startNeg->srValue = 1.0; // INFO set sr value
 			startNeg->distanceToEnd = estimatedDistance;
 			graphDirectSegments.push(startNeg);
+			ctx->stats.heapPushes++;
+			traceSegment(ctx, SEARCH_TRACE_PUSH, startNeg, 0);
+			trackQueuedSegment(ctx, startNeg, 1);
 		}
 		if(endPos.get() != NULL) {
 			endPos->srValue = 1.0; // INFO set sr value
 			endPos->distanceToEnd = estimatedDistance;
 			graphReverseSegments.push(endPos);
+			ctx->stats.heapPushes++;
+			traceSegment(ctx, SEARCH_TRACE_PUSH, endPos, 1);
+			trackQueuedSegment(ctx, endPos, 1);
 		}
 		if(endNeg.get() != NULL) {
 			endNeg->srValue = 1.0; // INFO set sr value
 			endNeg->distanceToEnd = estimatedDistance;
 			graphReverseSegments.push(endNeg);
+			ctx->stats.heapPushes++;
+			traceSegment(ctx, SEARCH_TRACE_PUSH, endNeg, 1);
+			trackQueuedSegment(ctx, endNeg, 1);
 		}
 }
 
@@ -341,10 +665,11 @@ bool checkIfGraphIsEmpty(RoutingContext* ctx, bool allowDirection,
 				while (pntIterator != pnt->others.end()) {
 					SHARED_PTR<RouteSegmentPoint> next = *pntIterator;
 					bool visitedAlready = false;
-					if (next->getSegmentStart() > 0 && visited.find(calculateRoutePointId(next, false)) != visited.end()) {
+					ctx->stats.visitedLookups++;
+					if (next->getSegmentStart() > 0 && visited.get(next, false).get() != NULL) {
 						visitedAlready = true;
 					} else if (next->getSegmentStart() < next->getRoad()->getPointsLength() - 1
-							&& visited.find(calculateRoutePointId(next, true)) != visited.end()) {
+							&& visited.get(next, true).get() != NULL) {
 						visitedAlready = true;
 					}
 					pntIterator = pnt->others.erase(pntIterator);
@@ -353,14 +678,20 @@ bool checkIfGraphIsEmpty(RoutingContext* ctx, bool allowDirection,
 						SHARED_PTR<RouteSegment> pos = RouteSegment::initRouteSegment(next, true);
 						SHARED_PTR<RouteSegment> neg = RouteSegment::initRouteSegment(next, false);
 						if (pos.get() != NULL) {
-							pos->srValue = readSrValueFromCache(pos->road->id); // INFO get sr value
+							pos->srValue = readSrValueFromCache(ctx, pos->road->id); // INFO get sr value
 							pos->distanceToEnd = estimatedDistance;
 							graphSegments.push(pos);
+							ctx->stats.heapPushes++;
+							traceSegment(ctx, SEARCH_TRACE_PUSH, pos);
+							trackQueuedSegment(ctx, pos, 1);
 						}
 						if (neg.get() != NULL) {
-							neg->srValue = readSrValueFromCache(neg->road->id); // INFO get sr value
+							neg->srValue = readSrValueFromCache(ctx, neg->road->id); // INFO get sr value
 							neg->distanceToEnd = estimatedDistance;
 							graphSegments.push(neg);
+							ctx->stats.heapPushes++;
+							traceSegment(ctx, SEARCH_TRACE_PUSH, neg);
+							trackQueuedSegment(ctx, neg, 1);
 						}
 						OsmAnd::LogPrintf(OsmAnd::LogSeverityLevel::Info, "Reiterate point with new start/destination ");						
 						printRoad("Reiterate point ", next);
@@ -377,7 +708,7 @@ bool checkIfGraphIsEmpty(RoutingContext* ctx, bool allowDirection,
 	}
 
 // INFO convert sr value for comparator
-static double convertSrValue(double srValue) {
+static double convertSrValue(double srValue, int srLevel) {
 	if (srValue == 1.0) {
 		return 1.0;
 	}
@@ -422,25 +753,46 @@ static double convertSrValue(double srValue) {
 }
 
 // INFO read all sr values from db to cache
-void readSrDbToCache(CppSQLite3DB &db) {
+void readSrDbToCache(RoutingContext* ctx, CppSQLite3DB &db) {
 	OsmAnd::LogPrintf(OsmAnd::LogSeverityLevel::Debug, "[Native] [INFO] read db start");
 	CppSQLite3Query query = db.execQuery("select * from srdata;");
 	while (!query.eof()) {
-		double convertedSrValue = convertSrValue(query.getFloatField(1, 1.0));
-		srValueMap[query.getInt64Field(0, 0)] = convertedSrValue;
+		double convertedSrValue = convertSrValue(query.getFloatField(1, 1.0), ctx->srLevel);
+		ctx->srValueMap[query.getInt64Field(0, 0)] = convertedSrValue;
 		query.nextRow();
 	}
 	OsmAnd::LogPrintf(OsmAnd::LogSeverityLevel::Debug, "[Native] [INFO] read db end");
 }
 
+// queues and visited segments of one search, anytime mode continues the same search with lower coefficient
+struct RouteSearchState {
+	SHARED_PTR<RoutingScratch> scratch;
+	SEGMENTS_QUEUE graphDirectSegments;
+	SEGMENTS_QUEUE graphReverseSegments;
+
+	RouteSearchState(RoutingContext* ctx) : scratch(acquireRoutingScratch(ctx)),
+			graphDirectSegments(SegmentsComparator(ctx)), graphReverseSegments(SegmentsComparator(ctx)) {
+	}
+};
+
+void initRouteSearch(RoutingContext* ctx, RouteSearchState& state, SHARED_PTR<RouteSegmentPoint> start,
+		SHARED_PTR<RouteSegmentPoint> end) {
+	ctx->visitedSegments = 0;
+	if (ctx->trace.get() != NULL) {
+		ctx->trace->add(SEARCH_TRACE_START, 0, (((int64_t) ctx->targetX) << 32) | (uint32_t) ctx->targetY, 0,
+				ctx->startX, ctx->startY, ctx->getHeuristicCoefficient(), 0, 0);
+	}
+	initQueuesWithStartEnd(ctx, start, end, state.graphDirectSegments, state.graphReverseSegments);
+}
+
 /**
- * Calculate route between start.segmentEnd and end.segmentStart (using A* algorithm)
+ * Calculate route between start.segmentEnd and end.segmentStart (using A* algorithm) continuing search of state
  * return list of segments
  */
-SHARED_PTR<RouteSegment> searchRouteInternal(RoutingContext* ctx, SHARED_PTR<RouteSegmentPoint> start, SHARED_PTR<RouteSegmentPoint> end, bool leftSideNavigation) {
+SHARED_PTR<RouteSegment> searchRouteInternal(RoutingContext* ctx, RouteSearchState& state,
+		SHARED_PTR<RouteSegmentPoint> start, SHARED_PTR<RouteSegmentPoint> end, bool leftSideNavigation) {
 	// FIXME intermediate points
 	// measure time
-	ctx->visitedSegments = 0;
 	int iterationsToUpdate = 0;
 	ctx->timeToCalculate.Start();
 
@@ -449,40 +801,36 @@ SHARED_PTR<RouteSegment> searchRouteInternal(RoutingContext* ctx, SHARED_PTR<Rou
 	OsmAnd::LogPrintf(OsmAnd::LogSeverityLevel::Debug, "[Native] [INFO] searchRouteInternal(): path to sr sb = %s", ctx->srDbPath.c_str());
 	OsmAnd::LogPrintf(OsmAnd::LogSeverityLevel::Debug, "[Native] [INFO] searchRouteInternal(): sr level = %i", ctx->srLevel);
 
-	srLevel = ctx->srLevel;
-	useSrRouting = ctx->useSrRouting;
-	if (ctx->srDbPath.c_str() == "") {
-		useSrRouting = false;
+	if (ctx->srDbPath.empty()) {
+		ctx->useSrRouting = false;
 	}
-	OsmAnd::LogPrintf(OsmAnd::LogSeverityLevel::Debug, "[Native] [INFO] searchRouteInternal(): use sr routing = %s", useSrRouting ? "true" : "false");
+	OsmAnd::LogPrintf(OsmAnd::LogSeverityLevel::Debug, "[Native] [INFO] searchRouteInternal(): use sr routing = %s", ctx->useSrRouting ? "true" : "false");
 
 	CppSQLite3DB db_ptr;
-	if (useSrRouting) {
+	if (ctx->useSrRouting) {
 		try {
 			db_ptr.open(ctx->srDbPath.c_str());
 			OsmAnd::LogPrintf(OsmAnd::LogSeverityLevel::Debug, "[Native] [INFO] opened db");
-			readSrDbToCache(db_ptr);
+			readSrDbToCache(ctx, db_ptr);
 		} catch (CppSQLite3Exception &e) {
 			OsmAnd::LogPrintf(OsmAnd::LogSeverityLevel::Error, "[Native] searchRouteInternal(): db error = %s", e.errorMessage());
-			useSrRouting = false;
+			ctx->useSrRouting = false;
 		}
 	}
 
-	SegmentsComparator sgmCmp(ctx);
 	NonHeuristicSegmentsComparator nonHeuristicSegmentsComparator;
-	SEGMENTS_QUEUE graphDirectSegments(sgmCmp);
-	SEGMENTS_QUEUE graphReverseSegments(sgmCmp);
+	SEGMENTS_QUEUE& graphDirectSegments = state.graphDirectSegments;
+	SEGMENTS_QUEUE& graphReverseSegments = state.graphReverseSegments;
 
 	// Set to not visit one segment twice (stores road.id << X + segmentStart)
-	VISITED_MAP visitedDirectSegments;
-	VISITED_MAP visitedOppositeSegments;
-
-	initQueuesWithStartEnd(ctx, start, end, graphDirectSegments, graphReverseSegments);
+	VISITED_MAP& visitedDirectSegments = state.scratch->visitedDirectSegments;
+	VISITED_MAP& visitedOppositeSegments = state.scratch->visitedOppositeSegments;
 
 	// Extract & analyze segment with min(f(x)) from queue while final segment is not found
-	bool forwardSearch = true;
+	// (continued search starts with reverse queue if forward one is exhausted)
+	bool forwardSearch = !graphDirectSegments.empty() || graphReverseSegments.empty();
 	
-	SEGMENTS_QUEUE * graphSegments = &graphDirectSegments;
+	SEGMENTS_QUEUE * graphSegments = forwardSearch ? &graphDirectSegments : &graphReverseSegments;
 	bool onlyBackward = ctx->getPlanRoadDirection() < 0;
 	bool onlyForward = ctx->getPlanRoadDirection() > 0;
 
@@ -490,9 +838,13 @@ SHARED_PTR<RouteSegment> searchRouteInternal(RoutingContext* ctx, SHARED_PTR<Rou
 	while (graphSegments->size() > 0) {
 		SHARED_PTR<RouteSegment> segment = graphSegments->top();
 		graphSegments->pop();
+		ctx->stats.heapPops++;
+		ctx->armDeadline();
 
 		// INFO check if sr value is set for segment
-		segment->srValue = readSrValueFromCache(segment->road->id);
+		segment->srValue = readSrValueFromCache(ctx, segment->road->id);
+		traceSegment(ctx, SEARCH_TRACE_POP, segment, forwardSearch ? 0 : 1);
+		trackQueuedSegment(ctx, segment, -1, forwardSearch ? 0 : 1);
 
 		// Memory management
 		// ctx.memoryOverhead = calculateSizeOfSearchMaps(graphDirectSegments, graphReverseSegments, visitedDirectSegments, visitedOppositeSegments);	
@@ -502,6 +854,7 @@ SHARED_PTR<RouteSegment> searchRouteInternal(RoutingContext* ctx, SHARED_PTR<Rou
 		if(segment->isFinal()) {
 			finalSegment = segment;
 			ctx->finalRouteSegment = segment;
+			tracePath(ctx, segment);
 			if(TRACE_ROUTING) {
 				OsmAnd::LogPrintf(OsmAnd::LogSeverityLevel::Debug, "Final segment found");
 			}
@@ -518,12 +871,15 @@ SHARED_PTR<RouteSegment> searchRouteInternal(RoutingContext* ctx, SHARED_PTR<Rou
 			processRouteSegment(ctx, true, graphReverseSegments, visitedOppositeSegments, segment,
 						visitedDirectSegments, doNotAddIntersections);
 		}
-		if(ctx->progress.get() && iterationsToUpdate-- < 0) {
-			iterationsToUpdate = 100;
-			ctx->progress->updateStatus(graphDirectSegments.empty()? 0 :graphDirectSegments.top()->distanceFromStart,
-					graphDirectSegments.size(),
-					graphReverseSegments.empty()? 0 :graphReverseSegments.top()->distanceFromStart,
-					graphReverseSegments.size());
+		if(ctx->progress.get()) {
+			// progress state is atomic (no callbacks), so cancel is checked on each iteration
+			if(iterationsToUpdate-- < 0) {
+				iterationsToUpdate = 100;
+				ctx->progress->updateStatus(graphDirectSegments.empty()? 0 :graphDirectSegments.top()->distanceFromStart,
+						graphDirectSegments.size(),
+						graphReverseSegments.empty()? 0 :graphReverseSegments.top()->distanceFromStart,
+						graphReverseSegments.size());
+			}
 			if(ctx->progress->isCancelled()) {
 				break;
 			}
@@ -565,8 +921,7 @@ SHARED_PTR<RouteSegment> searchRouteInternal(RoutingContext* ctx, SHARED_PTR<Rou
 			return finalSegment;
 		}
 	}
-	if (useSrRouting) {
-		srValueMap.clear(); // INFO clear cached sr values
+	if (ctx->useSrRouting) {
 		db_ptr.close(); // INFO close db
 	}
 	ctx->timeToCalculate.Pause();
@@ -580,6 +935,13 @@ SHARED_PTR<RouteSegment> searchRouteInternal(RoutingContext* ctx, SHARED_PTR<Rou
 	return finalSegment;
 }
 
+SHARED_PTR<RouteSegment> searchRouteInternal(RoutingContext* ctx, SHARED_PTR<RouteSegmentPoint> start,
+		SHARED_PTR<RouteSegmentPoint> end, bool leftSideNavigation) {
+	RouteSearchState state(ctx);
+	initRouteSearch(ctx, state, start, end);
+	return searchRouteInternal(ctx, state, start, end, leftSideNavigation);
+}
+
 bool checkIfInitialMovementAllowedOnSegment(RoutingContext* ctx, bool reverseWaySearch,
 			VISITED_MAP& visitedSegments, SHARED_PTR<RouteSegment> segment, SHARED_PTR<RouteDataObject> road) {
 	bool directionAllowed;
@@ -598,18 +960,41 @@ bool checkIfInitialMovementAllowedOnSegment(RoutingContext* ctx, bool reverseWay
 			directionAllowed = oneway >= 0;
 		}
 	}
-	VISITED_MAP::iterator mit = visitedSegments.find(calculateRoutePointId(segment, segment->isPositive()));
-	if(directionAllowed && mit != visitedSegments.end() && mit->second.get() != NULL) {
+	if(directionAllowed && ctx->overlay->isClosed(road->id)) {
 		directionAllowed = false;
 	}
+	ctx->stats.visitedLookups++;
+	SHARED_PTR<RouteSegment> visited = directionAllowed ? visitedSegments.get(segment, segment->isPositive()) :
+			SHARED_PTR<RouteSegment>();
+	// refinement steps of anytime mode expand interval again if it is reached faster than before,
+	// first step keeps such segments for the next one
+	bool faster = visited.get() != NULL && segment->distanceFromStart < visited->distanceFromStart;
+	if (visited.get() != NULL && !(ctx->isAnytimeRefinement() && faster)) {
+		ctx->stats.stalePops++;
+		directionAllowed = false;
+		if (ctx->isAnytime() && faster) {
+			visitedSegments.skipped.push_back(segment);
+		}
+	}
 
 	return directionAllowed;
 }
 
 
-float calculateTimeWithObstacles(RoutingContext* ctx, SHARED_PTR<RouteDataObject> road, float distOnRoadToPass, float obstaclesTime) {
+float calculateTimeWithObstacles(RoutingContext* ctx, SHARED_PTR<RouteSegment> segment, bool reverseWaySearch,
+		float distOnRoadToPass, float obstaclesTime) {
+	SHARED_PTR<RouteDataObject> road = segment->road;
 	float priority = ctx->config->router.defineSpeedPriority(road);
-	float speed = ctx->config->router.defineRoutingSpeed(road) * priority;
+	float speed;
+	if (ctx->isTimeDependent()) {
+		// reverse search goes against direction of movement
+		bool forward = segment->isPositive() != reverseWaySearch;
+		speed = ctx->config->router.defineRoutingSpeed(road, ctx->speedProfile.get(), forward,
+				ctx->getTimeOfWeek(segment->distanceFromStart, reverseWaySearch)) * priority;
+	} else {
+		speed = ctx->config->router.defineRoutingSpeed(road) * priority;
+	}
+	speed *= ctx->overlay->getSpeedFactor(road->id);
 	if (speed == 0) {
 		speed = ctx->config->router.getMinDefaultSpeed();
 		if(priority > 0) {
@@ -626,19 +1011,12 @@ float calculateTimeWithObstacles(RoutingContext* ctx, SHARED_PTR<RouteDataObject
 
 bool checkViaRestrictions(SHARED_PTR<RouteSegment> from, SHARED_PTR<RouteSegment> to) {
     if(from.get() != NULL && to.get() != NULL) {
-        int64_t fid = to->getRoad()->getId();
-        for(uint i = 0; i < from->getRoad()->restrictions.size(); i++) {
-            int64_t id = from->getRoad()->restrictions[i] >> RouteDataObject::RESTRICTION_SHIFT;
-            if(fid == id) {
-                int tp = from->getRoad()->restrictions[i] & RouteDataObject::RESTRICTION_MASK;
-                if(tp == RESTRICTION_NO_LEFT_TURN || 
-                   tp == RESTRICTION_NO_RIGHT_TURN || 
-                   tp == RESTRICTION_NO_STRAIGHT_ON || 
-                   tp == RESTRICTION_NO_U_TURN) {
-                   return false;
-                }
-                break;
-            }
+        int tp = from->getRoad()->findRestriction(to->getRoad()->getId(), 0);
+        if(tp == RESTRICTION_NO_LEFT_TURN || 
+           tp == RESTRICTION_NO_RIGHT_TURN || 
+           tp == RESTRICTION_NO_STRAIGHT_ON || 
+           tp == RESTRICTION_NO_U_TURN) {
+           return false;
         }
     }
     return true;
@@ -656,23 +1034,26 @@ bool checkIfOppositieSegmentWasVisited(RoutingContext* ctx, bool reverseWaySearc
 		SHARED_PTR<RouteSegment> segment, VISITED_MAP& oppositeSegments, 
 		 int segmentPoint, float segmentDist, float obstaclesTime) {
 	SHARED_PTR<RouteDataObject> road = segment -> getRoad();
-	int64_t opp = calculateRoutePointId(road, segment->isPositive() ? segmentPoint - 1 : segmentPoint, !segment->isPositive());
-	VISITED_MAP::iterator opIt = oppositeSegments.find(opp);
-	if (opIt != oppositeSegments.end() && opIt->second.get() != NULL ) {
-		SHARED_PTR<RouteSegment> opposite = opIt->second;
+	ctx->stats.visitedLookups++;
+	SHARED_PTR<RouteSegment> opposite = oppositeSegments.get(road, segment->isPositive() ? segmentPoint - 1 : segmentPoint,
+			!segment->isPositive());
+	if (opposite.get() != NULL) {
 		SHARED_PTR<RouteSegment> to = reverseWaySearch ? getParentDiffId(segment) : getParentDiffId(opposite);
         SHARED_PTR<RouteSegment> from = !reverseWaySearch ? getParentDiffId(segment) : getParentDiffId(opposite);
         if (checkViaRestrictions(from, to)) {			
 			SHARED_PTR<RouteSegment> frs = SHARED_PTR<RouteSegment>(new RouteSegment(road, segmentPoint));
-			float distStartObstacles = segment->distanceFromStart + calculateTimeWithObstacles(ctx, road, segmentDist , obstaclesTime);
+			float distStartObstacles = segment->distanceFromStart + calculateTimeWithObstacles(ctx, segment, reverseWaySearch, segmentDist, obstaclesTime);
 			frs->parentRoute = segment;
 			frs->parentSegmentEnd = segmentPoint;
 			frs->reverseWaySearch = reverseWaySearch? 1 : -1;
 			frs->distanceFromStart = opposite->distanceFromStart + distStartObstacles;
 			frs->distanceToEnd = 0;
 			frs->opposite = opposite;
-			frs->srValue = readSrValueFromCache(frs->road->id); // INFO get sr value
+			frs->srValue = readSrValueFromCache(ctx, frs->road->id); // INFO get sr value
 			graphSegments.push(frs);
+			ctx->stats.heapPushes++;
+			traceSegment(ctx, SEARCH_TRACE_PUSH, frs);
+			trackQueuedSegment(ctx, frs, 1);
 			if(TRACE_ROUTING){
 				printRoad("  >> Final segment : ", frs);
 			}
@@ -712,8 +1093,8 @@ void processRouteSegment(RoutingContext* ctx, bool reverseWaySearch, SEGMENTS_QU
 			directionAllowed = false;
 			continue;
 		}
-		visitedSegments[calculateRoutePointId(segment->getRoad(), segment->isPositive() ? segmentPoint - 1 : segmentPoint, 
-					segment->isPositive())]= prev.get() != NULL ? prev : segment;
+		visitedSegments.put(segment->getRoad(), segment->isPositive() ? segmentPoint - 1 : segmentPoint,
+				segment->isPositive(), prev.get() != NULL ? prev : segment);
 		int x = road->pointsX[segmentPoint];
 		int y = road->pointsY[segmentPoint];
 		int prevx = road->pointsX[prevInd];
@@ -735,7 +1116,9 @@ void processRouteSegment(RoutingContext* ctx, bool reverseWaySearch, SEGMENTS_QU
 		
 		bool alreadyVisited = checkIfOppositieSegmentWasVisited(ctx, reverseWaySearch, graphSegments, segment, oppositeSegments,
 				segmentPoint,  segmentDist, obstaclesTime);
-		if (alreadyVisited) {
+		// anytime mode goes on through segments visited by opposite search (their time could be improved by later
+		// steps), so queue of each direction keeps optimal route and gives its lower bound
+		if (alreadyVisited && !ctx->isAnytime()) {
 			directionAllowed = false;
 			continue;
 		}
@@ -755,10 +1138,10 @@ void processRouteSegment(RoutingContext* ctx, bool reverseWaySearch, SEGMENTS_QU
 
 		// INFO get sr value for next segment
 		if (roadNext.get() != NULL) {
-			roadNext->srValue = readSrValueFromCache(roadNext->road->id);
+			roadNext->srValue = readSrValueFromCache(ctx, roadNext->road->id);
 		}
 
-		float distStartObstacles = segment->distanceFromStart + calculateTimeWithObstacles(ctx, road, segmentDist , obstaclesTime);
+		float distStartObstacles = segment->distanceFromStart + calculateTimeWithObstacles(ctx, segment, reverseWaySearch, segmentDist, obstaclesTime);
 		if(!ctx->precalcRoute.empty && ctx->precalcRoute.followNext) {
 			//distStartObstacles = 0;
 			distStartObstacles = ctx->precalcRoute.getDeviationDistance(x, y) / ctx->precalcRoute.maxSpeed;
@@ -778,44 +1161,32 @@ void processRouteSegment(RoutingContext* ctx, bool reverseWaySearch, SEGMENTS_QU
 
 }
 
-void processRestriction(RoutingContext* ctx, SHARED_PTR<RouteSegment> inputNext, bool reverseWay, bool via,
+// viaId - id of road between road and next (0 if restrictions of road itself are processed)
+void processRestriction(RoutingContext* ctx, SHARED_PTR<RouteSegment> inputNext, bool reverseWay, int64_t viaId,
 			SHARED_PTR<RouteDataObject> road) {
-
+	bool via = viaId != 0;
 	SHARED_PTR<RouteSegment> next = inputNext;
 	bool exclusiveRestriction = false;
 	
 	while (next.get() != NULL) {
 		int type = -1;
 		if (!reverseWay) {
-			for (uint i = 0; i < road->restrictions.size(); i++) {
-				if ((road->restrictions[i] >> RouteDataObject::RESTRICTION_SHIFT) == next->road->id) {
-					type = road->restrictions[i] & RouteDataObject::RESTRICTION_MASK;
-					break;
-				}
-			}
+			type = road->findRestriction(next->road->id, viaId);
 		} else {
-			for (uint i = 0; i < next->road->restrictions.size(); i++) {
-				int rt = next->road->restrictions[i] & RouteDataObject::RESTRICTION_MASK;
-				int64_t restrictedTo = next->road->restrictions[i] >> RouteDataObject::RESTRICTION_SHIFT;
-				if (restrictedTo == road->id) {					
-					type = rt;
-					break;
-				}
-
-				// Check if there is restriction only to the other than current road
-				if (rt == RESTRICTION_ONLY_RIGHT_TURN || rt == RESTRICTION_ONLY_LEFT_TURN
-				|| rt == RESTRICTION_ONLY_STRAIGHT_ON) {
-					// check if that restriction applies to considered junk
-					SHARED_PTR<RouteSegment> foundNext = inputNext;
-					while (foundNext.get() != NULL) {
-						if (foundNext->road->id == restrictedTo) {
-							break;
-						}
-						foundNext = foundNext->next;
-					}
-					if (foundNext.get() != NULL) {
+			RouteDataObject* from = next->road.get();
+			type = from->findRestriction(road->id, viaId);
+			// Check if there is restriction only to the other than current road
+			if (type == -1 && (from->getFlags() & ROAD_FLAG_ONLY_RESTRICTION)) {
+				// check if that restriction applies to considered junk
+				SHARED_PTR<RouteSegment> foundNext = inputNext;
+				while (foundNext.get() != NULL) {
+					int rt = from->findRestriction(foundNext->road->id, viaId);
+					if (rt == RESTRICTION_ONLY_RIGHT_TURN || rt == RESTRICTION_ONLY_LEFT_TURN
+					|| rt == RESTRICTION_ONLY_STRAIGHT_ON) {
 						type = REVERSE_WAY_RESTRICTION_ONLY; // special constant
+						break;
 					}
+					foundNext = foundNext->next;
 				}
 			}
 		}
@@ -877,9 +1248,9 @@ bool proccessRestrictions(RoutingContext* ctx, SHARED_PTR<RouteSegment> segment,
 	}
 	ctx->segmentsToVisitPrescripted.clear();
 	ctx->segmentsToVisitNotForbidden.clear();
-	processRestriction(ctx, inputNext, reverseWay, false, road);
+	processRestriction(ctx, inputNext, reverseWay, 0, road);
 	if(parent.get() != NULL) {
-		processRestriction(ctx, inputNext, reverseWay, true, parent->road);
+		processRestriction(ctx, inputNext, reverseWay, road->id, parent->road);
 	}
 	return true;
 }
@@ -921,7 +1292,7 @@ SHARED_PTR<RouteSegment> processIntersections(RoutingContext* ctx, SEGMENTS_QUEU
 			// (and process it as other with small exception that we don't add to graph segments and process immediately)
 			itself = RouteSegment::initRouteSegment(next, segment->isPositive());
 			if(itself.get() != NULL) {
-				itself->srValue = readSrValueFromCache(itself->road->id); // INFO get sr value for itself
+				itself->srValue = readSrValueFromCache(ctx, itself->road->id); // INFO get sr value for itself
 			}
 			if(itself.get() == NULL) {
 				// do nothing
@@ -1034,38 +1405,115 @@ void addRouteSegmentToResult(vector<RouteSegmentResult>& result, RouteSegmentRes
 	}
 }
 
+void attachConnectedRoads(RoutingContext* ctx, RouteSegmentResult& segment) {
+	bool plus = segment.startPointIndex < segment.endPointIndex;
+	int j = segment.startPointIndex;
+	do {
+		SHARED_PTR<RouteSegment> s = ctx->loadRouteSegment(segment.object->pointsX[j], segment.object->pointsY[j]);
+		vector<RouteSegmentResult> r;
+		RouteSegment* rs = s.get();
+		while(rs != NULL) {
+			RouteSegmentResult res(rs->road, rs->getSegmentStart(), rs->getSegmentStart());
+			r.push_back(res);
+			rs = rs->next.get();
+		}
+		segment.attachedRoutes.push_back(r);
+		j = plus ? j + 1 : j - 1;
+	}while(j != segment.endPointIndex);
+}
+
 void attachConnectedRoads(RoutingContext* ctx, vector<RouteSegmentResult>& res) {
 	vector<RouteSegmentResult>::iterator it = res.begin();
 	for (; it != res.end(); it++) {
-		bool plus = it->startPointIndex < it->endPointIndex;
-		int j = it->startPointIndex;
-		do {
-			SHARED_PTR<RouteSegment> s = ctx->loadRouteSegment(it->object->pointsX[j], it->object->pointsY[j]);
-			vector<RouteSegmentResult> r;
-			RouteSegment* rs = s.get();
-			while(rs != NULL) {
-				RouteSegmentResult res(rs->road, rs->getSegmentStart(), rs->getSegmentStart());
-				r.push_back(res);
-				rs = rs->next.get();
-			}
-			it->attachedRoutes.push_back(r);
-			j = plus ? j + 1 : j - 1;
-		}while(j != it->endPointIndex);
+		attachConnectedRoads(ctx, *it);
+	}
+
+}
+
+SHARED_PTR<RouteResultSnapshot> createRouteResultSnapshot(SHARED_PTR<RoutingConfiguration> config, RoutingContext* ctx,
+		vector<RouteSegmentResult>& result) {
+	SHARED_PTR<RouteResultSnapshot> snapshot(new RouteResultSnapshot(config));
+	snapshot->ctx.retainRouteTiles(ctx, result);
+	snapshot->result = result;
+	return snapshot;
+}
+
+static std::mutex routeSnapshotsMutex;
+static UNORDERED(map)<int64_t, SHARED_PTR<RouteResultSnapshot> > routeSnapshots;
+static SHARED_PTR<RouteResultSnapshot> latestRouteSnapshot;
+static int64_t lastRouteSnapshotHandle = 0;
+
+int64_t publishRouteResultSnapshot(SHARED_PTR<RouteResultSnapshot> snapshot, bool referenced) {
+	std::lock_guard<std::mutex> lock(routeSnapshotsMutex);
+	latestRouteSnapshot = snapshot;
+	if (!referenced) {
+		return 0;
+	}
+	int64_t handle = ++lastRouteSnapshotHandle;
+	routeSnapshots[handle] = snapshot;
+	return handle;
+}
+
+SHARED_PTR<RouteResultSnapshot> getRouteResultSnapshot(int64_t handle) {
+	std::lock_guard<std::mutex> lock(routeSnapshotsMutex);
+	if (handle == 0) {
+		return latestRouteSnapshot;
+	}
+	UNORDERED(map)<int64_t, SHARED_PTR<RouteResultSnapshot> >::iterator it = routeSnapshots.find(handle);
+	return it == routeSnapshots.end() ? SHARED_PTR<RouteResultSnapshot>() : it->second;
+}
+
+void releaseRouteResultSnapshot(int64_t handle) {
+	// deleted after lock is released (or by load in progress)
+	SHARED_PTR<RouteResultSnapshot> released;
+	std::lock_guard<std::mutex> lock(routeSnapshotsMutex);
+	if (handle == 0) {
+		released.swap(latestRouteSnapshot);
+		return;
+	}
+	UNORDERED(map)<int64_t, SHARED_PTR<RouteResultSnapshot> >::iterator it = routeSnapshots.find(handle);
+	if (it != routeSnapshots.end()) {
+		released.swap(it->second);
+		routeSnapshots.erase(it);
+	}
+}
+
+bool loadAttachedRoads(RouteResultSnapshot* snapshot, uint segment, RouteSegmentResult& attached) {
+	std::lock_guard<std::mutex> lock(snapshot->mutex);
+	if (segment >= snapshot->result.size()) {
+		return false;
 	}
+	attached = snapshot->result[segment];
+	attached.attachedRoutes.clear();
+	attachConnectedRoads(&snapshot->ctx, attached);
+	return true;
+}
 
+// border join (hierarchical mode) connects nodes of different levels up to BORDER_JOIN_DISTANCE apart,
+// gap between them is passed with max speed (0 - roads are connected)
+static double calculateBorderJoinTime(RoutingContext* ctx, RouteDataObject* road, int point, RouteDataObject* next,
+		int nextPoint) {
+	if (road->pointsX[point] == next->pointsX[nextPoint] && road->pointsY[point] == next->pointsY[nextPoint]) {
+		return 0;
+	}
+	return sqrt(squareDist31TileMetric(road->pointsX[point], road->pointsY[point], next->pointsX[nextPoint],
+			next->pointsY[nextPoint])) / ctx->config->router.getMaxDefaultSpeed();
 }
 
 void processOneRoadIntersection(RoutingContext* ctx, SEGMENTS_QUEUE& graphSegments,
 			VISITED_MAP& visitedSegments, double distFromStart, double distanceToEnd,
 								SHARED_PTR<RouteSegment> segment, int segmentPoint, SHARED_PTR<RouteSegment> next) {
 	if (next.get() != NULL) {
-		next->srValue = readSrValueFromCache(next->road->id); // INFO get sr value
+		next->srValue = readSrValueFromCache(ctx, next->road->id); // INFO get sr value
 		double obstaclesTime = ctx->config->router.calculateTurnTime(next, next->isPositive()?
 				next->road->getPointsLength() - 1 : 0,  
 				segment, segmentPoint);
 		distFromStart += obstaclesTime;
-		VISITED_MAP::iterator visIt = visitedSegments.find(calculateRoutePointId(next, next->isPositive()));
-		if (visIt == visitedSegments.end() || visIt->second.get() == NULL) {
+		distFromStart += calculateBorderJoinTime(ctx, segment->road.get(), segmentPoint, next->road.get(),
+				next->getSegmentStart());
+		ctx->stats.visitedLookups++;
+		SHARED_PTR<RouteSegment> visited = visitedSegments.get(next, next->isPositive());
+		if (visited.get() == NULL) {
 			if (next->parentRoute.get() == NULL
 				// if next distFromStart + next distToEnd > current, then set back
 				|| roadPriorityComparator(next->distanceFromStart, next->distanceToEnd,
@@ -1080,6 +1528,9 @@ void processOneRoadIntersection(RoutingContext* ctx, SEGMENTS_QUEUE& graphSegmen
 				next->parentRoute = segment;
 				next->parentSegmentEnd = segmentPoint;
 				graphSegments.push(next);
+				ctx->stats.heapPushes++;
+				traceSegment(ctx, SEARCH_TRACE_PUSH, next);
+				trackQueuedSegment(ctx, next, 1);
 			}
 		} else {
 			// the segment was already visited! We need to follow better route if it exists
@@ -1102,6 +1553,21 @@ void processOneRoadIntersection(RoutingContext* ctx, SEGMENTS_QUEUE& graphSegmen
 					// ctx.visitor.visitSegment(next, false);
 				//}
 			}
+			// anytime mode : interval reached faster than it was visited is expanded again by refinement steps
+			if (ctx->isAnytime() && distFromStart < visited->distanceFromStart) {
+				next->distanceFromStart = distFromStart;
+				next->distanceToEnd = distanceToEnd;
+				next->parentRoute = segment;
+				next->parentSegmentEnd = segmentPoint;
+				if (ctx->isAnytimeRefinement()) {
+					graphSegments.push(next);
+					ctx->stats.heapPushes++;
+					traceSegment(ctx, SEARCH_TRACE_PUSH, next);
+					trackQueuedSegment(ctx, next, 1);
+				} else {
+					visitedSegments.skipped.push_back(next);
+				}
+			}
 		}
 	}
 }
@@ -1117,6 +1583,37 @@ float calcRoutingTime(float parentRoutingTime, SHARED_PTR<RouteSegment> finalSeg
 	return parentRoutingTime;
 
 }
+// consecutive segments joined at border are connected by straight segment (copy of previous road with tags),
+// so geometry of result is continuous, time of join is moved to it from following segment
+static void connectBorderJoins(RoutingContext* ctx, vector<RouteSegmentResult>& result) {
+	double joinDist = (double) RoutingContext::BORDER_JOIN_DISTANCE * RoutingContext::BORDER_JOIN_DISTANCE;
+	for (uint i = 1; i < result.size(); i++) {
+		RouteDataObject* p = result[i - 1].object.get();
+		RouteDataObject* o = result[i].object.get();
+		int pe = result[i - 1].endPointIndex;
+		int s = result[i].startPointIndex;
+		double time = calculateBorderJoinTime(ctx, p, pe, o, s);
+		if (time == 0 || squareDist31TileMetric(p->pointsX[pe], p->pointsY[pe], o->pointsX[s], o->pointsY[s]) > joinDist) {
+			continue;
+		}
+		SHARED_PTR<RouteDataObject> join(new RouteDataObject());
+		join->region = p->region;
+		join->id = p->id;
+		join->types = p->types;
+		join->names = p->names;
+		join->pointsX.push_back(p->pointsX[pe]);
+		join->pointsY.push_back(p->pointsY[pe]);
+		join->pointsX.push_back(o->pointsX[s]);
+		join->pointsY.push_back(o->pointsY[s]);
+		join->initFlags();
+		RouteSegmentResult res(join, 0, 1);
+		res.routingTime = (float) std::min((double) result[i].routingTime, time);
+		result[i].routingTime -= res.routingTime;
+		result.insert(result.begin() + i, res);
+		i++;
+	}
+}
+
 vector<RouteSegmentResult> convertFinalSegmentToResults(RoutingContext* ctx, SHARED_PTR<RouteSegment> finalSegment) {
 	vector<RouteSegmentResult> result;
 	if (finalSegment.get() != NULL) {
@@ -1151,14 +1648,260 @@ vector<RouteSegmentResult> convertFinalSegmentToResults(RoutingContext* ctx, SHA
 			addRouteSegmentToResult(result, res, true);
 		}
 		std::reverse(result.begin(), result.end());
-
+		if (ctx->stats.borderJoins > 0) {
+			connectBorderJoins(ctx, result);
+		}
 	}
 	return result;
 }
 
+void publishStatistics(RoutingContext* ctx, int64_t ruleEvaluationsBefore) {
+	RoutingStatistics& st = ctx->stats;
+	st.ruleEvaluations = ctx->config->router.ruleEvaluations - ruleEvaluationsBefore;
+	st.tilesLoaded = ctx->loadedTiles;
+	st.timeToSnap = (int) ctx->timeToSnap.GetElapsedMs();
+	st.timeToLoad = (int) ctx->timeToLoad.GetElapsedMs();
+	st.timeToSearch = (int) ctx->timeToCalculate.GetElapsedMs();
+	st.timeToConvertResult = (int) ctx->timeToConvertResult.GetElapsedMs();
+	OsmAnd::LogPrintf(OsmAnd::LogSeverityLevel::Info, "[Native] Routing statistics (heap push %d pop %d stale %d, "
+			"visited lookups %d, tiles loaded %d unloaded %d reloaded %d gc %d, rules %lld, sr lookups %d, decoded %lld Kb)",
+			st.heapPushes, st.heapPops, st.stalePops, st.visitedLookups, st.tilesLoaded, st.tilesUnloaded,
+			st.tilesReloaded, st.gcRuns,
+			(long long) st.ruleEvaluations, st.srLookups, (long long) (st.bytesDecoded / 1024));
+	OsmAnd::LogPrintf(OsmAnd::LogSeverityLevel::Info, "[Native] Routing timing (snap %d, load %d, search %d, result %d ms)",
+			st.timeToSnap, st.timeToLoad, st.timeToSearch, st.timeToConvertResult);
+	if (ctx->config->detailedRadius > 0) {
+		OsmAnd::LogPrintf(OsmAnd::LogSeverityLevel::Info, "[Native] Hierarchical routing (border joins %d, fallbacks %d)",
+				st.borderJoins, st.hierarchicalFallbacks);
+	}
+	if(ctx->progress.get()) {
+		ctx->progress->setStatistics(st);
+	}
+}
+
+static const float ANYTIME_MIN_COEFFICIENT_STEP = 0.05f;
+
+static bool isSearchStopped(RoutingContext* ctx) {
+	return ctx->isInterrupted() || (ctx->progress.get() != NULL && ctx->progress->isCancelled());
+}
+
+// lower bound of optimal route time by search of one direction : first segment of optimal route which was not
+// expanded with optimal time is queued or skipped (reached faster than its interval was visited) with optimal time
+// and heuristic doesn't overestimate, so min of g + h over them doesn't exceed optimal time (0 - nothing is left)
+static double calculateQueueLowerBound(SEGMENTS_QUEUE& queue, VISITED_MAP& visited) {
+	const vector<SHARED_PTR<RouteSegment> >& queued = queue.getSegments();
+	double bound = -1;
+	for (uint i = 0; i < queued.size(); i++) {
+		double f = (double) queued[i]->distanceFromStart + queued[i]->distanceToEnd;
+		bound = bound < 0 ? f : std::min(bound, f);
+	}
+	for (uint i = 0; i < visited.skipped.size(); i++) {
+		SHARED_PTR<RouteSegment>& s = visited.skipped[i];
+		SHARED_PTR<RouteSegment> v = visited.get(s, s->isPositive());
+		// interval could be expanded faster after segment was skipped
+		if (v.get() == NULL || s->distanceFromStart < v->distanceFromStart) {
+			double f = (double) s->distanceFromStart + s->distanceToEnd;
+			bound = bound < 0 ? f : std::min(bound, f);
+		}
+	}
+	return std::max(bound, 0.);
+}
+
+// both directions give bound, reverse one only if its times are the same as times of forward search
+static double calculateRouteLowerBound(RoutingContext* ctx, RouteSearchState& state) {
+	double forward = 0;
+	double reverse = 0;
+	if (ctx->getPlanRoadDirection() >= 0) {
+		forward = calculateQueueLowerBound(state.graphDirectSegments, state.scratch->visitedDirectSegments);
+	}
+	if (ctx->getPlanRoadDirection() <= 0 && !ctx->isTimeDependent()) {
+		reverse = calculateQueueLowerBound(state.graphReverseSegments, state.scratch->visitedOppositeSegments);
+	}
+	return std::max(forward, reverse);
+}
+
+// skipped segments which still reach their interval faster than it was visited are queued again
+static void requeueSkippedSegments(RoutingContext* ctx, SEGMENTS_QUEUE& queue, VISITED_MAP& visited) {
+	for (uint i = 0; i < visited.skipped.size(); i++) {
+		SHARED_PTR<RouteSegment>& s = visited.skipped[i];
+		SHARED_PTR<RouteSegment> v = visited.get(s, s->isPositive());
+		if (v.get() == NULL || s->distanceFromStart < v->distanceFromStart) {
+			queue.push(s);
+			ctx->stats.heapPushes++;
+			traceSegment(ctx, SEARCH_TRACE_PUSH, s);
+			trackQueuedSegment(ctx, s, 1);
+		}
+	}
+	visited.skipped.clear();
+	queue.reorder();
+}
+
+/**
+ * Anytime search (ARA*-like weighted A*) : first route is found with inflated heuristic coefficient w, then the
+ * same search continues with w = 1 + (w - 1) / 2 ... 1 while time limit allows : queues are reordered by new
+ * coefficient, visited intervals are kept and expanded again only when they are reached faster (skipped segments
+ * are queued again). Suboptimality bound of the best route is its time divided by lower bound of queued and skipped
+ * segments (not valid with sr values or precalculated route, their estimates could overestimate), search with w = 1
+ * continues until bound is 1. Time limit is counted from the first expanded segment and includes the first route.
+ */
+SHARED_PTR<RouteSegment> searchRouteAnytime(RoutingContext* ctx, SHARED_PTR<RouteSegmentPoint> start,
+		SHARED_PTR<RouteSegmentPoint> end, bool leftSideNavigation) {
+	float w = ctx->anytimeHeuristicCoefficient;
+	SHARED_PTR<RouteSegment> best;
+	ctx->heuristicCoefficient = w;
+	ctx->deadlineTimeLimit = ctx->anytimeTimeLimit;
+	ctx->hasDeadline = false;
+	RouteSearchState state(ctx);
+	initRouteSearch(ctx, state, start, end);
+	while (true) {
+		SHARED_PTR<RouteSegment> found = searchRouteInternal(ctx, state, start, end, leftSideNavigation);
+		bool admissible = !ctx->useSrRouting && ctx->precalcRoute.empty;
+		if (found.get() == NULL) {
+			// no route at all or search was interrupted
+			if (best.get() == NULL && ctx->isInterrupted()) {
+				OsmAnd::LogPrintf(OsmAnd::LogSeverityLevel::Warning, "[Native] Anytime route is not found in %d ms",
+						ctx->anytimeTimeLimit);
+			}
+			break;
+		}
+		if (best.get() == NULL || found->distanceFromStart < best->distanceFromStart) {
+			best = found;
+		}
+		ctx->suboptimalityBound = 0;
+		if (admissible) {
+			double lowerBound = calculateRouteLowerBound(ctx, state);
+			if (lowerBound > 0) {
+				// best route time is upper bound of optimal time
+				lowerBound = std::min(lowerBound, (double) best->distanceFromStart);
+				ctx->suboptimalityBound = (float) (best->distanceFromStart / lowerBound);
+			}
+		}
+		if (ctx->progress.get() != NULL) {
+			ctx->progress->routeImproved(best->distanceFromStart, ctx->suboptimalityBound);
+		}
+		OsmAnd::LogPrintf(OsmAnd::LogSeverityLevel::Info, "[Native] Anytime route with coefficient %f : time %f, bound %f",
+				w, best->distanceFromStart, ctx->suboptimalityBound);
+		// bidirectional search stops at first meeting, so route found with w = 1 is optimal only when bound is 1
+		if (admissible ? ctx->suboptimalityBound == 1 : w <= 1) {
+			break;
+		}
+		if (isSearchStopped(ctx)) {
+			break;
+		}
+		if (w > 1) {
+			w = w - 1 <= 2 * ANYTIME_MIN_COEFFICIENT_STEP ? 1 : 1 + (w - 1) / 2;
+			ctx->heuristicCoefficient = w;
+			requeueSkippedSegments(ctx, state.graphDirectSegments, state.scratch->visitedDirectSegments);
+			requeueSkippedSegments(ctx, state.graphReverseSegments, state.scratch->visitedOppositeSegments);
+		}
+	}
+	ctx->deadlineTimeLimit = 0;
+	// passed deadline stays armed, so fallback searches are not started after interrupted calculation
+	if (!ctx->isInterrupted()) {
+		ctx->hasDeadline = false;
+	}
+	ctx->heuristicCoefficient = ctx->config->heurCoefficient;
+	ctx->finalRouteSegment = best;
+	return best;
+}
+
+// tiles within corridor radius of precalculated route (and of start and target, which could be off route),
+// polyline is sampled with half tile step
+static void initRouteCorridor(RoutingContext* ctx) {
+	PrecalculatedRouteDirection& p = ctx->precalcRoute;
+	int z = ctx->config->zoomToLoad;
+	int tz = 31 - z;
+	// same meters to 31 coordinates conversion as squareDist31TileMetric
+	int64_t rx = (int64_t) (ctx->config->corridorRadius / 0.011);
+	int64_t ry = (int64_t) (ctx->config->corridorRadius / 0.01863);
+	vector<int64_t> xs;
+	vector<int64_t> ys;
+	xs.push_back(ctx->startX);
+	ys.push_back(ctx->startY);
+	for (uint i = 0; i < p.pointsX.size(); i++) {
+		if (i > 0) {
+			int64_t dx = (int64_t) p.pointsX[i] - p.pointsX[i - 1];
+			int64_t dy = (int64_t) p.pointsY[i] - p.pointsY[i - 1];
+			int steps = (int) (std::max(std::abs(dx), std::abs(dy)) >> (tz - 1));
+			for (int k = 1; k < steps; k++) {
+				xs.push_back(p.pointsX[i - 1] + dx * k / steps);
+				ys.push_back(p.pointsY[i - 1] + dy * k / steps);
+			}
+		}
+		xs.push_back(p.pointsX[i]);
+		ys.push_back(p.pointsY[i]);
+	}
+	xs.push_back(ctx->targetX);
+	ys.push_back(ctx->targetY);
+	int64_t maxTile = (1 << z) - 1;
+	vector<int64_t> tiles;
+	for (uint i = 0; i < xs.size(); i++) {
+		int64_t left = std::max((int64_t) 0, (xs[i] - rx) >> tz);
+		int64_t right = std::min(maxTile, (xs[i] + rx) >> tz);
+		int64_t top = std::max((int64_t) 0, (ys[i] - ry) >> tz);
+		int64_t bottom = std::min(maxTile, (ys[i] + ry) >> tz);
+		for (int64_t x = left; x <= right; x++) {
+			for (int64_t y = top; y <= bottom; y++) {
+				int64_t tileId = (x << z) + y;
+				if (ctx->corridorTiles.insert(tileId).second) {
+					tiles.push_back(tileId);
+				}
+			}
+		}
+	}
+	int prefetched = ctx->prefetchTiles(tiles);
+	OsmAnd::LogPrintf(OsmAnd::LogSeverityLevel::Info, "[Native] Route corridor : %d tiles, %d subregions prefetched",
+			(int) tiles.size(), prefetched);
+}
+
+// snaps start and target again (tiles could be indexed differently) and repeats search
+static SHARED_PTR<RouteSegment> searchRouteAgain(RoutingContext* ctx, bool leftSideNavigation) {
+	SHARED_PTR<RouteSegmentPoint> start = findRouteSegment(ctx->startX, ctx->startY, ctx);
+	SHARED_PTR<RouteSegmentPoint> end = findRouteSegment(ctx->targetX, ctx->targetY, ctx);
+	if (start.get() == NULL || end.get() == NULL) {
+		return SHARED_PTR<RouteSegment>();
+	}
+	return ctx->isAnytime() ? searchRouteAnytime(ctx, start, end, leftSideNavigation) :
+			searchRouteInternal(ctx, start, end, leftSideNavigation);
+}
+
+// route is found, consecutive segments are connected (border joins are connected by result conversion) and it is
+// not longer than max detour times straight distance between start and target
+static bool checkHierarchicalRouteQuality(RoutingContext* ctx, vector<RouteSegmentResult>& res) {
+	if (res.empty()) {
+		return false;
+	}
+	double length = 0;
+	for (uint i = 0; i < res.size(); i++) {
+		RouteDataObject* o = res[i].object.get();
+		int inc = res[i].startPointIndex <= res[i].endPointIndex ? 1 : -1;
+		for (int k = res[i].startPointIndex; k != res[i].endPointIndex; k += inc) {
+			length += sqrt(squareDist31TileMetric(o->pointsX[k], o->pointsY[k], o->pointsX[k + inc], o->pointsY[k + inc]));
+		}
+		if (i > 0) {
+			RouteDataObject* p = res[i - 1].object.get();
+			int pe = res[i - 1].endPointIndex;
+			int s = res[i].startPointIndex;
+			if (p->pointsX[pe] != o->pointsX[s] || p->pointsY[pe] != o->pointsY[s]) {
+				return false;
+			}
+		}
+	}
+	double straight = sqrt(squareDist31TileMetric(ctx->startX, ctx->startY, ctx->targetX, ctx->targetY));
+	// short routes are not checked, detour around river or mountain could be much longer than straight line
+	return straight < ctx->config->detailedRadius || length <= ctx->config->hierarchicalMaxDetour * straight;
+}
+
 vector<RouteSegmentResult> searchRouteInternal(RoutingContext* ctx, bool leftSideNavigation) {	
+	int64_t ruleEvaluations = ctx->config->router.ruleEvaluations;
+	if (!ctx->precalcRoute.empty && ctx->config->corridorRadius > 0 && !ctx->isGraphMode()) {
+		initRouteCorridor(ctx);
+	}
+	ctx->timeToSnap.Start();
 	SHARED_PTR<RouteSegmentPoint> start = findRouteSegment(ctx->startX, ctx->startY, ctx);
 	if(start.get() == NULL) {
+		ctx->timeToSnap.Pause();
+		publishStatistics(ctx, ruleEvaluations);
 		OsmAnd::LogPrintf(OsmAnd::LogSeverityLevel::Warning, "Start point was not found [Native]");
 		if(ctx->progress.get()) {
 			ctx->progress->setSegmentNotFound(0);
@@ -1168,7 +1911,9 @@ vector<RouteSegmentResult> searchRouteInternal(RoutingContext* ctx, bool leftSid
 		OsmAnd::LogPrintf(OsmAnd::LogSeverityLevel::Warning, "Start point was found %lld [Native]", start->road->id);
 	}
 	SHARED_PTR<RouteSegmentPoint> end = findRouteSegment(ctx->targetX, ctx->targetY, ctx);
+	ctx->timeToSnap.Pause();
 	if(end.get() == NULL) {
+		publishStatistics(ctx, ruleEvaluations);
 		if(ctx->progress.get()) {
 			ctx->progress->setSegmentNotFound(1);
 		}
@@ -1177,12 +1922,57 @@ vector<RouteSegmentResult> searchRouteInternal(RoutingContext* ctx, bool leftSid
 	} else {
 		OsmAnd::LogPrintf(OsmAnd::LogSeverityLevel::Warning, "End point was found %lld [Native]", end->road->id);
 	}
-	SHARED_PTR<RouteSegment> finalSegment = searchRouteInternal(ctx, start, end, leftSideNavigation);
+	SHARED_PTR<RouteSegment> finalSegment = ctx->isAnytime() ? searchRouteAnytime(ctx, start, end, leftSideNavigation) :
+			searchRouteInternal(ctx, start, end, leftSideNavigation);
+	if (finalSegment.get() == NULL && !ctx->corridorTiles.empty() && !isSearchStopped(ctx)) {
+		// route leaves corridor (closed road, detour), tiles outside of it are allowed only as fallback
+		OsmAnd::LogPrintf(OsmAnd::LogSeverityLevel::Info, "[Native] Route is not found in corridor, search without it");
+		ctx->corridorTiles.clear();
+		finalSegment = searchRouteAgain(ctx, leftSideNavigation);
+	}
+	ctx->timeToCalculate.Pause();
+	ctx->timeToConvertResult.Start();
 	vector<RouteSegmentResult> res = convertFinalSegmentToResults(ctx, finalSegment);
-	attachConnectedRoads(ctx, res);
+	ctx->timeToConvertResult.Pause();
+	if (ctx->isHierarchical() && !isSearchStopped(ctx) && !checkHierarchicalRouteQuality(ctx, res)) {
+		// levels are not joined or route passes through bad join, detailed graph is used everywhere
+		OsmAnd::LogPrintf(OsmAnd::LogSeverityLevel::Info, "[Native] Hierarchical route is %s, search over detailed graph",
+				res.empty() ? "not found" : "rejected");
+		ctx->stats.hierarchicalFallbacks++;
+		ctx->disableHierarchicalMode();
+		ctx->timeToCalculate.Start();
+		finalSegment = searchRouteAgain(ctx, leftSideNavigation);
+		ctx->timeToCalculate.Pause();
+		ctx->timeToConvertResult.Start();
+		res = convertFinalSegmentToResults(ctx, finalSegment);
+		ctx->timeToConvertResult.Pause();
+	}
+	ctx->timeToConvertResult.Start();
+	if (ctx->attachRoads) {
+		attachConnectedRoads(ctx, res);
+	}
+	ctx->timeToConvertResult.Pause();
+	publishStatistics(ctx, ruleEvaluations);
 	return res;
 }
 
+float searchRouteTime(RoutingContext* ctx) {
+	ctx->timeToSnap.Start();
+	SHARED_PTR<RouteSegmentPoint> start = findRouteSegment(ctx->startX, ctx->startY, ctx);
+	SHARED_PTR<RouteSegmentPoint> end;
+	if (start.get() != NULL) {
+		end = findRouteSegment(ctx->targetX, ctx->targetY, ctx);
+	}
+	ctx->timeToSnap.Pause();
+	if (end.get() == NULL) {
+		return -1;
+	}
+	SHARED_PTR<RouteSegment> finalSegment = ctx->isAnytime() ? searchRouteAnytime(ctx, start, end, false) :
+			searchRouteInternal(ctx, start, end, false);
+	ctx->timeToCalculate.Pause();
+	return finalSegment.get() == NULL ? -1 : finalSegment->distanceFromStart;
+}
+
 bool compareRoutingSubregionTile(SHARED_PTR<RoutingSubregionTile> o1, SHARED_PTR<RoutingSubregionTile> o2) {
 	int v1 = (o1->access + 1) * pow((float)10, o1->getUnloadCount() -1);
 	int v2 = (o2->access + 1) * pow((float)10, o2->getUnloadCount() -1);
@@ -4,8 +4,16 @@
 #include "common2.h"
 #include "binaryRead.h"
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
 #include "Logging.h"
 #include "generalRouter.h"
+#include "edgeOverlay.h"
+#include "routingGraph.h"
+#include "routeTileCache.h"
+#include "searchTrace.h"
+#include "routeSpeedBounds.h"
 
 typedef UNORDERED(map)<string, float> MAP_STR_FLOAT;
 typedef UNORDERED(map)<string, string> MAP_STR_STR;
@@ -124,8 +132,13 @@ struct RoutingSubregionTile {
 	int loaded;
 	uint size ;
 	UNORDERED(map)<int64_t, SHARED_PTR<RouteSegment> > routes;
+	// roads of all profiles, routes contain accepted ones
+	SHARED_PTR<SharedRouteTile> sharedTile;
+	// subregion of basemap level (hierarchical mode)
+	bool basemap;
 
-	RoutingSubregionTile(RouteSubregion& sub) : subregion(sub), access(0), loaded(0) {
+	RoutingSubregionTile(RouteSubregion& sub, bool basemap = false) : subregion(sub), access(0), loaded(0),
+			basemap(basemap) {
 		size = sizeof(RoutingSubregionTile);
 	}
 	~RoutingSubregionTile(){
@@ -140,6 +153,7 @@ struct RoutingSubregionTile {
 
 	void unload(){
 		routes.clear();
+		sharedTile.reset();
 		size = 0;
 		loaded = - abs(loaded);
 	}
@@ -152,6 +166,7 @@ struct RoutingSubregionTile {
 		return size + routes.size() * sizeof(std::pair<int64_t, SHARED_PTR<RouteSegment> >);
 	}
 
+	// bearings of shared roads are already computed
 	void add(SHARED_PTR<RouteDataObject> o) {
 		size += o->getSize() + sizeof(RouteSegment)* o->pointsX.size();
 		for (uint i = 0; i < o->pointsX.size(); i++) {
@@ -178,6 +193,14 @@ static int64_t calcRouteId(SHARED_PTR<RouteDataObject> o, int ind) {
 }
 
 typedef std::pair<int, std::pair<string, string> > ROUTE_TRIPLE;
+// order in which loaded tiles are unloaded once memory limit is reached
+enum TileEvictionPolicy {
+	// least accessed tiles first, tiles which were unloaded before are kept longer
+	TILE_EVICTION_ACCESS = 0,
+	// tiles furthest from both search frontiers first, tiles with queued segments are never unloaded
+	TILE_EVICTION_FRONTIER = 1
+};
+
 struct RoutingConfiguration {
 	GeneralRouter router;
 
@@ -188,10 +211,32 @@ struct RoutingConfiguration {
 	float heurCoefficient;
 	int planRoadDirection;
 	string routerName;
-	
+	// configurations with the same key accept the same roads, so acceptance of shared tiles is cached by it
+	// (empty - acceptance is not cached)
+	string profileKey;
+	// hierarchical mode : tiles further than radius (meters) from start and target are routed over basemap graph
+	// (0 - only detailed graph is used), route longer than max detour times straight distance is recalculated
+	// over detailed graph
+	float detailedRadius;
+	float hierarchicalMaxDetour;
+	// anytime mode : first route is found with this heuristic coefficient and then refined down to 1
+	// (0 - disabled) while search time (ms) is below time limit (0 - refine until route is optimal),
+	// time is counted from the first expanded segment and includes the first route
+	float anytimeHeuristicCoefficient;
+	int anytimeTimeLimit;
+	// corridor mode : with precalculated route only tiles within radius (meters) of it are loaded (0 - disabled)
+	float corridorRadius;
+	TileEvictionPolicy tileEvictionPolicy;
 	
 	void initParams(MAP_STR_STR& attributes) {
 		planRoadDirection = (int) parseFloat(attributes, "planRoadDirection", 0);
+		detailedRadius = parseFloat(attributes, "hierarchicalDetailedRadius", 0);
+		hierarchicalMaxDetour = parseFloat(attributes, "hierarchicalMaxDetour", 3);
+		anytimeHeuristicCoefficient = parseFloat(attributes, "anytimeHeuristicCoefficient", 0);
+		anytimeTimeLimit = (int) parseFloat(attributes, "anytimeTimeLimit", 0);
+		corridorRadius = parseFloat(attributes, "corridorRadius", 0);
+		tileEvictionPolicy = parseString(attributes, "tileEvictionPolicy", "access") == "frontier" ?
+				TILE_EVICTION_FRONTIER : TILE_EVICTION_ACCESS;
 		heurCoefficient = parseFloat(attributes, "heuristicCoefficient", 1);
 		// don't use file limitations?
 		memoryLimitation = (int)parseFloat(attributes, "nativeMemoryLimitInMB", memoryLimitation);
@@ -201,43 +246,161 @@ struct RoutingConfiguration {
 	}
 
 	RoutingConfiguration(float initDirection = -360, int memLimit = 64) :
-			memoryLimitation(memLimit), initialDirection(initDirection) {
+			memoryLimitation(memLimit), initialDirection(initDirection), detailedRadius(0), hierarchicalMaxDetour(3),
+			anytimeHeuristicCoefficient(0), anytimeTimeLimit(0), corridorRadius(0),
+			tileEvictionPolicy(TILE_EVICTION_ACCESS) {
 	}
 
 };
 
 bool compareRoutingSubregionTile(SHARED_PTR<RoutingSubregionTile> o1, SHARED_PTR<RoutingSubregionTile> o2);
 
+/**
+ * Counters collected during route calculation (plain increments, cheap enough to be always on)
+ */
+struct RoutingStatistics {
+	int heapPushes;
+	int heapPops;
+	// popped segments which were already visited
+	int stalePops;
+	int visitedLookups;
+	int tilesLoaded;
+	int tilesUnloaded;
+	// loaded tiles which were unloaded before by gc
+	int tilesReloaded;
+	int gcRuns;
+	int64_t ruleEvaluations;
+	int srLookups;
+	int64_t bytesDecoded;
+	// hierarchical mode : nodes joined to other level and routes recalculated over detailed graph
+	int borderJoins;
+	int hierarchicalFallbacks;
+	// time by phase in ms (load is included into search)
+	int timeToSnap;
+	int timeToLoad;
+	int timeToSearch;
+	int timeToConvertResult;
+
+	RoutingStatistics() : heapPushes(0), heapPops(0), stalePops(0), visitedLookups(0), tilesLoaded(0),
+		tilesUnloaded(0), tilesReloaded(0), gcRuns(0), ruleEvaluations(0), srLookups(0), bytesDecoded(0), borderJoins(0),
+		hierarchicalFallbacks(0), timeToSnap(0),
+		timeToLoad(0), timeToSearch(0), timeToConvertResult(0) {
+	}
+};
+
+/**
+ * Progress and cancel state of route calculation. Search loop only touches lock-free atomics, so the state
+ * could be polled (and cancelled) by another thread, e.g. java thread through direct ByteBuffer in native byte order :
+ * [0] int cancelled, [4] int segmentNotFound, [8] float distanceFromBegin, [12] int directSegmentQueueSize,
+ * [16] float distanceFromEnd, [20] int reverseSegmentQueueSize, [24] float routeTime, [28] float suboptimalityBound
+ * (route time and bound of the best route found so far in anytime mode, 0 - not found or unknown)
+ */
+struct RouteCalculationProgressState {
+	std::atomic<int32_t> cancelled;
+	std::atomic<int32_t> segmentNotFound;
+	std::atomic<float> distanceFromBegin;
+	std::atomic<int32_t> directSegmentQueueSize;
+	std::atomic<float> distanceFromEnd;
+	std::atomic<int32_t> reverseSegmentQueueSize;
+	std::atomic<float> routeTime;
+	std::atomic<float> suboptimalityBound;
+
+	void reset() {
+		// cancelled is not reset, calculation could be cancelled before it was started
+		segmentNotFound.store(-1, std::memory_order_relaxed);
+		distanceFromBegin.store(0, std::memory_order_relaxed);
+		directSegmentQueueSize.store(0, std::memory_order_relaxed);
+		distanceFromEnd.store(0, std::memory_order_relaxed);
+		reverseSegmentQueueSize.store(0, std::memory_order_relaxed);
+		routeTime.store(0, std::memory_order_relaxed);
+		suboptimalityBound.store(0, std::memory_order_relaxed);
+	}
+};
+static_assert(sizeof(RouteCalculationProgressState) == 32, "Progress state layout is shared with java");
+
 class RouteCalculationProgress {
 protected:
-	int segmentNotFound ;
-	float distanceFromBegin;
-	int directSegmentQueueSize;
-	float distanceFromEnd;
-	int reverseSegmentQueueSize;
+	RouteCalculationProgressState localState;
+	RouteCalculationProgressState* state;
+	RoutingStatistics statistics;
 
-	bool cancelled;
 public:
-	RouteCalculationProgress() : segmentNotFound(-1), distanceFromBegin(0),
-		directSegmentQueueSize(0), distanceFromEnd(0),  reverseSegmentQueueSize(0), cancelled(false){
+	/**
+	 * sharedState should be at least sizeof(RouteCalculationProgressState) bytes aligned by 4 and outlive calculation
+	 */
+	RouteCalculationProgress(void* sharedState = NULL) :
+		state(sharedState != NULL ? (RouteCalculationProgressState*) sharedState : &localState) {
+		if (state == &localState) {
+			localState.cancelled.store(0, std::memory_order_relaxed);
+		}
+		state->reset();
 	}
 
-	virtual bool isCancelled(){
-		return cancelled;
+	virtual ~RouteCalculationProgress() {
 	}
 
-	virtual void setSegmentNotFound(int s){
-		segmentNotFound = s;
+	bool isCancelled() {
+		return state->cancelled.load(std::memory_order_relaxed) != 0;
 	}
 
-	virtual void updateStatus(float distanceFromBegin,	int directSegmentQueueSize,	float distanceFromEnd,
+	void cancel() {
+		state->cancelled.store(1, std::memory_order_relaxed);
+	}
+
+	void setSegmentNotFound(int s) {
+		state->segmentNotFound.store(s, std::memory_order_relaxed);
+	}
+
+	int getSegmentNotFound() {
+		return state->segmentNotFound.load(std::memory_order_relaxed);
+	}
+
+	// only calculation thread writes status, so load + store is enough for max
+	void updateStatus(float distanceFromBegin, int directSegmentQueueSize, float distanceFromEnd,
 			int reverseSegmentQueueSize) {
-		this->distanceFromBegin = max(distanceFromBegin, this->distanceFromBegin );
-		this->distanceFromEnd = max(distanceFromEnd,this->distanceFromEnd);
-		this->directSegmentQueueSize = directSegmentQueueSize;
-		this->reverseSegmentQueueSize = reverseSegmentQueueSize;
+		state->distanceFromBegin.store(max(distanceFromBegin, getDistanceFromBegin()), std::memory_order_relaxed);
+		state->distanceFromEnd.store(max(distanceFromEnd, getDistanceFromEnd()), std::memory_order_relaxed);
+		state->directSegmentQueueSize.store(directSegmentQueueSize, std::memory_order_relaxed);
+		state->reverseSegmentQueueSize.store(reverseSegmentQueueSize, std::memory_order_relaxed);
+	}
+
+	float getDistanceFromBegin() {
+		return state->distanceFromBegin.load(std::memory_order_relaxed);
+	}
+
+	float getDistanceFromEnd() {
+		return state->distanceFromEnd.load(std::memory_order_relaxed);
+	}
+
+	int getDirectSegmentQueueSize() {
+		return state->directSegmentQueueSize.load(std::memory_order_relaxed);
+	}
+
+	int getReverseSegmentQueueSize() {
+		return state->reverseSegmentQueueSize.load(std::memory_order_relaxed);
+	}
+
+	// better route is found in anytime mode, it is returned unless even better route is found later
+	virtual void routeImproved(float routeTime, float suboptimalityBound) {
+		state->routeTime.store(routeTime, std::memory_order_relaxed);
+		state->suboptimalityBound.store(suboptimalityBound, std::memory_order_relaxed);
+	}
+
+	float getRouteTime() {
+		return state->routeTime.load(std::memory_order_relaxed);
+	}
+
+	float getSuboptimalityBound() {
+		return state->suboptimalityBound.load(std::memory_order_relaxed);
+	}
+
+	virtual void setStatistics(const RoutingStatistics& s) {
+		statistics = s;
 	}
 
+	const RoutingStatistics& getStatistics() {
+		return statistics;
+	}
 };
 
 struct PrecalculatedRouteDirection {
@@ -249,26 +412,55 @@ struct PrecalculatedRouteDirection {
 	float startFinishTime;
 	float endFinishTime;
 	bool followNext;
-	static int SHIFT;
-	static int SHIFTS[];
+	// smallest grid cell is 2^(31-17), grid is coarsened till it fits MAX_GRID_SIZE x MAX_GRID_SIZE
+	static const int MIN_CELL_SHIFT = 31 - 17;
+	static const int MAX_GRID_SIZE = 512;
+	// points further than 2^(31-7) from route are not matched
+	static const int MAX_SEARCH_RADIUS = 1 << (31 - 7);
 	bool empty;
 
 	uint64_t startPoint;
 	uint64_t endPoint;
-	quad_tree<int> quadTree;
+
+	// uniform grid over route points : points of cell c are cellPoints[cellStart[c]] .. cellPoints[cellStart[c + 1] - 1]
+	int cellShift;
+	int gridMinX;
+	int gridMinY;
+	int gridWidth;
+	int gridHeight;
+	vector<int> cellStart;
+	vector<int> cellPoints;
+	// direct mapped cache of nearest route point by calc(x31, y31), colliding point replaces previous one
+	static const int INDEX_CACHE_BITS = 12;
+	vector<uint64_t> cachedKeys;
+	// EMPTY_SLOT or index (-1 if point is too far from route)
+	static const int EMPTY_SLOT = -2;
+	vector<int> cachedIndexes;
+
+	PrecalculatedRouteDirection() : empty(true), cellShift(MIN_CELL_SHIFT), gridMinX(0), gridMinY(0), 
+		gridWidth(0), gridHeight(0) {
+	}
 
  	inline uint64_t calc(int x31, int y31) {
 		return (((uint64_t) x31) << 32l) + ((uint64_t)y31);
 	}
 
+	// should be called once all points are added
+	void buildIndex();
 	float getDeviationDistance(int x31, int y31, int ind);
 	float getDeviationDistance(int x31, int y31);
 	int getIndex(int x31, int y31);
 	float timeEstimate(int begX, int begY, int endX, int endY);
 
+private:
+	int findNearestIndex(int x31, int y31);
+	void searchCell(int64_t cx, int64_t cy, int x31, int y31, int& ind, double& minDist);
+
 };
 
 
+typedef UNORDERED(map)<int64_t, double> SRVALUE_MAP;
+
 struct RoutingContext {
 	typedef UNORDERED(map)<int64_t, SHARED_PTR<RoutingSubregionTile> > MAP_SUBREGION_TILES;
 
@@ -276,6 +468,9 @@ struct RoutingContext {
 	int loadedTiles;
 	OsmAnd::ElapsedTimer timeToLoad;
 	OsmAnd::ElapsedTimer timeToCalculate;
+	OsmAnd::ElapsedTimer timeToSnap;
+	OsmAnd::ElapsedTimer timeToConvertResult;
+	RoutingStatistics stats;
 	int firstRoadDirection;
 	int64_t firstRoadId;
 	RoutingConfiguration* config;
@@ -288,30 +483,102 @@ struct RoutingContext {
 	int targetX;
 	int targetY;
 	bool basemap;
+	// roads attached to route points are computed after search (false - on demand, see RouteResultSnapshot)
+	bool attachRoads;
     bool useSrRouting;
 	string srDbPath;
 	int srLevel;
+	// INFO sr values by road id, read from sr db for each calculation
+	SRVALUE_MAP srValueMap;
 
 	PrecalculatedRouteDirection precalcRoute;
 	SHARED_PTR<RouteSegment> finalRouteSegment;
 
+	// time dependent routing : departure in seconds since Monday 00:00 local time (-1 - disabled)
+	SHARED_PTR<SpeedProfile> speedProfile;
+	int departureTime;
+	// lower bound of route time, reverse search guesses time of day from it
+	float estimatedRouteTime;
+	// live speed multipliers and closures, same version is used for whole calculation
+	SHARED_PTR<const EdgeOverlaySnapshot> overlay;
+	// shared graph of opened files (server mode), tiles are not loaded when it is present
+	SHARED_PTR<const RoutingGraph> graph;
+	// coefficient of current search (changed by anytime mode)
+	float heuristicCoefficient;
+	float anytimeHeuristicCoefficient;
+	int anytimeTimeLimit;
+	// best route is at most bound times slower than optimal one (0 - unknown)
+	float suboptimalityBound;
+	// search is interrupted once deadline is passed, it is armed by first expanded segment after time limit (ms)
+	// is set (anytime mode), so snapping of start and target is not counted
+	int deadlineTimeLimit;
+	bool hasDeadline;
+	std::chrono::steady_clock::time_point deadline;
+	// binary trace of search tree (NULL - disabled)
+	SHARED_PTR<SearchTrace> trace;
+	// tiles (zoomToLoad) around precalculated route, other tiles are not loaded (empty - corridor is disabled)
+	UNORDERED(set)<int64_t> corridorTiles;
+	// frontier eviction policy : positions of last expanded segments of forward and reverse search and
+	// number of queued segments by tile (zoomToLoad)
+	int frontierX[2];
+	int frontierY[2];
+	UNORDERED(map)<int64_t, int> queuedTiles;
+	// heuristic from max speeds by cell around target (forward search) and start (reverse search),
+	// NULL - max speed of profile is used
+	SHARED_PTR<RouteSpeedRings> speedRings[2];
+
 	vector<SHARED_PTR<RouteSegment> > segmentsToVisitNotForbidden;
 	vector<SHARED_PTR<RouteSegment> > segmentsToVisitPrescripted;
 
 	MAP_SUBREGION_TILES subregionTiles;
 	UNORDERED(map)<int64_t, std::vector<SHARED_PTR<RoutingSubregionTile> > > indexedSubregions;
 
+	// hierarchical mode : border tiles (level differs from neighbour tile) load both levels, node of one level
+	// without node of other level at the same point is joined to nearest node of other level within join distance
+	static const int BORDER_JOIN_DISTANCE = 30;
+	static const int BORDER_CELL_SHIFT = 31 - 19;
+	struct BorderNode {
+		SHARED_PTR<RouteDataObject> road;
+		int point;
+		BorderNode(SHARED_PTR<RouteDataObject> road, int point) : road(road), point(point) {
+		}
+	};
+	// nodes of border tiles by level (0 - detailed, 1 - basemap) and cell of BORDER_CELL_SHIFT
+	UNORDERED(map)<int64_t, vector<BorderNode> > borderNodes[2];
+	UNORDERED(set)<int64_t> indexedBorderTiles;
+	// hierarchical route failed quality check, only detailed graph is used
+	bool detailedOnly;
+
 	RoutingContext(RoutingConfiguration* config) : 
 		visitedSegments(0), loadedTiles(0),
 		firstRoadDirection(0), firstRoadId(0),
-		config(config) {
+		config(config), basemap(false), attachRoads(true), useSrRouting(false), srLevel(2),
+		departureTime(-1), estimatedRouteTime(0), overlay(getEdgeOverlay().snapshot()),
+		graph(getOpenedFilesRoutingGraph()), heuristicCoefficient(config->heurCoefficient),
+		anytimeHeuristicCoefficient(config->anytimeHeuristicCoefficient), anytimeTimeLimit(config->anytimeTimeLimit),
+		suboptimalityBound(0), deadlineTimeLimit(0), hasDeadline(false), detailedOnly(false) {
 			precalcRoute.empty = true;
+			frontierX[0] = frontierX[1] = frontierY[0] = frontierY[1] = 0;
+	}
+
+	bool isTimeDependent() {
+		return departureTime >= 0 && speedProfile.get() != NULL && speedProfile->isOpened();
+	}
+
+	int getTimeOfWeek(float distanceFromStart, bool reverseWaySearch) {
+		float t = reverseWaySearch ? std::max(0.f, estimatedRouteTime - distanceFromStart) : distanceFromStart;
+		return departureTime + (int) t;
 	}
 
 	bool acceptLine(SHARED_PTR<RouteDataObject> r) {
 		return config->router.acceptLine(r);
 	}
 
+	// graph has only detailed roads, basemap routing still loads tiles
+	bool isGraphMode() {
+		return graph.get() != NULL && !basemap;
+	}
+
 	int getSize() {
 		// multiply 2 for to maps
 		int sz = subregionTiles.size() * sizeof(pair< int64_t, SHARED_PTR<RoutingSubregionTile> >)  * 2;
@@ -340,7 +607,11 @@ struct RoutingContext {
 				loaded++;
 			}
 		}
-		sort(list.begin(), list.end(), compareRoutingSubregionTile);
+		if (config->tileEvictionPolicy == TILE_EVICTION_FRONTIER) {
+			sortByFrontierDistance(list);
+		} else {
+			sort(list.begin(), list.end(), compareRoutingSubregionTile);
+		}
 		uint i = 0;
 		while(sz >= desirableSize && i < list.size()) {
 			SHARED_PTR<RoutingSubregionTile> unload = list[i];
@@ -349,12 +620,76 @@ struct RoutingContext {
 			unload->unload();
 			unloadedTiles ++;
 		}
+		stats.gcRuns++;
+		stats.tilesUnloaded += unloadedTiles;
 		for(i = 0; i<list.size(); i++) {
 			list[i]->access /= 3;
 		}
-		OsmAnd::LogPrintf(OsmAnd::LogSeverityLevel::Info, "Run GC (before %f Mb after %f Mb) unload %d of %d tiles",
-				occupiedBefore, getSize() / (1024.0*1024.0),
-				unloadedTiles, loaded);
+		OsmAnd::LogPrintf(OsmAnd::LogSeverityLevel::Info, "Run GC (before %f Mb after %f Mb) unload %d of %d tiles, "
+				"reloaded %d tiles", occupiedBefore, getSize() / (1024.0*1024.0),
+				unloadedTiles, loaded, stats.tilesReloaded);
+	}
+
+	inline int64_t getTileId(int x31, int y31) {
+		int z = config->zoomToLoad;
+		return (((int64_t) x31 >> (31 - z)) << z) + (y31 >> (31 - z));
+	}
+
+	void segmentQueued(int x31, int y31, int delta) {
+		int64_t tileId = getTileId(x31, y31);
+		int& cnt = queuedTiles[tileId];
+		cnt += delta;
+		if (cnt <= 0) {
+			queuedTiles.erase(tileId);
+		}
+	}
+
+	// tiles with queued segments are dropped from list, others are sorted from furthest to nearest to frontiers
+	void sortByFrontierDistance(vector<SHARED_PTR<RoutingSubregionTile> >& list) {
+		UNORDERED(set)<RoutingSubregionTile*> queued;
+		for (UNORDERED(map)<int64_t, int>::iterator it = queuedTiles.begin(); it != queuedTiles.end(); it++) {
+			const auto itSubregions = indexedSubregions.find(it->first);
+			if (itSubregions != indexedSubregions.end()) {
+				for (uint j = 0; j < itSubregions->second.size(); j++) {
+					queued.insert(itSubregions->second[j].get());
+				}
+			}
+		}
+		vector<std::pair<double, SHARED_PTR<RoutingSubregionTile> > > ranked;
+		for (uint i = 0; i < list.size(); i++) {
+			if (queued.find(list[i].get()) != queued.end()) {
+				continue;
+			}
+			RouteSubregion& sub = list[i]->subregion;
+			int cx = sub.left / 2 + sub.right / 2;
+			int cy = sub.top / 2 + sub.bottom / 2;
+			double dist = std::min(squareDist31TileMetric(cx, cy, frontierX[0], frontierY[0]),
+					squareDist31TileMetric(cx, cy, frontierX[1], frontierY[1]));
+			ranked.push_back(std::pair<double, SHARED_PTR<RoutingSubregionTile> >(-dist, list[i]));
+		}
+		sort(ranked.begin(), ranked.end());
+		list.clear();
+		for (uint i = 0; i < ranked.size(); i++) {
+			list.push_back(ranked[i].second);
+		}
+	}
+
+	SHARED_PTR<const vector<bool> > getAcceptance(SHARED_PTR<SharedRouteTile>& tile) {
+		const string& profile = config->profileKey;
+		if (!profile.empty()) {
+			SHARED_PTR<const vector<bool> > accepted = tile->getAcceptance(profile);
+			if (accepted.get() != NULL) {
+				return accepted;
+			}
+		}
+		SHARED_PTR<vector<bool> > accepted(new vector<bool>(tile->roads.size()));
+		for (uint k = 0; k < tile->roads.size(); k++) {
+			(*accepted)[k] = acceptLine(tile->roads[k]);
+		}
+		if (profile.empty()) {
+			return accepted;
+		}
+		return tile->putAcceptance(profile, accepted);
 	}
 
 	void loadHeaderObjects(int64_t tileId) {
@@ -373,26 +708,189 @@ struct RoutingContext {
 		}
 		for(uint j = 0; j<subregions.size(); j++) {
 			if(!subregions[j]->isLoaded()) {
-				loadedTiles++;
-				subregions[j]->setLoaded();
-				SearchQuery q;
-				vector<RouteDataObject*> res;
-				searchRouteDataForSubRegion(&q, res, &subregions[j]->subregion);
-				vector<RouteDataObject*>::iterator i = res.begin();
-				for(;i!=res.end(); i++) {
-					if(*i != NULL) {
-						SHARED_PTR<RouteDataObject> o(*i);
-						if(acceptLine(o)) {
-							subregions[j]->add(o);
-						}
+				loadSubregionTile(subregions[j]);
+			}
+		}
+	}
+
+	void loadSubregionTile(SHARED_PTR<RoutingSubregionTile>& subregion) {
+		loadedTiles++;
+		if (subregion->loaded < 0) {
+			stats.tilesReloaded++;
+		}
+		subregion->setLoaded();
+		bool decoded;
+		SHARED_PTR<SharedRouteTile> tile = loadSharedRouteTile(&subregion->subregion, decoded);
+		if (decoded) {
+			stats.bytesDecoded += subregion->subregion.length;
+		}
+		SHARED_PTR<const vector<bool> > accepted = getAcceptance(tile);
+		for (uint k = 0; k < tile->roads.size(); k++) {
+			if ((*accepted)[k]) {
+				subregion->add(tile->roads[k]);
+			}
+		}
+		subregion->sharedTile = tile;
+		if (trace.get() != NULL) {
+			RouteSubregion& sub = subregion->subregion;
+			trace->add(SEARCH_TRACE_TILE, 0, tile->roads.size(), 0, sub.left / 2 + sub.right / 2,
+					sub.top / 2 + sub.bottom / 2, 0, 0, 0);
+		}
+	}
+
+	static bool compareSubregionsByFilePosition(const SHARED_PTR<RoutingSubregionTile>& a,
+			const SHARED_PTR<RoutingSubregionTile>& b) {
+		if (a->subregion.routingIndex != b->subregion.routingIndex) {
+			return a->subregion.routingIndex < b->subregion.routingIndex;
+		}
+		return a->subregion.filePointer + a->subregion.mapDataBlock < b->subregion.filePointer + b->subregion.mapDataBlock;
+	}
+
+	// loads data of tiles in order of position in files (one pass over each file) while it fits into 70% of memory limit,
+	// tiles which don't fit are loaded on demand
+	int prefetchTiles(const vector<int64_t>& tileIds) {
+		timeToLoad.Start();
+		int z = config->zoomToLoad;
+		vector<SHARED_PTR<RoutingSubregionTile> > list;
+		UNORDERED(set)<RoutingSubregionTile*> added;
+		for (uint i = 0; i < tileIds.size(); i++) {
+			int64_t tileId = tileIds[i];
+			indexHeaders(tileId >> z, tileId & ((1 << z) - 1));
+			std::vector<SHARED_PTR<RoutingSubregionTile> >& subregions = indexedSubregions[tileId];
+			for (uint j = 0; j < subregions.size(); j++) {
+				if (!subregions[j]->isLoaded() && added.insert(subregions[j].get()).second) {
+					list.push_back(subregions[j]);
+				}
+			}
+		}
+		sort(list.begin(), list.end(), compareSubregionsByFilePosition);
+		float limit = config->memoryLimitation * 0.7f * 1024 * 1024;
+		int sz = getSize();
+		uint i = 0;
+		for (; i < list.size() && sz < limit; i++) {
+			loadSubregionTile(list[i]);
+			sz += list[i]->getSize();
+		}
+		timeToLoad.Pause();
+		return i;
+	}
+
+	inline static uint32_t clamp31(uint32_t v, uint32_t left, uint32_t right) {
+		return v < left ? left : (v > right ? right : v);
+	}
+
+	bool isHierarchical() {
+		return !basemap && !detailedOnly && config->detailedRadius > 0 && !isGraphMode();
+	}
+
+	// in hierarchical mode tiles which don't intersect detailed radius around start and target use basemap graph,
+	// levels are joined in border tiles (see borderNodes)
+	bool isBasemapTile(uint32_t xloc, uint32_t yloc) {
+		if (basemap) {
+			return true;
+		}
+		if (!isHierarchical()) {
+			return false;
+		}
+		int tz = 31 - config->zoomToLoad;
+		uint32_t left = xloc << tz, right = ((xloc + 1) << tz) - 1;
+		uint32_t top = yloc << tz, bottom = ((yloc + 1) << tz) - 1;
+		double r2 = (double) config->detailedRadius * config->detailedRadius;
+		if (squareDist31TileMetric(startX, startY, clamp31(startX, left, right), clamp31(startY, top, bottom)) <= r2) {
+			return false;
+		}
+		if (squareDist31TileMetric(targetX, targetY, clamp31(targetX, left, right), clamp31(targetY, top, bottom)) <= r2) {
+			return false;
+		}
+		return true;
+	}
+
+	bool isBorderTile(uint32_t xloc, uint32_t yloc) {
+		if (!isHierarchical()) {
+			return false;
+		}
+		bool level = isBasemapTile(xloc, yloc);
+		uint32_t maxTile = (1u << config->zoomToLoad) - 1;
+		for (int dx = -1; dx <= 1; dx++) {
+			for (int dy = -1; dy <= 1; dy++) {
+				int64_t x = (int64_t) xloc + dx;
+				int64_t y = (int64_t) yloc + dy;
+				if (x >= 0 && y >= 0 && x <= maxTile && y <= maxTile && isBasemapTile(x, y) != level) {
+					return true;
+				}
+			}
+		}
+		return false;
+	}
+
+	inline static int64_t borderCell(int64_t x, int64_t y) {
+		return ((x >> BORDER_CELL_SHIFT) << 31) + (y >> BORDER_CELL_SHIFT);
+	}
+
+	// indexes nodes of loaded border tile by level
+	void indexBorderNodes(int64_t tileId) {
+		if (!indexedBorderTiles.insert(tileId).second) {
+			return;
+		}
+		std::vector<SHARED_PTR<RoutingSubregionTile> >& subregions = indexedSubregions[tileId];
+		for (uint j = 0; j < subregions.size(); j++) {
+			UNORDERED(map)<int64_t, SHARED_PTR<RouteSegment> >::iterator s = subregions[j]->routes.begin();
+			for (; s != subregions[j]->routes.end(); s++) {
+				int64_t cell = borderCell(s->first >> 31, s->first & ((1ll << 31) - 1));
+				for (SHARED_PTR<RouteSegment> seg = s->second; seg.get() != NULL; seg = seg->next) {
+					borderNodes[subregions[j]->basemap ? 1 : 0][cell].push_back(BorderNode(seg->road,
+							seg->getSegmentStart()));
+				}
+			}
+		}
+	}
+
+	// nearest node of level within join distance (NULL - no node)
+	SHARED_PTR<RouteSegment> findBorderJoin(int x31, int y31, int level) {
+		SHARED_PTR<RouteSegment> join;
+		double minDist = (double) BORDER_JOIN_DISTANCE * BORDER_JOIN_DISTANCE;
+		for (int dx = -1; dx <= 1; dx++) {
+			for (int dy = -1; dy <= 1; dy++) {
+				UNORDERED(map)<int64_t, vector<BorderNode> >::iterator it = borderNodes[level].find(
+						borderCell(x31 + ((int64_t) dx << BORDER_CELL_SHIFT), y31 + ((int64_t) dy << BORDER_CELL_SHIFT)));
+				if (it == borderNodes[level].end()) {
+					continue;
+				}
+				for (uint k = 0; k < it->second.size(); k++) {
+					BorderNode& n = it->second[k];
+					double d = squareDist31TileMetric(x31, y31, n.road->pointsX[n.point], n.road->pointsY[n.point]);
+					if (d <= minDist) {
+						minDist = d;
+						join = SHARED_PTR<RouteSegment>(new RouteSegment(n.road, n.point));
 					}
 				}
 			}
 		}
+		return join;
+	}
+
+	// route is recalculated over detailed graph, tiles of basemap level are indexed again
+	void disableHierarchicalMode() {
+		detailedOnly = true;
+		indexedSubregions.clear();
+		borderNodes[0].clear();
+		borderNodes[1].clear();
+		indexedBorderTiles.clear();
 	}
 
 	void loadHeaders(uint32_t xloc, uint32_t yloc) {
+		int64_t tileId = (xloc << config->zoomToLoad) + yloc;
+		if (!corridorTiles.empty() && corridorTiles.find(tileId) == corridorTiles.end()) {
+			return;
+		}
 		timeToLoad.Start();
+		indexHeaders(xloc, yloc);
+		loadHeaderObjects(tileId);
+		timeToLoad.Pause();
+	}
+
+	// finds subregions of tile without loading their data
+	void indexHeaders(uint32_t xloc, uint32_t yloc) {
 		int z  = config->zoomToLoad;
 		int tz = 31 - z;
 		int64_t tileId = (xloc << z) + yloc;
@@ -400,20 +898,36 @@ struct RoutingContext {
 			SearchQuery q((uint32_t) (xloc << tz),
 							(uint32_t) ((xloc + 1) << tz), (uint32_t) (yloc << tz), (uint32_t) ((yloc + 1) << tz));
 			std::vector<RouteSubregion> tempResult;
-			searchRouteSubregions(&q, tempResult, basemap);
+			bool basemapTile = isBasemapTile(xloc, yloc);
+			searchRouteSubregions(&q, tempResult, basemapTile);
+			if (basemapTile && !basemap && tempResult.empty()) {
+				// no basemap boxes for that tile (old files), fall back to detailed graph
+				basemapTile = false;
+				searchRouteSubregions(&q, tempResult, false);
+			}
+			// border tile has subregions of both levels (basemap ones are after levelStart)
+			uint levelStart = basemapTile ? 0 : tempResult.size();
+			if (isBorderTile(xloc, yloc)) {
+				std::vector<RouteSubregion> other;
+				searchRouteSubregions(&q, other, !basemapTile);
+				if (basemapTile) {
+					levelStart = other.size();
+					tempResult.insert(tempResult.begin(), other.begin(), other.end());
+				} else {
+					tempResult.insert(tempResult.end(), other.begin(), other.end());
+				}
+			}
 			std::vector<SHARED_PTR<RoutingSubregionTile> > collection;
 			for(uint i = 0; i<tempResult.size(); i++) {
 				RouteSubregion& rs = tempResult[i];
 				int64_t key = ((int64_t)rs.left << 31)+ rs.filePointer;
 				if(subregionTiles.find(key) == subregionTiles.end()) {
-					subregionTiles[key] = SHARED_PTR<RoutingSubregionTile>(new RoutingSubregionTile(rs));
+					subregionTiles[key] = SHARED_PTR<RoutingSubregionTile>(new RoutingSubregionTile(rs, i >= levelStart));
 				}
 				collection.push_back(subregionTiles[key]);
 			}
 			indexedSubregions[tileId] = collection;
 		}
-		loadHeaderObjects(tileId);
-		timeToLoad.Pause();
 	}
 
 
@@ -426,6 +940,10 @@ struct RoutingContext {
 		} else {
 			t = 1 << t;
 		}
+		if (isGraphMode()) {
+			loadGraphData(x31, y31, (int64_t) t * coordinatesShift, dataObjects);
+			return;
+		}
 		UNORDERED(set)<int64_t> ids;
 		int z  = config->zoomToLoad;
 		for(int i = -t; i <= t; i++) {
@@ -458,8 +976,71 @@ struct RoutingContext {
 		}
 	}
 
+	// same area as tiles of loadTileData
+	void loadGraphData(int x31, int y31, int64_t radius, vector<SHARED_PTR<RouteDataObject> >& dataObjects) {
+		int tz = 31 - config->zoomToLoad;
+		int64_t maxCoord = INT_MAX;
+		uint32_t left = (uint32_t) (std::max((int64_t) 0, x31 - radius) >> tz << tz);
+		uint32_t top = (uint32_t) (std::max((int64_t) 0, y31 - radius) >> tz << tz);
+		uint32_t right = (uint32_t) std::min(maxCoord, ((x31 + radius) >> tz << tz) + (1 << tz) - 1);
+		uint32_t bottom = (uint32_t) std::min(maxCoord, ((y31 + radius) >> tz << tz) + (1 << tz) - 1);
+		vector<uint32_t> roads;
+		graph->getRoads(left, top, right, bottom, roads);
+		for (uint i = 0; i < roads.size(); i++) {
+			const SHARED_PTR<RouteDataObject>& ro = graph->getRoad(roads[i]);
+			if (acceptLine(ro)) {
+				dataObjects.push_back(ro);
+			}
+		}
+	}
+
+	SHARED_PTR<RouteSegment> loadGraphSegment(int x31, int y31) {
+		const RoutingGraphSegment* begin;
+		const RoutingGraphSegment* end;
+		SHARED_PTR<RouteSegment> original;
+		if (!graph->getNodeSegments(x31, y31, begin, end)) {
+			return original;
+		}
+		for (; begin != end; begin++) {
+			const SHARED_PTR<RouteDataObject>& ro = graph->getRoad(begin->road);
+			if (acceptLine(ro)) {
+				SHARED_PTR<RouteSegment> s = SHARED_PTR<RouteSegment>(new RouteSegment(ro, begin->point));
+				s->next = original;
+				original = s;
+			}
+		}
+		return original;
+	}
+
+	// shares tiles of route points with other context, so roads at them are not loaded again
+	void retainRouteTiles(RoutingContext* from, vector<RouteSegmentResult>& result) {
+		basemap = from->basemap;
+		for (uint i = 0; i < result.size(); i++) {
+			RouteDataObject* o = result[i].object.get();
+			for (uint j = 0; j < o->pointsX.size(); j++) {
+				int64_t tileId = getTileId(o->pointsX[j], o->pointsY[j]);
+				if (indexedSubregions.find(tileId) != indexedSubregions.end()) {
+					continue;
+				}
+				UNORDERED(map)<int64_t, std::vector<SHARED_PTR<RoutingSubregionTile> > >::iterator it =
+						from->indexedSubregions.find(tileId);
+				if (it == from->indexedSubregions.end()) {
+					continue;
+				}
+				indexedSubregions[tileId] = it->second;
+				for (uint k = 0; k < it->second.size(); k++) {
+					RouteSubregion& rs = it->second[k]->subregion;
+					subregionTiles[((int64_t) rs.left << 31) + rs.filePointer] = it->second[k];
+				}
+			}
+		}
+	}
+
 	// void searchRouteRegion(SearchQuery* q, std::vector<RouteDataObject*>& list, RoutingIndex* rs, RouteSubregion* sub)
 	SHARED_PTR<RouteSegment> loadRouteSegment(int x31, int y31) {
+		if (isGraphMode()) {
+			return loadGraphSegment(x31, y31);
+		}
 		int z  = config->zoomToLoad;
 		int64_t xloc = x31 >> (31 - z);
 		int64_t yloc = y31 >> (31 - z);
@@ -472,10 +1053,14 @@ struct RoutingContext {
         auto& subregions = itSubregions->second;
 		UNORDERED(map)<int64_t, SHARED_PTR<RouteDataObject> > excludeDuplications;
 		SHARED_PTR<RouteSegment> original;
+		bool levels[2] = { false, false };
 		for(uint j = 0; j<subregions.size(); j++) {
 			if(subregions[j]->isLoaded()) {
 				SHARED_PTR<RouteSegment> segment = subregions[j]->routes[l];
 				subregions[j]->access++;
+				if (segment.get() != NULL) {
+					levels[subregions[j]->basemap ? 1 : 0] = true;
+				}
 				while (segment.get() != NULL) {
 					SHARED_PTR<RouteDataObject> ro = segment->road;
 					SHARED_PTR<RouteDataObject> toCmp = excludeDuplications[calcRouteId(ro, segment->getSegmentStart())];
@@ -489,16 +1074,42 @@ struct RoutingContext {
 				}
 			}
 		}
-
+		if (levels[0] != levels[1] && isBorderTile(xloc, yloc)) {
+			indexBorderNodes(tileId);
+			// gap to joined node is added to cost of the segment and connected in result
+			SHARED_PTR<RouteSegment> join = findBorderJoin(x31, y31, levels[0] ? 1 : 0);
+			if (join.get() != NULL) {
+				stats.borderJoins++;
+				join->next = original;
+				original = join;
+			}
+		}
 		return original;
 	}
 
 
 	bool isInterrupted(){
-		return false;
+		return hasDeadline && std::chrono::steady_clock::now() > deadline;
+	}
+
+	void armDeadline() {
+		if (deadlineTimeLimit > 0 && !hasDeadline) {
+			hasDeadline = true;
+			deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(deadlineTimeLimit);
+		}
+	}
+
+	bool isAnytime() {
+		return anytimeHeuristicCoefficient > 1;
 	}
+
+	// search with coefficient lower than initial one continues search of previous step
+	bool isAnytimeRefinement() {
+		return isAnytime() && heuristicCoefficient < anytimeHeuristicCoefficient;
+	}
+
 	float getHeuristicCoefficient(){
-		return config->heurCoefficient;
+		return heuristicCoefficient;
 	}
 
 	bool planRouteIn2Directions() {
@@ -512,4 +1123,52 @@ struct RoutingContext {
 
 
 vector<RouteSegmentResult> searchRouteInternal(RoutingContext* ctx, bool leftSideNavigation);
+
+/**
+ * Time of route between start and target of context (-1 if route is not found), result is not converted
+ * so it is cheaper for matrices. Context could be reused for several calculations (tiles stay loaded).
+ */
+float searchRouteTime(RoutingContext* ctx);
+
+/**
+ * Search state of graph mode (arrays of all graph points) is reused by following calculations, at most limit
+ * idle states are kept (default - number of hardware threads), others are freed once calculation is finished
+ */
+void setIdleRoutingScratchesLimit(int limit);
+
+/**
+ * Route with tiles of its points kept after search, roads attached to route points (needed only for turn
+ * instructions) are loaded on demand instead of delaying route
+ */
+struct RouteResultSnapshot {
+	SHARED_PTR<RoutingConfiguration> config;
+	RoutingContext ctx;
+	vector<RouteSegmentResult> result;
+	// context is not thread safe
+	std::mutex mutex;
+
+	RouteResultSnapshot(SHARED_PTR<RoutingConfiguration> config) : config(config), ctx(config.get()) {
+	}
+};
+
+// snapshot of route calculated by context
+SHARED_PTR<RouteResultSnapshot> createRouteResultSnapshot(SHARED_PTR<RoutingConfiguration> config, RoutingContext* ctx,
+		vector<RouteSegmentResult>& result);
+
+/**
+ * Snapshot becomes the latest one (handle 0, previous latest is released), referenced snapshot also gets
+ * its own handle valid until releaseRouteResultSnapshot. Handles are not pointers, so snapshot released
+ * during load of attached roads is deleted once the load is finished.
+ */
+int64_t publishRouteResultSnapshot(SHARED_PTR<RouteResultSnapshot> snapshot, bool referenced);
+
+// NULL if handle was released
+SHARED_PTR<RouteResultSnapshot> getRouteResultSnapshot(int64_t handle);
+
+void releaseRouteResultSnapshot(int64_t handle);
+
+/**
+ * Fills attached roads of segment of snapshot (segment of result is not changed)
+ */
+bool loadAttachedRoads(RouteResultSnapshot* snapshot, uint segment, RouteSegmentResult& attached);
 #endif /*_OSMAND_BINARY_ROUTE_PLANNER_H*/
@@ -0,0 +1,67 @@
+#ifndef _OSMAND_EDGE_OVERLAY_CPP
+#define _OSMAND_EDGE_OVERLAY_CPP
+#include "edgeOverlay.h"
+#include "Logging.h"
+
+int64_t EdgeOverlay::update(const std::vector<EdgeOverlayUpdate>& updates) {
+	std::lock_guard<std::mutex> lock(writeMutex);
+	SHARED_PTR<const EdgeOverlaySnapshot> prev = std::atomic_load(&current);
+	// shards are shared with previous snapshot till they are changed
+	SHARED_PTR<EdgeOverlaySnapshot> next(new EdgeOverlaySnapshot(*prev));
+	next->version = prev->version + 1;
+	SHARED_PTR<EdgeOverlayShard> changed[EdgeOverlaySnapshot::SHARDS];
+	for (uint i = 0; i < updates.size(); i++) {
+		float f = updates[i].factor < 0 ? 0 : updates[i].factor;
+		int64_t roadId = updates[i].roadId;
+		int sh = EdgeOverlaySnapshot::getShard(roadId);
+		if (changed[sh].get() == NULL) {
+			if (next->getSpeedFactor(roadId) == f) {
+				continue;
+			}
+			const EdgeOverlayShard* shard = prev->shards[sh].get();
+			changed[sh] = SHARED_PTR<EdgeOverlayShard>(shard == NULL ? new EdgeOverlayShard() : new EdgeOverlayShard(*shard));
+		}
+		if (f == 1) {
+			changed[sh]->factors.erase(roadId);
+		} else {
+			changed[sh]->factors[roadId] = f;
+		}
+	}
+	next->maxFactor = 1;
+	for (int sh = 0; sh < EdgeOverlaySnapshot::SHARDS; sh++) {
+		EdgeOverlayShard* shard = changed[sh].get();
+		if (shard != NULL) {
+			shard->maxFactor = 1;
+			UNORDERED(map)<int64_t, float>::iterator it = shard->factors.begin();
+			for (; it != shard->factors.end(); it++) {
+				shard->maxFactor = std::max(shard->maxFactor, it->second);
+			}
+			next->shards[sh] = shard->factors.empty() ? SHARED_PTR<const EdgeOverlayShard>() :
+					SHARED_PTR<const EdgeOverlayShard>(changed[sh]);
+		}
+		if (next->shards[sh].get() != NULL) {
+			next->maxFactor = std::max(next->maxFactor, next->shards[sh]->maxFactor);
+		}
+	}
+	SHARED_PTR<const EdgeOverlaySnapshot> published = next;
+	std::atomic_store(&current, published);
+	return next->version;
+}
+
+int64_t EdgeOverlay::clear() {
+	std::lock_guard<std::mutex> lock(writeMutex);
+	SHARED_PTR<const EdgeOverlaySnapshot> prev = std::atomic_load(&current);
+	SHARED_PTR<EdgeOverlaySnapshot> next(new EdgeOverlaySnapshot());
+	next->version = prev->version + 1;
+	SHARED_PTR<const EdgeOverlaySnapshot> published = next;
+	std::atomic_store(&current, published);
+	OsmAnd::LogPrintf(OsmAnd::LogSeverityLevel::Info, "Edge overlay cleared (%d roads)", prev->size());
+	return next->version;
+}
+
+EdgeOverlay& getEdgeOverlay() {
+	static EdgeOverlay overlay;
+	return overlay;
+}
+
+#endif /*_OSMAND_EDGE_OVERLAY_CPP*/
@@ -0,0 +1,97 @@
+#ifndef _OSMAND_EDGE_OVERLAY_H
+#define _OSMAND_EDGE_OVERLAY_H
+#include <stdint.h>
+#include <mutex>
+#include <vector>
+#include <algorithm>
+#include "Common.h"
+#include "common2.h"
+
+// roads of overlay with the same hash, shard is immutable once published
+struct EdgeOverlayShard {
+	// speed multiplier by road, 0 - road is closed (roads without changes are not stored)
+	UNORDERED(map)<int64_t, float> factors;
+	float maxFactor;
+
+	EdgeOverlayShard() : maxFactor(1) {
+	}
+};
+
+/**
+ * Immutable state of overlay, route calculation keeps one snapshot for the whole search.
+ * Roads are split into shards, so update copies only shards of changed roads and shares the others.
+ */
+struct EdgeOverlaySnapshot {
+	static const int SHARD_BITS = 6;
+	static const int SHARDS = 1 << SHARD_BITS;
+	int64_t version;
+	// max speed multiplier of all roads (1 if no road is sped up)
+	float maxFactor;
+	// NULL - shard without roads
+	SHARED_PTR<const EdgeOverlayShard> shards[SHARDS];
+
+	EdgeOverlaySnapshot() : version(0), maxFactor(1) {
+	}
+
+	inline static int getShard(int64_t roadId) {
+		return (int) (((uint64_t) roadId * 0x9E3779B97F4A7C15ull) >> (64 - SHARD_BITS));
+	}
+
+	inline float getSpeedFactor(int64_t roadId) const {
+		const EdgeOverlayShard* shard = shards[getShard(roadId)].get();
+		if (shard == NULL) {
+			return 1;
+		}
+		UNORDERED(map)<int64_t, float>::const_iterator it = shard->factors.find(roadId);
+		return it == shard->factors.end() ? 1 : it->second;
+	}
+
+	inline bool isClosed(int64_t roadId) const {
+		return getSpeedFactor(roadId) <= 0;
+	}
+
+	// number of changed roads
+	int size() const {
+		int sz = 0;
+		for (int i = 0; i < SHARDS; i++) {
+			sz += shards[i].get() == NULL ? 0 : shards[i]->factors.size();
+		}
+		return sz;
+	}
+};
+
+struct EdgeOverlayUpdate {
+	int64_t roadId;
+	float factor;
+
+	EdgeOverlayUpdate(int64_t roadId, float factor) : roadId(roadId), factor(factor) {
+	}
+};
+
+/**
+ * Live per road speed multipliers and closures (e.g. from traffic feed). Updates are applied copy-on-write
+ * and published atomically, so readers never block and see consistent versions. Overlay is applied during
+ * search expansion, loaded tiles don't depend on it and are never reloaded. Road reset to factor 1 is erased.
+ */
+class EdgeOverlay {
+private:
+	SHARED_PTR<const EdgeOverlaySnapshot> current;
+	std::mutex writeMutex;
+
+public:
+	EdgeOverlay() : current(new EdgeOverlaySnapshot()) {
+	}
+
+	SHARED_PTR<const EdgeOverlaySnapshot> snapshot() const {
+		return std::atomic_load(&current);
+	}
+
+	// returns new version
+	int64_t update(const std::vector<EdgeOverlayUpdate>& updates);
+
+	int64_t clear();
+};
+
+EdgeOverlay& getEdgeOverlay();
+
+#endif /*_OSMAND_EDGE_OVERLAY_H*/
@@ -4,7 +4,7 @@
 #include "binaryRoutePlanner.h"
 #include <sstream>
 const int RouteAttributeExpression::LESS_EXPRESSION = 1;
-const int RouteAttributeExpression::GREAT_EXPRESSION = 1;
+const int RouteAttributeExpression::GREAT_EXPRESSION = 2;
 
 
 float parseFloat(MAP_STR_STR attributes, string key, float def) {
@@ -70,17 +70,17 @@ double parseValue(string value, string type) {
 void GeneralRouter::addAttribute(string k, string v) {
 	attributes[k] = v;
 	if(k=="restrictionsAware") {
-		_restrictionsAware = parseBool(attributes, v, _restrictionsAware);
+		_restrictionsAware = parseBool(attributes, k, _restrictionsAware);
 	} else if(k=="leftTurn") {
-		leftTurn = parseFloat(attributes, v, leftTurn);
+		leftTurn = parseFloat(attributes, k, leftTurn);
 	} else if(k=="rightTurn") {
-		rightTurn = parseFloat(attributes, v, rightTurn);
+		rightTurn = parseFloat(attributes, k, rightTurn);
 	} else if(k=="roundaboutTurn") {
-		roundaboutTurn = parseFloat(attributes, v, roundaboutTurn);
+		roundaboutTurn = parseFloat(attributes, k, roundaboutTurn);
 	} else if(k=="minDefaultSpeed") {
-		minDefaultSpeed = parseFloat(attributes, v, minDefaultSpeed * 3.6f) / 3.6f;
+		minDefaultSpeed = parseFloat(attributes, k, minDefaultSpeed * 3.6f) / 3.6f;
 	} else if(k =="maxDefaultSpeed") {
-		maxDefaultSpeed = parseFloat(attributes, v, maxDefaultSpeed * 3.6f) / 3.6f;
+		maxDefaultSpeed = parseFloat(attributes, k, maxDefaultSpeed * 3.6f) / 3.6f;
 	}
 }
 
@@ -143,7 +143,7 @@ void RouteAttributeEvalRule::printRule(GeneralRouter* r) {
 	OsmAnd::LogPrintf(OsmAnd::LogSeverityLevel::Info, "%s", s.str().c_str());
 }
 
-RouteAttributeExpression::RouteAttributeExpression(vector<string>&vls, int type, string vType) : 
+RouteAttributeExpression::RouteAttributeExpression(const vector<string>& vls, int type, string vType) : 
 		 values(vls), expressionType(type), valueType(vType){
 	cacheValues.resize(vls.size());
 	for (uint i = 0; i < vls.size(); i++) {
@@ -177,7 +177,7 @@ void RouteAttributeEvalRule::registerAndTagValueCondition(GeneralRouter* r, stri
 	}
 }
 
-void RouteAttributeEvalRule::registerParamConditions(vector<string>& params) {
+void RouteAttributeEvalRule::registerParamConditions(const vector<string>& params) {
 	parameters.insert(parameters.end(), params.begin(), params.end());
 }
 
@@ -232,7 +232,46 @@ bool GeneralRouter::acceptLine(SHARED_PTR<RouteDataObject> way) {
 	return res >= 0;
 }
 
+bool RouteAttributeEvalRule::dependsOnlyOnOnewayFlags() {
+	if (selectValue == DOUBLE_MISSING || expressions.size() > 0) {
+		return false;
+	}
+	for (uint i = 0; i < tagValueCondDefTag.size(); i++) {
+		string& tag = tagValueCondDefTag[i];
+		string& value = tagValueCondDefValue[i];
+		// road with such tag always has one of flags (oneway=no and bare oneway tag don't set flag)
+		bool flagged = tag == "roundabout" || value == "roundabout" || (tag == "oneway" && value != "" && value != "no");
+		if (tagValueCondDefNot[i] || !flagged) {
+			return false;
+		}
+	}
+	return true;
+}
+
+void GeneralRouter::initOnewayWithoutFlags() {
+	onewayWithoutFlags = ONEWAY_BY_RULES;
+	if (!isObjContextAvailable(RouteDataObjectAttribute::ONEWAY)) {
+		return;
+	}
+	RouteAttributeContext& ctx = getObjContext(RouteDataObjectAttribute::ONEWAY);
+	for (uint k = 0; k < ctx.rules.size(); k++) {
+		if (!ctx.rules[k]->dependsOnlyOnOnewayFlags()) {
+			return;
+		}
+	}
+	// rules with tag conditions can't match such road, so result is the same as for road without tags
+	dynbitset empty(universalRules.size());
+	double d = ctx.evaluate(empty);
+	onewayWithoutFlags = d == DOUBLE_MISSING ? 0 : (int) d;
+}
+
 int GeneralRouter::isOneWay(SHARED_PTR<RouteDataObject> road) {
+	if (onewayWithoutFlags == ONEWAY_NOT_INITIALIZED) {
+		initOnewayWithoutFlags();
+	}
+	if (onewayWithoutFlags != ONEWAY_BY_RULES && !(road->getFlags() & (ROAD_FLAG_ONEWAY | ROAD_FLAG_ROUNDABOUT))) {
+		return onewayWithoutFlags;
+	}
 	return getObjContext(RouteDataObjectAttribute::ONEWAY).evaluateInt(road, 0);
 }
 
@@ -255,6 +294,12 @@ double GeneralRouter::defineRoutingSpeed(SHARED_PTR<RouteDataObject> road) {
 	return min(defineVehicleSpeed(road), maxDefaultSpeed);
 }
 
+double GeneralRouter::defineRoutingSpeed(SHARED_PTR<RouteDataObject> road, const SpeedProfile* profile, bool forward, 
+		int timeOfWeek) {
+	double speed = defineVehicleSpeed(road) * profile->getSpeedFactor(road->id, forward, timeOfWeek);
+	return min(speed, maxDefaultSpeed);
+}
+
 double GeneralRouter::defineVehicleSpeed(SHARED_PTR<RouteDataObject> road) {
 	return getObjContext(RouteDataObjectAttribute::ROAD_SPEED) .evaluateDouble(road, getMinDefaultSpeed());
 }
@@ -358,6 +403,7 @@ dynbitset RouteAttributeContext::convert(RoutingIndex* reg, std::vector<uint32_t
 }
 
 double RouteAttributeEvalRule::eval(dynbitset& types, ParameterContext& paramContext, GeneralRouter* router) {
+	router->ruleEvaluations++;
 	if (matches(types, paramContext, router)) {
 		return calcSelectValue(types, paramContext, router);
 	}
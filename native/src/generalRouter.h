@@ -9,6 +9,7 @@
 #include "boost/dynamic_bitset.hpp"
 #include "Logging.h"
 #include "binaryRead.h"
+#include "speedProfile.h"
 
 struct RouteSegment;
 class GeneralRouter;
@@ -70,7 +71,7 @@ struct RouteAttributeExpression {
 	string valueType;
 	vector<double> cacheValues; 
 
-	RouteAttributeExpression(vector<string>&vls, int type, string vType);
+	RouteAttributeExpression(const vector<string>& vls, int type, string vType);
 
 	bool matches(dynbitset& types, ParameterContext& paramContext, GeneralRouter* router) ;
 
@@ -113,7 +114,7 @@ public:
 	void registerAndTagValueCondition(GeneralRouter* r, string tag, string value, bool nt); 
 
 	// formated as [param1,-param2]
-	void registerParamConditions(vector<string>& params); 
+	void registerParamConditions(const vector<string>& params); 
 
 	void registerSelectValue(string selectValue, string selectType); 
 
@@ -121,6 +122,12 @@ public:
 		expressions.push_back(expression);
 	}
 
+	/**
+	 * return true if rule has constant value and matches roads without ROAD_FLAG_ONEWAY and ROAD_FLAG_ROUNDABOUT
+	 * the same way as road without tags
+	 */
+	bool dependsOnlyOnOnewayFlags();
+
 	// registerGreatCondition, registerLessCondition
 
 };
@@ -229,6 +236,10 @@ private:
 	bool shortestRoute;
 	
 	UNORDERED(map)<RoutingIndex*, MAP_INT_INT> regionConvert;
+	// oneway of roads without oneway and roundabout flags (ONEWAY_BY_RULES if rules should be evaluated for each road)
+	int onewayWithoutFlags;
+
+	void initOnewayWithoutFlags();
 		
 public:
 	// cached values
@@ -239,8 +250,14 @@ public:
 	double minDefaultSpeed ;
 	double maxDefaultSpeed ;
 	UNORDERED(set)<int64_t> impassableRoadIds;
+	// statistics : number of evaluated rules
+	int64_t ruleEvaluations;
 
-	GeneralRouter() : _restrictionsAware(true), minDefaultSpeed(10), maxDefaultSpeed(10) {
+	static const int ONEWAY_NOT_INITIALIZED = -100;
+	static const int ONEWAY_BY_RULES = -101;
+
+	GeneralRouter() : onewayWithoutFlags(ONEWAY_NOT_INITIALIZED), _restrictionsAware(true), minDefaultSpeed(10),
+			maxDefaultSpeed(10), ruleEvaluations(0) {
 	}
 
 	~GeneralRouter() {
@@ -286,6 +303,11 @@ public:
 	 */
 	double defineRoutingSpeed(SHARED_PTR<RouteDataObject> road);
 
+	/**
+	 * return routing speed in m/s adjusted by historical speed profile for time of week (seconds since Monday 00:00)
+	 */
+	double defineRoutingSpeed(SHARED_PTR<RouteDataObject> road, const SpeedProfile* profile, bool forward, int timeOfWeek);
+
 	/*
 	* return transition penalty between different road classes in seconds
 	*/
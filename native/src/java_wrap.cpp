@@ -12,6 +12,14 @@
 #include "binaryRead.h"
 #include "rendering.h"
 #include "binaryRoutePlanner.h"
+#include "routingConfiguration.h"
+#include "speedProfile.h"
+#include "routingGraph.h"
+#include "routeTileCache.h"
+#include "edgeOverlay.h"
+#include "routeOptimizer.h"
+#include "routeRequest.h"
+#include "routeResultBuffer.h"
 #include "Logging.h"
 
 JavaVM* globalJVM = NULL;
@@ -419,10 +427,25 @@ jfieldID jfield_RouteCalculationProgress_distanceFromBegin = NULL;
 jfieldID jfield_RouteCalculationProgress_directSegmentQueueSize = NULL;
 jfieldID jfield_RouteCalculationProgress_distanceFromEnd = NULL;
 jfieldID jfield_RouteCalculationProgress_reverseSegmentQueueSize = NULL;
-jfieldID jfield_RouteCalculationProgress_isCancelled = NULL;
+jfieldID jfield_RouteCalculationProgress_nativeState = NULL;
 jfieldID jfield_RouteCalculationProgress_routingCalculatedTime = NULL;
 jfieldID jfield_RouteCalculationProgress_visitedSegments = NULL;
 jfieldID jfield_RouteCalculationProgress_loadedTiles = NULL;
+jfieldID jfield_RouteCalculationProgress_heapPushes = NULL;
+jfieldID jfield_RouteCalculationProgress_heapPops = NULL;
+jfieldID jfield_RouteCalculationProgress_stalePops = NULL;
+jfieldID jfield_RouteCalculationProgress_visitedLookups = NULL;
+jfieldID jfield_RouteCalculationProgress_tilesUnloaded = NULL;
+jfieldID jfield_RouteCalculationProgress_tilesReloaded = NULL;
+jfieldID jfield_RouteCalculationProgress_routeSnapshot = NULL;
+jfieldID jfield_RouteCalculationProgress_gcRuns = NULL;
+jfieldID jfield_RouteCalculationProgress_ruleEvaluations = NULL;
+jfieldID jfield_RouteCalculationProgress_srLookups = NULL;
+jfieldID jfield_RouteCalculationProgress_bytesDecoded = NULL;
+jfieldID jfield_RouteCalculationProgress_timeToSnap = NULL;
+jfieldID jfield_RouteCalculationProgress_timeToLoad = NULL;
+jfieldID jfield_RouteCalculationProgress_timeToSearch = NULL;
+jfieldID jfield_RouteCalculationProgress_timeToConvertResult = NULL;
 
 jclass jclass_RoutingConfiguration = NULL;
 jfieldID jfield_RoutingConfiguration_heuristicCoefficient = NULL;
@@ -544,7 +567,7 @@ void loadJniRenderingContext(JNIEnv* env)
 			"[[Lnet/osmand/router/RouteSegmentResult;");
 
 	jclass_RouteCalculationProgress = findGlobalClass(env, "net/osmand/router/RouteCalculationProgress");
-	jfield_RouteCalculationProgress_isCancelled  = getFid(env, jclass_RouteCalculationProgress, "isCancelled", "Z");
+	jfield_RouteCalculationProgress_nativeState  = getFid(env, jclass_RouteCalculationProgress, "nativeState", "Ljava/nio/ByteBuffer;");
 	jfield_RouteCalculationProgress_segmentNotFound  = getFid(env, jclass_RouteCalculationProgress, "segmentNotFound", "I");
 	jfield_RouteCalculationProgress_distanceFromBegin  = getFid(env, jclass_RouteCalculationProgress, "distanceFromBegin", "F");
 	jfield_RouteCalculationProgress_distanceFromEnd  = getFid(env, jclass_RouteCalculationProgress, "distanceFromEnd", "F");
@@ -553,6 +576,21 @@ void loadJniRenderingContext(JNIEnv* env)
 	jfield_RouteCalculationProgress_routingCalculatedTime  = getFid(env, jclass_RouteCalculationProgress, "routingCalculatedTime", "F");
 	jfield_RouteCalculationProgress_visitedSegments  = getFid(env, jclass_RouteCalculationProgress, "visitedSegments", "I");
 	jfield_RouteCalculationProgress_loadedTiles  = getFid(env, jclass_RouteCalculationProgress, "loadedTiles", "I");
+	jfield_RouteCalculationProgress_heapPushes  = getFid(env, jclass_RouteCalculationProgress, "heapPushes", "I");
+	jfield_RouteCalculationProgress_heapPops  = getFid(env, jclass_RouteCalculationProgress, "heapPops", "I");
+	jfield_RouteCalculationProgress_stalePops  = getFid(env, jclass_RouteCalculationProgress, "stalePops", "I");
+	jfield_RouteCalculationProgress_visitedLookups  = getFid(env, jclass_RouteCalculationProgress, "visitedLookups", "I");
+	jfield_RouteCalculationProgress_tilesUnloaded  = getFid(env, jclass_RouteCalculationProgress, "tilesUnloaded", "I");
+	jfield_RouteCalculationProgress_tilesReloaded  = getFid(env, jclass_RouteCalculationProgress, "tilesReloaded", "I");
+	jfield_RouteCalculationProgress_routeSnapshot  = getFid(env, jclass_RouteCalculationProgress, "routeSnapshot", "J");
+	jfield_RouteCalculationProgress_gcRuns  = getFid(env, jclass_RouteCalculationProgress, "gcRuns", "I");
+	jfield_RouteCalculationProgress_ruleEvaluations  = getFid(env, jclass_RouteCalculationProgress, "ruleEvaluations", "J");
+	jfield_RouteCalculationProgress_srLookups  = getFid(env, jclass_RouteCalculationProgress, "srLookups", "I");
+	jfield_RouteCalculationProgress_bytesDecoded  = getFid(env, jclass_RouteCalculationProgress, "bytesDecoded", "J");
+	jfield_RouteCalculationProgress_timeToSnap  = getFid(env, jclass_RouteCalculationProgress, "timeToSnap", "I");
+	jfield_RouteCalculationProgress_timeToLoad  = getFid(env, jclass_RouteCalculationProgress, "timeToLoad", "I");
+	jfield_RouteCalculationProgress_timeToSearch  = getFid(env, jclass_RouteCalculationProgress, "timeToSearch", "I");
+	jfield_RouteCalculationProgress_timeToConvertResult  = getFid(env, jclass_RouteCalculationProgress, "timeToConvertResult", "I");
 
 	jclass_RoutingConfiguration = findGlobalClass(env, "net/osmand/router/RoutingConfiguration");
 	jfield_RoutingConfiguration_heuristicCoefficient = getFid(env, jclass_RoutingConfiguration, "heuristicCoefficient", "F");
@@ -833,10 +871,40 @@ jobject convertRouteSegmentResultToJava(JNIEnv* ienv, RouteSegmentResult& r, UNO
 	return resobj;
 }
 
+typedef std::pair<uint64_t, uint32_t> LocationIndex;
+
+inline bool compareLocationIndex(const LocationIndex& o1, const LocationIndex& o2) {
+	return o1.first < o2.first;
+}
+
 class NativeRoutingTile {
 public:
 	std::vector<RouteDataObject*> result;
-	UNORDERED(map)<uint64_t, std::vector<RouteDataObject*> > cachedByLocations;
+	// (location, index in result) for each point of each object sorted by location,
+	// location is (x31 << 31) + y31
+	std::vector<LocationIndex> cachedByLocations;
+
+	void indexLocations() {
+		size_t points = 0;
+		for (uint i = 0; i < result.size(); i++) {
+			points += result[i]->pointsX.size();
+		}
+		cachedByLocations.reserve(points);
+		for (uint i = 0; i < result.size(); i++) {
+			for (uint j = 0; j < result[i]->pointsX.size(); j++) {
+				uint64_t lr = ((uint64_t) result[i]->pointsX[j] << 31) + result[i]->pointsY[j];
+				cachedByLocations.push_back(LocationIndex(lr, i));
+			}
+		}
+		// objects of location stay in order of result
+		std::sort(cachedByLocations.begin(), cachedByLocations.end());
+	}
+
+	std::pair<std::vector<LocationIndex>::const_iterator, std::vector<LocationIndex>::const_iterator>
+			findLocation(uint64_t lr) const {
+		return std::equal_range(cachedByLocations.begin(), cachedByLocations.end(), LocationIndex(lr, 0),
+				compareLocationIndex);
+	}
 };
 
 
@@ -851,40 +919,53 @@ extern "C" JNIEXPORT void JNICALL Java_net_osmand_NativeLibrary_deleteRouteSearc
 	delete t;
 }
 
-class RouteCalculationProgressWrapper: public RouteCalculationProgress {
-	JNIEnv* ienv;
-	jobject j;
-public:
-	RouteCalculationProgressWrapper(JNIEnv* ienv, jobject j) : RouteCalculationProgress(),
-			ienv(ienv), j(j)  {
-	}
-	virtual bool isCancelled() {
-		if(j == NULL) {
-			return false;
-		}
-		return ienv->GetBooleanField(j, jfield_RouteCalculationProgress_isCancelled);
+void* getRouteCalculationProgressState(JNIEnv* ienv, jobject j) {
+	if(j == NULL) {
+		return NULL;
 	}
-	virtual void setSegmentNotFound(int s) {
-		if(j != NULL) {
-			ienv->SetIntField(j, jfield_RouteCalculationProgress_segmentNotFound, s);
+	void* state = NULL;
+	jobject buf = ienv->GetObjectField(j, jfield_RouteCalculationProgress_nativeState);
+	if(buf != NULL) {
+		if(ienv->GetDirectBufferCapacity(buf) >= (jlong) sizeof(RouteCalculationProgressState)) {
+			state = ienv->GetDirectBufferAddress(buf);
+		} else {
+			OsmAnd::LogPrintf(OsmAnd::LogSeverityLevel::Error, "Route calculation progress buffer is too small");
 		}
+		ienv->DeleteLocalRef(buf);
+	} else {
+		OsmAnd::LogPrintf(OsmAnd::LogSeverityLevel::Error,
+				"Route calculation progress has no native state, calculation can't be cancelled");
 	}
-	virtual void updateStatus(float distanceFromBegin, int directSegmentQueueSize, float distanceFromEnd,
-			int reverseSegmentQueueSize) {
-		RouteCalculationProgress::updateStatus(distanceFromBegin, directSegmentQueueSize,
-				distanceFromEnd, reverseSegmentQueueSize);
-		if(j != NULL) {
-		   ienv->SetFloatField(j, jfield_RouteCalculationProgress_distanceFromBegin, this->distanceFromBegin);
-		   ienv->SetFloatField(j, jfield_RouteCalculationProgress_distanceFromEnd, this->distanceFromEnd);
-		   ienv->SetIntField(j, jfield_RouteCalculationProgress_directSegmentQueueSize, this->directSegmentQueueSize);
-		   ienv->SetIntField(j, jfield_RouteCalculationProgress_reverseSegmentQueueSize, this->reverseSegmentQueueSize);
-        }
-	}
-};
+	return state;
+}
+
+// progress is updated by search through shared state, fields are only pushed once after calculation
+void pushRouteCalculationProgress(JNIEnv* ienv, jobject j, RouteCalculationProgress* p) {
+	ienv->SetIntField(j, jfield_RouteCalculationProgress_segmentNotFound, p->getSegmentNotFound());
+	ienv->SetFloatField(j, jfield_RouteCalculationProgress_distanceFromBegin, p->getDistanceFromBegin());
+	ienv->SetFloatField(j, jfield_RouteCalculationProgress_distanceFromEnd, p->getDistanceFromEnd());
+	ienv->SetIntField(j, jfield_RouteCalculationProgress_directSegmentQueueSize, p->getDirectSegmentQueueSize());
+	ienv->SetIntField(j, jfield_RouteCalculationProgress_reverseSegmentQueueSize, p->getReverseSegmentQueueSize());
+	const RoutingStatistics& s = p->getStatistics();
+	ienv->SetIntField(j, jfield_RouteCalculationProgress_heapPushes, s.heapPushes);
+	ienv->SetIntField(j, jfield_RouteCalculationProgress_heapPops, s.heapPops);
+	ienv->SetIntField(j, jfield_RouteCalculationProgress_stalePops, s.stalePops);
+	ienv->SetIntField(j, jfield_RouteCalculationProgress_visitedLookups, s.visitedLookups);
+	ienv->SetIntField(j, jfield_RouteCalculationProgress_tilesUnloaded, s.tilesUnloaded);
+	ienv->SetIntField(j, jfield_RouteCalculationProgress_tilesReloaded, s.tilesReloaded);
+	ienv->SetIntField(j, jfield_RouteCalculationProgress_gcRuns, s.gcRuns);
+	ienv->SetLongField(j, jfield_RouteCalculationProgress_ruleEvaluations, s.ruleEvaluations);
+	ienv->SetIntField(j, jfield_RouteCalculationProgress_srLookups, s.srLookups);
+	ienv->SetLongField(j, jfield_RouteCalculationProgress_bytesDecoded, s.bytesDecoded);
+	ienv->SetIntField(j, jfield_RouteCalculationProgress_timeToSnap, s.timeToSnap);
+	ienv->SetIntField(j, jfield_RouteCalculationProgress_timeToLoad, s.timeToLoad);
+	ienv->SetIntField(j, jfield_RouteCalculationProgress_timeToSearch, s.timeToSearch);
+	ienv->SetIntField(j, jfield_RouteCalculationProgress_timeToConvertResult, s.timeToConvertResult);
+}
 
-void parsePrecalculatedRoute(JNIEnv* ienv, RoutingContext& ctx,  jobject precalculatedRoute) {
+void parsePrecalculatedRoute(JNIEnv* ienv, RouteRequest& request,  jobject precalculatedRoute) {
 	if(precalculatedRoute != NULL) {
-		ctx.precalcRoute.empty = false;
+		request.precalculated = true;
 		jintArray pointsY = (jintArray) ienv->GetObjectField(precalculatedRoute, jfield_PrecalculatedRouteDirection_pointsY);
 		jintArray pointsX = (jintArray) ienv->GetObjectField(precalculatedRoute, jfield_PrecalculatedRouteDirection_pointsX);
 		jfloatArray tms = (jfloatArray) ienv->GetObjectField(precalculatedRoute, jfield_PrecalculatedRouteDirection_tms);
@@ -892,22 +973,15 @@ void parsePrecalculatedRoute(JNIEnv* ienv, RoutingContext& ctx,  jobject precalc
 		jint* pointsXF = (jint*)ienv->GetIntArrayElements(pointsX, NULL);
 		jfloat* tmsF = (jfloat*)ienv->GetFloatArrayElements(tms, NULL);
 		for(int k = 0; k < ienv->GetArrayLength(pointsY); k++) {
-			int y = pointsYF[k];
-			int x = pointsXF[k];
-			int ind = ctx.precalcRoute.pointsX.size();
-			ctx.precalcRoute.pointsY.push_back(y);
-			ctx.precalcRoute.pointsX.push_back(x);
-			ctx.precalcRoute.times.push_back(tmsF[k]);
-			SkRect r = SkRect::MakeLTRB(x, y, x, y);
-			ctx.precalcRoute.quadTree.insert(ind, r);
+			request.precalcPointsY.push_back(pointsYF[k]);
+			request.precalcPointsX.push_back(pointsXF[k]);
+			request.precalcTimes.push_back(tmsF[k]);
 		}
-		ctx.precalcRoute.startPoint = ctx.precalcRoute.calc(ctx.startX, ctx.startY);
-		ctx.precalcRoute.endPoint = ctx.precalcRoute.calc(ctx.targetX, ctx.targetY);
-		ctx.precalcRoute.minSpeed = ienv->GetFloatField(precalculatedRoute, jfield_PrecalculatedRouteDirection_minSpeed);
-		ctx.precalcRoute.maxSpeed = ienv->GetFloatField(precalculatedRoute, jfield_PrecalculatedRouteDirection_maxSpeed);
-		ctx.precalcRoute.followNext = ienv->GetBooleanField(precalculatedRoute, jfield_PrecalculatedRouteDirection_followNext);
-		ctx.precalcRoute.startFinishTime = ienv->GetFloatField(precalculatedRoute, jfield_PrecalculatedRouteDirection_startFinishTime);
-		ctx.precalcRoute.endFinishTime = ienv->GetFloatField(precalculatedRoute, jfield_PrecalculatedRouteDirection_endFinishTime);
+		request.precalcMinSpeed = ienv->GetFloatField(precalculatedRoute, jfield_PrecalculatedRouteDirection_minSpeed);
+		request.precalcMaxSpeed = ienv->GetFloatField(precalculatedRoute, jfield_PrecalculatedRouteDirection_maxSpeed);
+		request.precalcFollowNext = ienv->GetBooleanField(precalculatedRoute, jfield_PrecalculatedRouteDirection_followNext);
+		request.precalcStartFinishTime = ienv->GetFloatField(precalculatedRoute, jfield_PrecalculatedRouteDirection_startFinishTime);
+		request.precalcEndFinishTime = ienv->GetFloatField(precalculatedRoute, jfield_PrecalculatedRouteDirection_endFinishTime);
 		ienv->ReleaseIntArrayElements(pointsY, pointsYF, 0);
 		ienv->ReleaseIntArrayElements(pointsX, pointsXF, 0);
 		ienv->ReleaseFloatArrayElements(tms, tmsF, 0);
@@ -930,7 +1004,7 @@ vector<string> convertJArrayToStrings(JNIEnv* ienv, jobjectArray ar) {
 	return res;
 }
 
-void parseRouteAttributeEvalRule(JNIEnv* ienv, jobject rule, RouteAttributeEvalRule* erule, GeneralRouter* router) {
+void parseRouteAttributeEvalRule(JNIEnv* ienv, jobject rule, RoutingRuleDefinition& erule) {
 	jstring jselectValue = (jstring) ienv->GetObjectField(rule, jfield_RouteAttributeEvalRule_selectValueDef);
 	string selectValue = getString(ienv, jselectValue);
 	ienv->DeleteLocalRef(jselectValue);
@@ -941,12 +1015,12 @@ void parseRouteAttributeEvalRule(JNIEnv* ienv, jobject rule, RouteAttributeEvalR
 		ienv->DeleteLocalRef(jselectType);
 	}
 
-	erule->registerSelectValue(selectValue, selectType); 
+	erule.selectValue = selectValue;
+	erule.selectType = selectType;
 
 	jobjectArray ar = (jobjectArray) ienv->CallObjectMethod(rule, jmethod_RouteAttributeEvalRule_getParameters);
-	vector<string> params = convertJArrayToStrings(ienv, ar);
+	erule.parameters = convertJArrayToStrings(ienv, ar);
 	ienv->DeleteLocalRef(ar);
-	erule->registerParamConditions(params); 
 
 	ar = (jobjectArray) ienv->CallObjectMethod(rule, jmethod_RouteAttributeEvalRule_getTagValueCondDefValue);
 	vector<string> tagValueDefValues = convertJArrayToStrings(ienv, ar);
@@ -959,7 +1033,9 @@ void parseRouteAttributeEvalRule(JNIEnv* ienv, jobject rule, RouteAttributeEvalR
 	jbooleanArray tagValueDefNot = (jbooleanArray)ienv->CallObjectMethod(rule, jmethod_RouteAttributeEvalRule_getTagValueCondDefNot);
 	jboolean* nots = ienv->GetBooleanArrayElements(tagValueDefNot, NULL);
 	for(uint i = 0; i < tagValueDefValues.size(); i++) {
-		erule->registerAndTagValueCondition(router, tagValueDefTags[i], tagValueDefValues[i], nots[i]);
+		erule.tags.push_back(tagValueDefTags[i]);
+		erule.values.push_back(tagValueDefValues[i]);
+		erule.nots.push_back(nots[i]);
 	}
 	ienv->ReleaseBooleanArrayElements(tagValueDefNot, nots, 0);
 	ienv->DeleteLocalRef(tagValueDefNot);
@@ -980,15 +1056,17 @@ void parseRouteAttributeEvalRule(JNIEnv* ienv, jobject rule, RouteAttributeEvalR
 			ienv->DeleteLocalRef(jvalueType);
 		}
 
-		RouteAttributeExpression e(values, expressionType, valueType);
-		erule->registerExpression(e);
+		erule.expressionValues.push_back(values);
+		erule.expressionTypes.push_back(expressionType);
+		erule.expressionValueTypes.push_back(valueType);
 		ienv->DeleteLocalRef(expr);
 	}
 	ienv->DeleteLocalRef(expressions);
 
 }
 
-void parseRouteConfiguration(JNIEnv* ienv, RoutingConfiguration& rConfig, jobject jRouteConfig) {
+// router is collected into request and built by createRouteRequestConfiguration, so request could be captured
+void parseRouteConfiguration(JNIEnv* ienv, RouteRequest& rConfig, jobject jRouteConfig) {
 	rConfig.planRoadDirection = ienv->GetIntField(jRouteConfig, jfield_RoutingConfiguration_planRoadDirection);
 	rConfig.heurCoefficient = ienv->GetFloatField(jRouteConfig, jfield_RoutingConfiguration_heuristicCoefficient);
 	rConfig.zoomToLoad = ienv->GetIntField(jRouteConfig, jfield_RoutingConfiguration_ZOOM_TO_LOAD_TILES);
@@ -997,12 +1075,12 @@ void parseRouteConfiguration(JNIEnv* ienv, RoutingConfiguration& rConfig, jobjec
 
 	jobject lrouter = ienv->GetObjectField(jRouteConfig, jfield_RoutingConfiguration_router);
 	jobject router = ienv->NewGlobalRef(lrouter);
-	rConfig.router._restrictionsAware = ienv->GetBooleanField(router, jfield_GeneralRouter_restrictionsAware);
-	rConfig.router.leftTurn = ienv->GetFloatField(router, jfield_GeneralRouter_leftTurn);
-	rConfig.router.roundaboutTurn = ienv->GetFloatField(router, jfield_GeneralRouter_roundaboutTurn);
-	rConfig.router.rightTurn = ienv->GetFloatField(router, jfield_GeneralRouter_rightTurn);
-	rConfig.router.minDefaultSpeed = ienv->GetFloatField(router, jfield_GeneralRouter_minDefaultSpeed);
-	rConfig.router.maxDefaultSpeed = ienv->GetFloatField(router, jfield_GeneralRouter_maxDefaultSpeed);
+	rConfig.restrictionsAware = ienv->GetBooleanField(router, jfield_GeneralRouter_restrictionsAware);
+	rConfig.leftTurn = ienv->GetFloatField(router, jfield_GeneralRouter_leftTurn);
+	rConfig.roundaboutTurn = ienv->GetFloatField(router, jfield_GeneralRouter_roundaboutTurn);
+	rConfig.rightTurn = ienv->GetFloatField(router, jfield_GeneralRouter_rightTurn);
+	rConfig.minDefaultSpeed = ienv->GetFloatField(router, jfield_GeneralRouter_minDefaultSpeed);
+	rConfig.maxDefaultSpeed = ienv->GetFloatField(router, jfield_GeneralRouter_maxDefaultSpeed);
 	// Map<String, String> attributes; // Attributes are not sync not used for calculation
 	// Map<String, RoutingParameter> parameters;  // not used for calculation
 	// Map<String, Integer> universalRules; // dynamically managed
@@ -1014,26 +1092,24 @@ void parseRouteConfiguration(JNIEnv* ienv, RoutingConfiguration& rConfig, jobjec
 	jobjectArray objectAttributes = (jobjectArray) ienv->GetObjectField(router, jfield_GeneralRouter_objectAttributes);
 	for(int i = 0; i < ienv->GetArrayLength(objectAttributes); i++) {
 		// RouteAttributeContext
-		RouteAttributeContext* rctx = rConfig.router.newRouteAttributeContext();
+		rConfig.attributes.push_back(RouteRequestAttributes());
+		RouteRequestAttributes& rctx = rConfig.attributes.back();
 		jobject ctx = ienv->GetObjectArrayElement(objectAttributes, i);
 		jobjectArray ar = (jobjectArray) ienv->CallObjectMethod(ctx, jmethod_RouteAttributeContext_getParamKeys);
-		vector<string> paramKeys = convertJArrayToStrings(ienv, ar);
+		rctx.paramKeys = convertJArrayToStrings(ienv, ar);
 		ienv->DeleteLocalRef(ar);
 		ar = (jobjectArray) ienv->CallObjectMethod(ctx, jmethod_RouteAttributeContext_getParamValues);
-		vector<string> paramValues = convertJArrayToStrings(ienv, ar);
+		rctx.paramValues = convertJArrayToStrings(ienv, ar);
 		ienv->DeleteLocalRef(ar);
 
-		rctx->registerParams(paramKeys, paramValues);
-		
 		jobjectArray rules = (jobjectArray) ienv->CallObjectMethod(ctx, jmethod_RouteAttributeContext_getRules);
 		for(int j = 0; j < ienv->GetArrayLength(rules); j++) {
-			RouteAttributeEvalRule* erule = rctx->newEvaluationRule();
+			rctx.rules.push_back(RoutingRuleDefinition());
 			jobject rule = ienv->GetObjectArrayElement(rules, j);
-			parseRouteAttributeEvalRule(ienv, rule, erule, &rConfig.router);
+			parseRouteAttributeEvalRule(ienv, rule, rctx.rules.back());
 			ienv->DeleteLocalRef(rule);
 		}
 		ienv->DeleteLocalRef(rules);
-		//printf("\n >>>>>>> %d \n", i + 1); rctx->printRules();
 
 		ienv->DeleteLocalRef(ctx);
 	}
@@ -1041,7 +1117,7 @@ void parseRouteConfiguration(JNIEnv* ienv, RoutingConfiguration& rConfig, jobjec
 	if(impassableRoadIds != NULL && ienv->GetArrayLength(impassableRoadIds) > 0) {
 		jlong* iRi = (jlong*)ienv->GetLongArrayElements(impassableRoadIds, NULL);		
 		for(int i = 0; i < ienv->GetArrayLength(impassableRoadIds); i++) {
-			rConfig.router.impassableRoadIds.insert(iRi[i]);
+			rConfig.impassableRoadIds.push_back(iRi[i]);
 		}
 		ienv->ReleaseLongArrayElements(impassableRoadIds, (jlong*)iRi, 0);
 	}
@@ -1054,27 +1130,7 @@ void parseRouteConfiguration(JNIEnv* ienv, RoutingConfiguration& rConfig, jobjec
 
 }
 
-extern "C" JNIEXPORT jobjectArray JNICALL Java_net_osmand_NativeLibrary_nativeRouting(JNIEnv* ienv,
-		jobject obj, jintArray  coordinates, jobject jRouteConfig, jfloat initDirection,
-		jobjectArray regions, jobject progress, jobject precalculatedRoute, bool basemap,
-		bool useSrRouting, jstring srDbPath, int srLevel) {
-	RoutingConfiguration config(initDirection);
-	parseRouteConfiguration(ienv, config, jRouteConfig);
-	RoutingContext c(&config);
-	c.progress = SHARED_PTR<RouteCalculationProgress>(new RouteCalculationProgressWrapper(ienv, progress));
-	int* data = (int*)ienv->GetIntArrayElements(coordinates, NULL);
-	c.startX = data[0];
-	c.startY = data[1];
-	c.targetX = data[2];
-	c.targetY = data[3];
-	c.basemap = basemap;
-    c.useSrRouting = useSrRouting; // INFO set sr routing
-	c.srDbPath = ienv->GetStringUTFChars(srDbPath, NULL); // INFO set sr db path
-	c.srLevel = srLevel; // INFO set sr level
-	parsePrecalculatedRoute(ienv, c, precalculatedRoute);
-	ienv->ReleaseIntArrayElements(coordinates, (jint*)data, 0);
-	vector<RouteSegmentResult> r = searchRouteInternal(&c, false);
-	UNORDERED(map)<int64_t, int> indexes;
+void initRouteRegionIndexes(JNIEnv* ienv, jobjectArray regions, UNORDERED(map)<int64_t, int>& indexes) {
 	for (int t = 0; t< ienv->GetArrayLength(regions); t++) {
 		jobject oreg = ienv->GetObjectArrayElement(regions, t);
 		int64_t fp = ienv->GetIntField(oreg, jfield_RouteRegion_filePointer);
@@ -1082,36 +1138,349 @@ extern "C" JNIEXPORT jobjectArray JNICALL Java_net_osmand_NativeLibrary_nativeRo
 		ienv->DeleteLocalRef(oreg);
 		indexes[(fp <<31) + ln] = t;
 	}
+}
 
-	// convert results
+jobjectArray convertRouteSegmentResultsToJava(JNIEnv* ienv, vector<RouteSegmentResult>& r,
+		UNORDERED(map)<int64_t, int>& indexes, jobjectArray regions) {
 	jobjectArray res = ienv->NewObjectArray(r.size(), jclass_RouteSegmentResult, NULL);
 	for (uint i = 0; i < r.size(); i++) {
 		jobject resobj = convertRouteSegmentResultToJava(ienv, r[i], indexes, regions);
 		ienv->SetObjectArrayElement(res, i, resobj);
 		ienv->DeleteLocalRef(resobj);
 	}
-	if(c.finalRouteSegment.get() != NULL) {
-		ienv->SetFloatField(progress, jfield_RouteCalculationProgress_routingCalculatedTime, c.finalRouteSegment->distanceFromStart);
+	return res;
+}
+
+void parseRouteRequest(JNIEnv* ienv, RouteRequest& request, jintArray coordinates, float initDirection,
+		jobject precalculatedRoute, bool basemap, bool useSrRouting, jstring srDbPath, int srLevel) {
+	int* data = (int*)ienv->GetIntArrayElements(coordinates, NULL);
+	request.startX = data[0];
+	request.startY = data[1];
+	request.targetX = data[2];
+	request.targetY = data[3];
+	ienv->ReleaseIntArrayElements(coordinates, (jint*)data, 0);
+	request.initialDirection = initDirection;
+	request.basemap = basemap;
+	request.useSrRouting = useSrRouting; // INFO set sr routing
+	request.srDbPath = srDbPath == NULL ? "" : getString(ienv, srDbPath); // INFO set sr db path
+	request.srLevel = srLevel; // INFO set sr level
+	parsePrecalculatedRoute(ienv, request, precalculatedRoute);
+}
+
+// parameters of native calculation which are not passed to router
+struct NativeRoutingOptions {
+	// file name of binary search trace (debugging of search, see search_trace tool)
+	string traceFile;
+	// roads attached to route points are not loaded with route, but by nativeLoadAttachedRoads
+	bool lazyAttachedRoads;
+
+	NativeRoutingOptions() : lazyAttachedRoads(false) {
+	}
+};
+
+vector<RouteSegmentResult> calculateRouteWithConfig(JNIEnv* ienv, SHARED_PTR<RoutingConfiguration> config,
+		RouteRequest& request, jobject progress, NativeRoutingOptions& options) {
+	RoutingContext c(config.get());
+	initRouteRequestContext(request, c);
+	if (!options.traceFile.empty()) {
+		c.trace = SearchTrace::open(options.traceFile.c_str());
+	}
+	c.attachRoads = !options.lazyAttachedRoads;
+	c.progress = SHARED_PTR<RouteCalculationProgress>(new RouteCalculationProgress(
+			getRouteCalculationProgressState(ienv, progress)));
+	OsmAnd::ElapsedTimer timer;
+	timer.Start();
+	vector<RouteSegmentResult> r = searchRouteInternal(&c, false);
+	timer.Pause();
+	captureRouteRequest(request, c, r.size(), timer.GetElapsedMs());
+	if(progress != NULL) {
+		if(c.finalRouteSegment.get() != NULL) {
+			ienv->SetFloatField(progress, jfield_RouteCalculationProgress_routingCalculatedTime, c.finalRouteSegment->distanceFromStart);
+		}
+		ienv->SetIntField(progress, jfield_RouteCalculationProgress_visitedSegments, c.visitedSegments);
+		ienv->SetIntField(progress, jfield_RouteCalculationProgress_loadedTiles, c.loadedTiles);
+		pushRouteCalculationProgress(ienv, progress, c.progress.get());
+	}
+	if (options.lazyAttachedRoads) {
+		// latest snapshot is available without progress by handle 0, handle of progress is released by
+		// nativeReleaseRouteSnapshot or replaced by next route
+		int64_t handle = 0;
+		if (r.size() > 0) {
+			handle = publishRouteResultSnapshot(createRouteResultSnapshot(config, &c, r), progress != NULL);
+		}
+		if (progress != NULL) {
+			releaseRouteResultSnapshot(ienv->GetLongField(progress, jfield_RouteCalculationProgress_routeSnapshot));
+			ienv->SetLongField(progress, jfield_RouteCalculationProgress_routeSnapshot, (jlong) handle);
+		}
 	}
-	ienv->SetIntField(progress, jfield_RouteCalculationProgress_visitedSegments, c.visitedSegments);
-	ienv->SetIntField(progress, jfield_RouteCalculationProgress_loadedTiles, c.loadedTiles);
 	if (r.size() == 0) {
 		OsmAnd::LogPrintf(OsmAnd::LogSeverityLevel::Info, "No route found");
 	}
+	return r;
+}
+
+// routing.xml profile with parameters, special parameters of native calculation are not passed to router
+SHARED_PTR<RoutingConfiguration> parseRouteProfile(JNIEnv* ienv, RouteRequest& request, jstring routingXml,
+		jstring routerName, jobjectArray paramKeys, jobjectArray paramValues, NativeRoutingOptions& options) {
+	request.profile = true;
+	request.routingXml = getString(ienv, routingXml);
+	request.routerName = routerName == NULL ? "" : getString(ienv, routerName);
+	vector<string> keys = convertJArrayToStrings(ienv, paramKeys);
+	vector<string> vls = convertJArrayToStrings(ienv, paramValues);
+	for (uint i = 0; i < keys.size() && i < vls.size(); i++) {
+		if (keys[i] == "departure_time") {
+			// departure time (seconds since Monday 00:00 local time) enables time dependent routing with loaded speed profile
+			request.departureTime = atoi(vls[i].c_str());
+		} else if (keys[i] == "search_trace") {
+			options.traceFile = vls[i];
+		} else if (keys[i] == "lazy_attached_roads") {
+			options.lazyAttachedRoads = vls[i] == "true";
+		} else {
+			request.paramKeys.push_back(keys[i]);
+			request.paramValues.push_back(vls[i]);
+		}
+	}
+	return createRouteRequestConfiguration(request);
+}
+
+jobjectArray nativeRoutingWithConfig(JNIEnv* ienv, SHARED_PTR<RoutingConfiguration> config, RouteRequest& request,
+		jobjectArray regions, jobject progress, NativeRoutingOptions& options) {
+	vector<RouteSegmentResult> r = calculateRouteWithConfig(ienv, config, request, progress, options);
+	UNORDERED(map)<int64_t, int> indexes;
+	initRouteRegionIndexes(ienv, regions, indexes);
+
+	// convert results
+	jobjectArray res = convertRouteSegmentResultsToJava(ienv, r, indexes, regions);
+	fflush(stdout);
+	return res;
+}
+
+extern "C" JNIEXPORT jobjectArray JNICALL Java_net_osmand_NativeLibrary_nativeRouting(JNIEnv* ienv,
+		jobject obj, jintArray  coordinates, jobject jRouteConfig, jfloat initDirection,
+		jobjectArray regions, jobject progress, jobject precalculatedRoute, bool basemap,
+		bool useSrRouting, jstring srDbPath, int srLevel) {
+	RouteRequest request;
+	parseRouteRequest(ienv, request, coordinates, initDirection, precalculatedRoute, basemap, useSrRouting,
+			srDbPath, srLevel);
+	parseRouteConfiguration(ienv, request, jRouteConfig);
+	SHARED_PTR<RoutingConfiguration> config = createRouteRequestConfiguration(request);
+	NativeRoutingOptions options;
+	return nativeRoutingWithConfig(ienv, config, request, regions, progress, options);
+}
+
+//	protected static native RouteSegmentResult[] nativeRoutingWithProfile(int[] coordinates, String routingXml, String routerName,
+//			String[] paramKeys, String[] paramValues, float initDirection, RouteRegion[] regions, RouteCalculationProgress progress,
+//			PrecalculatedRouteDirection precalculatedRoute, boolean basemap, boolean useSrRouting, String srDbPath, int srLevel);
+extern "C" JNIEXPORT jobjectArray JNICALL Java_net_osmand_NativeLibrary_nativeRoutingWithProfile(JNIEnv* ienv,
+		jobject obj, jintArray  coordinates, jstring routingXml, jstring routerName, jobjectArray paramKeys,
+		jobjectArray paramValues, jfloat initDirection, jobjectArray regions, jobject progress,
+		jobject precalculatedRoute, bool basemap, bool useSrRouting, jstring srDbPath, int srLevel) {
+	RouteRequest request;
+	parseRouteRequest(ienv, request, coordinates, initDirection, precalculatedRoute, basemap, useSrRouting,
+			srDbPath, srLevel);
+	NativeRoutingOptions options;
+	SHARED_PTR<RoutingConfiguration> config = parseRouteProfile(ienv, request, routingXml, routerName, paramKeys,
+			paramValues, options);
+	if (config.get() == NULL) {
+		throwNewException(ienv, "Routing configuration can not be loaded");
+		return NULL;
+	}
+	return nativeRoutingWithConfig(ienv, config, request, regions, progress, options);
+}
+
+//	protected static native ByteBuffer nativeRoutingWithProfileBuffer(int[] coordinates, String routingXml, String routerName,
+//			String[] paramKeys, String[] paramValues, float initDirection, RouteRegion[] regions, RouteCalculationProgress progress,
+//			PrecalculatedRouteDirection precalculatedRoute, boolean basemap, boolean useSrRouting, String srDbPath, int srLevel);
+// result is flat buffer (see routeResultBuffer.h) which should be released by nativeReleaseRouteResultBuffer
+extern "C" JNIEXPORT jobject JNICALL Java_net_osmand_NativeLibrary_nativeRoutingWithProfileBuffer(JNIEnv* ienv,
+		jobject obj, jintArray  coordinates, jstring routingXml, jstring routerName, jobjectArray paramKeys,
+		jobjectArray paramValues, jfloat initDirection, jobjectArray regions, jobject progress,
+		jobject precalculatedRoute, bool basemap, bool useSrRouting, jstring srDbPath, int srLevel) {
+	RouteRequest request;
+	parseRouteRequest(ienv, request, coordinates, initDirection, precalculatedRoute, basemap, useSrRouting,
+			srDbPath, srLevel);
+	NativeRoutingOptions options;
+	SHARED_PTR<RoutingConfiguration> config = parseRouteProfile(ienv, request, routingXml, routerName, paramKeys,
+			paramValues, options);
+	if (config.get() == NULL) {
+		throwNewException(ienv, "Routing configuration can not be loaded");
+		return NULL;
+	}
+	vector<RouteSegmentResult> r = calculateRouteWithConfig(ienv, config, request, progress, options);
+	UNORDERED(map)<int64_t, int> indexes;
+	initRouteRegionIndexes(ienv, regions, indexes);
+	size_t size = writeRouteResultBuffer(r, indexes, NULL);
+	uint8_t* data = (uint8_t*) malloc(size);
+	if (data == NULL) {
+		throwNewException(ienv, "Route result buffer can not be allocated");
+		return NULL;
+	}
+	writeRouteResultBuffer(r, indexes, data);
 	fflush(stdout);
+	return ienv->NewDirectByteBuffer(data, size);
+}
+
+//	protected static native void nativeReleaseRouteResultBuffer(ByteBuffer buffer);
+extern "C" JNIEXPORT void JNICALL Java_net_osmand_NativeLibrary_nativeReleaseRouteResultBuffer(JNIEnv* ienv,
+		jobject obj, jobject buffer) {
+	if (buffer != NULL) {
+		free(ienv->GetDirectBufferAddress(buffer));
+	}
+}
+
+//	protected static native RouteSegmentResult[][] nativeLoadAttachedRoads(long snapshot, int segment,
+//			RouteRegion[] regions);
+// roads attached to points of route segment (route was calculated with lazy_attached_roads), snapshot 0 - latest route
+extern "C" JNIEXPORT jobjectArray JNICALL Java_net_osmand_NativeLibrary_nativeLoadAttachedRoads(JNIEnv* ienv,
+		jobject obj, jlong ref, jint segment, jobjectArray regions) {
+	// snapshot is kept alive by load even if it is released meanwhile
+	SHARED_PTR<RouteResultSnapshot> snapshot = getRouteResultSnapshot(ref);
+	RouteSegmentResult attached(SHARED_PTR<RouteDataObject>(), 0, 0);
+	if (snapshot.get() == NULL || segment < 0 || !loadAttachedRoads(snapshot.get(), segment, attached)) {
+		return NULL;
+	}
+	UNORDERED(map)<int64_t, int> indexes;
+	initRouteRegionIndexes(ienv, regions, indexes);
+	jobjectArray res = ienv->NewObjectArray(attached.attachedRoutes.size(), jclass_RouteSegmentResultAr, NULL);
+	for (jsize k = 0; k < (jsize) attached.attachedRoutes.size(); k++) {
+		jobjectArray art = convertRouteSegmentResultsToJava(ienv, attached.attachedRoutes[k], indexes, regions);
+		ienv->SetObjectArrayElement(res, k, art);
+		ienv->DeleteLocalRef(art);
+	}
+	return res;
+}
+
+//	protected static native void nativeReleaseRouteSnapshot(long snapshot);
+extern "C" JNIEXPORT void JNICALL Java_net_osmand_NativeLibrary_nativeReleaseRouteSnapshot(JNIEnv* ienv,
+		jobject obj, jlong ref) {
+	releaseRouteResultSnapshot(ref);
+}
+
+//	protected static native void nativeSetRouteRequestCapture(String directory, int minCalculationTime);
+extern "C" JNIEXPORT void JNICALL Java_net_osmand_NativeLibrary_nativeSetRouteRequestCapture(JNIEnv* ienv,
+		jobject obj, jstring directory, jint minCalculationTime) {
+	// null disables capture
+	setRouteRequestCapture(directory == NULL ? "" : getString(ienv, directory), minCalculationTime);
+}
+
+//	protected static native RouteSegmentResult[][] nativeOptimizeRouteOrder(int[] coordinates, int[] timeWindows,
+//			String routingXml, String routerName, String[] paramKeys, String[] paramValues, boolean roundTrip,
+//			int threads, RouteRegion[] regions, int[] order);
+extern "C" JNIEXPORT jobjectArray JNICALL Java_net_osmand_NativeLibrary_nativeOptimizeRouteOrder(JNIEnv* ienv,
+		jobject obj, jintArray coordinates, jintArray timeWindows, jstring routingXml, jstring routerName,
+		jobjectArray paramKeys, jobjectArray paramValues, jboolean roundTrip, jint threads, jobjectArray regions,
+		jintArray order) {
+	RouteOptimizerParams params;
+	params.routingXml = getString(ienv, routingXml);
+	params.router = routerName == NULL ? "" : getString(ienv, routerName);
+	vector<string> keys = convertJArrayToStrings(ienv, paramKeys);
+	vector<string> vls = convertJArrayToStrings(ienv, paramValues);
+	for (uint i = 0; i < keys.size() && i < vls.size(); i++) {
+		params.params[keys[i]] = vls[i];
+	}
+	params.roundTrip = roundTrip;
+	if (threads > 0) {
+		params.threads = threads;
+	}
+	// coordinates are x31, y31 pairs, time windows (optional) are earliest, latest, service time triples
+	vector<RouteOptimizerStop> stops;
+	int sz = ienv->GetArrayLength(coordinates) / 2;
+	int* data = (int*)ienv->GetIntArrayElements(coordinates, NULL);
+	for (int i = 0; i < sz; i++) {
+		stops.push_back(RouteOptimizerStop(data[2 * i], data[2 * i + 1]));
+	}
+	ienv->ReleaseIntArrayElements(coordinates, (jint*)data, JNI_ABORT);
+	if (timeWindows != NULL && ienv->GetArrayLength(timeWindows) >= 3 * sz) {
+		int* tw = (int*)ienv->GetIntArrayElements(timeWindows, NULL);
+		for (int i = 0; i < sz; i++) {
+			stops[i].earliest = tw[3 * i];
+			stops[i].latest = tw[3 * i + 1];
+			stops[i].serviceTime = tw[3 * i + 2];
+		}
+		ienv->ReleaseIntArrayElements(timeWindows, (jint*)tw, JNI_ABORT);
+	}
+	RouteOptimizerResult result;
+	if (!optimizeRouteOrder(stops, params, result)) {
+		return NULL;
+	}
+	if (order != NULL && ienv->GetArrayLength(order) >= (int) result.order.size()) {
+		ienv->SetIntArrayRegion(order, 0, result.order.size(), (jint*) &result.order[0]);
+	}
+	UNORDERED(map)<int64_t, int> indexes;
+	initRouteRegionIndexes(ienv, regions, indexes);
+	jobjectArray res = ienv->NewObjectArray(result.legs.size(), jclass_RouteSegmentResultAr, NULL);
+	for (uint i = 0; i < result.legs.size(); i++) {
+		jobjectArray leg = convertRouteSegmentResultsToJava(ienv, result.legs[i], indexes, regions);
+		ienv->SetObjectArrayElement(res, i, leg);
+		ienv->DeleteLocalRef(leg);
+	}
 	return res;
 }
 
+//	protected static native boolean nativeLoadSpeedProfile(String fileName);
+extern "C" JNIEXPORT jboolean JNICALL Java_net_osmand_NativeLibrary_nativeLoadSpeedProfile(JNIEnv* ienv,
+		jobject obj, jstring fileName) {
+	string f = fileName == NULL ? "" : getString(ienv, fileName);
+	SHARED_PTR<SpeedProfile> profile = loadSpeedProfile(f.c_str());
+	return f.empty() || profile.get() != NULL;
+}
+
+//	protected static native boolean nativeLoadRoutingGraph(String[] files);
+extern "C" JNIEXPORT jboolean JNICALL Java_net_osmand_NativeLibrary_nativeLoadRoutingGraph(JNIEnv* ienv,
+		jobject obj, jobjectArray files) {
+	// null unloads graph, empty array loads all opened files
+	if (files == NULL) {
+		unloadRoutingGraph();
+		return true;
+	}
+	vector<string> names = convertJArrayToStrings(ienv, files);
+	return loadRoutingGraph(names).get() != NULL;
+}
+
+//	protected static native void nativeSetSharedRouteTilesLimit(int limitMb);
+extern "C" JNIEXPORT void JNICALL Java_net_osmand_NativeLibrary_nativeSetSharedRouteTilesLimit(JNIEnv* ienv,
+		jobject obj, jint limitMb) {
+	setSharedRouteTilesLimit(limitMb);
+}
+
+//	protected static native void nativeSetIdleRoutingScratchesLimit(int limit);
+extern "C" JNIEXPORT void JNICALL Java_net_osmand_NativeLibrary_nativeSetIdleRoutingScratchesLimit(JNIEnv* ienv,
+		jobject obj, jint limit) {
+	setIdleRoutingScratchesLimit(limit);
+}
+
+//	protected static native long nativeUpdateEdgeOverlay(long[] roadIds, float[] factors);
+extern "C" JNIEXPORT jlong JNICALL Java_net_osmand_NativeLibrary_nativeUpdateEdgeOverlay(JNIEnv* ienv,
+		jobject obj, jlongArray roadIds, jfloatArray factors) {
+	std::vector<EdgeOverlayUpdate> updates;
+	int sz = std::min(ienv->GetArrayLength(roadIds), ienv->GetArrayLength(factors));
+	jlong* ids = (jlong*)ienv->GetLongArrayElements(roadIds, NULL);
+	jfloat* fs = (jfloat*)ienv->GetFloatArrayElements(factors, NULL);
+	for (int i = 0; i < sz; i++) {
+		updates.push_back(EdgeOverlayUpdate(ids[i], fs[i]));
+	}
+	ienv->ReleaseLongArrayElements(roadIds, ids, JNI_ABORT);
+	ienv->ReleaseFloatArrayElements(factors, fs, JNI_ABORT);
+	return getEdgeOverlay().update(updates);
+}
+
+//	protected static native long nativeClearEdgeOverlay();
+extern "C" JNIEXPORT jlong JNICALL Java_net_osmand_NativeLibrary_nativeClearEdgeOverlay(JNIEnv* ienv, jobject obj) {
+	return getEdgeOverlay().clear();
+}
+
 //	protected static native RouteDataObject[] getRouteDataObjects(NativeRouteSearchResult rs, int x31, int y31!);
 extern "C" JNIEXPORT jobjectArray JNICALL Java_net_osmand_NativeLibrary_getRouteDataObjects(JNIEnv* ienv,
 		jobject obj, jobject reg, jlong ref, jint x31, jint y31) {
 
 	NativeRoutingTile* t = (NativeRoutingTile*) ref;
 	uint64_t lr = ((uint64_t) x31 << 31) + y31;
-	std::vector<RouteDataObject*> collected = t->cachedByLocations[lr];
-	jobjectArray res = ienv->NewObjectArray(collected.size(), jclass_RouteDataObject, NULL);
-	for (jint i = 0; i < (int)collected.size(); i++) {
-		jobject robj = convertRouteDataObjectToJava(ienv, collected[i], reg);
+	std::pair<std::vector<LocationIndex>::const_iterator, std::vector<LocationIndex>::const_iterator> collected =
+			t->findLocation(lr);
+	jobjectArray res = ienv->NewObjectArray(collected.second - collected.first, jclass_RouteDataObject, NULL);
+	jint i = 0;
+	for (std::vector<LocationIndex>::const_iterator it = collected.first; it != collected.second; it++, i++) {
+		jobject robj = convertRouteDataObjectToJava(ienv, t->result[it->second], reg);
 		ienv->SetObjectArrayElement(res, i, robj);
 		ienv->DeleteLocalRef(robj);
 	}
@@ -1160,14 +1529,9 @@ extern "C" JNIEXPORT jobject JNICALL Java_net_osmand_NativeLibrary_loadRoutingDa
 		for (jint i = 0; i < (int)result.size(); i++) {
 			if (result[i] != NULL) {
 				r->result.push_back(result[i]);
-				for (jint j = 0; j < (int)result[i]->pointsX.size(); j++) {
-					jint x = result[i]->pointsX[j];
-					jint y = result[i]->pointsY[j];
-					uint64_t lr = ((uint64_t) x << 31) + y;
-					r->cachedByLocations[lr].push_back(result[i]);
-				}
 			}
 		}
+		r->indexLocations();
 		jlong ref = (jlong) r;
 		if(r->result.size() == 0) {
 			ref = 0;
@@ -0,0 +1,84 @@
+#ifndef _OSMAND_MAPPED_FILE_CPP
+#define _OSMAND_MAPPED_FILE_CPP
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+#include "mappedFile.h"
+#include "Logging.h"
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+void MappedFile::close() {
+	if (data != NULL) {
+#if !defined(_WIN32)
+		if (mapped) {
+			munmap((void*) data, size);
+		} else {
+			delete[] data;
+		}
+#else
+		delete[] data;
+#endif
+	}
+	data = NULL;
+	size = 0;
+	mapped = false;
+}
+
+bool MappedFile::open(const char* fname, bool mapOnly) {
+	close();
+	filename = fname;
+	int fd = ::open(fname, O_RDONLY | O_BINARY);
+	if (fd < 0) {
+		return false;
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0) {
+		::close(fd);
+		return false;
+	}
+	size = st.st_size;
+#if !defined(_WIN32)
+	void* m = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+	if (m != MAP_FAILED) {
+		data = (const uint8_t*) m;
+		mapped = true;
+	}
+#endif
+	if (data == NULL && mapOnly) {
+		::close(fd);
+		close();
+		return false;
+	}
+	if (data == NULL) {
+		// no mmap available, read whole file
+		uint8_t* buf = new uint8_t[size];
+		size_t read = 0;
+		while (read < size) {
+			int r = ::read(fd, buf + read, size - read);
+			if (r <= 0) {
+				break;
+			}
+			read += r;
+		}
+		data = buf;
+		if (read < size) {
+			OsmAnd::LogPrintf(OsmAnd::LogSeverityLevel::Error, "File %s can not be read", fname);
+			::close(fd);
+			close();
+			return false;
+		}
+	}
+	::close(fd);
+	return true;
+}
+
+#endif /*_OSMAND_MAPPED_FILE_CPP*/
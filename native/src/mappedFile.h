@@ -0,0 +1,54 @@
+#ifndef _OSMAND_MAPPED_FILE_H
+#define _OSMAND_MAPPED_FILE_H
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+
+/**
+ * Read-only file mapped into memory (file is read into memory where mmap is not available)
+ */
+class MappedFile {
+private:
+	std::string filename;
+	const uint8_t* data;
+	size_t size;
+	bool mapped;
+
+	MappedFile(const MappedFile&);
+	MappedFile& operator=(const MappedFile&);
+
+public:
+	MappedFile() : data(NULL), size(0), mapped(false) {
+	}
+
+	~MappedFile() {
+		close();
+	}
+
+	// mapOnly - open fails instead of reading whole file into memory if it can't be mapped
+	bool open(const char* filename, bool mapOnly = false);
+	void close();
+
+	bool isOpened() const {
+		return data != NULL;
+	}
+
+	const std::string& getFilename() const {
+		return filename;
+	}
+
+	const uint8_t* getData() const {
+		return data;
+	}
+
+	size_t getSize() const {
+		return size;
+	}
+
+	// false if file was read into memory (no mmap)
+	bool isMapped() const {
+		return mapped;
+	}
+};
+
+#endif /*_OSMAND_MAPPED_FILE_H*/
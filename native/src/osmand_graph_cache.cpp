@@ -0,0 +1,57 @@
+#include "binaryRead.h"
+#include "routingGraphCache.h"
+#include <stdio.h>
+
+// Converts route data of obf files into routing graph cache files (<obf>.rgc),
+// which are picked up automatically by initBinaryMapFile next time obf is opened.
+
+void printUsage(std::string info) {
+	if (info.size() > 0) {
+		printf("%s\n", info.c_str());
+	}
+	printf("Usage : graph_cache [-output=file.rgc] file.obf [file.obf ...]\n");
+	printf("  Writes routing graph cache next to each obf file (output could be set for single file).\n");
+}
+
+int main(int argc, char** argv) {
+	char s[1024];
+	string output;
+	vector<string> files;
+	for (int i = 1; i < argc; i++) {
+		if (sscanf(argv[i], "-output=%1023s", s) == 1) {
+			output = s;
+		} else if (argv[i][0] != '-') {
+			files.push_back(argv[i]);
+		} else {
+			printUsage(string("Unknown parameter ") + argv[i]);
+			return 1;
+		}
+	}
+	if (files.empty() || (!output.empty() && files.size() > 1)) {
+		printUsage("Wrong parameters");
+		return 1;
+	}
+	int result = 0;
+	for (uint i = 0; i < files.size(); i++) {
+		// files are converted one by one, so only route data of converted file is found
+		BinaryMapFile* file = initBinaryMapFile(files[i]);
+		if (file == NULL) {
+			printf("File %s can not be opened\n", files[i].c_str());
+			result = 1;
+			continue;
+		}
+		// existing cache is rewritten from obf data
+		file->graphCache.reset();
+		string cacheFile = output.empty() ? getRoutingGraphCacheName(file) : output;
+		if (file->routingIndexes.empty()) {
+			printf("File %s has no routing data\n", files[i].c_str());
+		} else if (!writeRoutingGraphCache(file, cacheFile.c_str())) {
+			printf("Cache %s can not be written\n", cacheFile.c_str());
+			result = 1;
+		} else {
+			printf("Cache %s is written\n", cacheFile.c_str());
+		}
+		closeBinaryMapFile(files[i]);
+	}
+	return result;
+}
@@ -0,0 +1,216 @@
+#include "binaryRead.h"
+#include "renderRules.h"
+#include "Logging.h"
+#include <stdio.h>
+#include <string.h>
+#include <thread>
+#include <atomic>
+#include <chrono>
+
+// Multithreaded map repository benchmark : runs the same set of rendering and routing data queries with
+// increasing number of threads while another thread closes and reopens files, so concurrent reads of one
+// file and changes of repository during queries could be checked.
+
+struct ConcurrencyQuery {
+	int left;
+	int right;
+	int top;
+	int bottom;
+	bool routing;
+	// objects found by single threaded run, concurrent runs without reopening should match it
+	int objects;
+};
+
+struct ConcurrencyParams {
+	string renderingXml;
+	int maxThreads;
+	int iterations;
+	int zoom;
+	bool reopen;
+	int left;
+	int right;
+	int top;
+	int bottom;
+	vector<ConcurrencyQuery> queries;
+	vector<string> files;
+
+	ConcurrencyParams() : maxThreads(4), iterations(3), zoom(14), reopen(false), left(0), right(0), top(0),
+			bottom(0) {
+	}
+};
+
+void printUsage(std::string info) {
+	if (info.size() > 0) {
+		printf("%s\n", info.c_str());
+	}
+	printf("Usage : map_concurrency -bbox=topLat,leftLon,bottomLat,rightLon [-renderingXml=default.render.xml]\n");
+	printf("           [-zoom=14] [-threads=4] [-iterations=3] [-reopen] file.obf [file.obf ...]\n");
+	printf("  Reads tiles of bbox (routing data and map objects if rendering style is set) with 1, 2, 4 ... threads\n");
+	printf("  and prints throughput and scaling.\n");
+	printf("  -reopen closes and reopens files in separate thread while queries run.\n");
+}
+
+bool parseParams(int argc, char** argv, ConcurrencyParams& p) {
+	char s[1024];
+	int n;
+	double lat1, lon1, lat2, lon2;
+	bool bbox = false;
+	for (int i = 1; i < argc; i++) {
+		if (sscanf(argv[i], "-renderingXml=%1023s", s) == 1) {
+			p.renderingXml = s;
+		} else if (sscanf(argv[i], "-zoom=%d", &n) == 1) {
+			p.zoom = n;
+		} else if (sscanf(argv[i], "-threads=%d", &n) == 1) {
+			p.maxThreads = n;
+		} else if (sscanf(argv[i], "-iterations=%d", &n) == 1) {
+			p.iterations = n;
+		} else if (strcmp(argv[i], "-reopen") == 0) {
+			p.reopen = true;
+		} else if (sscanf(argv[i], "-bbox=%lg,%lg,%lg,%lg", &lat1, &lon1, &lat2, &lon2) == 4) {
+			p.left = get31TileNumberX(lon1);
+			p.top = get31TileNumberY(lat1);
+			p.right = get31TileNumberX(lon2);
+			p.bottom = get31TileNumberY(lat2);
+			bbox = true;
+		} else if (argv[i][0] != '-') {
+			p.files.push_back(argv[i]);
+		} else {
+			printUsage(string("Unknown parameter ") + argv[i]);
+			return false;
+		}
+	}
+	if (!bbox || p.files.empty() || p.zoom < 1 || p.zoom > 20) {
+		printUsage("Missing parameters");
+		return false;
+	}
+	// tiles of bbox, rendering and routing queries of each tile
+	int shift = 31 - p.zoom;
+	for (int x = p.left >> shift; x <= p.right >> shift; x++) {
+		for (int y = p.top >> shift; y <= p.bottom >> shift; y++) {
+			ConcurrencyQuery q;
+			q.left = x << shift;
+			q.right = (x + 1) << shift;
+			q.top = y << shift;
+			q.bottom = (y + 1) << shift;
+			q.objects = 0;
+			q.routing = true;
+			p.queries.push_back(q);
+			if (!p.renderingXml.empty()) {
+				q.routing = false;
+				p.queries.push_back(q);
+			}
+		}
+	}
+	return true;
+}
+
+int readRoutingData(ConcurrencyQuery& r) {
+	ResultPublisher publisher;
+	SearchQuery q(r.left, r.right, r.top, r.bottom, NULL, &publisher);
+	std::vector<RouteSubregion> subregions;
+	searchRouteSubregions(&q, subregions, false);
+	int objects = 0;
+	for (uint i = 0; i < subregions.size(); i++) {
+		std::vector<RouteDataObject*> list;
+		searchRouteDataForSubRegion(&q, list, &subregions[i]);
+		for (uint j = 0; j < list.size(); j++) {
+			if (list[j] != NULL) {
+				objects++;
+				delete list[j];
+			}
+		}
+	}
+	return objects;
+}
+
+int readMapObjects(ConcurrencyParams& p, ConcurrencyQuery& r, RenderingRulesStorage* storage) {
+	RenderingRuleSearchRequest req(storage);
+	ResultPublisher publisher;
+	SearchQuery q(r.left, r.right, r.top, r.bottom, &req, &publisher);
+	q.zoom = p.zoom;
+	int renderedState = 0;
+	return searchObjectsForRendering(&q, true, "", renderedState)->result.size();
+}
+
+int readQuery(ConcurrencyParams& p, ConcurrencyQuery& r, RenderingRulesStorage* storage) {
+	return r.routing ? readRoutingData(r) : readMapObjects(p, r, storage);
+}
+
+int main(int argc, char** argv) {
+	ConcurrencyParams p;
+	if (!parseParams(argc, argv, p)) {
+		return 1;
+	}
+	for (uint i = 0; i < p.files.size(); i++) {
+		if (initBinaryMapFile(p.files[i]) == NULL) {
+			printf("File %s can not be opened\n", p.files[i].c_str());
+			return 1;
+		}
+	}
+	// storage is only read by queries
+	RenderingRulesStorage* storage = NULL;
+	if (!p.renderingXml.empty()) {
+		storage = new RenderingRulesStorage(p.renderingXml.c_str());
+		storage->parseRulesFromXmlInputStream(p.renderingXml.c_str(), NULL);
+	}
+	// reference results
+	for (uint i = 0; i < p.queries.size(); i++) {
+		p.queries[i].objects = readQuery(p, p.queries[i], storage);
+	}
+	printf("%d queries of %d tiles\n", (int) p.queries.size(), (int) p.queries.size() / (storage != NULL ? 2 : 1));
+	double singleRate = 0;
+	for (int threads = 1; threads <= p.maxThreads; threads *= 2) {
+		std::atomic<int> next(0);
+		std::atomic<int> mismatches(0);
+		std::atomic<bool> finished(false);
+		int reopened = 0;
+		int total = p.iterations * p.queries.size() * threads;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		vector<std::thread> workers;
+		for (int t = 0; t < threads; t++) {
+			workers.push_back(std::thread([&]() {
+				int task;
+				while ((task = next++) < total) {
+					ConcurrencyQuery& r = p.queries[task % p.queries.size()];
+					if (readQuery(p, r, storage) != r.objects) {
+						mismatches++;
+					}
+				}
+			}));
+		}
+		std::thread reopener;
+		if (p.reopen) {
+			reopener = std::thread([&]() {
+				while (!finished) {
+					string& file = p.files[reopened++ % p.files.size()];
+					closeBinaryMapFile(file);
+					if (initBinaryMapFile(file) == NULL) {
+						printf("File %s can not be reopened\n", file.c_str());
+						return;
+					}
+				}
+			});
+		}
+		for (uint t = 0; t < workers.size(); t++) {
+			workers[t].join();
+		}
+		finished = true;
+		if (reopener.joinable()) {
+			reopener.join();
+		}
+		double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		double rate = total / sec;
+		if (threads == 1) {
+			singleRate = rate;
+		}
+		// queries running while their file is closed find less objects
+		printf("threads %d : %d queries in %.2f s, %.2f queries/s, scaling %.2f, mismatches %d%s, reopened %d\n",
+				threads, total, sec, rate, singleRate > 0 ? rate / singleRate : 0, mismatches.load(),
+				p.reopen ? " (expected with reopen)" : "", reopened);
+	}
+	for (uint i = 0; i < p.files.size(); i++) {
+		closeBinaryMapFile(p.files[i]);
+	}
+	delete storage;
+	return 0;
+}
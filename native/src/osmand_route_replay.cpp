@@ -0,0 +1,163 @@
+#include "binaryRead.h"
+#include "binaryRoutePlanner.h"
+#include "routeRequest.h"
+#include "ElapsedTimer.h"
+#include <stdio.h>
+#include <string.h>
+
+// Replays captured route requests (nativeSetRouteRequestCapture) and compares results with captured ones :
+// visited segments don't depend on device, so they are main measure of search regressions.
+
+struct ReplayParams {
+	int iterations;
+	// allowed growth (percent) of visited segments and calculation time
+	int tolerance;
+	// directory with obf files (captured paths are device paths)
+	string mapsDir;
+	// routing.xml for requests of routing.xml profiles
+	string routingXml;
+	vector<string> requests;
+
+	ReplayParams() : iterations(3), tolerance(20) {
+	}
+};
+
+void printUsage(std::string info) {
+	if (info.size() > 0) {
+		printf("%s\n", info.c_str());
+	}
+	printf("Usage : route_replay [-iterations=3] [-tolerance=20] [-mapsDir=dir] [-routingXml=routing.xml]\n");
+	printf("           request.req [request.req ...]\n");
+	printf("  Recalculates captured requests and reports changed routes and regressions (visited segments,\n");
+	printf("  best calculation time) above tolerance percent.\n");
+}
+
+bool parseParams(int argc, char** argv, ReplayParams& p) {
+	char s[1024];
+	int n;
+	for (int i = 1; i < argc; i++) {
+		if (sscanf(argv[i], "-iterations=%d", &n) == 1) {
+			p.iterations = std::max(1, n);
+		} else if (sscanf(argv[i], "-tolerance=%d", &n) == 1) {
+			p.tolerance = n;
+		} else if (sscanf(argv[i], "-mapsDir=%1023s", s) == 1) {
+			p.mapsDir = s;
+		} else if (sscanf(argv[i], "-routingXml=%1023s", s) == 1) {
+			p.routingXml = s;
+		} else if (argv[i][0] != '-') {
+			p.requests.push_back(argv[i]);
+		} else {
+			printUsage(string("Unknown parameter ") + argv[i]);
+			return false;
+		}
+	}
+	if (p.requests.empty()) {
+		printUsage("Missing requests");
+		return false;
+	}
+	return true;
+}
+
+string mapFileName(ReplayParams& p, const string& file) {
+	if (p.mapsDir.empty()) {
+		return file;
+	}
+	size_t slash = file.find_last_of('/');
+	return p.mapsDir + "/" + (slash == string::npos ? file : file.substr(slash + 1));
+}
+
+// files of previous request are closed, so only captured files are used for routing
+bool openRequestFiles(ReplayParams& p, RouteRequest& request, vector<string>& opened) {
+	vector<string> files;
+	for (uint i = 0; i < request.files.size(); i++) {
+		files.push_back(mapFileName(p, request.files[i]));
+	}
+	if (files == opened) {
+		return true;
+	}
+	for (uint i = 0; i < opened.size(); i++) {
+		closeBinaryMapFile(opened[i]);
+	}
+	opened.clear();
+	for (uint i = 0; i < files.size(); i++) {
+		if (initBinaryMapFile(files[i]) == NULL) {
+			printf("File %s can not be opened\n", files[i].c_str());
+			return false;
+		}
+		opened.push_back(files[i]);
+	}
+	return true;
+}
+
+bool exceeds(int value, int captured, int tolerance) {
+	return captured > 0 && value > captured * (100 + tolerance) / 100.0;
+}
+
+int main(int argc, char** argv) {
+	ReplayParams p;
+	if (!parseParams(argc, argv, p)) {
+		return 1;
+	}
+	vector<string> opened;
+	int regressions = 0;
+	int changed = 0;
+	for (uint i = 0; i < p.requests.size(); i++) {
+		RouteRequest request;
+		if (!readRouteRequest(p.requests[i].c_str(), request)) {
+			printf("%s : request can not be read\n", p.requests[i].c_str());
+			regressions++;
+			continue;
+		}
+		if (request.profile && !p.routingXml.empty()) {
+			request.routingXml = p.routingXml;
+		}
+		if (!request.speedProfileFile.empty()) {
+			// speed profile is looked up next to obf files as well
+			request.speedProfileFile = mapFileName(p, request.speedProfileFile);
+		}
+		if (!openRequestFiles(p, request, opened)) {
+			regressions++;
+			continue;
+		}
+		int bestTime = -1;
+		int segments = 0;
+		int visited = 0;
+		float routeTime = 0;
+		for (int it = 0; it < p.iterations; it++) {
+			SHARED_PTR<RoutingConfiguration> config = createRouteRequestConfiguration(request);
+			if (config.get() == NULL) {
+				printf("%s : routing configuration can not be loaded\n", p.requests[i].c_str());
+				break;
+			}
+			RoutingContext ctx(config.get());
+			if (!initReplayedRouteRequestContext(request, ctx)) {
+				printf("%s : speed profile differs from captured one\n", p.requests[i].c_str());
+				break;
+			}
+			OsmAnd::ElapsedTimer timer;
+			timer.Start();
+			vector<RouteSegmentResult> r = searchRouteInternal(&ctx, false);
+			timer.Pause();
+			int ms = timer.GetElapsedMs();
+			bestTime = bestTime < 0 ? ms : std::min(bestTime, ms);
+			segments = r.size();
+			visited = ctx.visitedSegments;
+			routeTime = ctx.finalRouteSegment.get() != NULL ? ctx.finalRouteSegment->distanceFromStart : 0;
+		}
+		if (bestTime < 0) {
+			regressions++;
+			continue;
+		}
+		bool routeChanged = segments != request.segments || fabs(routeTime - request.routeTime) > 0.001 * request.routeTime;
+		bool regression = exceeds(visited, request.visitedSegments, p.tolerance)
+				|| exceeds(bestTime, request.calculationTime, p.tolerance);
+		printf("%s : time %d ms (captured %d ms), visited %d (captured %d), route %.1f s / %d segments "
+				"(captured %.1f s / %d)%s%s\n", p.requests[i].c_str(), bestTime, request.calculationTime, visited,
+				request.visitedSegments, routeTime, segments, request.routeTime, request.segments,
+				routeChanged ? " ROUTE CHANGED" : "", regression ? " REGRESSION" : "");
+		changed += routeChanged ? 1 : 0;
+		regressions += regression ? 1 : 0;
+	}
+	printf("Replayed %d requests : %d changed routes, %d regressions\n", (int) p.requests.size(), changed, regressions);
+	return regressions > 0 ? 1 : 0;
+}
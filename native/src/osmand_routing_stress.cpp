@@ -0,0 +1,177 @@
+#include "binaryRead.h"
+#include "binaryRoutePlanner.h"
+#include "routingConfiguration.h"
+#include "routingGraph.h"
+#include "Logging.h"
+#include <stdio.h>
+#include <string.h>
+#include <thread>
+#include <atomic>
+#include <chrono>
+
+// Multithreaded routing benchmark : runs the same set of routes with increasing number of threads,
+// so scaling of concurrent route calculations (and their independence) could be checked.
+
+struct StressRoute {
+	int startX;
+	int startY;
+	int targetX;
+	int targetY;
+	// result of single threaded run, concurrent runs should match it
+	int segments;
+	float routeTime;
+};
+
+struct StressParams {
+	string routingXml;
+	string router;
+	int maxThreads;
+	int iterations;
+	bool graph;
+	// search traces of reference runs are written to <trace>.<route>.trace
+	string trace;
+	vector<StressRoute> routes;
+	vector<string> files;
+
+	StressParams() : maxThreads(4), iterations(3), graph(false) {
+	}
+};
+
+void printUsage(std::string info) {
+	if (info.size() > 0) {
+		printf("%s\n", info.c_str());
+	}
+	printf("Usage : routing_stress -routingXml=routing.xml [-router=car] [-threads=4] [-iterations=3] [-graph]\n");
+	printf("           [-trace=prefix]\n");
+	printf("           -route=startLat,startLon,endLat,endLon [-route=...] file.obf [file.obf ...]\n");
+	printf("  Calculates routes with 1, 2, 4 ... threads and prints throughput and scaling.\n");
+	printf("  -graph loads whole routing graph into memory before calculations.\n");
+	printf("  -trace writes search trace of single threaded runs (prefix.N.trace) for search_trace tool.\n");
+}
+
+bool parseParams(int argc, char** argv, StressParams& p) {
+	char s[1024];
+	int n;
+	double lat1, lon1, lat2, lon2;
+	for (int i = 1; i < argc; i++) {
+		if (sscanf(argv[i], "-routingXml=%1023s", s) == 1) {
+			p.routingXml = s;
+		} else if (sscanf(argv[i], "-router=%1023s", s) == 1) {
+			p.router = s;
+		} else if (sscanf(argv[i], "-threads=%d", &n) == 1) {
+			p.maxThreads = n;
+		} else if (sscanf(argv[i], "-iterations=%d", &n) == 1) {
+			p.iterations = n;
+		} else if (strcmp(argv[i], "-graph") == 0) {
+			p.graph = true;
+		} else if (sscanf(argv[i], "-trace=%1023s", s) == 1) {
+			p.trace = s;
+		} else if (sscanf(argv[i], "-route=%lg,%lg,%lg,%lg", &lat1, &lon1, &lat2, &lon2) == 4) {
+			StressRoute r;
+			r.startX = get31TileNumberX(lon1);
+			r.startY = get31TileNumberY(lat1);
+			r.targetX = get31TileNumberX(lon2);
+			r.targetY = get31TileNumberY(lat2);
+			r.segments = 0;
+			r.routeTime = 0;
+			p.routes.push_back(r);
+		} else if (argv[i][0] != '-') {
+			p.files.push_back(argv[i]);
+		} else {
+			printUsage(string("Unknown parameter ") + argv[i]);
+			return false;
+		}
+	}
+	if (p.routingXml.empty() || p.routes.empty() || p.files.empty()) {
+		printUsage("Missing parameters");
+		return false;
+	}
+	return true;
+}
+
+bool calculateRoute(StressParams& p, StressRoute& r, int& segments, float& routeTime,
+		SHARED_PTR<SearchTrace> trace = SHARED_PTR<SearchTrace>()) {
+	MAP_STR_STR params;
+	SHARED_PTR<RoutingConfiguration> config = getRoutingConfiguration(p.routingXml, p.router, params);
+	if (config.get() == NULL) {
+		return false;
+	}
+	RoutingContext ctx(config.get());
+	ctx.progress = SHARED_PTR<RouteCalculationProgress>(new RouteCalculationProgress());
+	ctx.startX = r.startX;
+	ctx.startY = r.startY;
+	ctx.targetX = r.targetX;
+	ctx.targetY = r.targetY;
+	ctx.trace = trace;
+	vector<RouteSegmentResult> res = searchRouteInternal(&ctx, false);
+	segments = res.size();
+	routeTime = ctx.finalRouteSegment.get() != NULL ? ctx.finalRouteSegment->distanceFromStart : 0;
+	return !res.empty();
+}
+
+int main(int argc, char** argv) {
+	StressParams p;
+	if (!parseParams(argc, argv, p)) {
+		return 1;
+	}
+	for (uint i = 0; i < p.files.size(); i++) {
+		if (initBinaryMapFile(p.files[i]) == NULL) {
+			printf("File %s can not be opened\n", p.files[i].c_str());
+			return 1;
+		}
+	}
+	if (p.graph && loadRoutingGraph(p.files).get() == NULL) {
+		printf("Routing graph can not be loaded\n");
+		return 1;
+	}
+	// reference results
+	for (uint i = 0; i < p.routes.size(); i++) {
+		SHARED_PTR<SearchTrace> trace;
+		if (!p.trace.empty()) {
+			char name[1100];
+			sprintf(name, "%s.%d.trace", p.trace.c_str(), i);
+			trace = SearchTrace::open(name);
+		}
+		if (!calculateRoute(p, p.routes[i], p.routes[i].segments, p.routes[i].routeTime, trace)) {
+			printf("Route %d is not found\n", i);
+		}
+	}
+	double singleRate = 0;
+	for (int threads = 1; threads <= p.maxThreads; threads *= 2) {
+		std::atomic<int> next(0);
+		std::atomic<int> mismatches(0);
+		int total = p.iterations * p.routes.size() * threads;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		vector<std::thread> workers;
+		for (int t = 0; t < threads; t++) {
+			workers.push_back(std::thread([&]() {
+				int task;
+				while ((task = next++) < total) {
+					StressRoute& r = p.routes[task % p.routes.size()];
+					int segments;
+					float routeTime;
+					calculateRoute(p, r, segments, routeTime);
+					if (segments != r.segments || routeTime != r.routeTime) {
+						mismatches++;
+					}
+				}
+			}));
+		}
+		for (uint t = 0; t < workers.size(); t++) {
+			workers[t].join();
+		}
+		double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		double rate = total / sec;
+		if (threads == 1) {
+			singleRate = rate;
+		}
+		printf("threads %d : %d routes in %.2f s, %.2f routes/s, scaling %.2f, mismatches %d\n", threads, total, sec,
+				rate, singleRate > 0 ? rate / singleRate : 0, mismatches.load());
+	}
+	// graph roads refer to routing indexes of files
+	unloadRoutingGraph();
+	for (uint i = 0; i < p.files.size(); i++) {
+		closeBinaryMapFile(p.files[i]);
+	}
+	return 0;
+}
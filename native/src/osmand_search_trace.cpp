@@ -0,0 +1,213 @@
+#include "searchTrace.h"
+#include <stdio.h>
+#include <set>
+
+// Replays search trace (RoutingContext::trace) : prints statistics of each search and
+// writes visited segments, loaded tiles and found route as GeoJSON.
+
+struct TraceSearchStats {
+	int pops[2];
+	int pushes[2];
+	int maxFrontier[2];
+	int tiles;
+	int reexpanded;
+	int wasted;
+	int pathPops;
+	int inadmissible;
+	double heuristicRatio;
+	float routeTime;
+	// frontier sizes (both directions) sampled by pops
+	vector<std::pair<int, int> > growth;
+
+	TraceSearchStats() : tiles(0), reexpanded(0), wasted(0), pathPops(0), inadmissible(0), heuristicRatio(0),
+		routeTime(-1) {
+		pops[0] = pops[1] = pushes[0] = pushes[1] = maxFrontier[0] = maxFrontier[1] = 0;
+	}
+};
+
+static const int GROWTH_SAMPLES = 10;
+
+void printUsage(std::string info) {
+	if (info.size() > 0) {
+		printf("%s\n", info.c_str());
+	}
+	printf("Usage : search_trace [-geojson=file.geojson] [-search=N] file.trace\n");
+	printf("  Prints frontier growth, wasted expansions and heuristic error of each search in trace.\n");
+	printf("  -geojson writes visited segments, tiles and route of search N (last by default).\n");
+}
+
+static inline int64_t segmentKey(const SearchTraceEvent& e) {
+	return (e.id << 17) + (e.segmentStart << 1) + e.direction;
+}
+
+// searches are delimited by start events
+static void splitSearches(vector<SearchTraceEvent>& events, vector<std::pair<size_t, size_t> >& searches) {
+	size_t begin = 0;
+	for (size_t i = 0; i <= events.size(); i++) {
+		if (i == events.size() || (events[i].type == SEARCH_TRACE_START && i > begin)) {
+			searches.push_back(std::pair<size_t, size_t>(begin, i));
+			begin = i;
+		}
+	}
+}
+
+static void analyzeSearch(vector<SearchTraceEvent>& events, size_t begin, size_t end, TraceSearchStats& st,
+		std::set<int64_t>& path) {
+	for (size_t i = begin; i < end; i++) {
+		if (events[i].type == SEARCH_TRACE_PATH) {
+			path.insert(segmentKey(events[i]));
+		} else if (events[i].type == SEARCH_TRACE_FINAL) {
+			st.routeTime = events[i].distanceFromStart;
+		}
+	}
+	int totalPops = 0;
+	for (size_t i = begin; i < end; i++) {
+		if (events[i].type == SEARCH_TRACE_POP) {
+			totalPops++;
+		}
+	}
+	int sampleStep = std::max(1, totalPops / GROWTH_SAMPLES);
+	std::set<int64_t> expanded;
+	for (size_t i = begin; i < end; i++) {
+		const SearchTraceEvent& e = events[i];
+		int d = e.direction & 1;
+		if (e.type == SEARCH_TRACE_PUSH) {
+			st.pushes[d]++;
+			st.maxFrontier[d] = std::max(st.maxFrontier[d], st.pushes[d] - st.pops[d]);
+		} else if (e.type == SEARCH_TRACE_TILE) {
+			st.tiles++;
+		} else if (e.type == SEARCH_TRACE_POP) {
+			st.pops[d]++;
+			int64_t key = segmentKey(e);
+			if (!expanded.insert(key).second) {
+				st.reexpanded++;
+			}
+			if (path.find(key) == path.end()) {
+				st.wasted++;
+			} else if (st.routeTime > 0) {
+				// g + exact remaining time is route time for segments of route
+				float remaining = st.routeTime - e.distanceFromStart;
+				st.pathPops++;
+				if (remaining > 0) {
+					st.heuristicRatio += e.distanceToEnd / remaining;
+				}
+				if (e.distanceToEnd > remaining + 1) {
+					st.inadmissible++;
+				}
+			}
+			if ((st.pops[0] + st.pops[1]) % sampleStep == 0) {
+				st.growth.push_back(std::pair<int, int>(st.pushes[0] - st.pops[0], st.pushes[1] - st.pops[1]));
+			}
+		}
+	}
+}
+
+static void printSearch(int index, const SearchTraceEvent& start, TraceSearchStats& st) {
+	int pops = st.pops[0] + st.pops[1];
+	printf("Search %d (heuristic coefficient %.2f) : ", index, start.type == SEARCH_TRACE_START ?
+			start.distanceFromStart : 0);
+	if (st.routeTime >= 0) {
+		printf("route time %.1f s\n", st.routeTime);
+	} else {
+		printf("route is not found\n");
+	}
+	printf("  expanded %d (forward %d, reverse %d), pushed %d / %d, loaded tiles %d\n", pops, st.pops[0],
+			st.pops[1], st.pushes[0], st.pushes[1], st.tiles);
+	printf("  max frontier %d / %d, growth :", st.maxFrontier[0], st.maxFrontier[1]);
+	for (uint i = 0; i < st.growth.size(); i++) {
+		printf(" %d/%d", st.growth[i].first, st.growth[i].second);
+	}
+	printf("\n");
+	printf("  wasted expansions %d (%.1f%%), re-expanded %d\n", st.wasted, pops > 0 ? 100.0 * st.wasted / pops : 0.0,
+			st.reexpanded);
+	if (st.pathPops > 0) {
+		printf("  heuristic on route : mean h / remaining %.3f, inadmissible %d of %d\n",
+				st.heuristicRatio / st.pathPops, st.inadmissible, st.pathPops);
+	}
+}
+
+static void writePoint(FILE* f, bool& first, const SearchTraceEvent& e, const char* type, int order, bool onPath) {
+	fprintf(f, "%s\n{\"type\":\"Feature\",\"geometry\":{\"type\":\"Point\",\"coordinates\":[%.6f,%.6f]},",
+			first ? "" : ",", get31LongitudeX(e.x31), get31LatitudeY(e.y31));
+	fprintf(f, "\"properties\":{\"event\":\"%s\",\"order\":%d,\"direction\":%d,\"road\":%lld,\"segment\":%d,"
+			"\"g\":%.2f,\"h\":%.2f,\"sr\":%.3f,\"route\":%s}}", type, order, (int) e.direction, (long long) e.id,
+			(int) e.segmentStart, e.distanceFromStart, e.distanceToEnd, e.srValue, onPath ? "true" : "false");
+	first = false;
+}
+
+static bool writeGeoJson(const char* fileName, vector<SearchTraceEvent>& events, size_t begin, size_t end,
+		std::set<int64_t>& path) {
+	FILE* f = fopen(fileName, "w");
+	if (f == NULL) {
+		return false;
+	}
+	fprintf(f, "{\"type\":\"FeatureCollection\",\"features\":[");
+	bool first = true;
+	int order = 0;
+	for (size_t i = begin; i < end; i++) {
+		const SearchTraceEvent& e = events[i];
+		if (e.type == SEARCH_TRACE_POP) {
+			writePoint(f, first, e, "pop", order++, path.find(segmentKey(e)) != path.end());
+		} else if (e.type == SEARCH_TRACE_TILE) {
+			writePoint(f, first, e, "tile", order, false);
+		} else if (e.type == SEARCH_TRACE_FINAL || e.type == SEARCH_TRACE_PATH) {
+			writePoint(f, first, e, e.type == SEARCH_TRACE_FINAL ? "final" : "route", order, true);
+		}
+	}
+	fprintf(f, "\n]}\n");
+	fclose(f);
+	return true;
+}
+
+int main(int argc, char** argv) {
+	char s[1024];
+	int n;
+	string geojson;
+	string file;
+	int search = -1;
+	for (int i = 1; i < argc; i++) {
+		if (sscanf(argv[i], "-geojson=%1023s", s) == 1) {
+			geojson = s;
+		} else if (sscanf(argv[i], "-search=%d", &n) == 1) {
+			search = n;
+		} else if (argv[i][0] != '-' && file.empty()) {
+			file = argv[i];
+		} else {
+			printUsage(string("Unknown parameter ") + argv[i]);
+			return 1;
+		}
+	}
+	if (file.empty()) {
+		printUsage("Missing trace file");
+		return 1;
+	}
+	vector<SearchTraceEvent> events;
+	if (!readSearchTrace(file.c_str(), events)) {
+		printf("Trace %s can not be read\n", file.c_str());
+		return 1;
+	}
+	if (events.empty()) {
+		printf("Trace %s is empty\n", file.c_str());
+		return 0;
+	}
+	vector<std::pair<size_t, size_t> > searches;
+	splitSearches(events, searches);
+	if (search < 0) {
+		search = searches.size() - 1;
+	}
+	printf("Trace %s : %d events, %d searches\n", file.c_str(), (int) events.size(), (int) searches.size());
+	for (uint i = 0; i < searches.size(); i++) {
+		TraceSearchStats st;
+		std::set<int64_t> path;
+		analyzeSearch(events, searches[i].first, searches[i].second, st, path);
+		printSearch(i, events[searches[i].first], st);
+		if (!geojson.empty() && (int) i == search) {
+			if (!writeGeoJson(geojson.c_str(), events, searches[i].first, searches[i].second, path)) {
+				printf("GeoJSON %s can not be written\n", geojson.c_str());
+				return 1;
+			}
+			printf("GeoJSON of search %d is written to %s\n", i, geojson.c_str());
+		}
+	}
+	return 0;
+}
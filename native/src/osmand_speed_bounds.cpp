@@ -0,0 +1,70 @@
+#include "binaryRead.h"
+#include "binaryRoutePlanner.h"
+#include "routingConfiguration.h"
+#include "routeSpeedBounds.h"
+#include <stdio.h>
+#include <string.h>
+
+// Writes max speeds of routing profile by coarse tile (<obf>.<router>.rsb), which are picked up by
+// route calculations with the same profile and parameters to tighten A* heuristic.
+
+void printUsage(std::string info) {
+	if (info.size() > 0) {
+		printf("%s\n", info.c_str());
+	}
+	printf("Usage : speed_bounds -routingXml=routing.xml [-router=car] [-param=key=value ...] file.obf [file.obf ...]\n");
+	printf("  Parameters should be the same as parameters of route calculations (e.g. avoid_motorway=true).\n");
+}
+
+int main(int argc, char** argv) {
+	char s[1024];
+	string routingXml;
+	string router = "car";
+	MAP_STR_STR params;
+	vector<string> files;
+	for (int i = 1; i < argc; i++) {
+		if (sscanf(argv[i], "-routingXml=%1023s", s) == 1) {
+			routingXml = s;
+		} else if (sscanf(argv[i], "-router=%1023s", s) == 1) {
+			router = s;
+		} else if (sscanf(argv[i], "-param=%1023s", s) == 1 && strchr(s, '=') != NULL) {
+			char* eq = strchr(s, '=');
+			params[string(s, eq - s)] = string(eq + 1);
+		} else if (argv[i][0] != '-') {
+			files.push_back(argv[i]);
+		} else {
+			printUsage(string("Unknown parameter ") + argv[i]);
+			return 1;
+		}
+	}
+	if (routingXml.empty() || files.empty()) {
+		printUsage("Missing parameters");
+		return 1;
+	}
+	SHARED_PTR<RoutingConfiguration> config = getRoutingConfiguration(routingXml, router, params);
+	if (config.get() == NULL) {
+		printf("Router %s can not be loaded from %s\n", router.c_str(), routingXml.c_str());
+		return 1;
+	}
+	int result = 0;
+	for (uint i = 0; i < files.size(); i++) {
+		// files are processed one by one, so only route data of processed file is found
+		BinaryMapFile* file = initBinaryMapFile(files[i]);
+		if (file == NULL) {
+			printf("File %s can not be opened\n", files[i].c_str());
+			result = 1;
+			continue;
+		}
+		string boundsFile = getRouteSpeedBoundsName(file->inputName, config->routerName);
+		if (file->routingIndexes.empty()) {
+			printf("File %s has no routing data\n", files[i].c_str());
+		} else if (!writeRouteSpeedBounds(file, config.get(), boundsFile.c_str())) {
+			printf("Speed bounds %s can not be written\n", boundsFile.c_str());
+			result = 1;
+		} else {
+			printf("Speed bounds %s are written\n", boundsFile.c_str());
+		}
+		closeBinaryMapFile(files[i]);
+	}
+	return result;
+}
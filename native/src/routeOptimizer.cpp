@@ -0,0 +1,340 @@
+#ifndef _OSMAND_ROUTE_OPTIMIZER_CPP
+#define _OSMAND_ROUTE_OPTIMIZER_CPP
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <random>
+#include <thread>
+#include "routeOptimizer.h"
+#include "routingConfiguration.h"
+#include "routeTileCache.h"
+#include "ElapsedTimer.h"
+#include "Logging.h"
+
+// travel time between stops without route, large enough to be avoided by any order
+static const float UNREACHABLE_TIME = 1e7f;
+// time windows are soft, each second of lateness costs as much as this amount of travel time
+static const double LATENESS_PENALTY = 100;
+static const double IMPROVEMENT_EPS = 1e-3;
+static const int OR_OPT_MAX_LENGTH = 3;
+
+struct RouteOptimizerTour {
+	const vector<RouteOptimizerStop>& stops;
+	const vector<float>& matrix;
+	bool roundTrip;
+
+	RouteOptimizerTour(const vector<RouteOptimizerStop>& stops, const vector<float>& matrix, bool roundTrip) :
+		stops(stops), matrix(matrix), roundTrip(roundTrip) {
+	}
+
+	inline float time(int from, int to) const {
+		return matrix[from * stops.size() + to];
+	}
+
+	double evaluate(const vector<int>& order, vector<float>* arrivals = NULL, double* lateness = NULL) const {
+		double t = 0;
+		double late = 0;
+		for (uint k = 0; k < order.size(); k++) {
+			if (k > 0) {
+				t += time(order[k - 1], order[k]);
+			}
+			const RouteOptimizerStop& s = stops[order[k]];
+			if (t < s.earliest) {
+				t = s.earliest;
+			}
+			if (s.latest >= 0 && t > s.latest) {
+				late += t - s.latest;
+			}
+			if (arrivals != NULL) {
+				arrivals->push_back((float) t);
+			}
+			t += s.serviceTime;
+		}
+		if (roundTrip && order.size() > 1) {
+			t += time(order.back(), order[0]);
+		}
+		if (lateness != NULL) {
+			*lateness = late;
+		}
+		return t + LATENESS_PENALTY * late;
+	}
+
+	// first improvement until local optimum, first stop is never moved
+	void localSearch(vector<int>& order, double& cost) const {
+		int n = order.size();
+		vector<int> candidate;
+		bool improved = true;
+		while (improved) {
+			improved = false;
+			// 2-opt : reverse order[i..j]
+			for (int i = 1; i < n - 1; i++) {
+				for (int j = i + 1; j < n; j++) {
+					candidate = order;
+					std::reverse(candidate.begin() + i, candidate.begin() + j + 1);
+					double c = evaluate(candidate);
+					if (c < cost - IMPROVEMENT_EPS) {
+						order.swap(candidate);
+						cost = c;
+						improved = true;
+					}
+				}
+			}
+			// Or-opt : move up to 3 consecutive stops to another position
+			for (int len = 1; len <= OR_OPT_MAX_LENGTH; len++) {
+				for (int i = 1; i + len <= n; i++) {
+					for (int p = 1; p <= n - len; p++) {
+						if (p == i) {
+							continue;
+						}
+						candidate.assign(order.begin(), order.begin() + i);
+						candidate.insert(candidate.end(), order.begin() + i + len, order.end());
+						candidate.insert(candidate.begin() + p, order.begin() + i, order.begin() + i + len);
+						double c = evaluate(candidate);
+						if (c < cost - IMPROVEMENT_EPS) {
+							order.swap(candidate);
+							cost = c;
+							improved = true;
+						}
+					}
+				}
+			}
+		}
+	}
+
+	void nearestNeighbour(vector<int>& order) const {
+		int n = stops.size();
+		vector<bool> visited(n, false);
+		order.clear();
+		order.push_back(0);
+		visited[0] = true;
+		for (int k = 1; k < n; k++) {
+			int best = -1;
+			for (int j = 1; j < n; j++) {
+				if (!visited[j] && (best == -1 || time(order.back(), j) < time(order.back(), best))) {
+					best = j;
+				}
+			}
+			visited[best] = true;
+			order.push_back(best);
+		}
+	}
+
+	// double bridge : a b c d -> a c b d, it can't be undone by single 2-opt or Or-opt move
+	static void perturb(vector<int>& order, std::mt19937& random) {
+		int n = order.size();
+		if (n < 5) {
+			return;
+		}
+		int cuts[3];
+		for (int k = 0; k < 3; k++) {
+			cuts[k] = 1 + random() % (n - 1);
+		}
+		std::sort(cuts, cuts + 3);
+		if (cuts[0] == cuts[1] || cuts[1] == cuts[2]) {
+			return;
+		}
+		std::rotate(order.begin() + cuts[0], order.begin() + cuts[1], order.begin() + cuts[2]);
+	}
+};
+
+// tiles of finished worker contexts are held until route is optimized, searches from other stops reuse them
+struct RouteOptimizerTiles {
+	std::mutex mutex;
+	UNORDERED(set)<SharedRouteTile*> ids;
+	vector<SHARED_PTR<SharedRouteTile> > tiles;
+	int64_t size;
+	int64_t limit;
+
+	RouteOptimizerTiles(int limitMb) : size(0), limit((int64_t) limitMb * 1024 * 1024) {
+	}
+
+	void retain(RoutingContext* ctx) {
+		std::lock_guard<std::mutex> lock(mutex);
+		RoutingContext::MAP_SUBREGION_TILES::iterator it = ctx->subregionTiles.begin();
+		for (; it != ctx->subregionTiles.end() && size < limit; it++) {
+			SHARED_PTR<SharedRouteTile>& tile = it->second->sharedTile;
+			if (tile.get() != NULL && ids.insert(tile.get()).second) {
+				tiles.push_back(tile);
+				size += tile->size;
+			}
+		}
+	}
+};
+
+static SHARED_PTR<RoutingConfiguration> loadRouteOptimizerConfiguration(const RouteOptimizerParams& params) {
+	MAP_STR_STR p = params.params;
+	SHARED_PTR<RoutingConfiguration> config = getRoutingConfiguration(params.routingXml, params.router, p);
+	if (config.get() == NULL) {
+		OsmAnd::LogPrintf(OsmAnd::LogSeverityLevel::Error, "Routing configuration %s (%s) can't be loaded",
+				params.routingXml.c_str(), params.router.c_str());
+	}
+	return config;
+}
+
+// one routing context per thread, tiles loaded for one row are reused by the next ones
+static bool calculateTravelTimeMatrix(const vector<RouteOptimizerStop>& stops, const RouteOptimizerParams& params,
+		vector<float>& matrix, RouteOptimizerTiles& tiles) {
+	int n = stops.size();
+	matrix.assign(n * n, 0);
+	std::atomic<int> nextRow(0);
+	std::atomic<bool> failed(false);
+	vector<std::thread> workers;
+	int threads = std::max(1, std::min(params.threads, n));
+	for (int t = 0; t < threads; t++) {
+		workers.push_back(std::thread([&]() {
+			SHARED_PTR<RoutingConfiguration> config = loadRouteOptimizerConfiguration(params);
+			if (config.get() == NULL) {
+				failed = true;
+				return;
+			}
+			RoutingContext ctx(config.get());
+			int i;
+			while (!failed && (i = nextRow++) < n) {
+				ctx.startX = stops[i].x31;
+				ctx.startY = stops[i].y31;
+				for (int j = 0; j < n; j++) {
+					if (i == j) {
+						continue;
+					}
+					ctx.targetX = stops[j].x31;
+					ctx.targetY = stops[j].y31;
+					float time = searchRouteTime(&ctx);
+					matrix[i * n + j] = time < 0 ? UNREACHABLE_TIME : time;
+				}
+			}
+			tiles.retain(&ctx);
+		}));
+	}
+	for (uint t = 0; t < workers.size(); t++) {
+		workers[t].join();
+	}
+	return !failed;
+}
+
+bool calculateTravelTimeMatrix(const vector<RouteOptimizerStop>& stops, const RouteOptimizerParams& params,
+		vector<float>& matrix) {
+	RouteOptimizerTiles tiles(params.sharedTilesLimit);
+	return calculateTravelTimeMatrix(stops, params, matrix, tiles);
+}
+
+static bool calculateLegs(const vector<RouteOptimizerStop>& stops, const RouteOptimizerParams& params,
+		RouteOptimizerResult& result, RouteOptimizerTiles& tiles) {
+	vector<std::pair<int, int> > legs;
+	for (uint k = 1; k < result.order.size(); k++) {
+		legs.push_back(std::pair<int, int>(result.order[k - 1], result.order[k]));
+	}
+	if (params.roundTrip && result.order.size() > 1) {
+		legs.push_back(std::pair<int, int>(result.order.back(), result.order[0]));
+	}
+	result.legs.assign(legs.size(), vector<RouteSegmentResult>());
+	std::atomic<int> nextLeg(0);
+	std::atomic<bool> failed(false);
+	vector<std::thread> workers;
+	int threads = std::max(1, std::min(params.threads, (int) legs.size()));
+	for (int t = 0; t < threads; t++) {
+		workers.push_back(std::thread([&]() {
+			SHARED_PTR<RoutingConfiguration> config = loadRouteOptimizerConfiguration(params);
+			if (config.get() == NULL) {
+				failed = true;
+				return;
+			}
+			SHARED_PTR<RoutingContext> ctx;
+			int k;
+			while (!failed && (k = nextLeg++) < (int) legs.size()) {
+				// context after hierarchical fallback stays detailed only, next leg starts with new one
+				if (ctx.get() == NULL || ctx->detailedOnly) {
+					if (ctx.get() != NULL) {
+						tiles.retain(ctx.get());
+					}
+					ctx.reset(new RoutingContext(config.get()));
+				}
+				ctx->startX = stops[legs[k].first].x31;
+				ctx->startY = stops[legs[k].first].y31;
+				ctx->targetX = stops[legs[k].second].x31;
+				ctx->targetY = stops[legs[k].second].y31;
+				result.legs[k] = searchRouteInternal(ctx.get(), false);
+			}
+		}));
+	}
+	for (uint t = 0; t < workers.size(); t++) {
+		workers[t].join();
+	}
+	return !failed;
+}
+
+bool optimizeRouteOrder(const vector<RouteOptimizerStop>& stops, const RouteOptimizerParams& params,
+		RouteOptimizerResult& result) {
+	if (stops.size() < 2) {
+		return false;
+	}
+	OsmAnd::ElapsedTimer timer;
+	timer.Start();
+	RouteOptimizerTiles tiles(params.sharedTilesLimit);
+	vector<float> matrix;
+	if (!calculateTravelTimeMatrix(stops, params, matrix, tiles)) {
+		return false;
+	}
+	int matrixTime = timer.GetElapsedMs();
+
+	RouteOptimizerTour tour(stops, matrix, params.roundTrip);
+	int starts = std::max(1, params.starts);
+	vector<vector<int> > orders(starts);
+	vector<double> costs(starts);
+	std::atomic<int> nextStart(0);
+	vector<std::thread> workers;
+	int threads = std::max(1, std::min(params.threads, starts));
+	for (int t = 0; t < threads; t++) {
+		workers.push_back(std::thread([&]() {
+			int s;
+			while ((s = nextStart++) < starts) {
+				// seeded by start index, so result doesn't depend on threads
+				std::mt19937 random(s + 1);
+				vector<int>& order = orders[s];
+				tour.nearestNeighbour(order);
+				if (s > 0) {
+					std::shuffle(order.begin() + 1, order.end(), random);
+				}
+				double cost = tour.evaluate(order);
+				tour.localSearch(order, cost);
+				for (int k = 0; k < params.perturbations; k++) {
+					vector<int> candidate = order;
+					RouteOptimizerTour::perturb(candidate, random);
+					double c = tour.evaluate(candidate);
+					tour.localSearch(candidate, c);
+					if (c < cost - IMPROVEMENT_EPS) {
+						order.swap(candidate);
+						cost = c;
+					}
+				}
+				costs[s] = cost;
+			}
+		}));
+	}
+	for (uint t = 0; t < workers.size(); t++) {
+		workers[t].join();
+	}
+	int best = 0;
+	for (int s = 1; s < starts; s++) {
+		if (costs[s] < costs[best]) {
+			best = s;
+		}
+	}
+	result.order = orders[best];
+	result.arrivalTimes.clear();
+	double lateness;
+	double cost = tour.evaluate(result.order, &result.arrivalTimes, &lateness);
+	result.lateness = (float) lateness;
+	result.totalTime = (float) (cost - LATENESS_PENALTY * lateness);
+	int searchTime = timer.GetElapsedMs() - matrixTime;
+
+	if (!calculateLegs(stops, params, result, tiles)) {
+		return false;
+	}
+	timer.Pause();
+	OsmAnd::LogPrintf(OsmAnd::LogSeverityLevel::Info,
+			"Route order of %d stops optimized in %d ms (matrix %d ms, search %d ms) : time %f, lateness %f",
+			(int) stops.size(), (int) timer.GetElapsedMs(), matrixTime, searchTime, result.totalTime, result.lateness);
+	return true;
+}
+
+#endif /*_OSMAND_ROUTE_OPTIMIZER_CPP*/
@@ -0,0 +1,67 @@
+#ifndef _OSMAND_ROUTE_OPTIMIZER_H
+#define _OSMAND_ROUTE_OPTIMIZER_H
+#include "Common.h"
+#include "common2.h"
+#include "binaryRoutePlanner.h"
+
+/**
+ * Stop of multi-stop route, times are seconds since departure from the first stop
+ * (latest < 0 - stop has no time window)
+ */
+struct RouteOptimizerStop {
+	int x31;
+	int y31;
+	int earliest;
+	int latest;
+	int serviceTime;
+
+	RouteOptimizerStop(int x31, int y31) : x31(x31), y31(y31), earliest(0), latest(-1), serviceTime(0) {
+	}
+};
+
+struct RouteOptimizerParams {
+	string routingXml;
+	string router;
+	MAP_STR_STR params;
+	// route returns to the first stop
+	bool roundTrip;
+	int threads;
+	// independent local searches (first one starts from nearest neighbour tour)
+	int starts;
+	// perturbations (double bridge) of each local search
+	int perturbations;
+	// route tiles (MB) of finished worker contexts held while matrix and legs are calculated, searches from other
+	// stops reuse them (global shared tiles limit is not changed)
+	int sharedTilesLimit;
+
+	RouteOptimizerParams() : roundTrip(false), threads(4), starts(8), perturbations(30), sharedTilesLimit(256) {
+	}
+};
+
+struct RouteOptimizerResult {
+	// indexes of stops in visiting order, first stop is always first
+	vector<int> order;
+	// arrival time at stops of order (after waiting for time window)
+	vector<float> arrivalTimes;
+	// routes between consecutive stops of order (and back to first stop for round trip)
+	vector<vector<RouteSegmentResult> > legs;
+	float totalTime;
+	// sum of time windows violations
+	float lateness;
+};
+
+/**
+ * Travel times between all stops (n * n, row by source stop), rows are calculated in parallel with one routing
+ * context per thread. Returns false if routing configuration can't be loaded.
+ */
+bool calculateTravelTimeMatrix(const vector<RouteOptimizerStop>& stops, const RouteOptimizerParams& params,
+		vector<float>& matrix);
+
+/**
+ * Orders stops (first stop is fixed) : travel time matrix is calculated by the routing engine with rows
+ * in parallel, then parallel local searches (2-opt, Or-opt) minimize total time with time windows penalty.
+ */
+bool optimizeRouteOrder(const vector<RouteOptimizerStop>& stops, const RouteOptimizerParams& params,
+		RouteOptimizerResult& result);
+
+#endif /*_OSMAND_ROUTE_OPTIMIZER_H*/
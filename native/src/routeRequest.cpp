@@ -0,0 +1,371 @@
+#ifndef _OSMAND_ROUTE_REQUEST_CPP
+#define _OSMAND_ROUTE_REQUEST_CPP
+#include <stdio.h>
+#include <time.h>
+#include <atomic>
+#include <mutex>
+#include "routeRequest.h"
+#include "binaryRead.h"
+#include "Logging.h"
+
+static const uint32_t ROUTE_REQUEST_MAGIC = 0x51525452;
+static const uint32_t ROUTE_REQUEST_VERSION = 2;
+
+SHARED_PTR<RoutingConfiguration> createRouteRequestConfiguration(RouteRequest& request) {
+	if (request.profile) {
+		MAP_STR_STR params;
+		for (uint i = 0; i < request.paramKeys.size() && i < request.paramValues.size(); i++) {
+			params[request.paramKeys[i]] = request.paramValues[i];
+		}
+		SHARED_PTR<RoutingConfiguration> config = getRoutingConfiguration(request.routingXml, request.routerName, params);
+		if (config.get() != NULL) {
+			config->initialDirection = request.initialDirection;
+		}
+		return config;
+	}
+	// same registration order as router of java
+	SHARED_PTR<RoutingConfiguration> config(new RoutingConfiguration(request.initialDirection));
+	config->planRoadDirection = request.planRoadDirection;
+	config->heurCoefficient = request.heurCoefficient;
+	config->zoomToLoad = request.zoomToLoad;
+	config->routerName = request.routerName;
+	GeneralRouter& router = config->router;
+	router._restrictionsAware = request.restrictionsAware;
+	router.leftTurn = request.leftTurn;
+	router.roundaboutTurn = request.roundaboutTurn;
+	router.rightTurn = request.rightTurn;
+	router.minDefaultSpeed = request.minDefaultSpeed;
+	router.maxDefaultSpeed = request.maxDefaultSpeed;
+	for (uint k = 0; k < request.attributes.size(); k++) {
+		RouteRequestAttributes& a = request.attributes[k];
+		RouteAttributeContext* rctx = router.newRouteAttributeContext();
+		rctx->registerParams(a.paramKeys, a.paramValues);
+		for (uint j = 0; j < a.rules.size(); j++) {
+			RoutingRuleDefinition& r = a.rules[j];
+			RouteAttributeEvalRule* erule = rctx->newEvaluationRule();
+			erule->registerSelectValue(r.selectValue, r.selectType);
+			erule->registerParamConditions(r.parameters);
+			for (uint i = 0; i < r.tags.size(); i++) {
+				erule->registerAndTagValueCondition(&router, r.tags[i], r.values[i], r.nots[i]);
+			}
+			for (uint i = 0; i < r.expressionValues.size(); i++) {
+				RouteAttributeExpression e(r.expressionValues[i], r.expressionTypes[i], r.expressionValueTypes[i]);
+				erule->registerExpression(e);
+			}
+		}
+	}
+	router.impassableRoadIds.insert(request.impassableRoadIds.begin(), request.impassableRoadIds.end());
+	return config;
+}
+
+void initRouteRequestContext(RouteRequest& request, RoutingContext& ctx) {
+	ctx.startX = request.startX;
+	ctx.startY = request.startY;
+	ctx.targetX = request.targetX;
+	ctx.targetY = request.targetY;
+	ctx.basemap = request.basemap;
+	ctx.useSrRouting = request.useSrRouting;
+	ctx.srDbPath = request.srDbPath;
+	ctx.srLevel = request.srLevel;
+	if (request.departureTime >= 0) {
+		ctx.speedProfile = getSpeedProfile();
+		ctx.departureTime = request.departureTime;
+	}
+	if (request.precalculated) {
+		PrecalculatedRouteDirection& p = ctx.precalcRoute;
+		p.empty = false;
+		p.pointsX.assign(request.precalcPointsX.begin(), request.precalcPointsX.end());
+		p.pointsY.assign(request.precalcPointsY.begin(), request.precalcPointsY.end());
+		p.times = request.precalcTimes;
+		p.buildIndex();
+		p.startPoint = p.calc(ctx.startX, ctx.startY);
+		p.endPoint = p.calc(ctx.targetX, ctx.targetY);
+		p.minSpeed = request.precalcMinSpeed;
+		p.maxSpeed = request.precalcMaxSpeed;
+		p.followNext = request.precalcFollowNext;
+		p.startFinishTime = request.precalcStartFinishTime;
+		p.endFinishTime = request.precalcEndFinishTime;
+	}
+}
+
+bool initReplayedRouteRequestContext(RouteRequest& request, RoutingContext& ctx) {
+	initRouteRequestContext(request, ctx);
+	vector<EdgeOverlayUpdate> updates;
+	for (uint i = 0; i < request.overlayRoadIds.size() && i < request.overlayFactors.size(); i++) {
+		updates.push_back(EdgeOverlayUpdate(request.overlayRoadIds[i], request.overlayFactors[i]));
+	}
+	EdgeOverlay overlay;
+	overlay.update(updates);
+	ctx.overlay = overlay.snapshot();
+	if (request.speedProfileFile.empty()) {
+		ctx.speedProfile.reset();
+		return true;
+	}
+	SHARED_PTR<SpeedProfile> profile = getSpeedProfile();
+	if (profile.get() == NULL || profile->getChecksum() != request.speedProfileChecksum) {
+		profile = loadSpeedProfile(request.speedProfileFile.c_str());
+	}
+	if (profile.get() == NULL || profile->getChecksum() != request.speedProfileChecksum) {
+		OsmAnd::LogPrintf(OsmAnd::LogSeverityLevel::Error, "Speed profile %s differs from captured one",
+				request.speedProfileFile.c_str());
+		return false;
+	}
+	ctx.speedProfile = profile;
+	return true;
+}
+
+// request file : magic, version and fields in order of declaration (little endian as written by host)
+struct RouteRequestWriter {
+	FILE* f;
+	bool ok;
+
+	RouteRequestWriter(FILE* f) : f(f), ok(true) {
+	}
+
+	template<typename T> void value(T v) {
+		ok = ok && fwrite(&v, sizeof(T), 1, f) == 1;
+	}
+
+	void value(bool v) {
+		value((uint8_t) (v ? 1 : 0));
+	}
+
+	void value(const string& s) {
+		value((uint32_t) s.size());
+		ok = ok && (s.empty() || fwrite(s.data(), 1, s.size(), f) == s.size());
+	}
+
+	template<typename T> void values(const vector<T>& v) {
+		value((uint32_t) v.size());
+		for (uint i = 0; i < v.size(); i++) {
+			value((T) v[i]);
+		}
+	}
+};
+
+struct RouteRequestReader {
+	FILE* f;
+	bool ok;
+
+	RouteRequestReader(FILE* f) : f(f), ok(true) {
+	}
+
+	template<typename T> void value(T& v) {
+		ok = ok && fread(&v, sizeof(T), 1, f) == 1;
+	}
+
+	void value(bool& v) {
+		uint8_t b = 0;
+		value(b);
+		v = b != 0;
+	}
+
+	void value(string& s) {
+		uint32_t sz = 0;
+		value(sz);
+		// strings are short (names, tags, paths), size check protects from corrupted files
+		ok = ok && sz < (1 << 20);
+		if (ok) {
+			s.resize(sz);
+			ok = sz == 0 || fread(&s[0], 1, sz, f) == sz;
+		}
+	}
+
+	template<typename T> void values(vector<T>& v) {
+		uint32_t sz = 0;
+		value(sz);
+		ok = ok && sz < (1 << 26);
+		for (uint i = 0; ok && i < sz; i++) {
+			T t;
+			value(t);
+			v.push_back(t);
+		}
+	}
+};
+
+// fields are listed once for both directions
+template<typename S> static void serializeRouteRequest(S& s, RouteRequest& r) {
+	s.value(r.startX);
+	s.value(r.startY);
+	s.value(r.targetX);
+	s.value(r.targetY);
+	s.value(r.initialDirection);
+	s.value(r.basemap);
+	s.value(r.useSrRouting);
+	s.value(r.srDbPath);
+	s.value(r.srLevel);
+	s.value(r.departureTime);
+
+	s.value(r.profile);
+	s.value(r.routingXml);
+	s.value(r.routerName);
+	s.values(r.paramKeys);
+	s.values(r.paramValues);
+
+	s.value(r.planRoadDirection);
+	s.value(r.heurCoefficient);
+	s.value(r.zoomToLoad);
+	s.value(r.restrictionsAware);
+	s.value(r.leftTurn);
+	s.value(r.roundaboutTurn);
+	s.value(r.rightTurn);
+	s.value(r.minDefaultSpeed);
+	s.value(r.maxDefaultSpeed);
+	uint32_t attributes = r.attributes.size();
+	s.value(attributes);
+	r.attributes.resize(attributes);
+	for (uint k = 0; s.ok && k < attributes; k++) {
+		RouteRequestAttributes& a = r.attributes[k];
+		s.values(a.paramKeys);
+		s.values(a.paramValues);
+		uint32_t rules = a.rules.size();
+		s.value(rules);
+		a.rules.resize(rules);
+		for (uint j = 0; s.ok && j < rules; j++) {
+			RoutingRuleDefinition& rule = a.rules[j];
+			s.value(rule.selectValue);
+			s.value(rule.selectType);
+			s.values(rule.parameters);
+			s.values(rule.tags);
+			s.values(rule.values);
+			s.values(rule.nots);
+			uint32_t expressions = rule.expressionValues.size();
+			s.value(expressions);
+			rule.expressionValues.resize(expressions);
+			for (uint i = 0; s.ok && i < expressions; i++) {
+				s.values(rule.expressionValues[i]);
+			}
+			s.values(rule.expressionTypes);
+			s.values(rule.expressionValueTypes);
+		}
+	}
+	s.values(r.impassableRoadIds);
+
+	s.value(r.precalculated);
+	s.values(r.precalcPointsX);
+	s.values(r.precalcPointsY);
+	s.values(r.precalcTimes);
+	s.value(r.precalcMinSpeed);
+	s.value(r.precalcMaxSpeed);
+	s.value(r.precalcFollowNext);
+	s.value(r.precalcStartFinishTime);
+	s.value(r.precalcEndFinishTime);
+
+	s.values(r.files);
+	s.value(r.overlayVersion);
+	s.values(r.overlayRoadIds);
+	s.values(r.overlayFactors);
+	s.value(r.speedProfileFile);
+	s.value(r.speedProfileChecksum);
+
+	s.value(r.routeTime);
+	s.value(r.segments);
+	s.value(r.visitedSegments);
+	s.value(r.calculationTime);
+}
+
+bool writeRouteRequest(const char* fileName, RouteRequest& request) {
+	FILE* f = fopen(fileName, "wb");
+	if (f == NULL) {
+		OsmAnd::LogPrintf(OsmAnd::LogSeverityLevel::Error, "Route request %s can not be written", fileName);
+		return false;
+	}
+	RouteRequestWriter w(f);
+	w.value(ROUTE_REQUEST_MAGIC);
+	w.value(ROUTE_REQUEST_VERSION);
+	serializeRouteRequest(w, request);
+	bool ok = w.ok;
+	ok = fclose(f) == 0 && ok;
+	if (!ok) {
+		OsmAnd::LogPrintf(OsmAnd::LogSeverityLevel::Error, "Route request %s can not be written", fileName);
+		remove(fileName);
+	}
+	return ok;
+}
+
+bool readRouteRequest(const char* fileName, RouteRequest& request) {
+	FILE* f = fopen(fileName, "rb");
+	if (f == NULL) {
+		return false;
+	}
+	RouteRequestReader r(f);
+	uint32_t magic = 0;
+	uint32_t version = 0;
+	r.value(magic);
+	r.value(version);
+	r.ok = r.ok && magic == ROUTE_REQUEST_MAGIC && version == ROUTE_REQUEST_VERSION;
+	if (r.ok) {
+		serializeRouteRequest(r, request);
+	}
+	fclose(f);
+	if (!r.ok) {
+		OsmAnd::LogPrintf(OsmAnd::LogSeverityLevel::Error, "%s is not route request of supported version", fileName);
+	}
+	return r.ok;
+}
+
+static std::mutex captureMutex;
+static string captureDirectory;
+static int captureMinCalculationTime = 0;
+static std::atomic<bool> captureEnabled(false);
+static int capturedRequests = 0;
+
+void setRouteRequestCapture(const string& directory, int minCalculationTime) {
+	std::lock_guard<std::mutex> lock(captureMutex);
+	captureDirectory = directory;
+	captureMinCalculationTime = minCalculationTime;
+	captureEnabled = !directory.empty();
+}
+
+bool isRouteRequestCaptureEnabled() {
+	return captureEnabled;
+}
+
+void captureRouteRequest(RouteRequest& request, RoutingContext& ctx, int segments, int calculationTime) {
+	if (!captureEnabled) {
+		return;
+	}
+	char name[1024];
+	{
+		std::lock_guard<std::mutex> lock(captureMutex);
+		if (captureDirectory.empty() || calculationTime < captureMinCalculationTime) {
+			return;
+		}
+		snprintf(name, sizeof(name), "%s/route_%ld_%d.req", captureDirectory.c_str(), (long) time(NULL),
+				capturedRequests++);
+	}
+	request.routeTime = ctx.finalRouteSegment.get() != NULL ? ctx.finalRouteSegment->distanceFromStart : 0;
+	request.segments = segments;
+	request.visitedSegments = ctx.visitedSegments;
+	request.calculationTime = calculationTime;
+	request.files.clear();
+	getRoutingBinaryMapFiles(request.files);
+	request.overlayRoadIds.clear();
+	request.overlayFactors.clear();
+	request.overlayVersion = 0;
+	if (ctx.overlay.get() != NULL) {
+		request.overlayVersion = ctx.overlay->version;
+		for (int i = 0; i < EdgeOverlaySnapshot::SHARDS; i++) {
+			const EdgeOverlayShard* shard = ctx.overlay->shards[i].get();
+			if (shard == NULL) {
+				continue;
+			}
+			UNORDERED(map)<int64_t, float>::const_iterator it = shard->factors.begin();
+			for (; it != shard->factors.end(); it++) {
+				request.overlayRoadIds.push_back(it->first);
+				request.overlayFactors.push_back(it->second);
+			}
+		}
+	}
+	request.speedProfileFile.clear();
+	request.speedProfileChecksum = 0;
+	if (ctx.isTimeDependent()) {
+		request.speedProfileFile = ctx.speedProfile->getFilename();
+		request.speedProfileChecksum = ctx.speedProfile->getChecksum();
+	}
+	if (writeRouteRequest(name, request)) {
+		OsmAnd::LogPrintf(OsmAnd::LogSeverityLevel::Info, "Route request is captured to %s", name);
+	}
+}
+
+#endif /*_OSMAND_ROUTE_REQUEST_CPP*/
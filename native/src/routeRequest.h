@@ -0,0 +1,118 @@
+#ifndef _OSMAND_ROUTE_REQUEST_H
+#define _OSMAND_ROUTE_REQUEST_H
+#include "Common.h"
+#include "common2.h"
+#include "routingConfiguration.h"
+
+/**
+ * Attribute context of router sent from java (parameters and rules in order of registration)
+ */
+struct RouteRequestAttributes {
+	vector<string> paramKeys;
+	vector<string> paramValues;
+	vector<RoutingRuleDefinition> rules;
+};
+
+/**
+ * Complete input of route calculation as it is received through JNI, so calculation could be captured
+ * to file and replayed later by route_replay tool
+ */
+struct RouteRequest {
+	int startX;
+	int startY;
+	int targetX;
+	int targetY;
+	float initialDirection;
+	bool basemap;
+	bool useSrRouting;
+	string srDbPath;
+	int srLevel;
+	int departureTime;
+
+	// router is built from routing.xml (nativeRoutingWithProfile) or sent from java as rules (nativeRouting)
+	bool profile;
+	string routingXml;
+	string routerName;
+	vector<string> paramKeys;
+	vector<string> paramValues;
+
+	int planRoadDirection;
+	float heurCoefficient;
+	int zoomToLoad;
+	bool restrictionsAware;
+	float leftTurn;
+	float roundaboutTurn;
+	float rightTurn;
+	float minDefaultSpeed;
+	float maxDefaultSpeed;
+	vector<RouteRequestAttributes> attributes;
+	vector<int64_t> impassableRoadIds;
+
+	bool precalculated;
+	vector<int> precalcPointsX;
+	vector<int> precalcPointsY;
+	vector<float> precalcTimes;
+	float precalcMinSpeed;
+	float precalcMaxSpeed;
+	bool precalcFollowNext;
+	float precalcStartFinishTime;
+	float precalcEndFinishTime;
+
+	// obf files opened at time of calculation
+	vector<string> files;
+	// state used by captured calculation : changed roads of edge overlay and speed profile (empty file - none)
+	int64_t overlayVersion;
+	vector<int64_t> overlayRoadIds;
+	vector<float> overlayFactors;
+	string speedProfileFile;
+	uint64_t speedProfileChecksum;
+
+	// result of captured calculation
+	float routeTime;
+	int segments;
+	int visitedSegments;
+	int calculationTime;
+
+	RouteRequest() : startX(0), startY(0), targetX(0), targetY(0), initialDirection(-360), basemap(false),
+		useSrRouting(false), srLevel(2), departureTime(-1), profile(false), planRoadDirection(0), heurCoefficient(1),
+		zoomToLoad(16), restrictionsAware(true), leftTurn(0), roundaboutTurn(0), rightTurn(0), minDefaultSpeed(10),
+		maxDefaultSpeed(10), precalculated(false), precalcMinSpeed(0), precalcMaxSpeed(0), precalcFollowNext(false),
+		precalcStartFinishTime(0), precalcEndFinishTime(0), overlayVersion(0), speedProfileChecksum(0), routeTime(0),
+		segments(0), visitedSegments(0), calculationTime(0) {
+	}
+};
+
+/**
+ * Configuration of request : pooled configuration of routing.xml profile or router built from captured rules
+ * (NULL if profile can't be loaded)
+ */
+SHARED_PTR<RoutingConfiguration> createRouteRequestConfiguration(RouteRequest& request);
+
+/**
+ * Sets start, target, precalculated route and other parameters of calculation
+ */
+void initRouteRequestContext(RouteRequest& request, RoutingContext& ctx);
+
+/**
+ * Context of captured request : edge overlay is restored from request and speed profile of request is loaded,
+ * returns false if speed profile differs from captured one (route could differ)
+ */
+bool initReplayedRouteRequestContext(RouteRequest& request, RoutingContext& ctx);
+
+bool writeRouteRequest(const char* fileName, RouteRequest& request);
+
+bool readRouteRequest(const char* fileName, RouteRequest& request);
+
+/**
+ * Requests calculated longer than minCalculationTime (ms) are written to directory (empty - capture is disabled)
+ */
+void setRouteRequestCapture(const string& directory, int minCalculationTime);
+
+bool isRouteRequestCaptureEnabled();
+
+/**
+ * Writes request with result of calculation if capture is enabled and calculation was slow enough
+ */
+void captureRouteRequest(RouteRequest& request, RoutingContext& ctx, int segments, int calculationTime);
+
+#endif /*_OSMAND_ROUTE_REQUEST_H*/
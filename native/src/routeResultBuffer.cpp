@@ -0,0 +1,183 @@
+#ifndef _OSMAND_ROUTE_RESULT_BUFFER_CPP
+#define _OSMAND_ROUTE_RESULT_BUFFER_CPP
+#include <string.h>
+#include "routeResultBuffer.h"
+
+// values are written to data at position, without data only position is advanced (size of buffer)
+struct RouteResultBufferWriter {
+	uint8_t* data;
+	int32_t pos;
+	UNORDERED(map)<std::string, int> stringIndexes;
+	vector<const std::string*> strings;
+
+	RouteResultBufferWriter(uint8_t* data) : data(data), pos(0) {
+	}
+
+	int32_t position() {
+		return pos;
+	}
+
+	void putBytes(const void* v, size_t size) {
+		if (data != NULL && size > 0) {
+			memcpy(data + pos, v, size);
+		}
+		pos += size;
+	}
+
+	template<typename T> void put(T v) {
+		putBytes(&v, sizeof(T));
+	}
+
+	void set(int32_t position, int32_t v) {
+		if (data != NULL) {
+			memcpy(data + position, &v, sizeof(v));
+		}
+	}
+
+	template<typename T> void putArray(const vector<T>& v) {
+		put((int32_t) v.size());
+		if (!v.empty()) {
+			putBytes(&v[0], v.size() * sizeof(T));
+		}
+	}
+
+	void putString(const std::string& s) {
+		std::pair<UNORDERED(map)<std::string, int>::iterator, bool> it =
+				stringIndexes.insert(std::make_pair(s, (int) strings.size()));
+		if (it.second) {
+			strings.push_back(&it.first->first);
+		}
+		put((int32_t) it.first->second);
+	}
+
+	void putObject(RouteDataObject* o, UNORDERED(map)<int64_t, int>& regionIndexes) {
+		put(o->id);
+		int region = -1;
+		if (o->region != NULL) {
+			UNORDERED(map)<int64_t, int>::iterator it = regionIndexes.find(
+					((int64_t) o->region->filePointer << 31) + o->region->length);
+			region = it == regionIndexes.end() ? -1 : it->second;
+		}
+		put((int32_t) region);
+		putArray(o->types);
+		put((int32_t) o->pointsX.size());
+		for (uint i = 0; i < o->pointsX.size(); i++) {
+			put((int32_t) o->pointsX[i]);
+		}
+		for (uint i = 0; i < o->pointsY.size(); i++) {
+			put((int32_t) o->pointsY[i]);
+		}
+		putArray(o->restrictions);
+		for (uint i = 0; i < o->pointsX.size(); i++) {
+			if (i < o->pointTypes.size()) {
+				putArray(o->pointTypes[i]);
+			} else {
+				put((int32_t) 0);
+			}
+		}
+		put((int32_t) o->names.size());
+		for (UNORDERED(map)<int, std::string>::iterator it = o->names.begin(); it != o->names.end(); it++) {
+			put((int32_t) it->first);
+			putString(it->second);
+		}
+		for (uint i = 0; i < o->pointsX.size(); i++) {
+			uint count = i < o->pointNames.size() && i < o->pointNameTypes.size() ?
+					std::min(o->pointNames[i].size(), o->pointNameTypes[i].size()) : 0;
+			put((int32_t) count);
+			for (uint k = 0; k < count; k++) {
+				put((int32_t) o->pointNameTypes[i][k]);
+				putString(o->pointNames[i][k]);
+			}
+		}
+	}
+};
+
+size_t writeRouteResultBuffer(vector<RouteSegmentResult>& result, UNORDERED(map)<int64_t, int>& regionIndexes,
+		uint8_t* data) {
+	RouteResultBufferWriter w(data);
+	// route first, attached roads are appended after route segments
+	vector<RouteSegmentResult*> segments;
+	for (uint i = 0; i < result.size(); i++) {
+		segments.push_back(&result[i]);
+	}
+	for (uint i = 0; i < segments.size(); i++) {
+		RouteSegmentResult& s = *segments[i];
+		for (uint p = 0; p < s.attachedRoutes.size(); p++) {
+			for (uint k = 0; k < s.attachedRoutes[p].size(); k++) {
+				segments.push_back(&s.attachedRoutes[p][k]);
+			}
+		}
+	}
+	UNORDERED(map)<RouteDataObject*, int> objectIndexes;
+	vector<RouteDataObject*> objects;
+	RouteResultBufferHeader header;
+	header.magic = ROUTE_RESULT_BUFFER_MAGIC;
+	header.version = ROUTE_RESULT_BUFFER_VERSION;
+	header.segmentsCount = segments.size();
+	header.resultsCount = result.size();
+	header.segmentsOffset = sizeof(RouteResultBufferHeader);
+	w.pos = header.segmentsOffset;
+	int32_t attachedOffset = header.segmentsOffset + segments.size() * 5 * sizeof(int32_t);
+	for (uint i = 0; i < segments.size(); i++) {
+		RouteDataObject* o = segments[i]->object.get();
+		std::pair<UNORDERED(map)<RouteDataObject*, int>::iterator, bool> it =
+				objectIndexes.insert(std::make_pair(o, (int) objects.size()));
+		if (it.second) {
+			objects.push_back(o);
+		}
+		w.put((int32_t) it.first->second);
+		w.put((int32_t) segments[i]->startPointIndex);
+		w.put((int32_t) segments[i]->endPointIndex);
+		w.put(segments[i]->routingTime);
+		RouteSegmentResult& s = *segments[i];
+		if (s.attachedRoutes.empty()) {
+			w.put((int32_t) -1);
+			continue;
+		}
+		w.put(attachedOffset);
+		attachedOffset += (1 + s.attachedRoutes.size()) * sizeof(int32_t);
+		for (uint p = 0; p < s.attachedRoutes.size(); p++) {
+			attachedOffset += s.attachedRoutes[p].size() * sizeof(int32_t);
+		}
+	}
+	// attached segments have the same order as they were appended
+	int32_t attachedSegment = result.size();
+	for (uint i = 0; i < segments.size(); i++) {
+		RouteSegmentResult& s = *segments[i];
+		if (s.attachedRoutes.empty()) {
+			continue;
+		}
+		w.put((int32_t) s.attachedRoutes.size());
+		for (uint p = 0; p < s.attachedRoutes.size(); p++) {
+			w.put((int32_t) s.attachedRoutes[p].size());
+			for (uint k = 0; k < s.attachedRoutes[p].size(); k++) {
+				w.put(attachedSegment++);
+			}
+		}
+	}
+
+	header.objectsCount = objects.size();
+	header.objectsOffset = w.position();
+	w.pos += objects.size() * sizeof(int32_t);
+	for (uint i = 0; i < objects.size(); i++) {
+		w.set(header.objectsOffset + i * sizeof(int32_t), w.position());
+		w.putObject(objects[i], regionIndexes);
+	}
+
+	header.stringsCount = w.strings.size();
+	header.stringsOffset = w.position();
+	int32_t offset = header.stringsOffset + (w.strings.size() + 1) * sizeof(int32_t);
+	for (uint i = 0; i <= w.strings.size(); i++) {
+		w.put(offset);
+		offset += i < w.strings.size() ? w.strings[i]->size() : 0;
+	}
+	for (uint i = 0; i < w.strings.size(); i++) {
+		w.putBytes(w.strings[i]->data(), w.strings[i]->size());
+	}
+	if (data != NULL) {
+		memcpy(data, &header, sizeof(header));
+	}
+	return w.position();
+}
+
+#endif /*_OSMAND_ROUTE_RESULT_BUFFER_CPP*/
@@ -0,0 +1,49 @@
+#ifndef _OSMAND_ROUTE_RESULT_BUFFER_H
+#define _OSMAND_ROUTE_RESULT_BUFFER_H
+#include <stdint.h>
+#include "Common.h"
+#include "common2.h"
+#include "binaryRoutePlanner.h"
+
+/**
+ * Route result as one flat buffer, so it is passed to java as direct ByteBuffer and decoded lazily instead
+ * of creating all objects through JNI. Values are int32 (int64 and float where noted) in byte order of host,
+ * offsets are in bytes from start of buffer :
+ *  header   : magic "ORRB", version, segmentsCount, resultsCount, objectsCount, stringsCount,
+ *             segmentsOffset, objectsOffset, stringsOffset
+ *  segments : segmentsCount x { object, startPointIndex, endPointIndex, float routingTime, attachedOffset },
+ *             first resultsCount segments are route, others are attached roads (attachedOffset -1 - none)
+ *  attached : pointsCount, for each point : count, indexes of segments
+ *  objects  : objectsCount x offset of object, each object :
+ *             int64 id, region (index in regions array, -1 - unknown),
+ *             typesCount, types[], pointsCount, pointsX[], pointsY[], restrictionsCount, int64 restrictions[],
+ *             pointTypes : for each point count, types[],
+ *             namesCount, names[] (tag, string),
+ *             pointNames : for each point count, (type, string)[]
+ *  strings  : (stringsCount + 1) x offset, utf8 data (string i is between offsets i and i + 1)
+ * Types are ids of decoding rules of route region, every object and string is stored once.
+ */
+struct RouteResultBufferHeader {
+	int32_t magic;
+	int32_t version;
+	int32_t segmentsCount;
+	int32_t resultsCount;
+	int32_t objectsCount;
+	int32_t stringsCount;
+	int32_t segmentsOffset;
+	int32_t objectsOffset;
+	int32_t stringsOffset;
+};
+
+const int32_t ROUTE_RESULT_BUFFER_MAGIC = 0x4252524f;
+const int32_t ROUTE_RESULT_BUFFER_VERSION = 1;
+
+/**
+ * Writes result to data and returns size of buffer, data NULL - only size is calculated, so buffer is allocated
+ * by caller once and result is written directly into it.
+ * Region of object is found by key (filePointer << 31) + length of routing index
+ */
+size_t writeRouteResultBuffer(vector<RouteSegmentResult>& result, UNORDERED(map)<int64_t, int>& regionIndexes,
+		uint8_t* data);
+
+#endif /*_OSMAND_ROUTE_RESULT_BUFFER_H*/
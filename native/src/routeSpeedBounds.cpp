@@ -0,0 +1,232 @@
+#ifndef _OSMAND_ROUTE_SPEED_BOUNDS_CPP
+#define _OSMAND_ROUTE_SPEED_BOUNDS_CPP
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <mutex>
+#include "routeSpeedBounds.h"
+#include "binaryRoutePlanner.h"
+#include "Logging.h"
+
+static bool getObfStat(const std::string& obfName, uint64_t& size, uint64_t& modified) {
+	struct stat st;
+	if (stat(obfName.c_str(), &st) != 0) {
+		return false;
+	}
+	size = st.st_size;
+	modified = st.st_mtime;
+	return true;
+}
+
+bool RouteSpeedBounds::read(const char* fileName, const std::string& obfName, uint64_t profileHash) {
+	FILE* f = fopen(fileName, "rb");
+	if (f == NULL) {
+		return false;
+	}
+	RouteSpeedBoundsHeader header;
+	uint64_t obfSize, obfModified;
+	bool ok = fread(&header, sizeof(header), 1, f) == 1 && header.magic == MAGIC && header.version == VERSION
+			&& header.zoom == (uint32_t) ZOOM && header.profileHash == profileHash
+			&& getObfStat(obfName, obfSize, obfModified) && header.obfSize == obfSize
+			&& header.obfModified == obfModified;
+	vector<RouteSpeedBoundsCell> list;
+	if (ok) {
+		list.resize(header.cellsCount);
+		ok = list.empty() || fread(&list[0], sizeof(RouteSpeedBoundsCell), list.size(), f) == list.size();
+	}
+	fclose(f);
+	if (!ok) {
+		OsmAnd::LogPrintf(OsmAnd::LogSeverityLevel::Warning, "Route speed bounds %s are stale or corrupted", fileName);
+		return false;
+	}
+	// files could overlap (borders, basemap)
+	for (uint i = 0; i < list.size(); i++) {
+		float& speed = cells[((int64_t) list[i].x << ZOOM) + list[i].y];
+		speed = std::max(speed, list[i].speed);
+	}
+	return true;
+}
+
+RouteSpeedRings::RouteSpeedRings(SHARED_PTR<RouteSpeedBounds> bounds, int x31, int y31, float speedFactor,
+		float maxSpeed) : bounds(bounds), centerX(x31), centerY(y31), speedFactor(speedFactor), maxSpeed(maxSpeed),
+		rawSpeed(0) {
+	// same meters to 31 coordinates conversion as squareRootDist, smaller x coefficient keeps bound admissible
+	cellSize = (1 << (31 - RouteSpeedBounds::ZOOM)) * 0.011;
+}
+
+void RouteSpeedRings::addRing() {
+	int k = speeds.size();
+	int cx = centerX >> (31 - RouteSpeedBounds::ZOOM);
+	int cy = centerY >> (31 - RouteSpeedBounds::ZOOM);
+	int max = (1 << RouteSpeedBounds::ZOOM) - 1;
+	for (int x = std::max(0, cx - k); x <= std::min(max, cx + k); x++) {
+		// only border of square is new
+		int step = (x == cx - k || x == cx + k) ? 1 : std::max(1, 2 * k);
+		for (int y = cy - k; y <= cy + k; y += step) {
+			if (y >= 0 && y <= max) {
+				rawSpeed = std::max(rawSpeed, bounds->getCellSpeed(x, y));
+			}
+		}
+	}
+	// no roads around center (data of another profile or gap), limit of profile is still admissible
+	float speed = rawSpeed > 0 ? std::min(rawSpeed * speedFactor, maxSpeed) : maxSpeed;
+	speeds.push_back(speed);
+	times.push_back(k == 0 ? 0 : times.back() + cellSize / speed);
+}
+
+double RouteSpeedRings::time(double distance) {
+	int k = (int) (distance / cellSize);
+	if (k + 1 < MAX_RINGS) {
+		while ((int) speeds.size() <= k + 1) {
+			addRing();
+		}
+		return times[k] + (distance - k * cellSize) / speeds[k + 1];
+	}
+	while ((int) speeds.size() < MAX_RINGS) {
+		addRing();
+	}
+	return times[MAX_RINGS - 1] + (distance - (MAX_RINGS - 1) * cellSize) / maxSpeed;
+}
+
+std::string getRouteSpeedBoundsName(const std::string& obfName, const std::string& routerName) {
+	return obfName + "." + routerName + ".rsb";
+}
+
+uint64_t getRouteSpeedBoundsProfileHash(RoutingConfiguration* config) {
+	// key is "routing.xml|router|params#generation", path of routing.xml and generation are not part of profile
+	const string& key = config->profileKey;
+	size_t begin = key.find('|');
+	size_t end = key.rfind('#');
+	if (key.empty() || begin == string::npos) {
+		return 0;
+	}
+	uint64_t hash = 0xcbf29ce484222325ull;
+	for (size_t i = begin; i < key.size() && i < end; i++) {
+		hash = (hash ^ (uint8_t) key[i]) * 0x100000001b3ull;
+	}
+	return hash;
+}
+
+struct CachedRouteSpeedBounds {
+	vector<string> files;
+	SHARED_PTR<RouteSpeedBounds> bounds;
+};
+
+static std::mutex boundsMutex;
+static UNORDERED(map)<uint64_t, CachedRouteSpeedBounds> cachedBounds;
+
+SHARED_PTR<RouteSpeedBounds> getRouteSpeedBounds(RoutingConfiguration* config) {
+	uint64_t profileHash = getRouteSpeedBoundsProfileHash(config);
+	if (profileHash == 0) {
+		return SHARED_PTR<RouteSpeedBounds>();
+	}
+	vector<string> files;
+	getRoutingBinaryMapFiles(files);
+	std::sort(files.begin(), files.end());
+	std::lock_guard<std::mutex> lock(boundsMutex);
+	CachedRouteSpeedBounds& cached = cachedBounds[profileHash];
+	// missing bounds are cached as well until set of files is changed
+	if (cached.files == files) {
+		return cached.bounds;
+	}
+	cached.files = files;
+	cached.bounds.reset();
+	if (files.empty()) {
+		return cached.bounds;
+	}
+	SHARED_PTR<RouteSpeedBounds> bounds(new RouteSpeedBounds());
+	for (uint i = 0; i < files.size(); i++) {
+		if (!bounds->read(getRouteSpeedBoundsName(files[i], config->routerName).c_str(), files[i], profileHash)) {
+			return cached.bounds;
+		}
+	}
+	cached.bounds = bounds;
+	OsmAnd::LogPrintf(OsmAnd::LogSeverityLevel::Info, "Route speed bounds of %s are loaded from %d files",
+			config->routerName.c_str(), (int) files.size());
+	return bounds;
+}
+
+static inline void putCellSpeed(UNORDERED(map)<int64_t, float>& cells, int64_t x, int64_t y, float speed) {
+	float& s = cells[(x << RouteSpeedBounds::ZOOM) + y];
+	s = std::max(s, speed);
+}
+
+bool writeRouteSpeedBounds(BinaryMapFile* file, RoutingConfiguration* config, const char* fileName) {
+	uint64_t profileHash = getRouteSpeedBoundsProfileHash(config);
+	RouteSpeedBoundsHeader header;
+	memset(&header, 0, sizeof(header));
+	if (profileHash == 0 || !getObfStat(file->inputName, header.obfSize, header.obfModified)) {
+		OsmAnd::LogPrintf(OsmAnd::LogSeverityLevel::Error, "Route speed bounds %s can not be created", fileName);
+		return false;
+	}
+	ResultPublisher publisher;
+	SearchQuery q(0, INT_MAX, 0, INT_MAX, NULL, &publisher);
+	std::vector<RouteSubregion> found;
+	searchRouteSubregions(&q, found, false);
+	searchRouteSubregions(&q, found, true);
+	GeneralRouter& router = config->router;
+	int shift = 31 - RouteSpeedBounds::ZOOM;
+	UNORDERED(map)<int64_t, float> cells;
+	UNORDERED(set)<uint32_t> dataBlocks;
+	for (uint i = 0; i < found.size(); i++) {
+		if (std::find(file->routingIndexes.begin(), file->routingIndexes.end(), found[i].routingIndex) ==
+				file->routingIndexes.end() || !dataBlocks.insert(found[i].filePointer + found[i].mapDataBlock).second) {
+			continue;
+		}
+		std::vector<RouteDataObject*> list;
+		searchRouteDataForSubRegion(&q, list, &found[i]);
+		for (uint j = 0; j < list.size(); j++) {
+			if (list[j] == NULL) {
+				continue;
+			}
+			SHARED_PTR<RouteDataObject> road(list[j]);
+			if (!router.acceptLine(road) || road->pointsX.empty()) {
+				continue;
+			}
+			// same limits as calculateTimeWithObstacles without live factors
+			double priority = router.defineSpeedPriority(road);
+			float speed = (float) std::max(router.defineRoutingSpeed(road) * priority,
+					router.getMinDefaultSpeed() * (priority > 0 ? priority : 1));
+			speed = std::min(speed, (float) router.getMaxDefaultSpeed());
+			// all cells of bbox of each road segment
+			for (uint k = 0; k < road->pointsX.size(); k++) {
+				uint l = k > 0 ? k - 1 : k;
+				int64_t left = std::min(road->pointsX[k], road->pointsX[l]) >> shift;
+				int64_t right = std::max(road->pointsX[k], road->pointsX[l]) >> shift;
+				int64_t top = std::min(road->pointsY[k], road->pointsY[l]) >> shift;
+				int64_t bottom = std::max(road->pointsY[k], road->pointsY[l]) >> shift;
+				for (int64_t x = left; x <= right; x++) {
+					for (int64_t y = top; y <= bottom; y++) {
+						putCellSpeed(cells, x, y, speed);
+					}
+				}
+			}
+		}
+	}
+	vector<RouteSpeedBoundsCell> list;
+	for (UNORDERED(map)<int64_t, float>::iterator it = cells.begin(); it != cells.end(); it++) {
+		RouteSpeedBoundsCell c;
+		c.x = (uint32_t) (it->first >> RouteSpeedBounds::ZOOM);
+		c.y = (uint32_t) (it->first & ((1 << RouteSpeedBounds::ZOOM) - 1));
+		c.speed = it->second;
+		c.reserved = 0;
+		list.push_back(c);
+	}
+	header.magic = RouteSpeedBounds::MAGIC;
+	header.version = RouteSpeedBounds::VERSION;
+	header.zoom = RouteSpeedBounds::ZOOM;
+	header.cellsCount = list.size();
+	header.profileHash = profileHash;
+	FILE* f = fopen(fileName, "wb");
+	bool ok = f != NULL && fwrite(&header, sizeof(header), 1, f) == 1
+			&& (list.empty() || fwrite(&list[0], sizeof(RouteSpeedBoundsCell), list.size(), f) == list.size());
+	ok = f != NULL && fclose(f) == 0 && ok;
+	if (!ok) {
+		OsmAnd::LogPrintf(OsmAnd::LogSeverityLevel::Error, "Route speed bounds %s can not be written", fileName);
+		remove(fileName);
+	}
+	return ok;
+}
+
+#endif /*_OSMAND_ROUTE_SPEED_BOUNDS_CPP*/
@@ -0,0 +1,108 @@
+#ifndef _OSMAND_ROUTE_SPEED_BOUNDS_H
+#define _OSMAND_ROUTE_SPEED_BOUNDS_H
+#include <stdint.h>
+#include "Common.h"
+#include "common2.h"
+#include "binaryRead.h"
+
+struct RoutingConfiguration;
+
+/**
+ * Maximum routing speed (m/s, speed * priority of profile) of roads by coarse tile, stored next to obf
+ * for each profile as <obf>.<router>.rsb (little endian) :
+ *  header : RouteSpeedBoundsHeader
+ *  cells  : cellsCount x RouteSpeedBoundsCell
+ * Bounds are valid only for profile (router and parameters) they were computed with, and are stale once
+ * obf size or modification time is changed.
+ */
+struct RouteSpeedBoundsHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t zoom;
+	uint32_t cellsCount;
+	uint64_t obfSize;
+	uint64_t obfModified;
+	uint64_t profileHash;
+};
+
+struct RouteSpeedBoundsCell {
+	uint32_t x;
+	uint32_t y;
+	float speed;
+	uint32_t reserved;
+};
+
+/**
+ * Merged bounds of all routing files for one profile
+ */
+class RouteSpeedBounds {
+private:
+	UNORDERED(map)<int64_t, float> cells;
+
+public:
+	static const uint32_t MAGIC = 0x4253524f;
+	static const uint32_t VERSION = 1;
+	static const int ZOOM = 12;
+
+	// max speed of roads in cell (0 - there are no roads)
+	float getCellSpeed(int cx, int cy) const {
+		UNORDERED(map)<int64_t, float>::const_iterator it = cells.find(((int64_t) cx << ZOOM) + cy);
+		return it == cells.end() ? 0 : it->second;
+	}
+
+	bool read(const char* fileName, const std::string& obfName, uint64_t profileHash);
+};
+
+/**
+ * Admissible lower bound of travel time to center point : path at distance r from center lies in cells of
+ * rings (chebyshev distance in cells) up to r / cell size + 1, so it can't be faster than max speed of them.
+ * Rings are computed lazily as search moves away from center.
+ */
+class RouteSpeedRings {
+private:
+	SHARED_PTR<RouteSpeedBounds> bounds;
+	int centerX;
+	int centerY;
+	// multiplier of cell speeds (live overlay, speed profile) and limit of profile
+	float speedFactor;
+	float maxSpeed;
+	// metric size of cell (meters), speed of rings and time to pass rings before ring
+	double cellSize;
+	vector<float> speeds;
+	vector<double> times;
+	// max cell speed of computed rings
+	float rawSpeed;
+
+	void addRing();
+
+public:
+	static const int MAX_RINGS = 1024;
+
+	RouteSpeedRings(SHARED_PTR<RouteSpeedBounds> bounds, int x31, int y31, float speedFactor, float maxSpeed);
+
+	bool isCenter(int x31, int y31) const {
+		return centerX == x31 && centerY == y31;
+	}
+
+	// time (s) to pass distance (meters, squareRootDist metric) to center
+	double time(double distance);
+};
+
+std::string getRouteSpeedBoundsName(const std::string& obfName, const std::string& routerName);
+
+/**
+ * Hash of profile (router and parameters), files written for another profile are ignored
+ */
+uint64_t getRouteSpeedBoundsProfileHash(RoutingConfiguration* config);
+
+/**
+ * Bounds of all opened routing files for profile (NULL if profile is not cacheable or any file has no bounds)
+ */
+SHARED_PTR<RouteSpeedBounds> getRouteSpeedBounds(RoutingConfiguration* config);
+
+/**
+ * Decodes all route data blocks of obf file and writes max speeds of profile by cell
+ */
+bool writeRouteSpeedBounds(BinaryMapFile* file, RoutingConfiguration* config, const char* fileName);
+
+#endif /*_OSMAND_ROUTE_SPEED_BOUNDS_H*/
@@ -0,0 +1,122 @@
+#ifndef _OSMAND_ROUTE_TILE_CACHE_CPP
+#define _OSMAND_ROUTE_TILE_CACHE_CPP
+#include <algorithm>
+#include "routeTileCache.h"
+#include "Logging.h"
+
+struct SharedRouteTileEntry {
+	// tile is alive while any context uses it
+	std::weak_ptr<SharedRouteTile> tile;
+	// tile kept after contexts are finished (within limit)
+	SHARED_PTR<SharedRouteTile> retained;
+	uint64_t lastAccess;
+
+	SharedRouteTileEntry() : lastAccess(0) {
+	}
+};
+
+typedef std::map<std::pair<RoutingIndex*, uint32_t>, SharedRouteTileEntry> SHARED_ROUTE_TILES;
+
+static std::mutex sharedTilesMutex;
+static SHARED_ROUTE_TILES sharedTiles;
+static uint64_t sharedTilesAccess = 0;
+static int64_t retainedSize = 0;
+static int64_t retainedLimit = 0;
+
+static bool compareEntriesByAccess(SHARED_ROUTE_TILES::iterator a, SHARED_ROUTE_TILES::iterator b) {
+	return a->second.lastAccess < b->second.lastAccess;
+}
+
+// same thresholds as tiles gc of routing context
+static void unloadRetainedTiles() {
+	if (retainedSize <= 0.9 * retainedLimit) {
+		return;
+	}
+	std::vector<SHARED_ROUTE_TILES::iterator> list;
+	for (SHARED_ROUTE_TILES::iterator it = sharedTiles.begin(); it != sharedTiles.end(); it++) {
+		if (it->second.retained.get() != NULL) {
+			list.push_back(it);
+		}
+	}
+	std::sort(list.begin(), list.end(), compareEntriesByAccess);
+	for (uint i = 0; i < list.size() && retainedSize > 0.7 * retainedLimit; i++) {
+		retainedSize -= list[i]->second.retained->size;
+		list[i]->second.retained.reset();
+		if (list[i]->second.tile.expired()) {
+			sharedTiles.erase(list[i]);
+		}
+	}
+}
+
+SHARED_PTR<SharedRouteTile> loadSharedRouteTile(RouteSubregion* sub, bool& decoded) {
+	std::pair<RoutingIndex*, uint32_t> key(sub->routingIndex, sub->filePointer + sub->mapDataBlock);
+	decoded = false;
+	{
+		std::lock_guard<std::mutex> lock(sharedTilesMutex);
+		SHARED_ROUTE_TILES::iterator it = sharedTiles.find(key);
+		if (it != sharedTiles.end()) {
+			SHARED_PTR<SharedRouteTile> tile = it->second.tile.lock();
+			if (tile.get() != NULL) {
+				it->second.lastAccess = ++sharedTilesAccess;
+				return tile;
+			}
+			sharedTiles.erase(it);
+		}
+	}
+	// tile is decoded without lock, if two contexts decode it concurrently the first published tile is used
+	SHARED_PTR<SharedRouteTile> tile(new SharedRouteTile(key.first, key.second));
+	SearchQuery q;
+	std::vector<RouteDataObject*> res;
+	searchRouteDataForSubRegion(&q, res, sub);
+	tile->roads.reserve(res.size());
+	for (uint i = 0; i < res.size(); i++) {
+		if (res[i] != NULL) {
+			SHARED_PTR<RouteDataObject> o(res[i]);
+			// turn costs use cached bearings, they are computed before tile is shared
+			o->initBearings();
+			tile->size += o->getSize() + o->bearings.capacity() * sizeof(float) + sizeof(SHARED_PTR<RouteDataObject>);
+			tile->roads.push_back(o);
+		}
+	}
+	std::lock_guard<std::mutex> lock(sharedTilesMutex);
+	SharedRouteTileEntry& entry = sharedTiles[key];
+	SHARED_PTR<SharedRouteTile> published = entry.tile.lock();
+	if (published.get() != NULL) {
+		entry.lastAccess = ++sharedTilesAccess;
+		return published;
+	}
+	decoded = true;
+	entry.tile = tile;
+	entry.lastAccess = ++sharedTilesAccess;
+	if (retainedLimit > 0) {
+		entry.retained = tile;
+		retainedSize += tile->size;
+		unloadRetainedTiles();
+	}
+	return tile;
+}
+
+void setSharedRouteTilesLimit(int limitMb) {
+	std::lock_guard<std::mutex> lock(sharedTilesMutex);
+	retainedLimit = (int64_t) limitMb * 1024 * 1024;
+	unloadRetainedTiles();
+	if (retainedLimit == 0) {
+		for (SHARED_ROUTE_TILES::iterator it = sharedTiles.begin(); it != sharedTiles.end(); it++) {
+			it->second.retained.reset();
+		}
+		retainedSize = 0;
+	}
+}
+
+void releaseSharedRouteTiles(RoutingIndex* routingIndex) {
+	std::lock_guard<std::mutex> lock(sharedTilesMutex);
+	SHARED_ROUTE_TILES::iterator it = sharedTiles.lower_bound(std::pair<RoutingIndex*, uint32_t>(routingIndex, 0));
+	while (it != sharedTiles.end() && it->first.first == routingIndex) {
+		if (it->second.retained.get() != NULL) {
+			retainedSize -= it->second.retained->size;
+		}
+		sharedTiles.erase(it++);
+	}
+}
+
+#endif /*_OSMAND_ROUTE_TILE_CACHE_CPP*/
@@ -0,0 +1,66 @@
+#ifndef _OSMAND_ROUTE_TILE_CACHE_H
+#define _OSMAND_ROUTE_TILE_CACHE_H
+#include <stdint.h>
+#include <mutex>
+#include "Common.h"
+#include "common2.h"
+#include "binaryRead.h"
+
+/**
+ * Decoded route data block with all roads (not filtered by profile), shared by routing contexts of any profile.
+ * Roads are immutable once tile is published, acceptance of roads by profile is computed lazily by contexts.
+ */
+struct SharedRouteTile {
+	RoutingIndex* routingIndex;
+	uint32_t dataBlock;
+	std::vector<SHARED_PTR<RouteDataObject> > roads;
+	int64_t size;
+
+private:
+	std::mutex acceptanceMutex;
+	UNORDERED(map)<std::string, SHARED_PTR<const std::vector<bool> > > acceptance;
+
+public:
+	SharedRouteTile(RoutingIndex* routingIndex, uint32_t dataBlock) :
+		routingIndex(routingIndex), dataBlock(dataBlock), size(sizeof(SharedRouteTile)) {
+	}
+
+	/**
+	 * Accepted roads (bit per road) for profile key, NULL if they were not computed yet
+	 */
+	SHARED_PTR<const std::vector<bool> > getAcceptance(const std::string& profile) {
+		std::lock_guard<std::mutex> lock(acceptanceMutex);
+		UNORDERED(map)<std::string, SHARED_PTR<const std::vector<bool> > >::iterator it = acceptance.find(profile);
+		return it == acceptance.end() ? SHARED_PTR<const std::vector<bool> >() : it->second;
+	}
+
+	// returns bitmap stored by another context if it was computed concurrently
+	SHARED_PTR<const std::vector<bool> > putAcceptance(const std::string& profile,
+			SHARED_PTR<const std::vector<bool> > accepted) {
+		std::lock_guard<std::mutex> lock(acceptanceMutex);
+		SHARED_PTR<const std::vector<bool> >& stored = acceptance[profile];
+		if (stored.get() == NULL) {
+			stored = accepted;
+			size += accepted->size() / 8 + profile.size();
+		}
+		return stored;
+	}
+};
+
+/**
+ * Returns decoded tile of route subregion, decoded is set if tile was not in memory (used by any context)
+ */
+SHARED_PTR<SharedRouteTile> loadSharedRouteTile(RouteSubregion* sub, bool& decoded);
+
+/**
+ * Size (MB) of tiles kept in memory after all contexts using them are finished (0 - tiles are only shared
+ * by concurrent contexts)
+ */
+void setSharedRouteTilesLimit(int limitMb);
+
+/**
+ * Drops tiles of routing index (file is closed)
+ */
+void releaseSharedRouteTiles(RoutingIndex* routingIndex);
+
+#endif /*_OSMAND_ROUTE_TILE_CACHE_H*/
@@ -0,0 +1,411 @@
+#ifndef _OSMAND_ROUTING_CONFIGURATION_CPP
+#define _OSMAND_ROUTING_CONFIGURATION_CPP
+#include <stack>
+#include <map>
+#include <mutex>
+#include <functional>
+#include <expat.h>
+#include "routingConfiguration.h"
+#include "Logging.h"
+
+int parseRouteDataObjectAttribute(string attr) {
+	if ("speed" == attr) {
+		return (int) RouteDataObjectAttribute::ROAD_SPEED;
+	} else if ("priority" == attr) {
+		return (int) RouteDataObjectAttribute::ROAD_PRIORITIES;
+	} else if ("access" == attr) {
+		return (int) RouteDataObjectAttribute::ACCESS;
+	} else if ("obstacle_time" == attr) {
+		return (int) RouteDataObjectAttribute::OBSTACLES;
+	} else if ("obstacle" == attr) {
+		return (int) RouteDataObjectAttribute::ROUTING_OBSTACLES;
+	} else if ("oneway" == attr) {
+		return (int) RouteDataObjectAttribute::ONEWAY;
+	} else if ("penalty_transition" == attr) {
+		return (int) RouteDataObjectAttribute::PENALTY_TRANSITION;
+	}
+	return -1;
+}
+
+vector<string> splitByComma(const string& s) {
+	vector<string> res;
+	if (s.length() == 0) {
+		return res;
+	}
+	size_t p = 0;
+	size_t n;
+	while ((n = s.find(',', p)) != string::npos) {
+		res.push_back(s.substr(p, n - p));
+		p = n + 1;
+	}
+	res.push_back(s.substr(p));
+	return res;
+}
+
+class RoutingConfigurationHandler {
+	friend bool parseRoutingConfigurationFromXml(const char* filename, RoutingConfigurationBuilder& builder);
+
+	struct RoutingRule {
+		string tagName;
+		string t;
+		string v;
+		string param;
+		string value1;
+		string value2;
+		string type;
+	};
+
+	RoutingConfigurationBuilder* builder;
+	RoutingProfileDefinition* currentRouter;
+	int currentAttribute;
+	string preType;
+	stack<RoutingRule> rulesStack;
+
+	RoutingConfigurationHandler(RoutingConfigurationBuilder* builder) :
+			builder(builder), currentRouter(NULL), currentAttribute(-1) {
+	}
+
+	static MAP_STR_STR& parseAttributes(const char **atts, MAP_STR_STR& m) {
+		while (*atts != NULL) {
+			m[string(atts[0])] = string(atts[1]);
+			atts += 2;
+		}
+		return m;
+	}
+
+	static bool checkTag(const string& name) {
+		return "select" == name || "if" == name || "ifnot" == name || "gt" == name || "le" == name;
+	}
+
+	static void addSubclause(const RoutingRule& rr, RoutingRuleDefinition& rule) {
+		bool nt = "ifnot" == rr.tagName;
+		if (rr.param.length() > 0) {
+			vector<string> params = splitByComma(rr.param);
+			for (uint i = 0; i < params.size(); i++) {
+				rule.parameters.push_back(nt ? "-" + params[i] : params[i]);
+			}
+		}
+		if (rr.t.length() > 0) {
+			rule.tags.push_back(rr.t);
+			rule.values.push_back(rr.v);
+			rule.nots.push_back(nt);
+		}
+		if ("gt" == rr.tagName || "le" == rr.tagName) {
+			vector<string> vls;
+			vls.push_back(rr.value1);
+			vls.push_back(rr.value2);
+			rule.expressionValues.push_back(vls);
+			rule.expressionTypes.push_back("gt" == rr.tagName ? RouteAttributeExpression::GREAT_EXPRESSION :
+					RouteAttributeExpression::LESS_EXPRESSION);
+			rule.expressionValueTypes.push_back(rr.type);
+		}
+	}
+
+	void parseRoutingRule(const string& name, MAP_STR_STR& attrs) {
+		if (currentRouter == NULL || currentAttribute < 0) {
+			OsmAnd::LogPrintf(OsmAnd::LogSeverityLevel::Error, "Select tag filter outside road attribute <%s>",
+					name.c_str());
+			// keep stack balanced for end element handler
+			rulesStack.push(RoutingRule());
+			return;
+		}
+		RoutingRule rr;
+		rr.tagName = name;
+		rr.t = attrs["t"];
+		rr.v = attrs["v"];
+		rr.param = attrs["param"];
+		rr.value1 = attrs["value1"];
+		rr.value2 = attrs["value2"];
+		rr.type = attrs["type"];
+		if (rr.type.length() == 0 && preType.length() > 0) {
+			rr.type = preType;
+		}
+		vector<RoutingRuleDefinition>& rules = currentRouter->rules[currentAttribute];
+		if ("select" == name) {
+			RoutingRuleDefinition rule;
+			rule.selectValue = attrs["value"];
+			rule.selectType = rr.type;
+			addSubclause(rr, rule);
+			// stack is iterated from top as in java parser
+			stack<RoutingRule> copy = rulesStack;
+			while (!copy.empty()) {
+				addSubclause(copy.top(), rule);
+				copy.pop();
+			}
+			rules.push_back(rule);
+		} else if (rulesStack.size() > 0 && rulesStack.top().tagName == "select" && rules.size() > 0) {
+			addSubclause(rr, rules[rules.size() - 1]);
+		}
+		rulesStack.push(rr);
+	}
+
+	void parseRoutingParameter(MAP_STR_STR& attrs) {
+		if (currentRouter == NULL) {
+			return;
+		}
+		RoutingParameter p;
+		p.id = attrs["id"];
+		p.name = attrs["name"];
+		p.description = attrs["description"];
+		string type = attrs["type"];
+		if ("boolean" == type) {
+			p.type = RoutingParameterType::BOOLEAN;
+		} else if ("numeric" == type) {
+			p.type = RoutingParameterType::NUMERIC;
+		} else {
+			p.type = RoutingParameterType::SYMBOLIC;
+		}
+		vector<string> vls = splitByComma(attrs["values"]);
+		for (uint i = 0; i < vls.size(); i++) {
+			p.possibleValues.push_back(atof(vls[i].c_str()));
+		}
+		p.possibleValueDescriptions = splitByComma(attrs["valueDescriptions"]);
+		currentRouter->parameters.push_back(p);
+	}
+
+	static void startElementHandler(void *data, const char *tag, const char **atts) {
+		RoutingConfigurationHandler* t = (RoutingConfigurationHandler*) data;
+		string name(tag);
+		MAP_STR_STR attrs;
+		parseAttributes(atts, attrs);
+		if ("osmand_routing_config" == name) {
+			t->builder->defaultRouter = attrs["defaultProfile"];
+		} else if ("routingProfile" == name) {
+			string routerName = attrs["name"];
+			t->currentRouter = &t->builder->routers[routerName];
+			t->currentRouter->name = routerName;
+			t->currentRouter->attributes = attrs;
+		} else if ("attribute" == name) {
+			if (t->currentRouter != NULL) {
+				t->currentRouter->attributes[attrs["name"]] = attrs["value"];
+			} else {
+				t->builder->attributes[attrs["name"]] = attrs["value"];
+			}
+		} else if ("parameter" == name) {
+			t->parseRoutingParameter(attrs);
+		} else if ("point" == name || "way" == name) {
+			t->currentAttribute = parseRouteDataObjectAttribute(attrs["attribute"]);
+			if (t->currentAttribute < 0) {
+				OsmAnd::LogPrintf(OsmAnd::LogSeverityLevel::Warning, "Unknown route attribute : %s",
+						attrs["attribute"].c_str());
+			}
+			t->preType = attrs["type"];
+		} else if (checkTag(name)) {
+			t->parseRoutingRule(name, attrs);
+		}
+	}
+
+	static void endElementHandler(void *data, const char *tag) {
+		RoutingConfigurationHandler* t = (RoutingConfigurationHandler*) data;
+		string name(tag);
+		if (checkTag(name)) {
+			t->rulesStack.pop();
+		} else if ("point" == name || "way" == name) {
+			t->currentAttribute = -1;
+			t->preType = "";
+		} else if ("routingProfile" == name) {
+			t->currentRouter = NULL;
+		}
+	}
+};
+
+bool parseRoutingConfigurationFromXml(const char* filename, RoutingConfigurationBuilder& builder) {
+	FILE *file = fopen(filename, "r");
+	if (file == NULL) {
+		OsmAnd::LogPrintf(OsmAnd::LogSeverityLevel::Error, "File can not be open %s", filename);
+		return false;
+	}
+	XML_Parser parser = XML_ParserCreate(NULL);
+	RoutingConfigurationHandler handler(&builder);
+	XML_SetUserData(parser, &handler);
+	XML_SetElementHandler(parser, RoutingConfigurationHandler::startElementHandler,
+			RoutingConfigurationHandler::endElementHandler);
+	char buffer[4096];
+	bool done = false;
+	bool ok = true;
+	while (!done) {
+		size_t len = fread(buffer, 1, sizeof(buffer), file);
+		done = len < sizeof(buffer);
+		if (XML_Parse(parser, buffer, len, done) == XML_STATUS_ERROR) {
+			OsmAnd::LogPrintf(OsmAnd::LogSeverityLevel::Error, "Routing config %s parse error at line %d : %s", filename,
+					(int) XML_GetCurrentLineNumber(parser), XML_ErrorString(XML_GetErrorCode(parser)));
+			ok = false;
+			break;
+		}
+	}
+	XML_ParserFree(parser);
+	fclose(file);
+	return ok;
+}
+
+bool checkRuleParameters(const RoutingRuleDefinition& r, MAP_STR_STR& params) {
+	for (uint i = 0; i < r.parameters.size(); i++) {
+		string p = r.parameters[i];
+		bool nt = p.length() > 0 && p[0] == '-';
+		if (nt) {
+			p = p.substr(1);
+		}
+		bool val = params.find(p) != params.end();
+		if (nt == val) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool RoutingConfigurationBuilder::build(RoutingConfiguration& config, string router, MAP_STR_STR& params) const {
+	if (router.length() == 0) {
+		router = defaultRouter;
+	}
+	UNORDERED(map)<string, RoutingProfileDefinition>::const_iterator it = routers.find(router);
+	if (it == routers.end()) {
+		OsmAnd::LogPrintf(OsmAnd::LogSeverityLevel::Error, "Routing profile %s is not defined", router.c_str());
+		return false;
+	}
+	const RoutingProfileDefinition& def = it->second;
+	MAP_STR_STR merged = attributes;
+	for (MAP_STR_STR::const_iterator a = def.attributes.begin(); a != def.attributes.end(); a++) {
+		merged[a->first] = a->second;
+		config.router.addAttribute(a->first, a->second);
+	}
+	config.initParams(merged);
+	config.routerName = router;
+
+	vector<string> keys;
+	vector<string> vls;
+	for (MAP_STR_STR::iterator p = params.begin(); p != params.end(); p++) {
+		keys.push_back(p->first);
+		vls.push_back(p->second);
+	}
+	for (uint k = 0; k < def.rules.size(); k++) {
+		RouteAttributeContext* ctx = config.router.newRouteAttributeContext();
+		ctx->registerParams(keys, vls);
+		for (uint j = 0; j < def.rules[k].size(); j++) {
+			const RoutingRuleDefinition& r = def.rules[k][j];
+			if (!checkRuleParameters(r, params)) {
+				continue;
+			}
+			RouteAttributeEvalRule* erule = ctx->newEvaluationRule();
+			erule->registerSelectValue(r.selectValue, r.selectType);
+			erule->registerParamConditions(r.parameters);
+			for (uint i = 0; i < r.tags.size(); i++) {
+				erule->registerAndTagValueCondition(&config.router, r.tags[i], r.values[i], r.nots[i]);
+			}
+			for (uint i = 0; i < r.expressionValues.size(); i++) {
+				RouteAttributeExpression e(r.expressionValues[i], r.expressionTypes[i], r.expressionValueTypes[i]);
+				erule->registerExpression(e);
+			}
+		}
+	}
+	return true;
+}
+
+static const uint MAX_IDLE_CONFIGURATIONS = 4;
+
+// parsed file, it is parsed once by first caller while others wait only for the same file
+struct CachedRoutingConfigurationFile {
+	std::once_flag parsed;
+	// NULL if file can't be parsed, builder is not changed after parse
+	SHARED_PTR<const RoutingConfigurationBuilder> builder;
+};
+
+// cacheMutex guards only maps below, files are parsed and configurations are built without it
+static std::mutex cacheMutex;
+static int cacheGeneration = 0;
+static UNORDERED(map)<string, SHARED_PTR<CachedRoutingConfigurationFile> > cachedFiles;
+// built configurations which are not used by any calculation (router keeps evaluation state, so it can't be shared)
+static UNORDERED(map)<string, vector<RoutingConfiguration*> > idleConfigurations;
+
+struct ReleaseRoutingConfiguration {
+	string key;
+	int generation;
+
+	ReleaseRoutingConfiguration(const string& key, int generation) : key(key), generation(generation) {
+	}
+
+	void operator()(RoutingConfiguration* config) const {
+		std::lock_guard<std::mutex> lock(cacheMutex);
+		vector<RoutingConfiguration*>& idle = idleConfigurations[key];
+		if (generation == cacheGeneration && idle.size() < MAX_IDLE_CONFIGURATIONS) {
+			idle.push_back(config);
+		} else {
+			delete config;
+		}
+	}
+};
+
+void parseCachedRoutingConfigurationFile(const string& filename, CachedRoutingConfigurationFile& file) {
+	OsmAnd::ElapsedTimer timer;
+	timer.Start();
+	SHARED_PTR<RoutingConfigurationBuilder> builder(new RoutingConfigurationBuilder());
+	if (!parseRoutingConfigurationFromXml(filename.c_str(), *builder)) {
+		return;
+	}
+	timer.Pause();
+	OsmAnd::LogPrintf(OsmAnd::LogSeverityLevel::Info, "Routing config %s parsed in %d ms, %d profiles",
+			filename.c_str(), timer.GetElapsedMs(), (int) builder->routers.size());
+	file.builder = builder;
+}
+
+SHARED_PTR<RoutingConfiguration> getRoutingConfiguration(string filename, string router, MAP_STR_STR& params) {
+	// key should not depend on order of unordered map
+	std::map<string, string> sorted(params.begin(), params.end());
+	string key = filename + "|" + router;
+	for (std::map<string, string>::iterator it = sorted.begin(); it != sorted.end(); it++) {
+		key += "|" + it->first + "=" + it->second;
+	}
+	SHARED_PTR<CachedRoutingConfigurationFile> file;
+	int generation;
+	{
+		std::lock_guard<std::mutex> lock(cacheMutex);
+		generation = cacheGeneration;
+		UNORDERED(map)<string, vector<RoutingConfiguration*> >::iterator c = idleConfigurations.find(key);
+		if (c != idleConfigurations.end() && !c->second.empty()) {
+			RoutingConfiguration* config = c->second.back();
+			c->second.pop_back();
+			return SHARED_PTR<RoutingConfiguration>(config, ReleaseRoutingConfiguration(key, generation));
+		}
+		SHARED_PTR<CachedRoutingConfigurationFile>& cached = cachedFiles[filename];
+		if (!cached) {
+			cached = SHARED_PTR<CachedRoutingConfigurationFile>(new CachedRoutingConfigurationFile());
+		}
+		file = cached;
+	}
+	std::call_once(file->parsed, parseCachedRoutingConfigurationFile, std::cref(filename), std::ref(*file));
+	if (!file->builder) {
+		// parse is retried by next call
+		std::lock_guard<std::mutex> lock(cacheMutex);
+		UNORDERED(map)<string, SHARED_PTR<CachedRoutingConfigurationFile> >::iterator f = cachedFiles.find(filename);
+		if (f != cachedFiles.end() && f->second == file) {
+			cachedFiles.erase(f);
+		}
+		return SHARED_PTR<RoutingConfiguration>();
+	}
+	RoutingConfiguration* config = new RoutingConfiguration();
+	if (!file->builder->build(*config, router, params)) {
+		delete config;
+		return SHARED_PTR<RoutingConfiguration>();
+	}
+	// xml could be changed after cache is cleared, so generation is part of the key
+	char gen[16];
+	sprintf(gen, "#%d", generation);
+	config->profileKey = key + gen;
+	return SHARED_PTR<RoutingConfiguration>(config, ReleaseRoutingConfiguration(key, generation));
+}
+
+void clearRoutingConfigurationCache() {
+	std::lock_guard<std::mutex> lock(cacheMutex);
+	// configurations in use are deleted once released
+	cacheGeneration++;
+	UNORDERED(map)<string, vector<RoutingConfiguration*> >::iterator it = idleConfigurations.begin();
+	for (; it != idleConfigurations.end(); it++) {
+		for (uint i = 0; i < it->second.size(); i++) {
+			delete it->second[i];
+		}
+	}
+	idleConfigurations.clear();
+	// files being parsed are kept by their callers
+	cachedFiles.clear();
+}
+
+#endif /*_OSMAND_ROUTING_CONFIGURATION_CPP*/
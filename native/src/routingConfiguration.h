@@ -0,0 +1,62 @@
+#ifndef _OSMAND_ROUTING_CONFIGURATION_H
+#define _OSMAND_ROUTING_CONFIGURATION_H
+#include "Common.h"
+#include "common2.h"
+#include "generalRouter.h"
+#include "binaryRoutePlanner.h"
+
+/**
+ * One <select> of routing.xml with all conditions of enclosing <if>/<ifnot>/<gt>/<le> tags
+ */
+struct RoutingRuleDefinition {
+	string selectValue;
+	string selectType;
+	// formatted as param or -param (ifnot)
+	vector<string> parameters;
+	vector<string> tags;
+	vector<string> values;
+	vector<bool> nots;
+	vector<vector<string> > expressionValues;
+	vector<int> expressionTypes;
+	vector<string> expressionValueTypes;
+};
+
+struct RoutingProfileDefinition {
+	string name;
+	MAP_STR_STR attributes;
+	vector<RoutingParameter> parameters;
+	// indexed by RouteDataObjectAttribute
+	vector<vector<RoutingRuleDefinition> > rules;
+
+	RoutingProfileDefinition() : rules((uint)RouteDataObjectAttribute::PENALTY_TRANSITION + 1) {
+	}
+};
+
+/**
+ * Parsed routing.xml, routers are not built until a parameter set is known
+ */
+struct RoutingConfigurationBuilder {
+	string defaultRouter;
+	MAP_STR_STR attributes;
+	UNORDERED(map)<string, RoutingProfileDefinition> routers;
+
+	/**
+	 * Build configuration for router (default router if empty), rules conditioned by parameters
+	 * which are not present in params are dropped the same way as GeneralRouter.build does in java.
+	 * Builder is not changed once parsed, so it could be used by several threads.
+	 */
+	bool build(RoutingConfiguration& config, string router, MAP_STR_STR& params) const;
+};
+
+bool parseRoutingConfigurationFromXml(const char* filename, RoutingConfigurationBuilder& builder);
+
+/**
+ * Returns configuration cached by file, router name and parameters (NULL if file can't be parsed).
+ * Configuration is used exclusively by caller and returned to cache once released, so concurrent
+ * calculations never share router state. initialDirection should be set by caller before routing.
+ */
+SHARED_PTR<RoutingConfiguration> getRoutingConfiguration(string filename, string router, MAP_STR_STR& params);
+
+void clearRoutingConfigurationCache();
+
+#endif /*_OSMAND_ROUTING_CONFIGURATION_H*/
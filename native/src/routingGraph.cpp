@@ -0,0 +1,213 @@
+#ifndef _OSMAND_ROUTING_GRAPH_CPP
+#define _OSMAND_ROUTING_GRAPH_CPP
+#include <algorithm>
+#include "routingGraph.h"
+#include "ElapsedTimer.h"
+#include "Logging.h"
+
+struct RoutingGraphNodeRef {
+	uint64_t key;
+	RoutingGraphSegment segment;
+
+	bool operator<(const RoutingGraphNodeRef& o) const {
+		return key < o.key || (key == o.key && (segment.road < o.segment.road ||
+				(segment.road == o.segment.road && segment.point < o.segment.point)));
+	}
+};
+
+static inline uint64_t calcGraphCellKey(uint32_t x31, uint32_t y31) {
+	const int shift = 31 - RoutingGraph::CELL_ZOOM;
+	return (((uint64_t) (x31 >> shift)) << 32) | (uint64_t) (y31 >> shift);
+}
+
+void RoutingGraph::indexRoads() {
+	std::vector<RoutingGraphNodeRef> refs;
+	std::vector<std::pair<uint64_t, uint32_t> > cells;
+	for (uint32_t r = 0; r < roads.size(); r++) {
+		RouteDataObject* o = roads[r].get();
+		// turn costs use cached bearings, they are computed once for all calculations
+		o->initBearings();
+		o->graphPointsStart = pointsCount;
+		pointsCount += o->pointsX.size();
+		for (uint32_t p = 0; p < o->pointsX.size(); p++) {
+			RoutingGraphNodeRef ref;
+			ref.key = (((uint64_t) o->pointsX[p]) << 31) + (uint64_t) o->pointsY[p];
+			ref.segment.road = r;
+			ref.segment.point = p;
+			refs.push_back(ref);
+			cells.push_back(std::pair<uint64_t, uint32_t>(calcGraphCellKey(o->pointsX[p], o->pointsY[p]), r));
+		}
+	}
+	std::sort(refs.begin(), refs.end());
+	nodeSegments.reserve(refs.size());
+	for (uint i = 0; i < refs.size(); i++) {
+		if (nodeKeys.empty() || nodeKeys.back() != refs[i].key) {
+			nodeKeys.push_back(refs[i].key);
+			nodeStart.push_back(nodeSegments.size());
+		}
+		nodeSegments.push_back(refs[i].segment);
+	}
+	nodeStart.push_back(nodeSegments.size());
+	std::vector<RoutingGraphNodeRef>().swap(refs);
+
+	std::sort(cells.begin(), cells.end());
+	cells.erase(std::unique(cells.begin(), cells.end()), cells.end());
+	cellRoads.reserve(cells.size());
+	for (uint i = 0; i < cells.size(); i++) {
+		if (cellKeys.empty() || cellKeys.back() != cells[i].first) {
+			cellKeys.push_back(cells[i].first);
+			cellStart.push_back(cellRoads.size());
+		}
+		cellRoads.push_back(cells[i].second);
+	}
+	cellStart.push_back(cellRoads.size());
+}
+
+void RoutingGraph::build(const std::vector<SHARED_PTR<RouteDataObject> >& graphRoads) {
+	roads = graphRoads;
+	// roads are not decoded from files, their flags are not computed yet
+	for (uint32_t r = 0; r < roads.size(); r++) {
+		roads[r]->initFlags();
+	}
+	indexRoads();
+}
+
+bool RoutingGraph::build(const std::vector<std::string>& fileNames) {
+	OsmAnd::ElapsedTimer timer;
+	timer.Start();
+	std::vector<std::string> names = fileNames;
+	if (names.empty()) {
+		getRoutingBinaryMapFiles(names);
+	}
+	std::vector<RoutingIndex*> indexes;
+	for (uint i = 0; i < names.size(); i++) {
+		SHARED_PTR<BinaryMapFile> file = getMapRepository().getFile(names[i]);
+		if (file.get() == NULL) {
+			OsmAnd::LogPrintf(OsmAnd::LogSeverityLevel::Error, "Routing graph : file %s is not opened",
+					names[i].c_str());
+			return false;
+		}
+		indexes.insert(indexes.end(), file->routingIndexes.begin(), file->routingIndexes.end());
+		if (!file->routingIndexes.empty()) {
+			fileRefs.push_back(file);
+		}
+	}
+	files = names;
+
+	ResultPublisher publisher;
+	SearchQuery q(0, INT_MAX, 0, INT_MAX, NULL, &publisher);
+	std::vector<RouteSubregion> subregions;
+	searchRouteSubregions(&q, subregions, false);
+	// roads crossing borders of tiles and files are stored several times, longest one is kept as in loadRouteSegment
+	UNORDERED(map)<int64_t, uint32_t> roadIndexes;
+	for (uint i = 0; i < subregions.size(); i++) {
+		if (std::find(indexes.begin(), indexes.end(), subregions[i].routingIndex) == indexes.end()) {
+			continue;
+		}
+		std::vector<RouteDataObject*> list;
+		searchRouteDataForSubRegion(&q, list, &subregions[i]);
+		for (uint j = 0; j < list.size(); j++) {
+			if (list[j] == NULL) {
+				continue;
+			}
+			SHARED_PTR<RouteDataObject> o(list[j]);
+			UNORDERED(map)<int64_t, uint32_t>::iterator it = roadIndexes.find(o->id);
+			if (it == roadIndexes.end()) {
+				roadIndexes[o->id] = roads.size();
+				roads.push_back(o);
+			} else if (roads[it->second]->pointsX.size() < o->pointsX.size()) {
+				roads[it->second] = o;
+			}
+		}
+	}
+
+	indexRoads();
+
+	timer.Pause();
+	OsmAnd::LogPrintf(OsmAnd::LogSeverityLevel::Info, "Routing graph loaded in %d ms : %d roads, %d nodes, %lld Kb",
+			(int) timer.GetElapsedMs(), (int) roads.size(), (int) nodeKeys.size(), getSize() / 1024);
+	return true;
+}
+
+bool RoutingGraph::isBuiltFromOpenedFiles() const {
+	std::vector<SHARED_PTR<BinaryMapFile> > opened;
+	getMapRepository().getFiles(opened);
+	uint routingFiles = 0;
+	for (uint i = 0; i < opened.size(); i++) {
+		if (opened[i]->routingIndexes.empty()) {
+			continue;
+		}
+		routingFiles++;
+		if (std::find(fileRefs.begin(), fileRefs.end(), opened[i]) == fileRefs.end()) {
+			return false;
+		}
+	}
+	return routingFiles == fileRefs.size();
+}
+
+void RoutingGraph::getRoads(uint32_t left, uint32_t top, uint32_t right, uint32_t bottom,
+		std::vector<uint32_t>& result) const {
+	const int shift = 31 - CELL_ZOOM;
+	size_t sz = result.size();
+	for (uint32_t cx = left >> shift; cx <= right >> shift; cx++) {
+		// cells of one column are consecutive in sorted keys
+		uint64_t from = calcGraphCellKey(cx << shift, top);
+		uint64_t to = calcGraphCellKey(cx << shift, bottom);
+		std::vector<uint64_t>::const_iterator it = std::lower_bound(cellKeys.begin(), cellKeys.end(), from);
+		for (; it != cellKeys.end() && *it <= to; it++) {
+			size_t cell = it - cellKeys.begin();
+			result.insert(result.end(), cellRoads.begin() + cellStart[cell], cellRoads.begin() + cellStart[cell + 1]);
+		}
+	}
+	std::sort(result.begin() + sz, result.end());
+	result.erase(std::unique(result.begin() + sz, result.end()), result.end());
+}
+
+int64_t RoutingGraph::getSize() const {
+	int64_t sz = sizeof(RoutingGraph);
+	for (uint i = 0; i < roads.size(); i++) {
+		sz += roads[i]->getSize() + roads[i]->bearings.capacity() * sizeof(float);
+	}
+	sz += roads.capacity() * sizeof(SHARED_PTR<RouteDataObject>);
+	sz += nodeKeys.capacity() * sizeof(uint64_t) + nodeStart.capacity() * sizeof(uint32_t);
+	sz += nodeSegments.capacity() * sizeof(RoutingGraphSegment);
+	sz += cellKeys.capacity() * sizeof(uint64_t) + cellStart.capacity() * sizeof(uint32_t);
+	sz += cellRoads.capacity() * sizeof(uint32_t);
+	return sz;
+}
+
+static SHARED_PTR<const RoutingGraph> sharedRoutingGraph;
+
+SHARED_PTR<const RoutingGraph> loadRoutingGraph(const std::vector<std::string>& files) {
+	SHARED_PTR<RoutingGraph> graph(new RoutingGraph());
+	if (!graph->build(files)) {
+		return SHARED_PTR<const RoutingGraph>();
+	}
+	SHARED_PTR<const RoutingGraph> published = graph;
+	publishRoutingGraph(published);
+	return published;
+}
+
+void publishRoutingGraph(SHARED_PTR<const RoutingGraph> graph) {
+	// calculations in progress keep previous graph alive
+	std::atomic_store(&sharedRoutingGraph, graph);
+}
+
+void unloadRoutingGraph() {
+	std::atomic_store(&sharedRoutingGraph, SHARED_PTR<const RoutingGraph>());
+}
+
+SHARED_PTR<const RoutingGraph> getRoutingGraph() {
+	return std::atomic_load(&sharedRoutingGraph);
+}
+
+SHARED_PTR<const RoutingGraph> getOpenedFilesRoutingGraph() {
+	SHARED_PTR<const RoutingGraph> graph = getRoutingGraph();
+	if (graph.get() != NULL && !graph->isBuiltFromOpenedFiles()) {
+		OsmAnd::LogPrintf(OsmAnd::LogSeverityLevel::Debug, "Routing graph is not used : opened files were changed");
+		return SHARED_PTR<const RoutingGraph>();
+	}
+	return graph;
+}
+
+#endif /*_OSMAND_ROUTING_GRAPH_CPP*/
@@ -0,0 +1,127 @@
+#ifndef _OSMAND_ROUTING_GRAPH_H
+#define _OSMAND_ROUTING_GRAPH_H
+#include <stdint.h>
+#include "Common.h"
+#include "common2.h"
+#include "binaryRead.h"
+
+struct RoutingGraphSegment {
+	uint32_t road;
+	uint32_t point;
+};
+
+/**
+ * Detailed routing graph of whole obf files loaded once and shared by concurrent route calculations
+ * (server mode, memory is not limited). Graph is immutable after it is built :
+ *  roads - all route objects (bearings are precomputed, duplicates from neighbour files are merged),
+ *  nodes - sorted locations ((x31 << 31) + y31) with road points passing through them,
+ *  cells - roads by cells of CELL_ZOOM to find roads around start and target.
+ * Roads are not filtered by profile, so acceptLine is checked by routing context.
+ */
+class RoutingGraph {
+private:
+	std::vector<std::string> files;
+	// graph is valid only while the same files are opened, roads refer to routing indexes of them
+	std::vector<SHARED_PTR<BinaryMapFile> > fileRefs;
+	uint32_t pointsCount;
+	std::vector<SHARED_PTR<RouteDataObject> > roads;
+	std::vector<uint64_t> nodeKeys;
+	std::vector<uint32_t> nodeStart;
+	std::vector<RoutingGraphSegment> nodeSegments;
+	std::vector<uint64_t> cellKeys;
+	std::vector<uint32_t> cellStart;
+	std::vector<uint32_t> cellRoads;
+
+	RoutingGraph(const RoutingGraph&);
+	RoutingGraph& operator=(const RoutingGraph&);
+
+	// nodes and cells of roads
+	void indexRoads();
+
+public:
+	static const int CELL_ZOOM = 15;
+
+	RoutingGraph() : pointsCount(0) {
+	}
+
+	/**
+	 * Loads route data of opened files (all opened files if list is empty)
+	 */
+	bool build(const std::vector<std::string>& files);
+
+	/**
+	 * Graph of given roads (not bound to files, e.g. generated network)
+	 */
+	void build(const std::vector<SHARED_PTR<RouteDataObject> >& roads);
+
+	const std::vector<std::string>& getFiles() const {
+		return files;
+	}
+
+	/**
+	 * True if opened files with routing data are exactly the files graph was built from (none was reopened)
+	 */
+	bool isBuiltFromOpenedFiles() const;
+
+	// points of all roads, road points are numbered from graphPointsStart of road
+	uint32_t getPointsCount() const {
+		return pointsCount;
+	}
+
+	size_t getRoadsCount() const {
+		return roads.size();
+	}
+
+	size_t getNodesCount() const {
+		return nodeKeys.size();
+	}
+
+	inline const SHARED_PTR<RouteDataObject>& getRoad(uint32_t road) const {
+		return roads[road];
+	}
+
+	/**
+	 * Road points at location, false if there is no node
+	 */
+	inline bool getNodeSegments(uint32_t x31, uint32_t y31, const RoutingGraphSegment*& begin,
+			const RoutingGraphSegment*& end) const {
+		uint64_t key = (((uint64_t) x31) << 31) + (uint64_t) y31;
+		std::vector<uint64_t>::const_iterator it = std::lower_bound(nodeKeys.begin(), nodeKeys.end(), key);
+		if (it == nodeKeys.end() || *it != key) {
+			return false;
+		}
+		size_t node = it - nodeKeys.begin();
+		begin = &nodeSegments[0] + nodeStart[node];
+		end = &nodeSegments[0] + nodeStart[node + 1];
+		return true;
+	}
+
+	/**
+	 * Roads having points in cells intersecting the box (each road once)
+	 */
+	void getRoads(uint32_t left, uint32_t top, uint32_t right, uint32_t bottom, std::vector<uint32_t>& result) const;
+
+	int64_t getSize() const;
+};
+
+/**
+ * Routing graph shared by all routing calculations (NULL if it can't be built),
+ * routing contexts created after graph is loaded use it instead of loading tiles
+ */
+SHARED_PTR<const RoutingGraph> loadRoutingGraph(const std::vector<std::string>& files);
+
+/**
+ * Shares graph built by caller (e.g. of generated roads), it is used while opened files are the files it was built from
+ */
+void publishRoutingGraph(SHARED_PTR<const RoutingGraph> graph);
+
+void unloadRoutingGraph();
+
+SHARED_PTR<const RoutingGraph> getRoutingGraph();
+
+/**
+ * Shared graph if it covers exactly the opened routing files (NULL otherwise), used by routing contexts
+ */
+SHARED_PTR<const RoutingGraph> getOpenedFilesRoutingGraph();
+
+#endif /*_OSMAND_ROUTING_GRAPH_H*/
@@ -0,0 +1,442 @@
+#ifndef _OSMAND_ROUTING_GRAPH_CACHE_CPP
+#define _OSMAND_ROUTING_GRAPH_CACHE_CPP
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include "routingGraphCache.h"
+#include "Logging.h"
+
+static inline uint64_t align8(uint64_t v) {
+	return (v + 7) & ~((uint64_t) 7);
+}
+
+// offsets of arrays inside of tile block
+struct RoutingGraphCacheLayout {
+	uint64_t ids;
+	uint64_t pointsStart;
+	uint64_t typesStart;
+	uint64_t pointTypesStart;
+	uint64_t restrictionsStart;
+	uint64_t namesStart;
+	uint64_t pointNamesStart;
+	uint64_t pointsX;
+	uint64_t pointsY;
+	uint64_t types;
+	uint64_t pointTypes;
+	uint64_t restrictions;
+	uint64_t restrictionsVia;
+	uint64_t names;
+	uint64_t pointNames;
+	uint64_t strings;
+
+	// offsets of start arrays depend only on objects count, so they are valid with zero counts as well
+	RoutingGraphCacheLayout(uint32_t objects, uint32_t points, uint32_t types, uint32_t pointTypes,
+			uint32_t restrictions, uint32_t names, uint32_t pointNames) {
+		uint64_t startsSize = align8(((uint64_t) objects + 1) * sizeof(uint32_t));
+		ids = 0;
+		pointsStart = align8((uint64_t) objects * sizeof(int64_t));
+		typesStart = pointsStart + startsSize;
+		pointTypesStart = typesStart + startsSize;
+		restrictionsStart = pointTypesStart + startsSize;
+		namesStart = restrictionsStart + startsSize;
+		pointNamesStart = namesStart + startsSize;
+		pointsX = pointNamesStart + startsSize;
+		pointsY = pointsX + align8((uint64_t) points * sizeof(uint32_t));
+		this->types = pointsY + align8((uint64_t) points * sizeof(uint32_t));
+		this->pointTypes = this->types + align8((uint64_t) types * sizeof(uint32_t));
+		this->restrictions = this->pointTypes + align8((uint64_t) pointTypes * 2 * sizeof(uint32_t));
+		restrictionsVia = this->restrictions + (uint64_t) restrictions * sizeof(uint64_t);
+		this->names = restrictionsVia + (uint64_t) restrictions * sizeof(int64_t);
+		this->pointNames = this->names + align8((uint64_t) names * 3 * sizeof(uint32_t));
+		strings = this->pointNames + align8((uint64_t) pointNames * 4 * sizeof(uint32_t));
+	}
+};
+
+bool RoutingGraphCache::open(const char* fname, uint64_t obfSize, uint64_t obfModified) {
+	header = NULL;
+	tiles = NULL;
+	if (!file.open(fname)) {
+		return false;
+	}
+	const uint8_t* data = file.getData();
+	const RoutingGraphCacheHeader* h = (const RoutingGraphCacheHeader*) data;
+	if (file.getSize() < sizeof(RoutingGraphCacheHeader) || h->magic != MAGIC || h->version != VERSION) {
+		OsmAnd::LogPrintf(OsmAnd::LogSeverityLevel::Warning, "Routing graph cache %s has unsupported format", fname);
+		file.close();
+		return false;
+	}
+	if (h->obfSize != obfSize || h->obfModified != obfModified) {
+		OsmAnd::LogPrintf(OsmAnd::LogSeverityLevel::Warning, "Routing graph cache %s is stale", fname);
+		file.close();
+		return false;
+	}
+	uint64_t tilesEnd = sizeof(RoutingGraphCacheHeader) + (uint64_t) h->tilesCount * sizeof(RoutingGraphCacheTile);
+	if (tilesEnd > file.getSize()) {
+		OsmAnd::LogPrintf(OsmAnd::LogSeverityLevel::Error, "Routing graph cache %s is truncated", fname);
+		file.close();
+		return false;
+	}
+	const RoutingGraphCacheTile* t = (const RoutingGraphCacheTile*) (data + sizeof(RoutingGraphCacheHeader));
+	for (uint32_t i = 0; i < h->tilesCount; i++) {
+		if (t[i].offset % 8 != 0 || t[i].offset + t[i].length > file.getSize() ||
+				(i > 0 && t[i - 1].dataBlock >= t[i].dataBlock)) {
+			OsmAnd::LogPrintf(OsmAnd::LogSeverityLevel::Error, "Routing graph cache %s has invalid tile index", fname);
+			file.close();
+			return false;
+		}
+	}
+	header = h;
+	tiles = t;
+	OsmAnd::LogPrintf(OsmAnd::LogSeverityLevel::Info, "Routing graph cache %s loaded : %d tiles", fname, h->tilesCount);
+	return true;
+}
+
+static inline bool checkStarts(const uint32_t* starts, uint32_t objects) {
+	for (uint32_t i = 0; i < objects; i++) {
+		if (starts[i] > starts[i + 1]) {
+			return false;
+		}
+	}
+	return starts[0] == 0;
+}
+
+bool RoutingGraphCache::getTileView(uint32_t dataBlock, RoutingGraphCacheTileView& v) const {
+	if (header == NULL) {
+		return false;
+	}
+	const RoutingGraphCacheTile* end = tiles + header->tilesCount;
+	const RoutingGraphCacheTile* t = tiles;
+	uint32_t count = header->tilesCount;
+	while (count > 0) {
+		uint32_t step = count / 2;
+		if (t[step].dataBlock < dataBlock) {
+			t += step + 1;
+			count -= step + 1;
+		} else {
+			count = step;
+		}
+	}
+	if (t == end || t->dataBlock != dataBlock) {
+		return false;
+	}
+	const uint8_t* block = file.getData() + t->offset;
+	uint32_t n = t->objectsCount;
+	RoutingGraphCacheLayout starts(n, 0, 0, 0, 0, 0, 0);
+	if (starts.pointsX > t->length) {
+		return false;
+	}
+	v.objects = n;
+	v.ids = (const int64_t*) (block + starts.ids);
+	v.pointsStart = (const uint32_t*) (block + starts.pointsStart);
+	v.typesStart = (const uint32_t*) (block + starts.typesStart);
+	v.pointTypesStart = (const uint32_t*) (block + starts.pointTypesStart);
+	v.restrictionsStart = (const uint32_t*) (block + starts.restrictionsStart);
+	v.namesStart = (const uint32_t*) (block + starts.namesStart);
+	v.pointNamesStart = (const uint32_t*) (block + starts.pointNamesStart);
+	RoutingGraphCacheLayout l(n, v.pointsStart[n], v.typesStart[n], v.pointTypesStart[n], v.restrictionsStart[n],
+			v.namesStart[n], v.pointNamesStart[n]);
+	if (l.strings > t->length || !checkStarts(v.pointsStart, n) || !checkStarts(v.typesStart, n) ||
+			!checkStarts(v.pointTypesStart, n) || !checkStarts(v.restrictionsStart, n) ||
+			!checkStarts(v.namesStart, n) || !checkStarts(v.pointNamesStart, n)) {
+		OsmAnd::LogPrintf(OsmAnd::LogSeverityLevel::Error, "Routing graph cache tile %d is corrupted", dataBlock);
+		v.objects = 0;
+		return false;
+	}
+	v.pointsX = (const uint32_t*) (block + l.pointsX);
+	v.pointsY = (const uint32_t*) (block + l.pointsY);
+	v.types = (const uint32_t*) (block + l.types);
+	v.pointTypes = (const uint32_t*) (block + l.pointTypes);
+	v.restrictions = (const uint64_t*) (block + l.restrictions);
+	v.restrictionsVia = (const int64_t*) (block + l.restrictionsVia);
+	v.names = (const uint32_t*) (block + l.names);
+	v.pointNames = (const uint32_t*) (block + l.pointNames);
+	v.strings = (const char*) (block + l.strings);
+	v.stringsSize = t->length - l.strings;
+	return true;
+}
+
+void RoutingGraphCacheTileView::readObject(uint32_t i, RoutingIndex* routingIndex, RouteDataObject* obj) const {
+	obj->region = routingIndex;
+	obj->id = ids[i];
+	obj->pointsX.assign(pointsX + pointsStart[i], pointsX + pointsStart[i + 1]);
+	obj->pointsY.assign(pointsY + pointsStart[i], pointsY + pointsStart[i + 1]);
+	obj->types.assign(types + typesStart[i], types + typesStart[i + 1]);
+	uint32_t pointsCount = getPointsCount(i);
+	// array of point types is allocated once for the last point with types
+	uint32_t pointTypesSize = 0;
+	for (uint32_t k = pointTypesStart[i]; k < pointTypesStart[i + 1]; k++) {
+		if (pointTypes[2 * k] < pointsCount) {
+			pointTypesSize = std::max(pointTypesSize, pointTypes[2 * k] + 1);
+		}
+	}
+	if (pointTypesSize > 0) {
+		obj->pointTypes.resize(pointTypesSize);
+		for (uint32_t k = pointTypesStart[i]; k < pointTypesStart[i + 1]; k++) {
+			if (pointTypes[2 * k] < pointsCount) {
+				obj->pointTypes[pointTypes[2 * k]].push_back(pointTypes[2 * k + 1]);
+			}
+		}
+	}
+	if (restrictionsStart[i] < restrictionsStart[i + 1]) {
+		obj->restrictions.assign(restrictions + restrictionsStart[i], restrictions + restrictionsStart[i + 1]);
+		for (uint32_t k = restrictionsStart[i]; k < restrictionsStart[i + 1]; k++) {
+			if (restrictionsVia[k] != 0) {
+				obj->restrictionsVia.assign(restrictionsVia + restrictionsStart[i],
+						restrictionsVia + restrictionsStart[i + 1]);
+				break;
+			}
+		}
+	}
+	for (uint32_t k = namesStart[i]; k < namesStart[i + 1]; k++) {
+		const uint32_t* nm = names + 3 * k;
+		if ((uint64_t) nm[1] + nm[2] <= stringsSize) {
+			obj->names[(int) nm[0]].assign(strings + nm[1], nm[2]);
+		}
+	}
+	for (uint32_t k = pointNamesStart[i]; k < pointNamesStart[i + 1]; k++) {
+		const uint32_t* nm = pointNames + 4 * k;
+		if ((uint64_t) nm[2] + nm[3] > stringsSize) {
+			continue;
+		}
+		uint32_t point = nm[0];
+		if (obj->pointNameTypes.size() <= point) {
+			obj->pointNameTypes.resize(point + 1, std::vector<uint32_t>());
+			obj->pointNames.resize(point + 1, std::vector<std::string>());
+		}
+		obj->pointNameTypes[point].push_back(nm[1]);
+		obj->pointNames[point].push_back(std::string(strings + nm[2], nm[3]));
+	}
+	obj->initFlags();
+}
+
+bool RoutingGraphCache::readTile(uint32_t dataBlock, RoutingIndex* routingIndex,
+		std::vector<RouteDataObject*>& list) const {
+	RoutingGraphCacheTileView v;
+	if (!getTileView(dataBlock, v)) {
+		return false;
+	}
+	list.reserve(list.size() + v.objects);
+	for (uint32_t i = 0; i < v.objects; i++) {
+		RouteDataObject* obj = new RouteDataObject;
+		v.readObject(i, routingIndex, obj);
+		list.push_back(obj);
+	}
+	return true;
+}
+
+std::string getRoutingGraphCacheName(BinaryMapFile* file) {
+	return file->inputName + ".rgc";
+}
+
+// date of obf header is not used, files initialized from cache have modification date of file instead
+static bool getObfStat(BinaryMapFile* file, uint64_t& size, uint64_t& modified) {
+	struct stat st;
+	if (fstat(file->fd, &st) != 0) {
+		return false;
+	}
+	size = st.st_size;
+	modified = st.st_mtime;
+	return true;
+}
+
+SHARED_PTR<RoutingGraphCache> openRoutingGraphCache(BinaryMapFile* file) {
+	std::string cacheFile = getRoutingGraphCacheName(file);
+	struct stat st;
+	if (file->routingIndexes.empty() || stat(cacheFile.c_str(), &st) != 0) {
+		return SHARED_PTR<RoutingGraphCache>();
+	}
+	uint64_t obfSize, obfModified;
+	if (!getObfStat(file, obfSize, obfModified)) {
+		return SHARED_PTR<RoutingGraphCache>();
+	}
+	SHARED_PTR<RoutingGraphCache> cache(new RoutingGraphCache());
+	if (!cache->open(cacheFile.c_str(), obfSize, obfModified)) {
+		return SHARED_PTR<RoutingGraphCache>();
+	}
+	return cache;
+}
+
+// arrays of one tile before they are written
+struct RoutingGraphCacheTileWriter {
+	std::vector<int64_t> ids;
+	std::vector<uint32_t> pointsStart;
+	std::vector<uint32_t> typesStart;
+	std::vector<uint32_t> pointTypesStart;
+	std::vector<uint32_t> restrictionsStart;
+	std::vector<uint32_t> namesStart;
+	std::vector<uint32_t> pointNamesStart;
+	std::vector<uint32_t> pointsX;
+	std::vector<uint32_t> pointsY;
+	std::vector<uint32_t> types;
+	std::vector<uint32_t> pointTypes;
+	std::vector<uint64_t> restrictions;
+	std::vector<int64_t> restrictionsVia;
+	std::vector<uint32_t> names;
+	std::vector<uint32_t> pointNames;
+	std::string strings;
+	UNORDERED(map)<std::string, uint32_t> stringOffsets;
+
+	RoutingGraphCacheTileWriter() {
+		pointsStart.push_back(0);
+		typesStart.push_back(0);
+		pointTypesStart.push_back(0);
+		restrictionsStart.push_back(0);
+		namesStart.push_back(0);
+		pointNamesStart.push_back(0);
+	}
+
+	uint32_t addString(const std::string& s) {
+		UNORDERED(map)<std::string, uint32_t>::iterator it = stringOffsets.find(s);
+		if (it != stringOffsets.end()) {
+			return it->second;
+		}
+		uint32_t offset = strings.size();
+		strings += s;
+		stringOffsets[s] = offset;
+		return offset;
+	}
+
+	void add(RouteDataObject* o) {
+		ids.push_back(o->id);
+		pointsX.insert(pointsX.end(), o->pointsX.begin(), o->pointsX.end());
+		pointsY.insert(pointsY.end(), o->pointsY.begin(), o->pointsY.end());
+		pointsStart.push_back(pointsX.size());
+		types.insert(types.end(), o->types.begin(), o->types.end());
+		typesStart.push_back(types.size());
+		for (uint k = 0; k < o->pointTypes.size(); k++) {
+			for (uint j = 0; j < o->pointTypes[k].size(); j++) {
+				pointTypes.push_back(k);
+				pointTypes.push_back(o->pointTypes[k][j]);
+			}
+		}
+		pointTypesStart.push_back(pointTypes.size() / 2);
+		for (uint k = 0; k < o->restrictions.size(); k++) {
+			restrictions.push_back(o->restrictions[k]);
+			restrictionsVia.push_back(k < o->restrictionsVia.size() ? o->restrictionsVia[k] : 0);
+		}
+		restrictionsStart.push_back(restrictions.size());
+		UNORDERED(map)<int, std::string>::iterator nm = o->names.begin();
+		for (; nm != o->names.end(); nm++) {
+			names.push_back(nm->first);
+			names.push_back(addString(nm->second));
+			names.push_back(nm->second.size());
+		}
+		namesStart.push_back(names.size() / 3);
+		for (uint k = 0; k < o->pointNames.size() && k < o->pointNameTypes.size(); k++) {
+			for (uint j = 0; j < o->pointNames[k].size() && j < o->pointNameTypes[k].size(); j++) {
+				pointNames.push_back(k);
+				pointNames.push_back(o->pointNameTypes[k][j]);
+				pointNames.push_back(addString(o->pointNames[k][j]));
+				pointNames.push_back(o->pointNames[k][j].size());
+			}
+		}
+		pointNamesStart.push_back(pointNames.size() / 4);
+	}
+
+	template<typename T>
+	void put(std::vector<uint8_t>& out, uint64_t offset, const std::vector<T>& v) {
+		if (!v.empty()) {
+			memcpy(&out[offset], &v[0], v.size() * sizeof(T));
+		}
+	}
+
+	void write(std::vector<uint8_t>& out) {
+		uint32_t n = ids.size();
+		RoutingGraphCacheLayout l(n, pointsX.size(), types.size(), pointTypes.size() / 2, restrictions.size(),
+				names.size() / 3, pointNames.size() / 4);
+		out.assign(align8(l.strings + strings.size()), 0);
+		put(out, l.ids, ids);
+		put(out, l.pointsStart, pointsStart);
+		put(out, l.typesStart, typesStart);
+		put(out, l.pointTypesStart, pointTypesStart);
+		put(out, l.restrictionsStart, restrictionsStart);
+		put(out, l.namesStart, namesStart);
+		put(out, l.pointNamesStart, pointNamesStart);
+		put(out, l.pointsX, pointsX);
+		put(out, l.pointsY, pointsY);
+		put(out, l.types, types);
+		put(out, l.pointTypes, pointTypes);
+		put(out, l.restrictions, restrictions);
+		put(out, l.restrictionsVia, restrictionsVia);
+		put(out, l.names, names);
+		put(out, l.pointNames, pointNames);
+		if (!strings.empty()) {
+			memcpy(&out[l.strings], strings.data(), strings.size());
+		}
+	}
+};
+
+static bool sortGraphCacheRegions(const RouteSubregion& i, const RouteSubregion& j) {
+	return i.filePointer + i.mapDataBlock < j.filePointer + j.mapDataBlock;
+}
+
+bool writeRoutingGraphCache(BinaryMapFile* file, const char* cacheFile) {
+	ResultPublisher publisher;
+	SearchQuery q(0, INT_MAX, 0, INT_MAX, NULL, &publisher);
+	std::vector<RouteSubregion> found;
+	searchRouteSubregions(&q, found, false);
+	searchRouteSubregions(&q, found, true);
+	std::vector<RouteSubregion> subregions;
+	for (uint i = 0; i < found.size(); i++) {
+		if (std::find(file->routingIndexes.begin(), file->routingIndexes.end(), found[i].routingIndex) !=
+				file->routingIndexes.end()) {
+			subregions.push_back(found[i]);
+		}
+	}
+	std::sort(subregions.begin(), subregions.end(), sortGraphCacheRegions);
+
+	FILE* f = fopen(cacheFile, "wb");
+	if (f == NULL) {
+		OsmAnd::LogPrintf(OsmAnd::LogSeverityLevel::Error, "Routing graph cache %s can not be created", cacheFile);
+		return false;
+	}
+	std::vector<RoutingGraphCacheTile> tiles;
+	RoutingGraphCacheHeader header;
+	memset(&header, 0, sizeof(header));
+	// header and tile index are written once all blocks are known
+	std::vector<uint8_t> block;
+	uint64_t offset = align8(sizeof(RoutingGraphCacheHeader) + subregions.size() * sizeof(RoutingGraphCacheTile));
+	bool ok = fseek(f, offset, SEEK_SET) == 0;
+	for (uint i = 0; i < subregions.size() && ok; i++) {
+		uint32_t dataBlock = subregions[i].filePointer + subregions[i].mapDataBlock;
+		if (!tiles.empty() && tiles.back().dataBlock == dataBlock) {
+			continue;
+		}
+		std::vector<RouteDataObject*> list;
+		searchRouteDataForSubRegion(&q, list, &subregions[i]);
+		RoutingGraphCacheTileWriter w;
+		for (uint j = 0; j < list.size(); j++) {
+			if (list[j] != NULL) {
+				w.add(list[j]);
+				delete list[j];
+			}
+		}
+		w.write(block);
+		RoutingGraphCacheTile t;
+		t.dataBlock = dataBlock;
+		t.objectsCount = w.ids.size();
+		t.offset = offset;
+		t.length = block.size();
+		tiles.push_back(t);
+		ok = block.empty() || fwrite(&block[0], 1, block.size(), f) == block.size();
+		offset += block.size();
+	}
+	header.magic = RoutingGraphCache::MAGIC;
+	header.version = RoutingGraphCache::VERSION;
+	header.tilesCount = tiles.size();
+	ok = ok && getObfStat(file, header.obfSize, header.obfModified);
+	ok = ok && fseek(f, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, f) == 1;
+	ok = ok && (tiles.empty() || fwrite(&tiles[0], sizeof(RoutingGraphCacheTile), tiles.size(), f) == tiles.size());
+	ok = fclose(f) == 0 && ok;
+	if (!ok) {
+		OsmAnd::LogPrintf(OsmAnd::LogSeverityLevel::Error, "Routing graph cache %s can not be written", cacheFile);
+		remove(cacheFile);
+		return false;
+	}
+	OsmAnd::LogPrintf(OsmAnd::LogSeverityLevel::Info, "Routing graph cache %s written : %d tiles, %d bytes", cacheFile,
+			(int) tiles.size(), (int) offset);
+	return true;
+}
+
+#endif /*_OSMAND_ROUTING_GRAPH_CACHE_CPP*/
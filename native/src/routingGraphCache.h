@@ -0,0 +1,118 @@
+#ifndef _OSMAND_ROUTING_GRAPH_CACHE_H
+#define _OSMAND_ROUTING_GRAPH_CACHE_H
+#include <stdint.h>
+#include "Common.h"
+#include "common2.h"
+#include "mappedFile.h"
+#include "binaryRead.h"
+
+/**
+ * Route data blocks of obf file stored as flat arrays, so tiles are loaded from memory mapped file without
+ * protobuf decoding. File is stored next to obf as <obf>.rgc (little endian, arrays are 8 byte aligned) :
+ *  header : RoutingGraphCacheHeader
+ *  tiles  : tilesCount x RoutingGraphCacheTile sorted by dataBlock
+ *  blocks : for each tile of n objects :
+ *           int64 ids[n],
+ *           uint32 pointsStart[n + 1], typesStart[n + 1], pointTypesStart[n + 1], restrictionsStart[n + 1],
+ *                  namesStart[n + 1], pointNamesStart[n + 1] - CSR offsets of object into arrays below,
+ *           uint32 pointsX[], pointsY[], types[], pointTypes[] (point, type),
+ *           uint64 restrictions[], int64 restrictionsVia[],
+ *           uint32 names[] (tag, string offset, length), pointNames[] (point, tag, string offset, length),
+ *           char strings[] - strings of tile (each string is stored once)
+ * Types are ids of decoding rules of routing index, cache is stale once obf size or modification time is changed.
+ */
+struct RoutingGraphCacheHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t tilesCount;
+	uint32_t reserved;
+	uint64_t obfSize;
+	uint64_t obfModified;
+};
+
+struct RoutingGraphCacheTile {
+	// obf file pointer of route data block (subregion filePointer + mapDataBlock)
+	uint32_t dataBlock;
+	uint32_t objectsCount;
+	uint64_t offset;
+	uint64_t length;
+};
+
+/**
+ * Arrays of one cached tile pointing into mapped file (valid while cache is opened), object i uses
+ * range [start[i], start[i + 1]) of each array
+ */
+struct RoutingGraphCacheTileView {
+	uint32_t objects;
+	const int64_t* ids;
+	const uint32_t* pointsStart;
+	const uint32_t* typesStart;
+	const uint32_t* pointTypesStart;
+	const uint32_t* restrictionsStart;
+	const uint32_t* namesStart;
+	const uint32_t* pointNamesStart;
+	const uint32_t* pointsX;
+	const uint32_t* pointsY;
+	const uint32_t* types;
+	const uint32_t* pointTypes;
+	const uint64_t* restrictions;
+	const int64_t* restrictionsVia;
+	const uint32_t* names;
+	const uint32_t* pointNames;
+	const char* strings;
+	uint64_t stringsSize;
+
+	RoutingGraphCacheTileView() : objects(0) {
+	}
+
+	uint32_t getPointsCount(uint32_t i) const {
+		return pointsStart[i + 1] - pointsStart[i];
+	}
+
+	// fills object from arrays of tile, vectors are allocated with exact size
+	void readObject(uint32_t i, RoutingIndex* routingIndex, RouteDataObject* obj) const;
+};
+
+class RoutingGraphCache {
+private:
+	MappedFile file;
+	const RoutingGraphCacheHeader* header;
+	const RoutingGraphCacheTile* tiles;
+
+public:
+	static const uint32_t MAGIC = 0x4347524f;
+	static const uint32_t VERSION = 1;
+
+	RoutingGraphCache() : header(NULL), tiles(NULL) {
+	}
+
+	bool open(const char* filename, uint64_t obfSize, uint64_t obfModified);
+
+	bool isOpened() const {
+		return header != NULL;
+	}
+
+	/**
+	 * Arrays of route data block without copying, false if tile is not in cache or corrupted
+	 */
+	bool getTileView(uint32_t dataBlock, RoutingGraphCacheTileView& view) const;
+
+	/**
+	 * Creates objects of route data block, false if tile is not in cache
+	 */
+	bool readTile(uint32_t dataBlock, RoutingIndex* routingIndex, std::vector<RouteDataObject*>& list) const;
+};
+
+std::string getRoutingGraphCacheName(BinaryMapFile* file);
+
+/**
+ * Opens <obf>.rgc if it exists and matches obf file (NULL otherwise)
+ */
+SHARED_PTR<RoutingGraphCache> openRoutingGraphCache(BinaryMapFile* file);
+
+/**
+ * Decodes all route data blocks of obf file and writes them into cache file
+ */
+bool writeRoutingGraphCache(BinaryMapFile* file, const char* cacheFile);
+
+#endif /*_OSMAND_ROUTING_GRAPH_CACHE_H*/
@@ -0,0 +1,50 @@
+#ifndef _OSMAND_SEARCH_TRACE_CPP
+#define _OSMAND_SEARCH_TRACE_CPP
+#include "searchTrace.h"
+#include "Logging.h"
+
+SHARED_PTR<SearchTrace> SearchTrace::open(const char* fileName) {
+	FILE* f = fopen(fileName, "wb");
+	if (f == NULL) {
+		OsmAnd::LogPrintf(OsmAnd::LogSeverityLevel::Error, "Search trace %s can not be created", fileName);
+		return SHARED_PTR<SearchTrace>();
+	}
+	uint32_t header[3] = { MAGIC, VERSION, (uint32_t) sizeof(SearchTraceEvent) };
+	fwrite(header, sizeof(header), 1, f);
+	return SHARED_PTR<SearchTrace>(new SearchTrace(f));
+}
+
+void SearchTrace::flush() {
+	if (size > 0 && fwrite(buffer, sizeof(SearchTraceEvent), size, file) != (size_t) size) {
+		OsmAnd::LogPrintf(OsmAnd::LogSeverityLevel::Error, "Search trace can not be written");
+	}
+	size = 0;
+}
+
+SearchTrace::~SearchTrace() {
+	flush();
+	fclose(file);
+}
+
+bool readSearchTrace(const char* fileName, std::vector<SearchTraceEvent>& events) {
+	FILE* f = fopen(fileName, "rb");
+	if (f == NULL) {
+		return false;
+	}
+	uint32_t header[3];
+	if (fread(header, sizeof(header), 1, f) != 1 || header[0] != SearchTrace::MAGIC
+			|| header[1] != SearchTrace::VERSION || header[2] != sizeof(SearchTraceEvent)) {
+		OsmAnd::LogPrintf(OsmAnd::LogSeverityLevel::Error, "%s is not search trace of supported version", fileName);
+		fclose(f);
+		return false;
+	}
+	SearchTraceEvent buffer[SearchTrace::BUFFER_SIZE];
+	size_t read;
+	while ((read = fread(buffer, sizeof(SearchTraceEvent), SearchTrace::BUFFER_SIZE, f)) > 0) {
+		events.insert(events.end(), buffer, buffer + read);
+	}
+	fclose(f);
+	return true;
+}
+
+#endif /*_OSMAND_SEARCH_TRACE_CPP*/
@@ -0,0 +1,87 @@
+#ifndef _OSMAND_SEARCH_TRACE_H
+#define _OSMAND_SEARCH_TRACE_H
+#include <stdint.h>
+#include <stdio.h>
+#include "Common.h"
+#include "common2.h"
+
+enum SearchTraceEventType {
+	// new search (anytime mode runs several) : x31, y31 - start, id - target (x31 << 32 | y31), g - heuristic coefficient
+	SEARCH_TRACE_START = 0,
+	SEARCH_TRACE_POP = 1,
+	SEARCH_TRACE_PUSH = 2,
+	// segment connecting both directions : g - route time
+	SEARCH_TRACE_FINAL = 3,
+	// segments of found route (from final segment to start and to target)
+	SEARCH_TRACE_PATH = 4,
+	// x31, y31 - center of tile, id - number of roads
+	SEARCH_TRACE_TILE = 5
+};
+
+/**
+ * Fixed size record of trace file (little endian as written by host)
+ */
+struct SearchTraceEvent {
+	int64_t id;
+	float distanceFromStart;
+	float distanceToEnd;
+	float srValue;
+	int32_t x31;
+	int32_t y31;
+	uint16_t segmentStart;
+	uint8_t type;
+	// 0 - forward search, 1 - reverse search
+	uint8_t direction;
+};
+
+/**
+ * Binary trace of search tree written by routing context (RoutingContext::trace), replayed by search_trace tool.
+ * Events are buffered, file is written when buffer is full and on destruction.
+ */
+class SearchTrace {
+public:
+	static const uint32_t MAGIC = 0x54525348;
+	static const uint32_t VERSION = 1;
+	static const int BUFFER_SIZE = 4096;
+
+	// direction of last popped segment, segments pushed while it is processed belong to same search
+	uint8_t direction;
+
+	~SearchTrace();
+
+	static SHARED_PTR<SearchTrace> open(const char* fileName);
+
+	inline void add(uint8_t type, uint8_t dir, int64_t id, uint16_t segmentStart, int32_t x31, int32_t y31,
+			float distanceFromStart, float distanceToEnd, float srValue) {
+		SearchTraceEvent& e = buffer[size++];
+		e.id = id;
+		e.distanceFromStart = distanceFromStart;
+		e.distanceToEnd = distanceToEnd;
+		e.srValue = srValue;
+		e.x31 = x31;
+		e.y31 = y31;
+		e.segmentStart = segmentStart;
+		e.type = type;
+		e.direction = dir;
+		if (size == BUFFER_SIZE) {
+			flush();
+		}
+	}
+
+	void flush();
+
+private:
+	FILE* file;
+	int size;
+	SearchTraceEvent buffer[BUFFER_SIZE];
+
+	SearchTrace(FILE* file) : direction(0), file(file), size(0) {
+	}
+};
+
+/**
+ * Reads all events of trace file
+ */
+bool readSearchTrace(const char* fileName, std::vector<SearchTraceEvent>& events);
+
+#endif /*_OSMAND_SEARCH_TRACE_H*/
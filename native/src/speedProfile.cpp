@@ -0,0 +1,97 @@
+#ifndef _OSMAND_SPEED_PROFILE_CPP
+#define _OSMAND_SPEED_PROFILE_CPP
+#include "speedProfile.h"
+#include "Logging.h"
+
+SpeedProfile::SpeedProfile() : header(NULL), table(NULL), profiles(NULL), bucketSeconds(0), checksum(0) {
+}
+
+SpeedProfile::~SpeedProfile() {
+	close();
+}
+
+void SpeedProfile::close() {
+	file.close();
+	header = NULL;
+	table = NULL;
+	profiles = NULL;
+	checksum = 0;
+}
+
+bool SpeedProfile::open(const char* fname) {
+	close();
+	if (!file.open(fname)) {
+		OsmAnd::LogPrintf(OsmAnd::LogSeverityLevel::Error, "Speed profile %s can not be opened", fname);
+		return false;
+	}
+	const uint8_t* data = file.getData();
+	if (file.getSize() < sizeof(SpeedProfileHeader)) {
+		OsmAnd::LogPrintf(OsmAnd::LogSeverityLevel::Error, "Speed profile %s is too small", fname);
+		close();
+		return false;
+	}
+	const SpeedProfileHeader* h = (const SpeedProfileHeader*) data;
+	if (h->magic != MAGIC || h->version != VERSION) {
+		OsmAnd::LogPrintf(OsmAnd::LogSeverityLevel::Error, "Speed profile %s has unsupported format", fname);
+		close();
+		return false;
+	}
+	if (h->tableSize == 0 || (h->tableSize & (h->tableSize - 1)) != 0 || h->bucketsPerDay == 0 ||
+			SECONDS_IN_DAY % h->bucketsPerDay != 0 || (h->days != 1 && h->days != 7)) {
+		OsmAnd::LogPrintf(OsmAnd::LogSeverityLevel::Error, "Speed profile %s has invalid header", fname);
+		close();
+		return false;
+	}
+	uint64_t tableEnd = sizeof(SpeedProfileHeader) + (uint64_t) h->tableSize * sizeof(SpeedProfileEntry);
+	uint64_t profilesEnd = tableEnd + (uint64_t) h->profilesCount * h->days * h->bucketsPerDay;
+	if (profilesEnd > file.getSize()) {
+		OsmAnd::LogPrintf(OsmAnd::LogSeverityLevel::Error, "Speed profile %s is truncated", fname);
+		close();
+		return false;
+	}
+	const SpeedProfileEntry* entries = (const SpeedProfileEntry*) (data + sizeof(SpeedProfileHeader));
+	for (uint32_t i = 0; i < h->tableSize; i++) {
+		if (entries[i].key != -1 && entries[i].profile >= h->profilesCount) {
+			OsmAnd::LogPrintf(OsmAnd::LogSeverityLevel::Error, "Speed profile %s references missing profile", fname);
+			close();
+			return false;
+		}
+	}
+	header = h;
+	table = entries;
+	profiles = data + tableEnd;
+	bucketSeconds = SECONDS_IN_DAY / h->bucketsPerDay;
+	checksum = 0xcbf29ce484222325ull;
+	for (size_t i = 0; i < file.getSize(); i++) {
+		checksum = (checksum ^ data[i]) * 0x100000001b3ull;
+	}
+	OsmAnd::LogPrintf(OsmAnd::LogSeverityLevel::Info, "Speed profile %s loaded : %d profiles, %d buckets per day",
+			fname, h->profilesCount, h->bucketsPerDay);
+	return true;
+}
+
+static SHARED_PTR<SpeedProfile> sharedSpeedProfile;
+
+SHARED_PTR<SpeedProfile> loadSpeedProfile(const char* filename) {
+	if (filename == NULL || filename[0] == 0) {
+		std::atomic_store(&sharedSpeedProfile, SHARED_PTR<SpeedProfile>());
+		return SHARED_PTR<SpeedProfile>();
+	}
+	SHARED_PTR<SpeedProfile> current = std::atomic_load(&sharedSpeedProfile);
+	if (current.get() != NULL && current->getFilename() == filename) {
+		return current;
+	}
+	SHARED_PTR<SpeedProfile> profile(new SpeedProfile());
+	if (!profile->open(filename)) {
+		return SHARED_PTR<SpeedProfile>();
+	}
+	// routing calculations in progress keep previous profile alive
+	std::atomic_store(&sharedSpeedProfile, profile);
+	return profile;
+}
+
+SHARED_PTR<SpeedProfile> getSpeedProfile() {
+	return std::atomic_load(&sharedSpeedProfile);
+}
+
+#endif /*_OSMAND_SPEED_PROFILE_CPP*/
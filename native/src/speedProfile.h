@@ -0,0 +1,110 @@
+#ifndef _OSMAND_SPEED_PROFILE_H
+#define _OSMAND_SPEED_PROFILE_H
+#include <stdint.h>
+#include <string>
+#include "Common.h"
+#include "common2.h"
+#include "mappedFile.h"
+
+/**
+ * Historical speed factors of roads by direction and time of week, file is memory mapped (little endian) :
+ *  header   : uint32 magic "OSPF", uint32 version, uint32 bucketsPerDay, uint32 days (1 or 7),
+ *             uint32 tableSize (power of 2), uint32 profilesCount
+ *  table    : tableSize x { int64 key, uint32 profile, uint32 reserved },
+ *             key = (roadId << 1) | (forward ? 1 : 0), empty slot key = -1,
+ *             open addressing with linear probing from speedProfileHash(key) & (tableSize - 1)
+ *  profiles : profilesCount x (days * bucketsPerDay) uint8, percent of routing speed (0 - no data),
+ *             day 0 is Monday
+ */
+struct SpeedProfileHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t bucketsPerDay;
+	uint32_t days;
+	uint32_t tableSize;
+	uint32_t profilesCount;
+};
+
+struct SpeedProfileEntry {
+	int64_t key;
+	uint32_t profile;
+	uint32_t reserved;
+};
+
+inline uint32_t speedProfileHash(int64_t key) {
+	return (uint32_t) (((uint64_t) key * 0x9E3779B97F4A7C15ull) >> 32);
+}
+
+class SpeedProfile {
+private:
+	MappedFile file;
+	const SpeedProfileHeader* header;
+	const SpeedProfileEntry* table;
+	const uint8_t* profiles;
+	int bucketSeconds;
+	uint64_t checksum;
+
+public:
+	static const uint32_t MAGIC = 0x4650534f;
+	static const uint32_t VERSION = 1;
+	static const int SECONDS_IN_DAY = 24 * 3600;
+	static const int SECONDS_IN_WEEK = 7 * SECONDS_IN_DAY;
+
+	SpeedProfile();
+	~SpeedProfile();
+
+	bool open(const char* filename);
+	void close();
+
+	bool isOpened() const {
+		return header != NULL;
+	}
+
+	const std::string& getFilename() const {
+		return file.getFilename();
+	}
+
+	// FNV-1a of file content, captured route requests are replayed only with the same profile
+	uint64_t getChecksum() const {
+		return checksum;
+	}
+
+	/**
+	 * Speed factor of road for time of week (seconds since Monday 00:00 local time), 1 if there is no data
+	 */
+	inline float getSpeedFactor(int64_t roadId, bool forward, int timeOfWeek) const {
+		if (header == NULL) {
+			return 1;
+		}
+		int64_t key = (roadId << 1) | (forward ? 1 : 0);
+		uint32_t mask = header->tableSize - 1;
+		uint32_t slot = speedProfileHash(key) & mask;
+		for (uint32_t probe = 0; probe <= mask; probe++) {
+			const SpeedProfileEntry& e = table[(slot + probe) & mask];
+			if (e.key == key) {
+				int t = timeOfWeek % SECONDS_IN_WEEK;
+				if (t < 0) {
+					t += SECONDS_IN_WEEK;
+				}
+				uint32_t day = header->days == 1 ? 0 : t / SECONDS_IN_DAY;
+				uint32_t bucket = (t % SECONDS_IN_DAY) / bucketSeconds;
+				uint8_t f = profiles[((size_t) e.profile * header->days + day) * header->bucketsPerDay + bucket];
+				return f == 0 ? 1 : f / 100.f;
+			}
+			if (e.key == -1) {
+				break;
+			}
+		}
+		return 1;
+	}
+};
+
+/**
+ * Speed profile shared by all routing calculations, NULL is returned if file can't be opened
+ * (empty filename unloads profile)
+ */
+SHARED_PTR<SpeedProfile> loadSpeedProfile(const char* filename);
+
+SHARED_PTR<SpeedProfile> getSpeedProfile();
+
+#endif /*_OSMAND_SPEED_PROFILE_H*/
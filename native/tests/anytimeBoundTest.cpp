@@ -0,0 +1,146 @@
+#include "testCommon.h"
+#include "binaryRoutePlanner.h"
+#include "routingGraph.h"
+#include <stdlib.h>
+#include <math.h>
+
+// Suboptimality bound of anytime routes is sound : each reported route is at most bound times slower than optimal
+// route (found by forward search without heuristic over the same graph) and refinement without time limit ends
+// with optimal route and bound 1
+
+const int N = 12;
+const int STEP = 20000;
+
+struct BoundsProgress : public RouteCalculationProgress {
+	vector<float> times;
+	vector<float> bounds;
+
+	virtual void routeImproved(float routeTime, float suboptimalityBound) {
+		RouteCalculationProgress::routeImproved(routeTime, suboptimalityBound);
+		times.push_back(routeTime);
+		bounds.push_back(suboptimalityBound);
+	}
+};
+
+int nodeX(int node) {
+	return (1 << 30) + (node % N) * STEP;
+}
+
+int nodeY(int node) {
+	return (1 << 30) + (node / N) * STEP;
+}
+
+// each grid edge is separate road, so speed factor is set by edge
+struct Grid {
+	vector<SHARED_PTR<RouteDataObject> > roads;
+	vector<int> from;
+	vector<int> to;
+
+	void add(RoutingIndex* index, int a, int b) {
+		SHARED_PTR<RouteDataObject> r(new RouteDataObject());
+		r->region = index;
+		r->id = roads.size() + 1;
+		r->types.push_back(0);
+		r->pointsX.push_back(nodeX(a));
+		r->pointsY.push_back(nodeY(a));
+		r->pointsX.push_back(nodeX(b));
+		r->pointsY.push_back(nodeY(b));
+		roads.push_back(r);
+		from.push_back(a);
+		to.push_back(b);
+	}
+};
+
+void initConfig(RoutingConfiguration& config, MAP_STR_STR& params) {
+	for (uint k = 0; k <= (uint) RouteDataObjectAttribute::PENALTY_TRANSITION; k++) {
+		config.router.newRouteAttributeContext();
+	}
+	config.router.leftTurn = 0;
+	config.router.rightTurn = 0;
+	config.router.roundaboutTurn = 0;
+	config.initParams(params);
+}
+
+float searchRouteTime(RoutingConfiguration& config, SHARED_PTR<RoutingGraph> graph, EdgeOverlay& overlay,
+		int start, int target, SHARED_PTR<RouteCalculationProgress> progress) {
+	RoutingContext ctx(&config);
+	ctx.graph = graph;
+	ctx.overlay = overlay.snapshot();
+	ctx.startX = nodeX(start);
+	ctx.startY = nodeY(start);
+	ctx.targetX = nodeX(target);
+	ctx.targetY = nodeY(target);
+	ctx.progress = progress;
+	return searchRouteTime(&ctx);
+}
+
+int main() {
+	RoutingIndex index;
+	index.initRouteEncodingRule(0, "highway", "primary");
+	// optimal route time is found by forward dijkstra (heuristic coefficient 0) with the same costs
+	MAP_STR_STR params;
+	params["planRoadDirection"] = "1";
+	params["heuristicCoefficient"] = "0";
+	RoutingConfiguration dijkstra;
+	initConfig(dijkstra, params);
+	params.clear();
+	params["anytimeHeuristicCoefficient"] = "3";
+	params["anytimeTimeLimit"] = "0";
+	RoutingConfiguration anytime;
+	initConfig(anytime, params);
+
+	Grid grid;
+	for (int y = 0; y < N; y++) {
+		for (int x = 0; x < N; x++) {
+			if (x + 1 < N) {
+				grid.add(&index, y * N + x, y * N + x + 1);
+			}
+			if (y + 1 < N) {
+				grid.add(&index, y * N + x, (y + 1) * N + x);
+			}
+		}
+	}
+	SHARED_PTR<RoutingGraph> graph(new RoutingGraph());
+	graph->build(grid.roads);
+
+	srand(11);
+	int improvedRoutes = 0;
+	for (int trial = 0; trial < 20; trial++) {
+		EdgeOverlay overlay;
+		vector<EdgeOverlayUpdate> updates;
+		for (uint e = 0; e < grid.roads.size(); e++) {
+			float f = rand() % 3 == 0 ? 1 : 0.2f + (rand() % 80) / 100.f;
+			updates.push_back(EdgeOverlayUpdate(grid.roads[e]->id, f));
+		}
+		overlay.update(updates);
+		int start = rand() % (N * N);
+		int target = rand() % (N * N);
+		if (start == target) {
+			continue;
+		}
+		float optimal = searchRouteTime(dijkstra, graph, overlay, start, target, SHARED_PTR<RouteCalculationProgress>());
+		SHARED_PTR<BoundsProgress> progress(new BoundsProgress());
+		float time = searchRouteTime(anytime, graph, overlay, start, target, progress);
+
+		double eps = 1e-3 * optimal;
+		CHECK(optimal > 0);
+		CHECK(time > 0);
+		CHECK(fabs(time - optimal) <= eps);
+		CHECK(!progress->times.empty());
+		for (uint i = 0; i < progress->times.size(); i++) {
+			CHECK(progress->times[i] >= optimal - eps);
+			CHECK(progress->bounds[i] == 0 || progress->bounds[i] >= 1);
+			CHECK(progress->bounds[i] == 0 || progress->times[i] <= progress->bounds[i] * optimal + eps);
+			if (i > 0) {
+				CHECK(progress->times[i] <= progress->times[i - 1]);
+			}
+		}
+		CHECK(progress->bounds.back() == 1);
+		if (progress->times.size() > 1 && progress->times.back() < progress->times[0]) {
+			improvedRoutes++;
+		}
+	}
+	// grid is slow enough for inflated heuristic to miss optimal route at least once
+	CHECK(improvedRoutes > 0);
+	return TEST_RESULT();
+}
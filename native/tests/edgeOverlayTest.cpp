@@ -0,0 +1,78 @@
+#include "testCommon.h"
+#include "edgeOverlay.h"
+
+// Updates are copy-on-write by shard : old snapshots don't change, untouched shards are shared, roads reset to
+// factor 1 are erased and each update or clear publishes new version
+
+vector<EdgeOverlayUpdate> single(int64_t roadId, float factor) {
+	vector<EdgeOverlayUpdate> updates;
+	updates.push_back(EdgeOverlayUpdate(roadId, factor));
+	return updates;
+}
+
+int main() {
+	EdgeOverlay overlay;
+	SHARED_PTR<const EdgeOverlaySnapshot> empty = overlay.snapshot();
+	CHECK(empty->version == 0);
+	CHECK(empty->size() == 0);
+
+	vector<EdgeOverlayUpdate> updates;
+	for (int64_t id = 1; id <= 1000; id++) {
+		updates.push_back(EdgeOverlayUpdate(id, id == 7 ? 0 : 0.5f));
+	}
+	updates.push_back(EdgeOverlayUpdate(2000, 1.5f));
+	CHECK(overlay.update(updates) == 1);
+	SHARED_PTR<const EdgeOverlaySnapshot> first = overlay.snapshot();
+	CHECK(first->version == 1);
+	CHECK(first->size() == 1001);
+	CHECK(first->getSpeedFactor(10) == 0.5f);
+	CHECK(first->isClosed(7));
+	CHECK(!first->isClosed(8));
+	CHECK(first->getSpeedFactor(5000) == 1);
+	CHECK(first->maxFactor == 1.5f);
+	// old snapshot is not changed
+	CHECK(empty->size() == 0);
+	CHECK(empty->getSpeedFactor(10) == 1);
+
+	// only shard of changed road is copied
+	CHECK(overlay.update(single(10, 0.25f)) == 2);
+	SHARED_PTR<const EdgeOverlaySnapshot> second = overlay.snapshot();
+	CHECK(second->getSpeedFactor(10) == 0.25f);
+	CHECK(first->getSpeedFactor(10) == 0.5f);
+	int changedShard = EdgeOverlaySnapshot::getShard(10);
+	int shared = 0;
+	for (int sh = 0; sh < EdgeOverlaySnapshot::SHARDS; sh++) {
+		if (second->shards[sh] == first->shards[sh]) {
+			shared++;
+		}
+	}
+	CHECK(shared == EdgeOverlaySnapshot::SHARDS - 1);
+	CHECK(second->shards[changedShard] != first->shards[changedShard]);
+
+	// reset to 1 erases road, max factor is recomputed
+	CHECK(overlay.update(single(2000, 1)) == 3);
+	SHARED_PTR<const EdgeOverlaySnapshot> third = overlay.snapshot();
+	CHECK(third->size() == 1000);
+	CHECK(third->maxFactor == 1);
+	CHECK(second->maxFactor == 1.5f);
+	updates.clear();
+	for (int64_t id = 1; id <= 1000; id++) {
+		updates.push_back(EdgeOverlayUpdate(id, 1));
+	}
+	CHECK(overlay.update(updates) == 4);
+	SHARED_PTR<const EdgeOverlaySnapshot> reset = overlay.snapshot();
+	CHECK(reset->size() == 0);
+	for (int sh = 0; sh < EdgeOverlaySnapshot::SHARDS; sh++) {
+		CHECK(reset->shards[sh].get() == NULL);
+	}
+
+	// update without changes keeps shards, clear drops all roads
+	CHECK(overlay.update(single(3000, 1)) == 5);
+	CHECK(overlay.snapshot()->size() == 0);
+	CHECK(overlay.update(single(3000, 0)) == 6);
+	CHECK(overlay.clear() == 7);
+	CHECK(overlay.snapshot()->size() == 0);
+	CHECK(!overlay.snapshot()->isClosed(3000));
+	CHECK(third->isClosed(7));
+	return TEST_RESULT();
+}
@@ -0,0 +1,349 @@
+#include "testCommon.h"
+#include "binaryRead.h"
+#include "renderRules.h"
+#include "google/protobuf/wire_format_lite.h"
+#include "proto/OBF.pb.h"
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <thread>
+
+// Rendering and route queries of small obf (map and route sections) run while file is closed and opened again :
+// query reads whole file or doesn't see it, lazy initialization of rules and trees of reopened file is run
+// concurrently by queries, closed file is unmapped only after last query using it
+
+using google::protobuf::internal::WireFormatLite;
+
+const char* OBF_FILE = "mapRepositoryTest.road.obf";
+const char* NOTHING_FOUND = "mapRepositoryTest nothing found";
+const int LEFT = 1 << 30;
+const int TOP = 1 << 30;
+const int SIZE = 1 << 16;
+const int OBJECTS = 4;
+const int ROADS = 6;
+const int64_t ROAD_ID = 1000;
+const int READERS = 4;
+const int ITERATIONS = 300;
+
+// coordinates are aligned to precision of map (5 bits) and route (4 bits) sections
+int pointX(int obj, int k) {
+	return LEFT + 1024 * (obj + 1) + 512 * k;
+}
+
+int pointY(int obj, int k) {
+	return TOP + 2048 * (k + 1);
+}
+
+void writeVarint(std::string& out, uint64_t v) {
+	while (v >= 0x80) {
+		out += (char) ((v & 0x7f) | 0x80);
+		v >>= 7;
+	}
+	out += (char) v;
+}
+
+void writeTag(std::string& out, int field, WireFormatLite::WireType type) {
+	writeVarint(out, WireFormatLite::MakeTag(field, type));
+}
+
+void writeUint(std::string& out, int field, uint64_t v) {
+	writeTag(out, field, WireFormatLite::WIRETYPE_VARINT);
+	writeVarint(out, v);
+}
+
+uint64_t zigZag(int64_t v) {
+	return ((uint64_t) v << 1) ^ (uint64_t) (v >> 63);
+}
+
+void writeSint(std::string& out, int field, int64_t v) {
+	writeUint(out, field, zigZag(v));
+}
+
+void writeBytes(std::string& out, int field, const std::string& bytes) {
+	writeTag(out, field, WireFormatLite::WIRETYPE_LENGTH_DELIMITED);
+	writeVarint(out, bytes.size());
+	out += bytes;
+}
+
+void setInt(std::string& out, size_t pos, uint32_t v) {
+	out[pos] = (char) (v >> 24);
+	out[pos + 1] = (char) (v >> 16);
+	out[pos + 2] = (char) (v >> 8);
+	out[pos + 3] = (char) v;
+}
+
+// sections of obf have fixed 4 byte length (set by endSection), returns start of section
+size_t beginSection(std::string& out, int field) {
+	writeTag(out, field, WireFormatLite::WIRETYPE_FIXED32_LENGTH_DELIMITED);
+	out.append(4, 0);
+	return out.size();
+}
+
+void endSection(std::string& out, size_t start) {
+	setInt(out, start - 4, out.size() - start);
+}
+
+// shift to data block is fixed 4 bytes relative to start of box, returns its position
+size_t writeShift(std::string& out, int field) {
+	writeTag(out, field, WireFormatLite::WIRETYPE_FIXED32);
+	out.append(4, 0);
+	return out.size() - 4;
+}
+
+// data block is written as blocks field, shift points to its length
+void writeBlock(std::string& out, int field, const std::string& block, size_t shift, size_t box) {
+	writeTag(out, field, WireFormatLite::WIRETYPE_LENGTH_DELIMITED);
+	setInt(out, shift, out.size() - box);
+	writeVarint(out, block.size());
+	out += block;
+}
+
+void writeEncodingRule(std::string& out, int field, int tagField, int valueField) {
+	std::string rule;
+	writeBytes(rule, tagField, "highway");
+	writeBytes(rule, valueField, "primary");
+	writeBytes(out, field, rule);
+}
+
+void writeMapIndex(std::string& file) {
+	using namespace OsmAnd::OBF;
+	size_t index = beginSection(file, OsmAndStructure::kMapIndexFieldNumber);
+	writeBytes(file, OsmAndMapIndex::kNameFieldNumber, "mapRepositoryTest");
+	// rule 1
+	writeEncodingRule(file, OsmAndMapIndex::kRulesFieldNumber, OsmAndMapIndex_MapEncodingRule::kTagFieldNumber,
+			OsmAndMapIndex_MapEncodingRule::kValueFieldNumber);
+	size_t level = beginSection(file, OsmAndMapIndex::kLevelsFieldNumber);
+	writeUint(file, OsmAndMapIndex_MapRootLevel::kMaxZoomFieldNumber, 22);
+	writeUint(file, OsmAndMapIndex_MapRootLevel::kMinZoomFieldNumber, 14);
+	writeUint(file, OsmAndMapIndex_MapRootLevel::kLeftFieldNumber, LEFT);
+	writeUint(file, OsmAndMapIndex_MapRootLevel::kRightFieldNumber, LEFT + SIZE);
+	writeUint(file, OsmAndMapIndex_MapRootLevel::kTopFieldNumber, TOP);
+	writeUint(file, OsmAndMapIndex_MapRootLevel::kBottomFieldNumber, TOP + SIZE);
+	// box of level bounds
+	size_t box = beginSection(file, OsmAndMapIndex_MapRootLevel::kBoxesFieldNumber);
+	writeSint(file, OsmAndMapIndex_MapDataBox::kLeftFieldNumber, 0);
+	writeSint(file, OsmAndMapIndex_MapDataBox::kRightFieldNumber, 0);
+	writeSint(file, OsmAndMapIndex_MapDataBox::kTopFieldNumber, 0);
+	writeSint(file, OsmAndMapIndex_MapDataBox::kBottomFieldNumber, 0);
+	size_t shift = writeShift(file, OsmAndMapIndex_MapDataBox::kShiftToMapDataFieldNumber);
+	endSection(file, box);
+
+	std::string block;
+	for (int obj = 0; obj < OBJECTS; obj++) {
+		std::string data;
+		std::string coordinates;
+		int px = LEFT;
+		int py = TOP;
+		for (int k = 0; k < 2; k++) {
+			writeVarint(coordinates, zigZag((pointX(obj, k) - px) >> 5));
+			writeVarint(coordinates, zigZag((pointY(obj, k) - py) >> 5));
+			px = pointX(obj, k);
+			py = pointY(obj, k);
+		}
+		writeBytes(data, MapData::kCoordinatesFieldNumber, coordinates);
+		std::string types;
+		writeVarint(types, 1);
+		writeBytes(data, MapData::kTypesFieldNumber, types);
+		writeSint(data, MapData::kIdFieldNumber, obj + 1);
+		writeBytes(block, MapDataBlock::kDataObjectsFieldNumber, data);
+	}
+	writeBlock(file, OsmAndMapIndex_MapRootLevel::kBlocksFieldNumber, block, shift, box);
+	endSection(file, level);
+	endSection(file, index);
+}
+
+void writeRoutingIndex(std::string& file) {
+	using namespace OsmAnd::OBF;
+	size_t index = beginSection(file, OsmAndStructure::kRoutingIndexFieldNumber);
+	writeBytes(file, OsmAndRoutingIndex::kNameFieldNumber, "mapRepositoryTest");
+	// rule 1
+	writeEncodingRule(file, OsmAndRoutingIndex::kRulesFieldNumber, OsmAndRoutingIndex_RouteEncodingRule::kTagFieldNumber,
+			OsmAndRoutingIndex_RouteEncodingRule::kValueFieldNumber);
+	// root box without data (its tree is read lazily by first search)
+	size_t root = beginSection(file, OsmAndRoutingIndex::kRootBoxesFieldNumber);
+	writeSint(file, OsmAndRoutingIndex_RouteDataBox::kLeftFieldNumber, LEFT);
+	writeSint(file, OsmAndRoutingIndex_RouteDataBox::kRightFieldNumber, LEFT + SIZE);
+	writeSint(file, OsmAndRoutingIndex_RouteDataBox::kTopFieldNumber, TOP);
+	writeSint(file, OsmAndRoutingIndex_RouteDataBox::kBottomFieldNumber, TOP + SIZE);
+	size_t box = beginSection(file, OsmAndRoutingIndex_RouteDataBox::kBoxesFieldNumber);
+	writeSint(file, OsmAndRoutingIndex_RouteDataBox::kLeftFieldNumber, 0);
+	writeSint(file, OsmAndRoutingIndex_RouteDataBox::kRightFieldNumber, 0);
+	writeSint(file, OsmAndRoutingIndex_RouteDataBox::kTopFieldNumber, 0);
+	writeSint(file, OsmAndRoutingIndex_RouteDataBox::kBottomFieldNumber, 0);
+	size_t shift = writeShift(file, OsmAndRoutingIndex_RouteDataBox::kShiftToDataFieldNumber);
+	endSection(file, box);
+	endSection(file, root);
+
+	std::string block;
+	std::string ids;
+	for (int r = 0; r < ROADS; r++) {
+		std::string data;
+		std::string types;
+		writeVarint(types, 1);
+		writeBytes(data, RouteData::kTypesFieldNumber, types);
+		// index of id table
+		writeUint(data, RouteData::kRouteIdFieldNumber, r);
+		std::string points;
+		int px = LEFT >> 4;
+		int py = TOP >> 4;
+		for (int k = 0; k < 2; k++) {
+			writeVarint(points, zigZag((pointX(r, k) >> 4) - px));
+			writeVarint(points, zigZag((pointY(r, k) >> 4) - py));
+			px = pointX(r, k) >> 4;
+			py = pointY(r, k) >> 4;
+		}
+		writeBytes(data, RouteData::kPointsFieldNumber, points);
+		writeBytes(block, OsmAndRoutingIndex_RouteDataBlock::kDataObjectsFieldNumber, data);
+		writeSint(ids, IdTable::kRouteIdFieldNumber, r == 0 ? ROAD_ID : 1);
+	}
+	writeBytes(block, OsmAndRoutingIndex_RouteDataBlock::kIdTableFieldNumber, ids);
+	writeBlock(file, OsmAndRoutingIndex::kBlocksFieldNumber, block, shift, box);
+	endSection(file, index);
+}
+
+bool writeFile(const char* name, const std::string& content) {
+	FILE* f = fopen(name, "wb");
+	if (f == NULL) {
+		return false;
+	}
+	bool written = fwrite(content.data(), 1, content.size(), f) == content.size();
+	fclose(f);
+	return written;
+}
+
+bool samePoints(MapDataObject* o, int obj) {
+	return o->points.size() == 2 && o->points[0] == int_pair(pointX(obj, 0), pointY(obj, 0))
+			&& o->points[1] == int_pair(pointX(obj, 1), pointY(obj, 1));
+}
+
+// all objects of file or only message that nothing is found (file is closed)
+bool checkRendered(std::vector<MapDataObject*>& result, bool& found) {
+	found = result.size() == OBJECTS + ROADS;
+	if (!found) {
+		return result.size() == 1 && result[0]->objectNames["name"] == NOTHING_FOUND;
+	}
+	std::vector<bool> seen(OBJECTS + ROADS, false);
+	for (uint i = 0; i < result.size(); i++) {
+		MapDataObject* o = result[i];
+		int k = o->id >= ROAD_ID ? OBJECTS + (int) (o->id - ROAD_ID) : (int) o->id - 1;
+		if (k < 0 || k >= OBJECTS + ROADS || seen[k] || !o->contains("highway", "primary")
+				|| !samePoints(o, k < OBJECTS ? k : k - OBJECTS)) {
+			return false;
+		}
+		seen[k] = true;
+	}
+	return true;
+}
+
+// roads of subregion or nothing (file is closed before data is read)
+bool checkRoads(std::vector<RouteDataObject*>& roads, bool& found) {
+	int count = 0;
+	bool valid = true;
+	for (uint i = 0; i < roads.size(); i++) {
+		RouteDataObject* r = roads[i];
+		if (r == NULL) {
+			continue;
+		}
+		int k = (int) (r->id - ROAD_ID);
+		if (k != count || r->pointsX.size() != 2 || r->pointsX[1] != (uint) pointX(k, 1)
+				|| r->pointsY[1] != (uint) pointY(k, 1) || r->region->decodingRules[r->types[0]].second != "primary") {
+			valid = false;
+		}
+		count++;
+		delete r;
+	}
+	found = count == ROADS;
+	return valid && (count == 0 || found);
+}
+
+int main() {
+	std::string file;
+	writeUint(file, OsmAnd::OBF::OsmAndStructure::kVersionFieldNumber, MAP_VERSION);
+	writeMapIndex(file);
+	writeRoutingIndex(file);
+	writeUint(file, OsmAnd::OBF::OsmAndStructure::kVersionConfirmFieldNumber, MAP_VERSION);
+	CHECK(writeFile(OBF_FILE, file));
+	// line rule of highway=primary, registered by tag/value key as rules loaded from java
+	RenderingRulesStorage storage(NULL);
+	std::map<std::string, std::string> attrs;
+	attrs["color"] = "#ff0000";
+	int key = (storage.getDictionaryValue("highway") << 16) | storage.getDictionaryValue("primary");
+	storage.registerGlobalRule(new RenderingRule(attrs, false, &storage), RenderingRulesStorage::LINE_RULES, key);
+
+	// closed file stays mapped while it is used
+	CHECK(initBinaryMapFile(OBF_FILE) != NULL);
+	SHARED_PTR<BinaryMapFile> pinned = getBinaryMapFile(OBF_FILE);
+	CHECK(pinned.get() != NULL);
+	CHECK(closeBinaryMapFile(OBF_FILE));
+	CHECK(getBinaryMapFile(OBF_FILE).get() == NULL);
+	if (pinned.get() != NULL) {
+		CHECK(pinned->routingIndexes.size() == 1 && pinned->mapIndexes.size() == 1);
+		CHECK(pinned->mapped.get() == NULL || (pinned->mapped->getSize() == file.size()
+				&& memcmp(pinned->mapped->getData(), file.data(), file.size()) == 0));
+	}
+	pinned.reset();
+
+	CHECK(initBinaryMapFile(OBF_FILE) != NULL);
+	std::atomic<bool> finished(false);
+	std::atomic<int> invalid(0);
+	std::atomic<int> rendered(0);
+	std::atomic<int> routed(0);
+	vector<std::thread> readers;
+	for (int t = 0; t < READERS; t++) {
+		readers.push_back(std::thread([&, t]() {
+			RenderingRuleSearchRequest req(&storage);
+			for (int k = 0; k < ITERATIONS; k++) {
+				bool found = false;
+				if ((k + t) % 2 == 0) {
+					ResultPublisher publisher;
+					SearchQuery q(LEFT, LEFT + SIZE, TOP, TOP + SIZE, &req, &publisher);
+					q.zoom = 15;
+					int renderedState = 0;
+					searchObjectsForRendering(&q, false, NOTHING_FOUND, renderedState);
+					if (!checkRendered(publisher.result, found)) {
+						invalid++;
+					}
+					rendered += found ? 1 : 0;
+				} else {
+					ResultPublisher publisher;
+					SearchQuery q(LEFT, LEFT + SIZE, TOP, TOP + SIZE, NULL, &publisher);
+					std::vector<RouteSubregion> subregions;
+					searchRouteSubregions(&q, subregions, false);
+					for (uint i = 0; i < subregions.size(); i++) {
+						std::vector<RouteDataObject*> roads;
+						searchRouteDataForSubRegion(&q, roads, &subregions[i]);
+						if (!checkRoads(roads, found)) {
+							invalid++;
+						}
+						routed += found ? 1 : 0;
+					}
+					if (subregions.size() > 1) {
+						invalid++;
+					}
+				}
+			}
+		}));
+	}
+	std::thread writer([&]() {
+		for (int k = 0; !finished; k++) {
+			if (k % 2 == 0) {
+				closeBinaryMapFile(OBF_FILE);
+			}
+			// replaces opened file
+			if (initBinaryMapFile(OBF_FILE) == NULL) {
+				invalid++;
+			}
+		}
+	});
+	for (uint t = 0; t < readers.size(); t++) {
+		readers[t].join();
+	}
+	finished = true;
+	writer.join();
+	CHECK(invalid == 0);
+	CHECK(rendered > 0);
+	CHECK(routed > 0);
+	closeBinaryMapFile(OBF_FILE);
+	remove(OBF_FILE);
+	return TEST_RESULT();
+}
@@ -0,0 +1,63 @@
+#include "testCommon.h"
+#include "mappedFile.h"
+#include <stdio.h>
+#include <string.h>
+#if defined(__linux__)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#endif
+
+// File which can't be mapped is not read into memory in map only mode : mmap is made to fail by address space
+// limit below file size, so reading file into memory would fail as well (bad_alloc)
+
+const char* SMALL_FILE = "mappedFileTest.small";
+const char* LARGE_FILE = "mappedFileTest.large";
+const long LARGE_SIZE = 512l * 1024 * 1024;
+
+int main() {
+	FILE* f = fopen(SMALL_FILE, "wb");
+	CHECK(f != NULL);
+	if (f == NULL) {
+		return TEST_RESULT();
+	}
+	fputs("mapped", f);
+	fclose(f);
+	MappedFile small;
+	CHECK(small.open(SMALL_FILE, true));
+	CHECK(small.isMapped());
+	CHECK(small.getSize() == 6 && memcmp(small.getData(), "mapped", 6) == 0);
+	small.close();
+	CHECK(!small.open("missingMappedFileTest", true));
+	remove(SMALL_FILE);
+
+#if defined(__linux__)
+	// sparse file, it doesn't occupy disk
+	int fd = open(LARGE_FILE, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+	CHECK(fd >= 0 && ftruncate(fd, LARGE_SIZE) == 0);
+	close(fd);
+	struct rlimit previous;
+	getrlimit(RLIMIT_AS, &previous);
+	long pages = 0;
+	FILE* statm = fopen("/proc/self/statm", "r");
+	CHECK(statm != NULL && fscanf(statm, "%ld", &pages) == 1);
+	if (statm != NULL) {
+		fclose(statm);
+	}
+	struct rlimit limit = previous;
+	limit.rlim_cur = pages * sysconf(_SC_PAGESIZE) + LARGE_SIZE / 4;
+	CHECK(setrlimit(RLIMIT_AS, &limit) == 0);
+	MappedFile large;
+	bool opened = large.open(LARGE_FILE, true);
+	setrlimit(RLIMIT_AS, &previous);
+	CHECK(!opened);
+	CHECK(!large.isOpened());
+	CHECK(large.getSize() == 0);
+	// without limit file is mapped
+	CHECK(large.open(LARGE_FILE, true));
+	CHECK(large.isMapped() && large.getSize() == (size_t) LARGE_SIZE);
+	large.close();
+	remove(LARGE_FILE);
+#endif
+	return TEST_RESULT();
+}
@@ -0,0 +1,75 @@
+#include "testCommon.h"
+#include "generalRouter.h"
+#include "binaryRead.h"
+
+// Oneway of roads without oneway flags is taken without rule evaluation only when rules can't match such roads
+
+void addRule(GeneralRouter& router, RouteAttributeContext* ctx, string value, string tag, string tagValue, bool nt) {
+	RouteAttributeEvalRule* rule = ctx->newEvaluationRule();
+	rule->registerSelectValue(value, "");
+	rule->registerAndTagValueCondition(&router, tag, tagValue, nt);
+}
+
+RouteAttributeContext* initContexts(GeneralRouter& router) {
+	RouteAttributeContext* oneway = NULL;
+	for (uint k = 0; k <= (uint) RouteDataObjectAttribute::PENALTY_TRANSITION; k++) {
+		RouteAttributeContext* ctx = router.newRouteAttributeContext();
+		if (k == (uint) RouteDataObjectAttribute::ONEWAY) {
+			oneway = ctx;
+		}
+	}
+	return oneway;
+}
+
+SHARED_PTR<RouteDataObject> road(RoutingIndex* index, int type) {
+	SHARED_PTR<RouteDataObject> r(new RouteDataObject());
+	r->region = index;
+	r->types.push_back(0);
+	if (type > 0) {
+		r->types.push_back(type);
+	}
+	r->pointsX.push_back(0);
+	r->pointsY.push_back(0);
+	r->pointsX.push_back(10);
+	r->pointsY.push_back(10);
+	r->initFlags();
+	return r;
+}
+
+int main() {
+	RoutingIndex index;
+	index.initRouteEncodingRule(0, "highway", "primary");
+	index.initRouteEncodingRule(1, "oneway", "yes");
+	index.initRouteEncodingRule(2, "oneway", "-1");
+	index.initRouteEncodingRule(3, "junction", "roundabout");
+	index.initRouteEncodingRule(4, "oneway", "no");
+
+	// default car rules : flags are enough
+	GeneralRouter car;
+	RouteAttributeContext* ctx = initContexts(car);
+	addRule(car, ctx, "1", "oneway", "yes", false);
+	addRule(car, ctx, "-1", "oneway", "-1", false);
+	addRule(car, ctx, "1", "junction", "roundabout", false);
+	CHECK(car.isOneWay(road(&index, 1)) == 1);
+	CHECK(car.isOneWay(road(&index, 2)) == -1);
+	CHECK(car.isOneWay(road(&index, 3)) == 1);
+	int64_t evaluations = car.ruleEvaluations;
+	CHECK(car.isOneWay(road(&index, 0)) == 0);
+	CHECK(car.isOneWay(road(&index, 4)) == 0);
+	CHECK(car.ruleEvaluations == evaluations);
+
+	// negated condition matches road without tags, so rules are evaluated
+	GeneralRouter negated;
+	ctx = initContexts(negated);
+	addRule(negated, ctx, "1", "oneway", "no", true);
+	CHECK(negated.isOneWay(road(&index, 0)) == 1);
+	CHECK(negated.isOneWay(road(&index, 4)) == 0);
+
+	// condition on other tag (oneway=no is not flagged)
+	GeneralRouter other;
+	ctx = initContexts(other);
+	addRule(other, ctx, "-1", "oneway", "no", false);
+	CHECK(other.isOneWay(road(&index, 4)) == -1);
+	CHECK(other.isOneWay(road(&index, 0)) == 0);
+	return TEST_RESULT();
+}
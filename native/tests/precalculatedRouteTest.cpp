@@ -0,0 +1,71 @@
+#include "testCommon.h"
+#include "binaryRoutePlanner.h"
+#include <stdlib.h>
+
+// Nearest route point from bounded index cache should match brute force search, also after slots are replaced
+
+double squareDist(PrecalculatedRouteDirection& route, int x31, int y31, int ind) {
+	double dx = (double) x31 - route.pointsX[ind];
+	double dy = (double) y31 - route.pointsY[ind];
+	return dx * dx + dy * dy;
+}
+
+int bruteForceIndex(PrecalculatedRouteDirection& route, int x31, int y31) {
+	int ind = -1;
+	double minDist = 0;
+	for (uint i = 0; i < route.pointsX.size(); i++) {
+		if (std::abs((double) x31 - route.pointsX[i]) > PrecalculatedRouteDirection::MAX_SEARCH_RADIUS
+				|| std::abs((double) y31 - route.pointsY[i]) > PrecalculatedRouteDirection::MAX_SEARCH_RADIUS) {
+			continue;
+		}
+		double ds = squareDist(route, x31, y31, i);
+		if (ind == -1 || ds < minDist) {
+			ind = i;
+			minDist = ds;
+		}
+	}
+	return ind;
+}
+
+int main() {
+	PrecalculatedRouteDirection route;
+	srand(17);
+	uint32_t x = 1 << 30, y = 1 << 30;
+	for (int i = 0; i < 2000; i++) {
+		x += rand() % 2000;
+		y += rand() % 2000 - 1000;
+		route.pointsX.push_back(x);
+		route.pointsY.push_back(y);
+		route.times.push_back(1);
+	}
+	route.buildIndex();
+	int cacheSize = 1 << PrecalculatedRouteDirection::INDEX_CACHE_BITS;
+	CHECK((int) route.cachedIndexes.size() == cacheSize);
+
+	// more points than slots, each queried twice
+	vector<int> px, py;
+	for (int i = 0; i < 4 * cacheSize; i++) {
+		px.push_back((1 << 30) + rand() % 4000000);
+		py.push_back((1 << 30) + rand() % 2000000 - 1000000);
+	}
+	// point far from route is not matched
+	px.push_back(1 << 20);
+	py.push_back(1 << 20);
+	for (int pass = 0; pass < 2; pass++) {
+		int mismatches = 0;
+		for (uint i = 0; i < px.size(); i++) {
+			int expected = bruteForceIndex(route, px[i], py[i]);
+			int ind = route.getIndex(px[i], py[i]);
+			// equal distance points could be chosen in different order
+			if (ind != expected && (ind == -1 || expected == -1
+					|| squareDist(route, px[i], py[i], ind) != squareDist(route, px[i], py[i], expected))) {
+				mismatches++;
+			}
+		}
+		CHECK(mismatches == 0);
+	}
+	CHECK(route.getIndex(1 << 20, 1 << 20) == -1);
+	// cache size doesn't grow with queried points
+	CHECK((int) route.cachedIndexes.size() == cacheSize);
+	return TEST_RESULT();
+}
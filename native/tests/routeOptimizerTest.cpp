@@ -0,0 +1,111 @@
+#include "testCommon.h"
+#include "routeOptimizer.h"
+#include "routingConfiguration.h"
+#include "routingGraph.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+// Travel time matrix calculated by workers reusing one routing context per thread equals times of separate
+// searches with new context for each pair, configuration which can't be loaded is reported as failure
+
+const int N = 10;
+const int STEP = 20000;
+const int STOPS = 7;
+
+int nodeX(int node) {
+	return (1 << 30) + (node % N) * STEP;
+}
+
+int nodeY(int node) {
+	return (1 << 30) + (node / N) * STEP;
+}
+
+SHARED_PTR<RouteDataObject> road(RoutingIndex* index, int64_t id, int a, int b) {
+	SHARED_PTR<RouteDataObject> r(new RouteDataObject());
+	r->region = index;
+	r->id = id;
+	r->types.push_back(0);
+	r->pointsX.push_back(nodeX(a));
+	r->pointsY.push_back(nodeY(a));
+	r->pointsX.push_back(nodeX(b));
+	r->pointsY.push_back(nodeY(b));
+	return r;
+}
+
+int main() {
+	const char* xml = "routeOptimizerTest.xml";
+	FILE* f = fopen(xml, "w");
+	CHECK(f != NULL);
+	if (f == NULL) {
+		return TEST_RESULT();
+	}
+	fputs("<osmand_routing_config defaultProfile=\"car\"><routingProfile name=\"car\" leftTurn=\"0\" rightTurn=\"0\" "
+			"roundaboutTurn=\"0\" minDefaultSpeed=\"36\" maxDefaultSpeed=\"36\"/></osmand_routing_config>", f);
+	fclose(f);
+
+	RoutingIndex index;
+	index.initRouteEncodingRule(0, "highway", "primary");
+	vector<SHARED_PTR<RouteDataObject> > roads;
+	for (int y = 0; y < N; y++) {
+		for (int x = 0; x < N; x++) {
+			if (x + 1 < N) {
+				roads.push_back(road(&index, roads.size() + 1, y * N + x, y * N + x + 1));
+			}
+			if (y + 1 < N) {
+				roads.push_back(road(&index, roads.size() + 1, y * N + x, (y + 1) * N + x));
+			}
+		}
+	}
+	SHARED_PTR<RoutingGraph> graph(new RoutingGraph());
+	graph->build(roads);
+	publishRoutingGraph(graph);
+	srand(7);
+	vector<EdgeOverlayUpdate> updates;
+	for (uint e = 0; e < roads.size(); e++) {
+		updates.push_back(EdgeOverlayUpdate(roads[e]->id, 0.2f + (rand() % 80) / 100.f));
+	}
+	getEdgeOverlay().update(updates);
+
+	vector<RouteOptimizerStop> stops;
+	for (int k = 0; k < STOPS; k++) {
+		int node = rand() % (N * N);
+		stops.push_back(RouteOptimizerStop(nodeX(node), nodeY(node)));
+	}
+	RouteOptimizerParams params;
+	params.routingXml = xml;
+	params.router = "car";
+	params.threads = 3;
+	vector<float> matrix;
+	CHECK(calculateTravelTimeMatrix(stops, params, matrix));
+	CHECK(matrix.size() == STOPS * STOPS);
+
+	MAP_STR_STR p;
+	SHARED_PTR<RoutingConfiguration> config = getRoutingConfiguration(xml, "car", p);
+	CHECK(config.get() != NULL);
+	for (int i = 0; config.get() != NULL && i < STOPS; i++) {
+		for (int j = 0; j < STOPS; j++) {
+			if (i == j || matrix.size() != STOPS * STOPS) {
+				continue;
+			}
+			RoutingContext ctx(config.get());
+			ctx.startX = stops[i].x31;
+			ctx.startY = stops[i].y31;
+			ctx.targetX = stops[j].x31;
+			ctx.targetY = stops[j].y31;
+			float time = searchRouteTime(&ctx);
+			CHECK(time >= 0);
+			CHECK(fabs(matrix[i * STOPS + j] - time) <= 1e-3 * time);
+		}
+	}
+
+	RouteOptimizerResult result;
+	CHECK(optimizeRouteOrder(stops, params, result));
+	CHECK(result.order.size() == STOPS);
+	CHECK(result.legs.size() == STOPS - 1);
+	params.routingXml = "missingRouteOptimizerTest.xml";
+	CHECK(!calculateTravelTimeMatrix(stops, params, matrix));
+	CHECK(!optimizeRouteOrder(stops, params, result));
+	remove(xml);
+	return TEST_RESULT();
+}
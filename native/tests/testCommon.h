@@ -0,0 +1,19 @@
+#ifndef _OSMAND_TEST_COMMON_H
+#define _OSMAND_TEST_COMMON_H
+#include <stdio.h>
+
+// Tests are standalone executables registered in ctest, failed check is printed and main returns non zero
+
+static int testFailures = 0;
+
+#define CHECK(condition) \
+	do { \
+		if (!(condition)) { \
+			printf("%s:%d : check failed : %s\n", __FILE__, __LINE__, #condition); \
+			testFailures++; \
+		} \
+	} while (0)
+
+#define TEST_RESULT() (testFailures == 0 ? (printf("OK\n"), 0) : (printf("%d checks failed\n", testFailures), 1))
+
+#endif /*_OSMAND_TEST_COMMON_H*/
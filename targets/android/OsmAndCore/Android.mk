@@ -41,6 +41,18 @@ LOCAL_SRC_FILES := \
 	$(OSMAND_CORE_RELATIVE)/src/rendering.cpp \
 	$(OSMAND_CORE_RELATIVE)/src/binaryRead.cpp \
         $(OSMAND_CORE_RELATIVE)/src/generalRouter.cpp \
+	$(OSMAND_CORE_RELATIVE)/src/routingConfiguration.cpp \
+	$(OSMAND_CORE_RELATIVE)/src/mappedFile.cpp \
+	$(OSMAND_CORE_RELATIVE)/src/speedProfile.cpp \
+	$(OSMAND_CORE_RELATIVE)/src/edgeOverlay.cpp \
+	$(OSMAND_CORE_RELATIVE)/src/routingGraphCache.cpp \
+	$(OSMAND_CORE_RELATIVE)/src/routingGraph.cpp \
+	$(OSMAND_CORE_RELATIVE)/src/routeTileCache.cpp \
+	$(OSMAND_CORE_RELATIVE)/src/routeOptimizer.cpp \
+	$(OSMAND_CORE_RELATIVE)/src/searchTrace.cpp \
+	$(OSMAND_CORE_RELATIVE)/src/routeRequest.cpp \
+	$(OSMAND_CORE_RELATIVE)/src/routeSpeedBounds.cpp \
+	$(OSMAND_CORE_RELATIVE)/src/routeResultBuffer.cpp \
 	$(OSMAND_CORE_RELATIVE)/src/binaryRoutePlanner.cpp \
 	$(OSMAND_CORE_RELATIVE)/src/proto/osmand_index.pb.cc \
 	$(OSMAND_CORE_RELATIVE)/src/java_wrap.cpp \